@@ -0,0 +1,465 @@
+#include <glad/glad.h>
+
+#include <glm-1.0.1/glm/glm.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "asset_pack.h"
+#include "texture_array.h"
+#include "mesh.h"
+#include "mesh_file.h"
+#include "cube_vertices.h"
+#include "thread_pool.h"
+#include "frame_stats.h"
+#include "hash.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+// Offline asset cooker: walks an asset directory and writes everything the engine loads into one
+// .pack archive in its runtime form. Images become power of two, BC1 compressed mip chains, .obj meshes
+// (and the built in cube) become .mesh blobs, shaders are preprocessed and checked. Assets are cooked
+// in parallel, and an asset whose source hash matches the entry in the existing pack is copied over
+// instead of being cooked again.
+//
+//   assetcook [asset directory] [output pack] [--jobs N] [--force] [--no-compress]
+
+namespace fs = std::filesystem;
+
+// bump when a cooked format or the cooking itself changes, every asset is cooked again
+const uint64_t COOK_VERSION = 1;
+const int MAX_TEXTURE_SIZE = 2048;
+const int MAX_INCLUDE_DEPTH = 16;
+
+struct CookJob
+{
+	std::string name;
+	fs::path source;
+	PackAssetType type;
+	// filled in by the cook
+	PackBlob blob;
+	bool reused = false;
+	bool failed = false;
+	std::string error;
+};
+
+static bool readFile(const fs::path& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	std::stringstream stream;
+	stream << file.rdbuf();
+	contents = stream.str();
+	return (bool)file;
+}
+
+// expands #include "file" lines (relative to the including file), turns CRLF into LF and drops trailing whitespace
+static bool preprocessShader(const fs::path& path, std::string& out, std::string& error, int depth = 0)
+{
+	std::string source;
+	if (depth > MAX_INCLUDE_DEPTH)
+	{
+		error = "includes nested too deep at " + path.generic_string();
+		return false;
+	}
+	if (!readFile(path, source))
+	{
+		error = "can't read " + path.generic_string();
+		return false;
+	}
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t end = line.find_last_not_of(" \t\r");
+		line = end == std::string::npos ? std::string() : line.substr(0, end + 1);
+		size_t first = line.find_first_not_of(" \t");
+		if (first != std::string::npos && line.compare(first, 8, "#include") == 0)
+		{
+			size_t open = line.find('"', first), close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos)
+			{
+				error = "malformed #include in " + path.generic_string();
+				return false;
+			}
+			if (!preprocessShader(path.parent_path() / line.substr(open + 1, close - open - 1), out, error, depth + 1))
+				return false;
+			continue;
+		}
+		out += line;
+		out += '\n';
+	}
+	return true;
+}
+
+// the source with comments blanked out, so the checks below don't trip over commented code
+static std::string stripComments(const std::string& source)
+{
+	std::string code = source;
+	for (size_t i = 0; i + 1 < code.size(); i++)
+	{
+		if (code[i] == '/' && code[i + 1] == '/')
+		{
+			while (i < code.size() && code[i] != '\n')
+				code[i++] = ' ';
+		}
+		else if (code[i] == '/' && code[i + 1] == '*')
+		{
+			size_t end = code.find("*/", i + 2);
+			end = end == std::string::npos ? code.size() : end + 2;
+			for (; i < end; i++)
+			{
+				if (code[i] != '\n')
+					code[i] = ' ';
+			}
+			i--;
+		}
+	}
+	return code;
+}
+
+// Checks what can be checked without a GL context: a leading #version, a main function and balanced
+// brackets. The real compile still happens in the driver (and lands in the program binary cache).
+static bool validateShader(const std::string& source, std::string& error)
+{
+	std::string code = stripComments(source);
+	size_t first = code.find_first_not_of(" \t\n");
+	if (first == std::string::npos || code.compare(first, 8, "#version") != 0)
+	{
+		error = "#version must come first";
+		return false;
+	}
+	if (!std::regex_search(code, std::regex("void\\s+main\\s*\\(")))
+	{
+		error = "no main function";
+		return false;
+	}
+	int braces = 0, parentheses = 0, line = 1;
+	for (char c : code)
+	{
+		line += c == '\n';
+		braces += (c == '{') - (c == '}');
+		parentheses += (c == '(') - (c == ')');
+		if (braces < 0 || parentheses < 0)
+		{
+			error = "unbalanced bracket on line " + std::to_string(line);
+			return false;
+		}
+	}
+	if (braces != 0 || parentheses != 0)
+	{
+		error = "unbalanced brackets";
+		return false;
+	}
+	return true;
+}
+
+// the members of the shared PerFrame block with whitespace collapsed, empty when the shader doesn't declare it
+static std::string perFrameBlock(const std::string& source)
+{
+	std::string code = stripComments(source);
+	size_t start = code.find("uniform PerFrame");
+	if (start == std::string::npos)
+		return std::string();
+	size_t open = code.find('{', start), close = code.find('}', start);
+	if (open == std::string::npos || close == std::string::npos)
+		return std::string();
+	std::string block;
+	for (size_t i = open + 1; i < close; i++)
+	{
+		bool space = code[i] == ' ' || code[i] == '\t' || code[i] == '\n';
+		if (!space)
+			block += code[i];
+		else if (!block.empty() && block.back() != ' ')
+			block += ' ';
+	}
+	return block;
+}
+
+// Wavefront .obj: v, vn and f records, polygons are fanned into triangles. Faces without normals get
+// the face normal. Texture coordinates are ignored, the vertex layout has none
+static bool readObj(const fs::path& path, Mesh& mesh, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = "can't read " + path.generic_string();
+		return false;
+	}
+	std::vector<glm::vec3> positions, normals;
+	std::vector<float> triangles;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream record(line);
+		std::string kind;
+		record >> kind;
+		if (kind == "v" || kind == "vn")
+		{
+			glm::vec3 value(0.0f);
+			record >> value.x >> value.y >> value.z;
+			(kind == "v" ? positions : normals).push_back(value);
+		}
+		else if (kind == "f")
+		{
+			std::vector<int> corners, cornerNormals;
+			std::string corner;
+			while (record >> corner)
+			{
+				// position[/texcoord[/normal]]
+				int position = atoi(corner.c_str()), normal = 0;
+				size_t firstSlash = corner.find('/');
+				size_t secondSlash = firstSlash == std::string::npos ? firstSlash : corner.find('/', firstSlash + 1);
+				if (secondSlash != std::string::npos)
+					normal = atoi(corner.c_str() + secondSlash + 1);
+				// negative indices count back from the end
+				corners.push_back(position < 0 ? (int)positions.size() + position : position - 1);
+				cornerNormals.push_back(normal < 0 ? (int)normals.size() + normal : normal - 1);
+			}
+			for (size_t i = 0; i < corners.size(); i++)
+			{
+				if (corners[i] < 0 || corners[i] >= (int)positions.size() || cornerNormals[i] >= (int)normals.size())
+				{
+					error = "index out of range in " + path.generic_string();
+					return false;
+				}
+			}
+			for (size_t i = 2; i < corners.size(); i++)
+			{
+				size_t triangle[3] = { 0, i - 1, i };
+				glm::vec3 faceNormal = glm::cross(positions[corners[i - 1]] - positions[corners[0]], positions[corners[i]] - positions[corners[0]]);
+				float length = glm::length(faceNormal);
+				faceNormal = length > 0.0f ? faceNormal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+				for (size_t corner : triangle)
+				{
+					glm::vec3 position = positions[corners[corner]];
+					glm::vec3 normal = cornerNormals[corner] >= 0 ? normals[cornerNormals[corner]] : faceNormal;
+					float vertex[6] = { position.x, position.y, position.z, normal.x, normal.y, normal.z };
+					triangles.insert(triangles.end(), vertex, vertex + 6);
+				}
+			}
+		}
+	}
+	if (triangles.empty())
+	{
+		error = "no faces in " + path.generic_string();
+		return false;
+	}
+	mesh = buildOptimizedMesh(triangles.data(), triangles.size() / 6, 6);
+	return true;
+}
+
+static bool isImage(const std::string& extension)
+{
+	return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga" || extension == ".bmp";
+}
+
+static void cook(CookJob& job, bool compress, const AssetPack& previous, bool force)
+{
+	uint64_t settings = hashBytes(&COOK_VERSION, sizeof(COOK_VERSION));
+	std::string source;
+	if (job.type == PACK_SHADER)
+	{
+		// hash what the runtime gets, so edits to included files are picked up too
+		if (!preprocessShader(job.source, source, job.error) || !validateShader(source, job.error))
+		{
+			job.failed = true;
+			return;
+		}
+	}
+	else if (job.source.empty())
+		source.assign((const char*)cubeVertices, sizeof(cubeVertices));
+	else if (!readFile(job.source, source))
+	{
+		job.failed = true;
+		job.error = "can't read " + job.source.generic_string();
+		return;
+	}
+	if (job.type == PACK_TEXTURE)
+	{
+		int textureSettings[2] = { compress ? 1 : 0, MAX_TEXTURE_SIZE };
+		settings = hashBytes(textureSettings, sizeof(textureSettings), settings);
+	}
+	uint64_t sourceHash = hashBytes(source.data(), source.size(), settings);
+	job.blob.entry = makePackEntry(job.name, job.type, sourceHash);
+
+	const PackEntry* cached = force ? NULL : previous.find(job.name.c_str(), job.type);
+	if (cached && cached->sourceHash == sourceHash)
+	{
+		job.blob.data.assign((const char*)previous.data(*cached), cached->size);
+		job.reused = true;
+		return;
+	}
+
+	if (job.type == PACK_SHADER)
+		job.blob.data = source;
+	else if (job.type == PACK_TEXTURE)
+	{
+		// images are flipped the way the runtime loader flips them, GL's origin is bottom left
+		CookedTexture texture;
+		if (!cookTexture(job.source.string(), true, compress, MAX_TEXTURE_SIZE, texture))
+		{
+			job.failed = true;
+			job.error = "can't decode " + job.source.generic_string();
+			return;
+		}
+		writeCookedTexture(job.blob.data, texture);
+	}
+	else
+	{
+		Mesh mesh;
+		if (job.source.empty())
+			mesh = buildOptimizedMesh(cubeVertices, CUBE_VERTEX_COUNT, 6);
+		else if (!readObj(job.source, mesh, job.error))
+		{
+			job.failed = true;
+			return;
+		}
+		std::ostringstream stream(std::ios::binary);
+		writeMeshFile(stream, mesh);
+		job.blob.data = stream.str();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	fs::path assetDirectory = ".";
+	fs::path packPath;
+	unsigned int jobs = 0;
+	bool force = false;
+	bool compress = true;
+	int positional = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+			jobs = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--force") == 0)
+			force = true;
+		else if (strcmp(argv[i], "--no-compress") == 0)
+			compress = false;
+		else if (argv[i][0] != '-' && positional == 0 && ++positional)
+			assetDirectory = argv[i];
+		else if (argv[i][0] != '-' && positional == 1 && ++positional)
+			packPath = argv[i];
+		else
+		{
+			std::cout << "usage: assetcook [asset directory] [output pack] [--jobs N] [--force] [--no-compress]" << std::endl;
+			return 1;
+		}
+	}
+	if (packPath.empty())
+		packPath = assetDirectory / "assets.pack";
+
+	double start = nowMs();
+	std::vector<CookJob> cookJobs;
+	std::error_code walkError;
+	for (fs::recursive_directory_iterator it(assetDirectory, walkError), end; !walkError && it != end; it.increment(walkError))
+	{
+		if (!it->is_regular_file())
+			continue;
+		fs::path path = it->path();
+		std::string extension = path.extension().string();
+		for (char& c : extension)
+			c = (char)tolower((unsigned char)c);
+		CookJob job;
+		job.source = path;
+		job.name = path.lexically_relative(assetDirectory).generic_string();
+		if (isImage(extension))
+			job.type = PACK_TEXTURE;
+		else if (extension == ".vert" || extension == ".frag")
+			job.type = PACK_SHADER;
+		else if (extension == ".obj")
+		{
+			job.type = PACK_MESH;
+			job.name = job.name.substr(0, job.name.size() - extension.size()) + ".mesh";
+		}
+		else
+			continue;
+		if (job.name.size() >= PACK_NAME_LENGTH)
+		{
+			std::cout << "ERROR::ASSET_COOK::NAME_TOO_LONG " << job.name << std::endl;
+			return 1;
+		}
+		cookJobs.push_back(job);
+	}
+	if (walkError)
+	{
+		std::cout << "ERROR::ASSET_COOK::CANT_READ_DIRECTORY " << assetDirectory.generic_string() << ": " << walkError.message() << std::endl;
+		return 1;
+	}
+	// the cube the engine draws lives in cube_vertices.h, it is cooked like a mesh file
+	CookJob cube;
+	cube.name = "cube.mesh";
+	cube.type = PACK_MESH;
+	cookJobs.push_back(cube);
+
+	// the old pack only has to stay mapped until its blobs are copied out
+	size_t reused = 0, failed = 0, bytes = 0;
+	std::vector<PackBlob> blobs;
+	{
+		AssetPack previous;
+		std::error_code existsError;
+		if (fs::exists(packPath, existsError))
+			previous.open(packPath.string().c_str());
+		ThreadPool pool(jobs);
+		pool.parallelFor(cookJobs.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				cook(cookJobs[i], compress, previous, force);
+		});
+	}
+
+	// every program sees the same PerFrame uniform buffer, so every declaration of it has to agree
+	std::string perFrame, perFrameSource;
+	for (CookJob& job : cookJobs)
+	{
+		if (job.failed || job.type != PACK_SHADER)
+			continue;
+		std::string block = perFrameBlock(job.blob.data);
+		if (block.empty())
+			continue;
+		if (perFrame.empty())
+		{
+			perFrame = block;
+			perFrameSource = job.name;
+		}
+		else if (block != perFrame)
+		{
+			job.failed = true;
+			job.error = "PerFrame block differs from the one in " + perFrameSource;
+		}
+	}
+
+	for (CookJob& job : cookJobs)
+	{
+		if (job.failed)
+		{
+			std::cout << "ERROR::ASSET_COOK::" << (job.type == PACK_SHADER ? "SHADER" : job.type == PACK_TEXTURE ? "TEXTURE" : "MESH")
+				<< " " << job.name << ": " << job.error << std::endl;
+			failed++;
+			continue;
+		}
+		reused += job.reused;
+		bytes += job.blob.data.size();
+		blobs.push_back(job.blob);
+	}
+	// a broken asset leaves the previous pack in place
+	if (failed > 0)
+		return 1;
+	if (!writeAssetPack(packPath.string().c_str(), blobs))
+	{
+		std::cout << "ERROR::ASSET_COOK::WRITE_FAILED " << packPath.generic_string() << std::endl;
+		return 1;
+	}
+	std::cout << "{ \"pack\": \"" << packPath.generic_string() << "\", \"assets\": " << blobs.size() << ", \"cooked\": " << blobs.size() - reused
+		<< ", \"reused\": " << reused << ", \"bytes\": " << bytes << ", \"ms\": " << nowMs() - start << " }" << std::endl;
+	return 0;
+}
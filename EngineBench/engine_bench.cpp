@@ -0,0 +1,386 @@
+// Micro-benchmarks of the engine's per-frame hot paths: camera math, Shader uniform setters (against
+// the recording GL stub, no context needed), vertex packing, scene graph transform updates and the
+// frustum culling kernels.
+//
+// usage: engine_bench [--out results.json] [--baseline baseline.json] [--tolerance 0.25] [--update-baseline]
+//
+// Results are printed (or written to --out) as JSON. With --baseline every benchmark is compared with
+// the same benchmark in that file, an earlier run's output on the same machine: one that got slower by
+// more than the tolerance, or makes more GL calls per operation, is a regression and the run exits
+// with 1. A missing baseline file (or --update-baseline) is written from this run instead.
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+#include <glm-1.0.1/glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include "recording_gl.h"
+#include "camera.h"
+#include "shader_s.h"
+#include "mesh.h"
+#include "scene_graph.h"
+#include "culling.h"
+#include "thread_pool.h"
+#include "frame_stats.h"
+
+// the engine's shaders, the build points this at FirstOpenGLProject
+#ifndef ENGINE_ASSET_DIR
+#define ENGINE_ASSET_DIR "../FirstOpenGLProject/"
+#endif
+
+// timing: each benchmark runs in batches of at least MIN_BATCH_MS, the fastest of BATCHES is reported
+// since it is the one least disturbed by the rest of the machine
+const double MIN_BATCH_MS = 20.0;
+const int BATCHES = 7;
+
+// results are summed into this so the compiler can't drop the work being timed
+volatile float benchSink = 0.0f;
+
+struct BenchResult
+{
+	std::string name;
+	// what one operation is
+	std::string unit;
+	double nsPerOp = 0.0;
+	double glCallsPerOp = 0.0;
+	// from the baseline file, negative when it has no such benchmark
+	double baselineNsPerOp = -1.0;
+	double baselineGlCallsPerOp = -1.0;
+	bool regressed = false;
+};
+
+// times `run`, which performs `ops` operations of `unit` per call
+template <typename Fn>
+BenchResult measure(const char* name, const char* unit, size_t ops, Fn run)
+{
+	BenchResult result;
+	result.name = name;
+	result.unit = unit;
+
+	// warm up, and count the GL calls of one run
+	run();
+	RecordingGL::reset();
+	run();
+	result.glCallsPerOp = (double)RecordingGL::totalCalls() / ops;
+
+	int repeats = 1;
+	for (;;)
+	{
+		double start = nowMs();
+		for (int i = 0; i < repeats; i++)
+			run();
+		if (nowMs() - start >= MIN_BATCH_MS)
+			break;
+		repeats *= 2;
+	}
+	double best = 1e30;
+	for (int batch = 0; batch < BATCHES; batch++)
+	{
+		double start = nowMs();
+		for (int i = 0; i < repeats; i++)
+			run();
+		best = std::min(best, nowMs() - start);
+	}
+	result.nsPerOp = best * 1e6 / ((double)repeats * ops);
+	return result;
+}
+
+static void benchmarkCamera(std::vector<BenchResult>& results)
+{
+	const size_t OPS = 1000;
+	Camera camera(glm::vec3(1.0f, 2.0f, 3.0f));
+	// ProcessMouseMovement is the public way into updateCameraVectors, the offsets alternate so the
+	// angles stay in range
+	results.push_back(measure("camera_update_vectors", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			camera.ProcessMouseMovement((i & 1) ? 3.0f : -3.0f, (i & 2) ? 1.0f : -1.0f);
+		benchSink = benchSink + camera.Front.x;
+	}));
+	results.push_back(measure("camera_view_matrix", "call", OPS, [&]()
+	{
+		float sum = 0.0f;
+		for (size_t i = 0; i < OPS; i++)
+		{
+			camera.Position.x = (float)(i & 7);
+			sum += camera.GetViewMatrix()[3][0];
+		}
+		benchSink = benchSink + sum;
+	}));
+}
+
+// the setters the draw loop uses, looked up by name (a string and a hash lookup per call) and by a
+// location fetched once
+static void benchmarkShaderUniforms(std::vector<BenchResult>& results)
+{
+	const size_t OPS = 1000;
+	RecordingGL::uniforms = { "model", "objectColor", "materialLayer", "lightColor", "viewPos", "blockColors[0]" };
+	Shader shader(ENGINE_ASSET_DIR "lighting.vert", ENGINE_ASSET_DIR "lighting.frag");
+	int modelLoc = shader.getUniformLocation("model");
+	int colorLoc = shader.getUniformLocation("objectColor");
+	int layerLoc = shader.getUniformLocation("materialLayer");
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+	glm::vec3 color(0.0f, 0.2f, 1.0f);
+
+	results.push_back(measure("shader_set_mat4_by_name", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			shader.setMat4("model", model);
+	}));
+	results.push_back(measure("shader_set_mat4_by_location", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			shader.setMat4(modelLoc, model);
+	}));
+	results.push_back(measure("shader_set_vec3_by_name", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			shader.setVec3("objectColor", color);
+	}));
+	results.push_back(measure("shader_set_vec3_by_location", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			shader.setVec3(colorLoc, color);
+	}));
+	results.push_back(measure("shader_set_int_by_name", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			shader.setInt("materialLayer", (int)i);
+	}));
+	results.push_back(measure("shader_set_int_by_location", "call", OPS, [&]()
+	{
+		for (size_t i = 0; i < OPS; i++)
+			shader.setInt(layerLoc, (int)i);
+	}));
+}
+
+static void benchmarkVertexPacking(std::vector<BenchResult>& results)
+{
+	const size_t VERTICES = 4096;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+	std::vector<MeshVertex> vertices(VERTICES);
+	for (MeshVertex& vertex : vertices)
+	{
+		vertex.position = glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng));
+		vertex.normal = glm::normalize(glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng)) + glm::vec3(0.01f));
+	}
+	results.push_back(measure("vertex_pack", "vertex", VERTICES, [&]()
+	{
+		std::vector<PackedVertex> packed = packVertices(vertices);
+		benchSink = benchSink + (float)packed[VERTICES / 2].normal;
+	}));
+}
+
+static void buildTree(SceneGraph& scene, SceneNode parent, int depth, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+	for (int child = 0; child < 4; child++)
+	{
+		SceneNode node = scene.add(parent, glm::vec3(offset(rng), offset(rng), offset(rng)));
+		if (depth > 1)
+			buildTree(scene, node, depth - 1, rng);
+	}
+}
+
+// world matrix updates of 8 trees of fanout 4 and depth 6 (43680 nodes): every node moving, and 1%
+// of them moving with the dirty flag update skipping the rest
+static void benchmarkTransforms(std::vector<BenchResult>& results)
+{
+	std::mt19937 rng(1234);
+	SceneGraph scene;
+	for (int i = 0; i < 8; i++)
+		buildTree(scene, scene.add(SceneGraph::NO_PARENT, glm::vec3((float)i, 0.0f, 0.0f)), 6, rng);
+	scene.update();
+	size_t nodeCount = scene.size();
+	const glm::vec3 axis(0.0f, 1.0f, 0.0f);
+	float angle = 0.0f;
+
+	results.push_back(measure("transform_update_full", "node", nodeCount, [&]()
+	{
+		angle += 0.01f;
+		for (uint32_t node = 0; node < nodeCount; node++)
+			scene.setRotation(node, glm::angleAxis(angle, axis));
+		scene.update();
+	}));
+
+	std::uniform_int_distribution<uint32_t> pick(0, (uint32_t)nodeCount - 1);
+	results.push_back(measure("transform_update_dirty", "frame", 1, [&]()
+	{
+		angle += 0.01f;
+		for (size_t i = 0; i < nodeCount / 100; i++)
+			scene.setRotation(pick(rng), glm::angleAxis(angle, axis));
+		scene.update();
+	}));
+}
+
+// 100000 random boxes around the camera, the kernel on one thread and FrustumCuller over the pool
+static void benchmarkCulling(std::vector<BenchResult>& results, ThreadPool& pool)
+{
+	const size_t BOXES = 100000;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.25f, 1.0f);
+	ObjectStore store;
+	store.reserve(BOXES);
+	for (size_t i = 0; i < BOXES; i++)
+		store.add(glm::vec3(position(rng), position(rng), position(rng)), glm::vec3(size(rng)));
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::fromMatrix(projection * view);
+
+	std::vector<uint32_t> visible(BOXES);
+	results.push_back(measure("cull_kernel", "box", BOXES, [&]()
+	{
+		benchSink = benchSink + (float)cullBoxes(store, frustum, 0, store.size(), visible.data());
+	}));
+	FrustumCuller culler;
+	results.push_back(measure("cull_pooled", "box", BOXES, [&]()
+	{
+		culler.cull(store, frustum, pool);
+		benchSink = benchSink + (float)culler.visible.size();
+	}));
+}
+
+// reads the results of an earlier run, only what this program writes
+static bool readBaseline(const char* path, std::vector<BenchResult>& baseline)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+	size_t position = 0;
+	for (;;)
+	{
+		position = text.find("\"name\": \"", position);
+		if (position == std::string::npos)
+			break;
+		position += 9;
+		size_t end = text.find('"', position);
+		size_t objectEnd = text.find('}', position);
+		if (end == std::string::npos || objectEnd == std::string::npos)
+			break;
+		BenchResult result;
+		result.name = text.substr(position, end - position);
+		size_t ns = text.find("\"ns_per_op\": ", end);
+		size_t calls = text.find("\"gl_calls_per_op\": ", end);
+		if (ns < objectEnd)
+			result.nsPerOp = atof(text.c_str() + ns + 13);
+		if (calls < objectEnd)
+			result.glCallsPerOp = atof(text.c_str() + calls + 19);
+		baseline.push_back(result);
+		position = objectEnd;
+	}
+	return true;
+}
+
+static int compareWithBaseline(std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double tolerance)
+{
+	int regressions = 0;
+	for (BenchResult& result : results)
+	{
+		for (const BenchResult& old : baseline)
+		{
+			if (old.name != result.name)
+				continue;
+			result.baselineNsPerOp = old.nsPerOp;
+			result.baselineGlCallsPerOp = old.glCallsPerOp;
+			result.regressed = result.nsPerOp > old.nsPerOp * (1.0 + tolerance) || result.glCallsPerOp > old.glCallsPerOp + 1e-9;
+			if (result.regressed)
+			{
+				regressions++;
+				std::cerr << "REGRESSION " << result.name << ": " << result.nsPerOp << " ns/" << result.unit << " (baseline " << old.nsPerOp
+					<< "), " << result.glCallsPerOp << " GL calls/" << result.unit << " (baseline " << old.glCallsPerOp << ")" << std::endl;
+			}
+		}
+	}
+	return regressions;
+}
+
+static void writeResults(std::ostream& out, const std::vector<BenchResult>& results, unsigned int threads, double tolerance, int regressions)
+{
+	out << "{\n\t\"culling_kernel\": \"" << CULLING_KERNEL << "\",\n\t\"threads\": " << threads << ",\n\t\"tolerance\": " << tolerance << ",\n";
+	out << "\t\"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& result = results[i];
+		out << "\t\t{ \"name\": \"" << result.name << "\", \"unit\": \"" << result.unit << "\", \"ns_per_op\": " << result.nsPerOp
+			<< ", \"gl_calls_per_op\": " << result.glCallsPerOp;
+		if (result.baselineNsPerOp >= 0.0)
+			out << ", \"baseline_ns_per_op\": " << result.baselineNsPerOp << ", \"ratio\": " << result.nsPerOp / std::max(result.baselineNsPerOp, 1e-9)
+				<< ", \"regressed\": " << (result.regressed ? "true" : "false");
+		out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "\t],\n\t\"regressions\": " << regressions << "\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	const char* outPath = NULL;
+	const char* baselinePath = NULL;
+	double tolerance = 0.25;
+	bool updateBaseline = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			outPath = argv[++i];
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+			tolerance = atof(argv[++i]);
+		else if (strcmp(argv[i], "--update-baseline") == 0)
+			updateBaseline = true;
+		else
+		{
+			std::cerr << "usage: engine_bench [--out results.json] [--baseline baseline.json] [--tolerance 0.25] [--update-baseline]" << std::endl;
+			return 2;
+		}
+	}
+
+	RecordingGL::install();
+	ThreadPool pool;
+	std::vector<BenchResult> results;
+	benchmarkCamera(results);
+	benchmarkShaderUniforms(results);
+	benchmarkVertexPacking(results);
+	benchmarkTransforms(results);
+	benchmarkCulling(results, pool);
+
+	int regressions = 0;
+	std::vector<BenchResult> baseline;
+	bool haveBaseline = baselinePath && !updateBaseline && readBaseline(baselinePath, baseline);
+	if (haveBaseline)
+		regressions = compareWithBaseline(results, baseline, tolerance);
+
+	if (outPath)
+	{
+		std::ofstream file(outPath);
+		writeResults(file, results, pool.size() + 1, tolerance, regressions);
+	}
+	else
+		writeResults(std::cout, results, pool.size() + 1, tolerance, regressions);
+
+	if (baselinePath && !haveBaseline)
+	{
+		std::ofstream file(baselinePath);
+		writeResults(file, results, pool.size() + 1, tolerance, 0);
+		if (!file)
+		{
+			std::cerr << "ERROR::ENGINE_BENCH::BASELINE_WRITE_FAILED " << baselinePath << std::endl;
+			return 1;
+		}
+		std::cerr << "baseline written to " << baselinePath << std::endl;
+	}
+	return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+#ifndef RECORDING_GL_H
+#define RECORDING_GL_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+// Stand-in for the GL driver. install() points glad's function pointers for the calls Shader makes at
+// functions that append the call and its arguments to a buffer instead of talking to a GPU, so the
+// engine's GL-facing code can be timed (and its call counts checked) without a context. Programs and
+// shaders always compile and link, and every program reports the uniforms in `uniforms`.
+class RecordingGL
+{
+public:
+	enum Call : uint32_t
+	{
+		CREATE_PROGRAM,
+		CREATE_SHADER,
+		SHADER_SOURCE,
+		COMPILE_SHADER,
+		GET_SHADER_IV,
+		GET_SHADER_INFO_LOG,
+		ATTACH_SHADER,
+		LINK_PROGRAM,
+		GET_PROGRAM_IV,
+		GET_PROGRAM_INFO_LOG,
+		DELETE_SHADER,
+		DELETE_PROGRAM,
+		USE_PROGRAM,
+		GET_ACTIVE_UNIFORM,
+		GET_UNIFORM_LOCATION,
+		GET_UNIFORM_BLOCK_INDEX,
+		UNIFORM_BLOCK_BINDING,
+		UNIFORM_1I,
+		UNIFORM_1F,
+		UNIFORM_3F,
+		UNIFORM_3FV,
+		UNIFORM_MATRIX_4FV,
+		GET_STRING,
+		GET_INTEGER_V,
+		CALL_COUNT
+	};
+
+	// names of the active uniforms every program reports, location = index
+	static inline std::vector<std::string> uniforms;
+	// calls per Call since the last reset()
+	static inline uint64_t counts[CALL_COUNT] = {};
+
+	static void install()
+	{
+		glad_glCreateProgram = createProgram;
+		glad_glCreateShader = createShader;
+		glad_glShaderSource = shaderSource;
+		glad_glCompileShader = compileShader;
+		glad_glGetShaderiv = getShaderiv;
+		glad_glGetShaderInfoLog = getShaderInfoLog;
+		glad_glAttachShader = attachShader;
+		glad_glLinkProgram = linkProgram;
+		glad_glGetProgramiv = getProgramiv;
+		glad_glGetProgramInfoLog = getProgramInfoLog;
+		glad_glDeleteShader = deleteShader;
+		glad_glDeleteProgram = deleteProgram;
+		glad_glUseProgram = useProgram;
+		glad_glGetActiveUniform = getActiveUniform;
+		glad_glGetUniformLocation = getUniformLocation;
+		glad_glGetUniformBlockIndex = getUniformBlockIndex;
+		glad_glUniformBlockBinding = uniformBlockBinding;
+		glad_glUniform1i = uniform1i;
+		glad_glUniform1f = uniform1f;
+		glad_glUniform3f = uniform3f;
+		glad_glUniform3fv = uniform3fv;
+		glad_glUniformMatrix4fv = uniformMatrix4fv;
+		glad_glGetString = getString;
+		glad_glGetIntegerv = getIntegerv;
+		stream.reserve(STREAM_WORDS);
+	}
+
+	static void reset()
+	{
+		memset(counts, 0, sizeof(counts));
+		stream.clear();
+	}
+
+	static uint64_t totalCalls()
+	{
+		uint64_t total = 0;
+		for (uint64_t count : counts)
+			total += count;
+		return total;
+	}
+
+	// words recorded since the last reset, what is left of them after the buffer wrapped
+	static size_t recordedWords()
+	{
+		return stream.size();
+	}
+
+private:
+	// the recording wraps around at this size so long benchmark loops don't grow it without bound
+	static const size_t STREAM_WORDS = 1 << 20;
+	static inline std::vector<uint32_t> stream;
+	static inline GLuint nextName = 1;
+
+	// one call: its id, two argument words, then any data it passes by pointer (values, matrices)
+	static void record(Call call, uint32_t a = 0, uint32_t b = 0, const void* data = NULL, size_t bytes = 0)
+	{
+		counts[call]++;
+		size_t words = 3 + (bytes + 3) / 4;
+		if (stream.size() + words > STREAM_WORDS)
+			stream.clear();
+		size_t offset = stream.size();
+		stream.resize(offset + words);
+		stream[offset] = call;
+		stream[offset + 1] = a;
+		stream[offset + 2] = b;
+		if (bytes)
+			memcpy(stream.data() + offset + 3, data, bytes);
+	}
+
+	static GLuint APIENTRY createProgram()
+	{
+		record(CREATE_PROGRAM);
+		return nextName++;
+	}
+
+	static GLuint APIENTRY createShader(GLenum type)
+	{
+		record(CREATE_SHADER, type);
+		return nextName++;
+	}
+
+	static void APIENTRY shaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths)
+	{
+		size_t bytes = 0;
+		for (GLsizei i = 0; i < count; i++)
+			bytes += lengths ? (size_t)lengths[i] : strlen(strings[i]);
+		record(SHADER_SOURCE, shader, (uint32_t)bytes);
+	}
+
+	static void APIENTRY compileShader(GLuint shader)
+	{
+		record(COMPILE_SHADER, shader);
+	}
+
+	static void APIENTRY getShaderiv(GLuint shader, GLenum name, GLint* value)
+	{
+		record(GET_SHADER_IV, shader, name);
+		*value = name == GL_COMPILE_STATUS ? GL_TRUE : 0;
+	}
+
+	static void APIENTRY getShaderInfoLog(GLuint shader, GLsizei size, GLsizei* length, GLchar* log)
+	{
+		record(GET_SHADER_INFO_LOG, shader);
+		if (length)
+			*length = 0;
+		if (size > 0)
+			log[0] = '\0';
+	}
+
+	static void APIENTRY attachShader(GLuint program, GLuint shader)
+	{
+		record(ATTACH_SHADER, program, shader);
+	}
+
+	static void APIENTRY linkProgram(GLuint program)
+	{
+		record(LINK_PROGRAM, program);
+	}
+
+	static void APIENTRY getProgramiv(GLuint program, GLenum name, GLint* value)
+	{
+		record(GET_PROGRAM_IV, program, name);
+		if (name == GL_LINK_STATUS)
+			*value = GL_TRUE;
+		else if (name == GL_ACTIVE_UNIFORMS)
+			*value = (GLint)uniforms.size();
+		else
+			*value = 0;
+	}
+
+	static void APIENTRY getProgramInfoLog(GLuint program, GLsizei size, GLsizei* length, GLchar* log)
+	{
+		record(GET_PROGRAM_INFO_LOG, program);
+		if (length)
+			*length = 0;
+		if (size > 0)
+			log[0] = '\0';
+	}
+
+	static void APIENTRY deleteShader(GLuint shader)
+	{
+		record(DELETE_SHADER, shader);
+	}
+
+	static void APIENTRY deleteProgram(GLuint program)
+	{
+		record(DELETE_PROGRAM, program);
+	}
+
+	static void APIENTRY useProgram(GLuint program)
+	{
+		record(USE_PROGRAM, program);
+	}
+
+	static void APIENTRY getActiveUniform(GLuint program, GLuint index, GLsizei size, GLsizei* length, GLint* count, GLenum* type, GLchar* name)
+	{
+		record(GET_ACTIVE_UNIFORM, program, index);
+		const char* uniform = index < uniforms.size() ? uniforms[index].c_str() : "";
+		GLsizei written = size > 0 ? (GLsizei)std::min(strlen(uniform), (size_t)size - 1) : 0;
+		memcpy(name, uniform, written);
+		if (size > 0)
+			name[written] = '\0';
+		if (length)
+			*length = written;
+		*count = 1;
+		*type = GL_FLOAT_MAT4;
+	}
+
+	static GLint APIENTRY getUniformLocation(GLuint program, const GLchar* name)
+	{
+		record(GET_UNIFORM_LOCATION, program);
+		for (size_t i = 0; i < uniforms.size(); i++)
+		{
+			if (uniforms[i] == name)
+				return (GLint)i;
+		}
+		return -1;
+	}
+
+	static GLuint APIENTRY getUniformBlockIndex(GLuint program, const GLchar* name)
+	{
+		record(GET_UNIFORM_BLOCK_INDEX, program);
+		return 0;
+	}
+
+	static void APIENTRY uniformBlockBinding(GLuint program, GLuint block, GLuint binding)
+	{
+		record(UNIFORM_BLOCK_BINDING, block, binding);
+	}
+
+	static void APIENTRY uniform1i(GLint location, GLint value)
+	{
+		record(UNIFORM_1I, (uint32_t)location, (uint32_t)value);
+	}
+
+	static void APIENTRY uniform1f(GLint location, GLfloat value)
+	{
+		record(UNIFORM_1F, (uint32_t)location, 0, &value, sizeof(value));
+	}
+
+	static void APIENTRY uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+	{
+		GLfloat value[3] = { x, y, z };
+		record(UNIFORM_3F, (uint32_t)location, 0, value, sizeof(value));
+	}
+
+	static void APIENTRY uniform3fv(GLint location, GLsizei count, const GLfloat* value)
+	{
+		record(UNIFORM_3FV, (uint32_t)location, (uint32_t)count, value, count * 3 * sizeof(GLfloat));
+	}
+
+	static void APIENTRY uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+	{
+		record(UNIFORM_MATRIX_4FV, (uint32_t)location, (uint32_t)count | ((uint32_t)transpose << 31), value, count * 16 * sizeof(GLfloat));
+	}
+
+	// vendor, renderer and version all name the stub
+	static const GLubyte* APIENTRY getString(GLenum name)
+	{
+		record(GET_STRING, name);
+		return (const GLubyte*)"RecordingGL";
+	}
+
+	// every queried limit or count is 0, which also keeps the program binary cache off
+	static void APIENTRY getIntegerv(GLenum name, GLint* value)
+	{
+		record(GET_INTEGER_V, name);
+		*value = 0;
+	}
+};
+
+#endif
@@ -5,22 +5,64 @@
 #include <glm-1.0.1/glm/gtc/matrix_transform.hpp>
 #include <glm-1.0.1/glm/gtc/type_ptr.hpp>
 #define STB_IMAGE_IMPLEMENTATION
-#include "C:\Users\pjbru\OneDrive\Desktop\stb_image.h"
+#include "stb_image.h"
 
 #include "shader_s.h"
+#include "per_frame.h"
 #include "camera.h"
+#include "headless.h"
+#include "framebuffer.h"
+#include "frame_stats.h"
+#include "instance_buffer.h"
+#include "thread_pool.h"
+#include "culling.h"
+#include "mesh.h"
+#include "mesh_file.h"
+#include "cube_vertices.h"
+#include "asset_pack.h"
+#include "texture_array.h"
+#include "render_queue.h"
+#include "simulation.h"
+#include "profiler.h"
+#include "scene_graph.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "frame_memory.h"
+#include "clustered_lighting.h"
+#include "voxel_world.h"
+#include "dynamic_resolution.h"
+#include "gl_trace.h"
+#include "soft_raster.h"
+#include "benchmarks.h"
 
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void proccessInput(GLFWwindow* window);
+void benchmarkCameraPath(float time);
+void buildCubeField(SceneGraph& scene, SceneNode parent, int count);
+SceneNode buildCubeScene(SceneGraph& scene, int cubeCount);
+void gatherInstances(const SceneGraph& scene, SceneNode parent, std::vector<InstanceData>& instances);
+int renderSoftware(const char* path, int frames, int cubeCount, ThreadPool& workers);
+int replayGLTrace(const char* path, const char* outPath, bool pace);
 
 //settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+// size of the default framebuffer, follows the window
+int viewportWidth = SCR_WIDTH;
+int viewportHeight = SCR_HEIGHT;
 bool wireframe = false;
 bool released = true;
 float mixer = 0.2;
@@ -31,44 +73,230 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing 
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// timestamped input from the window callbacks, consumed by the simulation thread
+InputEventQueue inputEvents;
 
-// position of the light
-glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+// default scene: where the cubes go
+const glm::vec3 cubePositions[] = {
+	glm::vec3(0.0f,  0.0f,  0.0f),
+	glm::vec3(2.0f,  5.0f, -15.0f),
+	glm::vec3(-1.5f, -2.2f, -2.5f),
+	glm::vec3(-3.8f, -2.0f, -12.3f),
+	glm::vec3(2.4f, -0.4f, -3.5f),
+	glm::vec3(-1.7f,  3.0f, -7.5f),
+	glm::vec3(1.3f, -2.0f, -2.5f),
+	glm::vec3(1.5f,  2.0f, -2.5f),
+	glm::vec3(1.5f,  0.2f, -1.5f),
+	glm::vec3(-1.3f,  1.0f, -1.5f)
+};
 
+// headless benchmark: fixed simulated timestep so every run renders the same frames
+const float BENCH_TIMESTEP = 1.0f / 60.0f;
 
-int main()
-{
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+int main(int argc, char* argv[])
+{
+	// command line: [--record input.bin] | --headless [--frames N] [--out stats.json] [--cubes N] [--replay input.bin]
+	//               [--trace trace.json] [--frame-budget ms] [--lod-error px | --no-lod] [--no-occlusion] [--textured] [--pack assets.pack] [--lights N]
+	//               [--voxels R] [--voxel-budget MB] [--dynamic-res ms [--min-res-scale s]] [--capture-gl calls.gltrace]
+	//               | --soft-render out.png [--frames N] [--cubes N] | --replay-gl calls.gltrace [--pace] [--out stats.json]
+	//               | --bench-cull [N] | --bench-mesh | --bench-queue | --bench-scene | --bench-raster | --bench-lod | --bench-occlusion | --bench-texture | --bench-lights | --bench-voxels
+	bool headless = false;
+	int benchFrames = 1000;
+	const char* benchOut = NULL;
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	const char* tracePath = NULL;
+	const char* softRenderPath = NULL;
+	const char* captureGLPath = NULL;
+	const char* replayGLPath = NULL;
+	bool replayPaced = false;
+	int cubeCount = 0;
+	bool lodEnabled = true;
+	bool occlusionEnabled = true;
+	bool texturedCubes = false;
+	const char* packPath = "assets.pack";
+	int pointLightCount = 0;
+	int voxelRadius = 0;
+	int voxelBudgetMb = 64;
+	float lodPixelError = 1.0f;
+	float resolutionBudgetMs = 0.0f;
+	float minResolutionScale = 0.5f;
+	for (int i = 1; i < argc; i++)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			benchFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			benchOut = argv[++i];
+		else if (strcmp(argv[i], "--cubes") == 0 && i + 1 < argc)
+			cubeCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+			Profiler::instance().frameBudgetMs = atof(argv[++i]);
+		else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc)
+			lodPixelError = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--no-lod") == 0)
+			lodEnabled = false;
+		else if (strcmp(argv[i], "--no-occlusion") == 0)
+			occlusionEnabled = false;
+		else if (strcmp(argv[i], "--textured") == 0)
+			texturedCubes = true;
+		else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+			packPath = argv[++i];
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			pointLightCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--voxels") == 0 && i + 1 < argc)
+			voxelRadius = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--voxel-budget") == 0 && i + 1 < argc)
+			voxelBudgetMb = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--dynamic-res") == 0 && i + 1 < argc)
+			resolutionBudgetMs = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--min-res-scale") == 0 && i + 1 < argc)
+			minResolutionScale = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--soft-render") == 0 && i + 1 < argc)
+			softRenderPath = argv[++i];
+		else if (strcmp(argv[i], "--capture-gl") == 0 && i + 1 < argc)
+			captureGLPath = argv[++i];
+		else if (strcmp(argv[i], "--replay-gl") == 0 && i + 1 < argc)
+			replayGLPath = argv[++i];
+		else if (strcmp(argv[i], "--pace") == 0)
+			replayPaced = true;
+		else if (strcmp(argv[i], "--bench-mesh") == 0)
+		{
+			runMeshBenchmark(std::cout, cubeVertices, CUBE_VERTEX_COUNT);
+			runMeshLoadBenchmark(std::cout, "bench_grid.mesh");
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-scene") == 0)
+		{
+			ThreadPool pool;
+			runSceneGraphBenchmark(std::cout, pool, 32, 20);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-queue") == 0)
+		{
+			runRenderQueueBenchmark(std::cout, 10000, 100);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-occlusion") == 0)
+		{
+			ThreadPool pool;
+			runOcclusionBenchmark(std::cout, pool, 40, cubeVertices, CUBE_VERTEX_COUNT, 20);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-texture") == 0)
+		{
+			ThreadPool pool;
+			runTextureBenchmark(std::cout, pool, { "container.jpg", "awesomeface.png" }, 10);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-lights") == 0)
+		{
+			ThreadPool pool;
+			runLightClusterBenchmark(std::cout, pool, 1000, 20);
+			runLightClusterBenchmark(std::cout, pool, 10000, 20);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-voxels") == 0)
+		{
+			ThreadPool pool;
+			runVoxelBenchmark(std::cout, pool, 8);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-lod") == 0)
+		{
+			runLodBenchmark(std::cout, 64, 100000, SCR_HEIGHT);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-raster") == 0)
+		{
+			ThreadPool pool;
+			runSoftRasterBenchmark(std::cout, pool, cubeVertices, CUBE_VERTEX_COUNT, SCR_WIDTH, SCR_HEIGHT, 20);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bench-cull") == 0)
+		{
+			// CPU only, runs before any context is created
+			size_t objects = (i + 1 < argc && argv[i + 1][0] != '-') ? (size_t)atol(argv[++i]) : 1000000;
+			ThreadPool pool;
+			runCullBenchmark(std::cout, pool, objects, 50);
+			return 0;
+		}
 	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	// worker threads for data parallel engine work
+	ThreadPool workers;
+
+	// the software rasterizer needs no context
+	if (softRenderPath)
+		return renderSoftware(softRenderPath, benchFrames, cubeCount, workers);
 
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	GLFWwindow* window = NULL;
+	HeadlessContext headlessContext;
+	if (headless || replayGLPath)
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		if (!headlessContext.create(3, 3))
+		{
+			std::cout << "Failed to create headless context" << std::endl;
+			return -1;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+		// a trace replays on its own, the scene below is whatever the trace draws
+		if (replayGLPath)
+			return replayGLTrace(replayGLPath, benchOut, replayPaced);
+	}
+	else
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwSetKeyCallback(window, key_callback);
+
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
 	}
 
+	// --capture-gl: every GL call from here on goes to the trace too, for --replay-gl to issue again
+	if (captureGLPath && !GLCapture::start(captureGLPath, headless ? SCR_WIDTH : viewportWidth, headless ? SCR_HEIGHT : viewportHeight))
+		return -1;
+
 	// z-buffer
 	glEnable(GL_DEPTH_TEST);
 
+	// hot path zones are timed from here on, see --trace
+	Profiler& profiler = Profiler::instance();
+	profiler.initGpu();
+
 	// print out the maximum number of vertex attributes supported by my hardware
 	/*
 	int nrAttributes;
@@ -76,11 +304,31 @@ int main()
 	std::cout << "Maximum nr of vertex attributes supported: " << nrAttributes << std::endl;
 	*/
 
+	// assets cooked by assetcook: shaders, textures and meshes are read from the pack as they are stored.
+	// Whatever the pack doesn't have (or all of it, without a pack) is loaded from the raw files
+	AssetPack assets;
+	if (assets.open(packPath) && !headless)
+		std::cout << "Assets from " << packPath << " (" << assets.contents().size() << " entries)" << std::endl;
+
 	// Create Shader Objects
 	//Shader yellowShader("Shader.vert", "Yellow.frag");
 	//Shader orangeShader("Shader.vert", "Orange.frag");
-	Shader lightingShader("lighting.vert", "lighting.frag");
-	Shader lightSourceShader("lightSource.vert", "lightSource.frag");
+	// programs come from the binary cache when an earlier run stored them, time it to compare cold and warm starts
+	double shaderStart = nowMs();
+	Shader lightingShader("lighting.vert", "lighting.frag", &assets);
+	Shader lightSourceShader("lightSource.vert", "lightSource.frag", &assets);
+	double shaderMs = nowMs() - shaderStart;
+	int shaderCacheHits = (int)lightingShader.loadedFromCache + (int)lightSourceShader.loadedFromCache;
+	if (!headless)
+		std::cout << "Shaders ready in " << shaderMs << " ms (" << shaderCacheHits << "/2 from cache)" << std::endl;
+
+	// projection, view and light data shared by every program, uploaded once per frame
+	PerFrameData perFrame;
+	perFrame.lightColor = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+
+	// look up the per-object uniforms once instead of every frame
+	int objectColorLoc = lightingShader.getUniformLocation("objectColor");
+	int lightSourceModelLoc = lightSourceShader.getUniformLocation("model");
 
 	// Set up vertex data (and buffer(s)) and configure vertex attributes
 	// ------------------------------------------------------------------
@@ -97,63 +345,7 @@ int main()
 	};
 	*/
 
-	float vertices[] = {
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		 0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		 0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-
-		 0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		 0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
-	};
 	/*
-	glm::vec3 cubePositions[] = {
-		glm::vec3(0.0f,  0.0f,  0.0f),
-		glm::vec3(2.0f,  5.0f, -15.0f),
-		glm::vec3(-1.5f, -2.2f, -2.5f),
-		glm::vec3(-3.8f, -2.0f, -12.3f),
-		glm::vec3(2.4f, -0.4f, -3.5f),
-		glm::vec3(-1.7f,  3.0f, -7.5f),
-		glm::vec3(1.3f, -2.0f, -2.5f),
-		glm::vec3(1.5f,  2.0f, -2.5f),
-		glm::vec3(1.5f,  0.2f, -1.5f),
-		glm::vec3(-1.3f,  1.0f, -1.5f)
-	};
-
 	unsigned int indicies[] = {
 		0, 1, 3, // first triangle 
 		1, 2, 3  // second triangle 
@@ -161,32 +353,27 @@ int main()
 	*/
 
 
-	unsigned int VBO, cubeVAO;
-	glGenVertexArrays(1, &cubeVAO);
-	glGenBuffers(1, &VBO);
-	//glGenBuffers(1, &EBO);
-
-	// Bind VBO and send verticies to the graphics card 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	// the cube comes from the asset pack or a memory mapped binary mesh file and is uploaded straight from the mapping.
+	// Without a pack, the first run writes that file from cubeVertices[]: deduplicated, ordered for the vertex cache and packed to 12 byte vertices.
+	BufferUploader uploader;
+	MeshFile cubeFile;
+	const PackEntry* cubeEntry = assets.find("cube.mesh", PACK_MESH);
+	if (cubeEntry ? !cubeFile.open(assets.data(*cubeEntry), cubeEntry->size) : !cubeFile.open("cube.mesh"))
+	{
+		Mesh cubeMesh = buildOptimizedMesh(cubeVertices, CUBE_VERTEX_COUNT, 6);
+		if (!writeMeshFile("cube.mesh", cubeMesh) || !cubeFile.open("cube.mesh"))
+		{
+			std::cout << "Failed to create cube.mesh" << std::endl;
+			return -1;
+		}
+	}
+	GpuMesh* cubeGpuMesh = cubeFile.createGpuMesh(&uploader);
 
 	// bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attribure(s)
 	// Start setup 
-	glBindVertexArray(cubeVAO);
-
-
-	/*
-	// Bind EBO and send indicies to the graphics card
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indicies), indicies, GL_STATIC_DRAW);
-	*/
-
-	// position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+	unsigned int cubeVAO;
+	glGenVertexArrays(1, &cubeVAO);
+	cubeGpuMesh->attach(cubeVAO);
 
 	// color attribute
 	//glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -196,14 +383,104 @@ int main()
 	// glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	// glEnableVertexAttribArray(2);
 
+	// scene: the cubePositions cubes (or a generated field of --cubes N cubes) under one node, and the light
+	SceneGraph scene;
+	SceneNode cubeField = buildCubeScene(scene, cubeCount);
+	SceneNode lightNode = scene.add(SceneGraph::NO_PARENT, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.2f));
+	scene.update(&workers);
+
+	// per-instance model and normal matrices
+	std::vector<InstanceData> cubeObjects;
+	gatherInstances(scene, cubeField, cubeObjects);
+
+	// transient memory: per-frame CPU scratch, and a fenced GPU ring holding each frame's uniforms and
+	// instances (room for every cube), so nothing in the loop allocates from the heap or the driver
+	FrameArena frameArena;
+	GpuRingBuffer frameRing(sizeof(PerFrameData) + cubeObjects.size() * sizeof(InstanceData) + 64 * 1024);
+	size_t arenaBytes = 0, ringBytes = 0;
+
+	// world space bounds of every cube, tested against the view frustum each frame
+	ObjectStore cubeBounds;
+	cubeBounds.reserve(cubeObjects.size());
+	for (const InstanceData& object : cubeObjects)
+		cubeBounds.addTransformed(object.model, glm::vec3(0.5f));
+	FrustumCuller cubeCuller;
+
+	// level of detail: simplified cubes stand in for the full one once their error projects below
+	// --lod-error pixels. Level 0 is the cube above, every level has its own mesh and vertex array
+	std::vector<LodLevel> cubeLods = buildLodChain(buildOptimizedMesh(cubeVertices, CUBE_VERTEX_COUNT, 6));
+	int cubeLodCount = (int)cubeLods.size();
+	std::vector<float> cubeLodErrors(cubeLodCount);
+	std::vector<GpuMesh*> cubeLodMeshes(cubeLodCount, cubeGpuMesh);
+	std::vector<unsigned int> cubeLodVAOs(cubeLodCount, cubeVAO);
+	for (int level = 0; level < cubeLodCount; level++)
+	{
+		cubeLodErrors[level] = cubeLods[level].error;
+		if (level == 0)
+			continue;
+		cubeLodMeshes[level] = new GpuMesh(cubeLods[level].mesh, &uploader);
+		glGenVertexArrays(1, &cubeLodVAOs[level]);
+		cubeLodMeshes[level]->attach(cubeLodVAOs[level]);
+	}
+	LodSelector cubeLodSelector;
+	cubeLodSelector.pixelError = lodPixelError;
+	// the cube's bounding sphere
+	const float CUBE_RADIUS = 0.8660254f;
+	long long trianglesDrawn = 0;
+
+	// occlusion: the nearest visible cubes are rasterized into a small depth pyramid on the workers,
+	// and cubes entirely behind them never reach LOD selection or the draw
+	OcclusionCuller cubeOcclusion;
+	std::vector<uint32_t> occluders;
+	long long cubesOccluded = 0;
+
+	// point lights orbiting through the scene's bounds on top of the main light, binned into clusters every frame
+	glm::vec3 sceneMin(0.0f), sceneMax(0.0f);
+	for (size_t i = 0; i < cubeObjects.size(); i++)
+	{
+		glm::vec3 position(cubeObjects[i].model[3]);
+		sceneMin = i ? glm::min(sceneMin, position) : position;
+		sceneMax = i ? glm::max(sceneMax, position) : position;
+	}
+	LightField pointLights;
+	pointLights.scatter(pointLightCount, sceneMin - glm::vec3(1.0f), sceneMax + glm::vec3(1.0f));
+	ClusteredLighting clusteredLighting(NEAR_PLANE, FAR_PLANE);
+	clusteredLighting.attach(lightingShader);
+	long long clusterLightRefs = 0;
+	uint32_t clusterMaxLights = 0;
+	if (!headless && pointLightCount > 0)
+		std::cout << pointLightCount << " point lights in " << LightClusterer::TILES_X << "x" << LightClusterer::TILES_Y << "x" << LightClusterer::SLICES << " clusters" << std::endl;
+
+	// block terrain below the cubes, --voxels R streams the chunks within R chunks of the camera
+	Shader* voxelShader = NULL;
+	VoxelWorld* voxels = NULL;
+	int voxelModelLoc = -1;
+	long long voxelTriangles = 0;
+	if (voxelRadius > 0)
+	{
+		voxelShader = new Shader("voxel.vert", "voxel.frag", &assets);
+		voxelShader->use();
+		glUniform3fv(voxelShader->getUniformLocation("blockColors"), BLOCK_TYPE_COUNT, &BLOCK_COLORS[0][0]);
+		voxelShader->setVec3("sunDirection", glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f)));
+		voxelShader->setFloat("fogDistance", FAR_PLANE);
+		voxelModelLoc = voxelShader->getUniformLocation("model");
+		voxels = new VoxelWorld(workers, voxelRadius, (size_t)voxelBudgetMb * 1024 * 1024);
+		// headless frames should time drawing the terrain, not its first load
+		if (headless)
+		{
+			voxels->update(camera.Position);
+			while (!voxels->idle())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				voxels->update(camera.Position);
+			}
+		}
+	}
+
 	unsigned int lightCubeVAO;
 	glGenVertexArrays(1, &lightCubeVAO);
-	glBindVertexArray(lightCubeVAO);
-	// bind the same VBO because it is the same shape
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// set the vertex attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	// bind the same buffers because it is the same shape, only the position is needed
+	cubeGpuMesh->attach(lightCubeVAO, false);
 
 	// create texture object
 	/*
@@ -255,31 +532,255 @@ int main()
 	//yellowShader.setInt("texture2", 1);
 	*/
 
+	// textures are packed into texture arrays by size, with their mip chains built and block compressed
+	// on the worker threads; materials name a layer, so every draw from one array shares a single bind
+	double textureStart = nowMs();
+	TextureAtlas textureAtlas;
+	textureAtlas.load({ "container.jpg", "awesomeface.png" }, workers, &assets);
+	double textureMs = nowMs() - textureStart;
+	const TextureLayer& containerLayer = textureAtlas.layers[0];
+	lightingShader.use();
+	lightingShader.setInt("materialTextures", RenderQueue::MATERIAL_TEXTURE_UNIT);
+	if (!headless)
+	{
+		std::cout << "Textures packed in " << textureMs << " ms: " << textureAtlas.arrays.size() << " arrays, " << textureAtlas.bytes / 1024
+			<< " KB" << (textureAtlas.compressed ? " BC1" : " RGBA8") << " (" << textureAtlas.uncompressedBytes / 1024 << " KB uncompressed)" << std::endl;
+	}
+
+
+	// headless runs draw into an offscreen target and time every frame
+	Framebuffer* offscreen = NULL;
+	GpuFrameTimer* gpuTimer = NULL;
+	FrameStats frameStats;
+	frameStats.metrics.push_back(std::make_pair(std::string("shader_startup_ms"), shaderMs));
+	frameStats.metrics.push_back(std::make_pair(std::string("shader_cache_hits"), (double)shaderCacheHits));
+	frameStats.metrics.push_back(std::make_pair(std::string("texture_pack_ms"), textureMs));
+	frameStats.metrics.push_back(std::make_pair(std::string("pack_entries"), (double)assets.contents().size()));
+	frameStats.metrics.push_back(std::make_pair(std::string("texture_bytes"), (double)textureAtlas.bytes));
+	frameStats.metrics.push_back(std::make_pair(std::string("texture_uncompressed_bytes"), (double)textureAtlas.uncompressedBytes));
+	if (headless)
+	{
+		offscreen = new Framebuffer(SCR_WIDTH, SCR_HEIGHT);
+		offscreen->bind();
+	}
+
+	// --dynamic-res: the 3D pass renders at a scale that follows the measured GPU frame time towards the
+	// budget, and is upscaled to the window (or the headless target) afterwards
+	DynamicResolution* dynamicResolution = NULL;
+	ResolutionController resolution(resolutionBudgetMs);
+	resolution.minScale = std::min(std::max(minResolutionScale, 0.1f), 1.0f);
+	if (resolutionBudgetMs > 0.0f)
+	{
+		dynamicResolution = new DynamicResolution(&assets);
+		if (!headless)
+			std::cout << "Dynamic resolution: " << resolutionBudgetMs << " ms GPU budget, scale " << resolution.minScale << " to 1" << std::endl;
+	}
+	if (headless || dynamicResolution)
+		gpuTimer = new GpuFrameTimer();
+
+	// draws are recorded with sort keys and issued in state order once per frame
+	RenderQueue renderQueue;
+	int materialLayerLoc = lightingShader.getUniformLocation("materialLayer");
+	uint16_t cubeMaterial = texturedCubes && containerLayer.array >= 0
+		? renderQueue.addMaterial(objectColorLoc, glm::vec3(1.0f), textureAtlas.texture(containerLayer), materialLayerLoc, containerLayer.layer)
+		: renderQueue.addMaterial(objectColorLoc, glm::vec3(0.0f, 0.2f, 1.0f), 0, materialLayerLoc, -1);
+	uint16_t lightMaterial = renderQueue.addMaterial(-1, glm::vec3(1.0f));
+	uint16_t voxelMaterial = renderQueue.addMaterial(-1, glm::vec3(1.0f));
+	long long unsortedStateChanges = 0, sortedStateChanges = 0;
+
+	// the simulation owns the camera, light and transforms; the loop below only draws its snapshots.
+	// Interactive runs advance it on its own thread, headless runs step it in lockstep with the frames,
+	// following either a recorded input replay or the scripted camera path
+	Simulation simulation(camera, cubeObjects);
+	if (replayPath && !readInputRecording(replayPath, simulation.replay))
+		return -1;
+	if (headless && !replayPath)
+		simulation.cameraScript = benchmarkCameraPath;
+	simulation.recording = recordPath != NULL;
+	simulation.begin();
+	if (!headless)
+		simulation.start(inputEvents);
 
 	// Draw loop
-	while (!glfwWindowShouldClose(window))
+	int frame = 0;
+	GLCapture::endFrame();
+	while (headless ? frame < benchFrames : !glfwWindowShouldClose(window))
 	{
-		// calculate delta time
-		// --------------------
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		double frameStart = nowMs();
+		double submitStart = frameStart;
+		profiler.beginFrame();
+		frameArena.reset();
+		frameRing.beginFrame();
+
+		if (gpuTimer)
+		{
+			int resultFrame;
+			double gpuMs;
+			if (gpuTimer->collect(frame, resultFrame, gpuMs))
+			{
+				if (headless)
+					frameStats.setGpu(resultFrame, gpuMs);
+				if (dynamicResolution)
+					resolution.update(frame, resultFrame, gpuMs);
+			}
+			gpuTimer->begin(frame);
+		}
 
 		// input
 		// -----
-		proccessInput(window);
+		if (headless)
+		{
+			submitStart = nowMs();
+			PROFILE_SCOPE("input");
+			simulation.advanceTo(frame * (double)BENCH_TIMESTEP);
+		}
+		else
+		{
+			PROFILE_SCOPE("input");
+			proccessInput(window);
+		}
+
+		// draw the newest world state. Interactive frames fall between ticks, so they show the last two
+		// ticks blended by how far into the next tick the clock is; headless frames land exactly on a tick
+		simulation.snapshots.consume();
+		const FrameSnapshot& snapshot = simulation.snapshots.readBuffer();
+		WorldState world = headless ? snapshot.current
+			: snapshot.interpolate((float)((simulation.elapsed() - snapshot.time) / SIM_TIMESTEP));
+		glm::vec3 lightPos = world.lightPos;
 
 		// render
 		// ------
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// the window (or headless target) the frame ends up in, and the size the 3D pass renders at
+		unsigned int outputFramebuffer = headless ? offscreen->ID : 0;
+		int outputWidth = std::max(headless ? offscreen->width : viewportWidth, 1);
+		int outputHeight = std::max(headless ? offscreen->height : viewportHeight, 1);
+		int renderWidth = outputWidth, renderHeight = outputHeight;
+		if (dynamicResolution)
+		{
+			dynamicResolution->beginScene(outputWidth, outputHeight, resolution.scale, resolution.maxScale);
+			renderWidth = dynamicResolution->renderWidth;
+			renderHeight = dynamicResolution->renderHeight;
+			resolution.frameRendered();
+		}
+		{
+			PROFILE_GPU_SCOPE("clear");
+			glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
 
-		lightingShader.use();
+		glm::mat4 projection = glm::perspective(glm::radians(world.cameraZoom), (float)outputWidth / (float)outputHeight, NEAR_PLANE, FAR_PLANE);
+		//float aspect = (float)SCR_WIDTH / SCR_HEIGHT;
+		//glm::mat4 projection = glm::ortho(-aspect, aspect, -1.0f, 1.0f, 0.1f, 100.0f);
+		glm::mat4 view = world.viewMatrix();
+
+		// the point lights move with the simulation clock, then the workers sort them into clusters
+		if (pointLightCount > 0)
+		{
+			PROFILE_SCOPE("light_clusters");
+			pointLights.animate(world.time, workers);
+			clusteredLighting.update(pointLights.lights, view, projection, workers);
+			clusterLightRefs += (long long)clusteredLighting.clusterer.lightRefs;
+			clusterMaxLights = std::max(clusterMaxLights, clusteredLighting.clusterer.maxClusterLights);
+		}
+
+		// chunks around the camera stream in and out, finished meshes are uploaded
+		if (voxels)
+		{
+			PROFILE_SCOPE("voxel_stream");
+			voxels->update(world.cameraPosition);
+		}
+
+		// per-frame uniforms for every program in one upload
+		{
+			PROFILE_SCOPE("uniform_upload");
+			perFrame.projection = projection;
+			perFrame.view = view;
+			perFrame.viewPos = glm::vec4(world.cameraPosition, 1.0f);
+			perFrame.lightPos = glm::vec4(lightPos, 1.0f);
+			perFrame.clusterScale = clusteredLighting.clusterScale(renderWidth, renderHeight);
+			perFrame.clusterSize = clusteredLighting.clusterSize();
+			uploadPerFrame(frameRing, perFrame);
+		}
+
+		// only the cubes inside the view frustum go into the instance buffer
+		{
+			PROFILE_SCOPE("cull");
+			cubeCuller.cull(cubeBounds, Frustum::fromMatrix(projection * view), workers);
+		}
+		const std::vector<uint32_t>* visibleCubes = &cubeCuller.visible;
+		if (occlusionEnabled)
+		{
+			PROFILE_SCOPE("occlusion");
+			cubeOcclusion.begin(projection * view);
+			cubeOcclusion.chooseOccluders(cubeBounds, cubeCuller.visible, world.cameraPosition, occluders);
+			for (uint32_t occluder : occluders)
+				cubeOcclusion.addOccluder(cubeLods[0].mesh, snapshot.instances[occluder].model);
+			cubeOcclusion.build(workers);
+			cubeOcclusion.test(cubeBounds, cubeCuller.visible, workers);
+			visibleCubes = &cubeOcclusion.visible;
+			cubesOccluded += cubeOcclusion.occludedCount;
+		}
+		// every visible cube gets a level, then the instances are written straight into the ring
+		// grouped by level, so each level is one contiguous range
+		size_t visibleCount = visibleCubes->size();
+		uint8_t* cubeLevels = frameArena.allocate<uint8_t>(visibleCount);
+		size_t* levelFirst = frameArena.allocate<size_t>(cubeLodCount + 1);
+		// view depth of the nearest visible cube of each level, what the level's draw is sorted by
+		float* levelNearest = frameArena.allocate<float>(cubeLodCount);
+		{
+			PROFILE_SCOPE("lod_select");
+			float projectionScale = LodSelector::projectionScale(world.cameraZoom, renderHeight);
+			cubeLodSelector.reset(cubeObjects.size(), cubeLodCount);
+			for (int level = 0; level < cubeLodCount; level++)
+				levelNearest[level] = FAR_PLANE;
+			for (size_t i = 0; i < visibleCount; i++)
+			{
+				uint32_t object = (*visibleCubes)[i];
+				const InstanceData& instance = snapshot.instances[object];
+				int level = 0;
+				if (lodEnabled)
+				{
+					float scale = std::max(glm::length(glm::vec3(instance.model[0])), std::max(glm::length(glm::vec3(instance.model[1])), glm::length(glm::vec3(instance.model[2]))));
+					float distance = glm::length(glm::vec3(instance.model[3]) - world.cameraPosition) - CUBE_RADIUS * scale;
+					level = cubeLodSelector.select(object, cubeLodErrors.data(), cubeLodCount, projectionScale, distance, scale);
+				}
+				cubeLevels[i] = (uint8_t)level;
+				levelNearest[level] = std::min(levelNearest[level], -(view * instance.model[3]).z);
+			}
+		}
+		{
+			PROFILE_SCOPE("instance_upload");
+			for (int level = 0; level <= cubeLodCount; level++)
+				levelFirst[level] = 0;
+			for (size_t i = 0; i < visibleCount; i++)
+				levelFirst[cubeLevels[i] + 1]++;
+			for (int level = 0; level < cubeLodCount; level++)
+				levelFirst[level + 1] += levelFirst[level];
+			GpuAllocation instanceSlice = frameRing.allocate(visibleCount * sizeof(InstanceData));
+			if (instanceSlice.data)
+			{
+				size_t* cursor = frameArena.allocate<size_t>(cubeLodCount);
+				for (int level = 0; level < cubeLodCount; level++)
+					cursor[level] = levelFirst[level];
+				InstanceData* instances = (InstanceData*)instanceSlice.data;
+				for (size_t i = 0; i < visibleCount; i++)
+					instances[cursor[cubeLevels[i]]++] = snapshot.instances[(*visibleCubes)[i]];
+				for (int level = 0; level < cubeLodCount; level++)
+				{
+					if (levelFirst[level + 1] > levelFirst[level])
+						attachInstanceAttributes(cubeLodVAOs[level], frameRing.ID, 2, instanceSlice.offset + levelFirst[level] * sizeof(InstanceData));
+				}
+			}
+			else
+			{
+				// out of ring space, skip the cubes this frame
+				for (int level = 0; level <= cubeLodCount; level++)
+					levelFirst[level] = 0;
+			}
+		}
+
+		renderQueue.begin();
 		//lightingShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
-		lightingShader.setVec3("objectColor", 0.0f, 0.2f, 1.0f);
-		lightingShader.setVec3("lightColor", 1.0f, 1.0f, 1.0f);
-		lightingShader.setVec3("lightPos", lightPos);
-		lightingShader.setVec3("viewPos", camera.Position);
 
 		// Toggle wireframe mode
 		// ---------------------
@@ -303,20 +804,23 @@ int main()
 		// activate shader
 		//yellowShader.setFloat("mixer", mixer);
 
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		//float aspect = (float)SCR_WIDTH / SCR_HEIGHT;
-		//glm::mat4 projection = glm::ortho(-aspect, aspect, -1.0f, 1.0f, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
-
-		// world transformation
-		glm::mat4 model = glm::mat4(1.0f);
-		lightingShader.setMat4("model", model);
+		// render all cubes in one instanced draw per level
+		for (int level = 0; level < cubeLodCount; level++)
+		{
+			size_t instanceCount = levelFirst[level + 1] - levelFirst[level];
+			if (instanceCount == 0)
+				continue;
+			renderQueue.submit(0, lightingShader.ID, cubeLodVAOs[level], cubeMaterial, levelNearest[level] / FAR_PLANE, GL_TRIANGLES,
+				cubeLodMeshes[level]->indexCount, cubeLodMeshes[level]->indexType, (GLsizei)instanceCount);
+			trianglesDrawn += (long long)instanceCount * (cubeLodMeshes[level]->indexCount / 3);
+		}
 
-		// render cube 
-		glBindVertexArray(cubeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		// every terrain chunk in view is one draw
+		if (voxels)
+		{
+			voxels->draw(renderQueue, voxelShader->ID, voxelModelLoc, voxelMaterial, view, FAR_PLANE, Frustum::fromMatrix(projection * view));
+			voxelTriangles += (long long)voxels->trianglesDrawn;
+		}
 
 		/*
 		model = glm::mat4(1.0f);
@@ -330,39 +834,321 @@ int main()
 
 
 		// render light source
-		lightSourceShader.use();
-		lightSourceShader.setMat4("projection", projection);
-		lightSourceShader.setMat4("view", view);
-		model = glm::mat4(1.0f);
-		lightPos = glm::vec3(2 * cos(glfwGetTime()), 2 * cos(glfwGetTime()), 2 * sin(glfwGetTime()));
-		model = glm::translate(model, lightPos);
-		model = glm::scale(model, glm::vec3(0.2f));
-		lightSourceShader.setMat4("model", model);
+		// only the light moves, the update leaves the static cube field alone
+		scene.setPosition(lightNode, lightPos);
+		scene.update(&workers);
+		glm::mat4 model = scene.worldMatrix(lightNode);
+		float lightDepth = -(view * glm::vec4(lightPos, 1.0f)).z / FAR_PLANE;
 
 		//glBindVertexArray(lightVAO);
-		glBindVertexArray(lightCubeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		renderQueue.submit(0, lightSourceShader.ID, lightCubeVAO, lightMaterial, lightDepth,
+			GL_TRIANGLES, cubeGpuMesh->indexCount, cubeGpuMesh->indexType, 1, lightSourceModelLoc, &model);
+
+		// the ring's writes are complete before the draws read them
+		frameRing.flush();
+		{
+			PROFILE_SCOPE("draw");
+			PROFILE_GPU_SCOPE("draw");
+			renderQueue.execute();
+		}
+		if (dynamicResolution)
+		{
+			PROFILE_GPU_SCOPE("upscale");
+			dynamicResolution->present(outputFramebuffer, outputWidth, outputHeight, resolution.minScale);
+		}
+		frameRing.endFrame();
+		arenaBytes += frameArena.bytesUsed;
+		ringBytes += frameRing.bytesUsed;
+		unsortedStateChanges += renderQueue.unsortedStats.stateChanges();
+		sortedStateChanges += renderQueue.sortedStats.stateChanges();
 
 		//glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+		if (gpuTimer)
+			gpuTimer->end();
+		if (headless)
+		{
+			double submitEnd = nowMs();
+			glFlush();
+			GLCapture::endFrame();
+			frameStats.addFrame(submitEnd - submitStart, nowMs() - frameStart);
+			profiler.endFrame();
+			frame++;
+			continue;
+		}
+
 		// glfw: swap buffers and poll IO events
 		// -------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		GLCapture::endFrame();
+		{
+			PROFILE_SCOPE("swap");
+			glfwSwapBuffers(window);
+		}
+		{
+			PROFILE_SCOPE("poll_events");
+			glfwPollEvents();
+		}
+		profiler.endFrame();
+		frame++;
 	}
 
+	simulation.stop();
+	if (recordPath)
+		writeInputRecording(recordPath, simulation.recorded);
+	if (inputEvents.dropped > 0)
+		std::cout << inputEvents.dropped << " input events dropped, the simulation fell behind" << std::endl;
+	if (tracePath)
+	{
+		std::ofstream traceFile(tracePath);
+		profiler.writeChromeTrace(traceFile);
+	}
+	if (!headless)
+	{
+		profiler.writeSummary(std::cout);
+		std::cout << "frame memory: arena " << arenaBytes / std::max(frame, 1) << " bytes/frame (high water " << frameArena.highWater
+			<< ", " << frameArena.heapAllocations << " heap blocks), ring " << ringBytes / std::max(frame, 1) << " bytes/frame, "
+			<< frameRing.fenceWaits << " fence waits, " << frameRing.overflows << " overflows" << std::endl;
+		if (voxels)
+			std::cout << "voxels: " << voxels->chunkCount() << " chunks (" << voxels->residentBytes / 1024 << " KB), "
+				<< voxelTriangles / std::max(frame, 1) << " triangles/frame, " << voxels->chunksMeshed << " chunks meshed at "
+				<< voxels->chunksMeshed * 1000.0 / std::max(voxels->meshMs, 1e-3) << " chunks/s per worker, " << voxels->chunksEvicted << " evicted" << std::endl;
+		if (GLCapture::active)
+			std::cout << "GL capture: " << GLCapture::calls << " calls in " << GLCapture::frames << " segments, "
+				<< GLCapture::bytes / 1024 << " KB written to " << captureGLPath << std::endl;
+		if (dynamicResolution)
+			std::cout << "dynamic resolution: mean scale " << resolution.meanScale() << " (lowest " << resolution.lowestScale << "), "
+				<< resolution.changes << " changes, " << resolution.framesOverBudget << "/" << resolution.measuredFrames << " frames over budget, "
+				<< resolution.outliers << " outliers" << std::endl;
+	}
+
+	if (headless)
+	{
+		// pick up the queries that are still in flight
+		for (int i = 0; i < GpuFrameTimer::QUERY_LATENCY; i++)
+		{
+			int resultFrame;
+			double gpuMs;
+			if (gpuTimer->collect(frame + i, resultFrame, gpuMs))
+				frameStats.setGpu(resultFrame, gpuMs);
+		}
+
+		frameStats.metrics.push_back(std::make_pair(std::string("gpu_samples_rejected"), (double)gpuTimer->rejectedSamples));
+		frameStats.metrics.push_back(std::make_pair(std::string("state_changes_unsorted_per_frame"), (double)unsortedStateChanges / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("state_changes_sorted_per_frame"), (double)sortedStateChanges / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("cubes_occluded_per_frame"), (double)cubesOccluded / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("cube_triangles_per_frame"), (double)trianglesDrawn / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("arena_bytes_per_frame"), (double)arenaBytes / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("arena_heap_allocations"), (double)frameArena.heapAllocations));
+		frameStats.metrics.push_back(std::make_pair(std::string("arena_high_water_bytes"), (double)frameArena.highWater));
+		frameStats.metrics.push_back(std::make_pair(std::string("ring_bytes_per_frame"), (double)ringBytes / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("ring_fence_waits"), (double)frameRing.fenceWaits));
+		frameStats.metrics.push_back(std::make_pair(std::string("ring_overflows"), (double)frameRing.overflows));
+		frameStats.metrics.push_back(std::make_pair(std::string("point_lights"), (double)pointLightCount));
+		frameStats.metrics.push_back(std::make_pair(std::string("cluster_light_refs_per_frame"), (double)clusterLightRefs / std::max(frame, 1)));
+		frameStats.metrics.push_back(std::make_pair(std::string("cluster_max_lights"), (double)clusterMaxLights));
+		if (voxels)
+		{
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_chunks"), (double)voxels->chunkCount()));
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_resident_bytes"), (double)voxels->residentBytes));
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_triangles_per_frame"), (double)voxelTriangles / std::max(frame, 1)));
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_chunks_meshed"), (double)voxels->chunksMeshed));
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_mesh_chunks_per_s"), voxels->chunksMeshed * 1000.0 / std::max(voxels->meshMs, 1e-3)));
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_evictions"), (double)voxels->chunksEvicted));
+			frameStats.metrics.push_back(std::make_pair(std::string("voxel_budget_evictions"), (double)voxels->budgetEvictions));
+		}
+		if (dynamicResolution)
+		{
+			frameStats.metrics.push_back(std::make_pair(std::string("resolution_budget_ms"), (double)resolution.budgetMs));
+			frameStats.metrics.push_back(std::make_pair(std::string("resolution_scale_mean"), (double)resolution.meanScale()));
+			frameStats.metrics.push_back(std::make_pair(std::string("resolution_scale_lowest"), (double)resolution.lowestScale));
+			frameStats.metrics.push_back(std::make_pair(std::string("resolution_changes"), (double)resolution.changes));
+			frameStats.metrics.push_back(std::make_pair(std::string("resolution_frames_over_budget"), (double)resolution.framesOverBudget));
+			frameStats.metrics.push_back(std::make_pair(std::string("resolution_outliers"), (double)resolution.outliers));
+		}
+		if (GLCapture::active)
+		{
+			frameStats.metrics.push_back(std::make_pair(std::string("gl_capture_calls"), (double)GLCapture::calls));
+			frameStats.metrics.push_back(std::make_pair(std::string("gl_capture_bytes"), (double)GLCapture::bytes));
+		}
+		profiler.addMetrics(frameStats.metrics);
+
+		std::string renderer = (const char*)glGetString(GL_RENDERER);
+		if (benchOut)
+		{
+			std::ofstream statsFile(benchOut);
+			frameStats.writeJson(statsFile, renderer, offscreen->width, offscreen->height);
+		}
+		else
+			frameStats.writeJson(std::cout, renderer, offscreen->width, offscreen->height);
+
+		delete offscreen;
+	}
+	delete gpuTimer;
+	delete dynamicResolution;
+
 	// de-allocate all resources once they've outlived their purpose:
 	// --------------------------------------------------------------
 	glDeleteVertexArrays(1, &cubeVAO);
 	glDeleteVertexArrays(1, &lightCubeVAO);
-	glDeleteBuffers(1, &VBO);
+	delete cubeGpuMesh;
+	delete voxels;
+	delete voxelShader;
+	for (int level = 1; level < cubeLodCount; level++)
+	{
+		glDeleteVertexArrays(1, &cubeLodVAOs[level]);
+		delete cubeLodMeshes[level];
+	}
+	profiler.releaseGpu();
+	GLCapture::stop();
 
 	// glfw: terminate, clearing all previousely allocated GLFW resources
 	// ------------------------------------------------------------------
-	glfwTerminate();
+	if (!headless)
+		glfwTerminate();
 	return 0;
 }
 
+// lays out `count` unit cubes on a grid centred on the origin, spaced so they don't touch
+void buildCubeField(SceneGraph& scene, SceneNode parent, int count)
+{
+	int side = (int)ceil(cbrt((double)count));
+	float spacing = 2.0f;
+	float offset = (side - 1) * spacing * 0.5f;
+	for (int i = 0; i < count; i++)
+	{
+		int x = i % side;
+		int y = (i / side) % side;
+		int z = i / (side * side);
+		scene.add(parent, glm::vec3(x * spacing - offset, y * spacing - offset, z * spacing - offset));
+	}
+}
+
+// the cubePositions cubes, or a generated field of `cubeCount` cubes, under one top level node
+SceneNode buildCubeScene(SceneGraph& scene, int cubeCount)
+{
+	SceneNode cubeField = scene.add(SceneGraph::NO_PARENT, glm::vec3(0.0f));
+	if (cubeCount > 0)
+		buildCubeField(scene, cubeField, cubeCount);
+	else
+	{
+		for (unsigned int i = 0; i < sizeof(cubePositions) / sizeof(cubePositions[0]); i++)
+			scene.add(cubeField, cubePositions[i], glm::angleAxis(glm::radians(20.0f * i), glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f))));
+	}
+	return cubeField;
+}
+
+// instance data of everything below `parent`, its subtree is contiguous right after it
+void gatherInstances(const SceneGraph& scene, SceneNode parent, std::vector<InstanceData>& instances)
+{
+	uint32_t first = scene.indexOf(parent) + 1;
+	instances.resize(scene.subtreeSizes[first - 1] - 1);
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		instances[i].model = scene.worldMatrices[first + i];
+		instances[i].normal = scene.normalMatrices[first + i];
+	}
+}
+
+// renders the last frame of a `frames` long headless run (same camera path, same scene) on the CPU and
+// writes it to `path` as a PNG, to compare against the GL renderer
+int renderSoftware(const char* path, int frames, int cubeCount, ThreadPool& workers)
+{
+	SceneGraph scene;
+	SceneNode cubeField = buildCubeScene(scene, cubeCount);
+	SceneNode lightNode = scene.add(SceneGraph::NO_PARENT, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.2f));
+	scene.update(&workers);
+	std::vector<InstanceData> cubeObjects;
+	gatherInstances(scene, cubeField, cubeObjects);
+
+	Simulation simulation(camera, cubeObjects);
+	simulation.cameraScript = benchmarkCameraPath;
+	simulation.begin();
+	simulation.advanceTo(std::max(frames - 1, 0) * (double)BENCH_TIMESTEP);
+	simulation.snapshots.consume();
+	const FrameSnapshot& snapshot = simulation.snapshots.readBuffer();
+	const WorldState& world = snapshot.current;
+
+	scene.setPosition(lightNode, world.lightPos);
+	scene.update(&workers);
+	InstanceData light;
+	light.model = scene.worldMatrix(lightNode);
+	light.normal = scene.normalMatrix(lightNode);
+
+	Mesh cube = buildOptimizedMesh(cubeVertices, CUBE_VERTEX_COUNT, 6);
+	std::vector<SoftDraw> draws;
+	SoftDraw cubes = { &cube, snapshot.instances.data(), snapshot.instances.size(), glm::vec3(0.0f, 0.2f, 1.0f), true };
+	SoftDraw lightCube = { &cube, &light, 1, glm::vec3(1.0f), false };
+	draws.push_back(cubes);
+	draws.push_back(lightCube);
+
+	SoftFrameParams params;
+	params.projection = glm::perspective(glm::radians(world.cameraZoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+	params.view = world.viewMatrix();
+	params.viewPos = world.cameraPosition;
+	params.lightPos = world.lightPos;
+	params.lightColor = glm::vec3(1.0f);
+
+	SoftFramebuffer target(SCR_WIDTH, SCR_HEIGHT);
+	SoftRasterizer rasterizer;
+	double start = nowMs();
+	target.clear(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+	rasterizer.draw(target, params, draws, workers);
+	double renderMs = nowMs() - start;
+	if (!target.writePng(path))
+		return -1;
+	std::cout << "Software frame " << std::max(frames - 1, 0) << ": " << rasterizer.triangleCount << " triangles, "
+		<< rasterizer.fragmentCount << " fragments in " << renderMs << " ms (" << SOFT_RASTER_KERNEL << ")" << std::endl;
+	return 0;
+}
+
+// issues a --capture-gl trace again in a headless context and writes the replay's frame times, like a
+// --headless run's. The input and simulation aren't involved, every replay draws exactly what was captured
+int replayGLTrace(const char* path, const char* outPath, bool pace)
+{
+	GLTraceReplayer replayer;
+	replayer.pace = pace;
+	if (!replayer.open(path))
+		return -1;
+	FrameStats stats;
+	bool complete = replayer.run(stats);
+
+	uint64_t frameCalls = 0;
+	for (uint64_t calls : replayer.frameCalls)
+		frameCalls += calls;
+	int frames = std::max((int)replayer.callsPerFrame.size(), 1);
+	stats.metrics.push_back(std::make_pair(std::string("trace_bytes"), (double)replayer.traceBytes()));
+	stats.metrics.push_back(std::make_pair(std::string("trace_load_ms"), replayer.loadMs));
+	stats.metrics.push_back(std::make_pair(std::string("trace_load_calls"), (double)replayer.loadCalls));
+	stats.metrics.push_back(std::make_pair(std::string("trace_shutdown_calls"), (double)replayer.shutdownCalls));
+	stats.metrics.push_back(std::make_pair(std::string("calls_per_frame"), (double)frameCalls / frames));
+	for (int call = 1; call < TRACE_CALL_COUNT; call++)
+	{
+		if (replayer.frameCalls[call] > 0)
+			stats.metrics.push_back(std::make_pair(std::string("calls_per_frame_") + GL_TRACE_CALL_NAMES[call], (double)replayer.frameCalls[call] / frames));
+	}
+	stats.metrics.push_back(std::make_pair(std::string("replay_paced"), pace ? 1.0 : 0.0));
+	stats.metrics.push_back(std::make_pair(std::string("replay_skipped_waits_per_frame"), (double)replayer.skippedWaits / frames));
+	stats.metrics.push_back(std::make_pair(std::string("replay_build_failures"), (double)replayer.buildFailures));
+	stats.metrics.push_back(std::make_pair(std::string("replay_gl_errors"), (double)replayer.glErrors));
+
+	std::string renderer = (const char*)glGetString(GL_RENDERER);
+	if (outPath)
+	{
+		std::ofstream statsFile(outPath);
+		stats.writeJson(statsFile, renderer, replayer.header.width, replayer.header.height);
+	}
+	else
+		stats.writeJson(std::cout, renderer, replayer.header.width, replayer.header.height);
+	return complete && replayer.buildFailures == 0 ? 0 : -1;
+}
+
+// scripted camera for headless benchmarks: orbits the scene while bobbing up and down
+void benchmarkCameraPath(float time)
+{
+	camera.Position = glm::vec3(4.0f * cos(0.5f * time), 1.5f + sin(0.3f * time), 4.0f * sin(0.5f * time));
+	camera.LookAt(glm::vec3(0.0f));
+}
+
 void proccessInput(GLFWwindow* window)
 {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -383,28 +1169,28 @@ void proccessInput(GLFWwindow* window)
 		mixer -= 0.01f;
 	}
 	*/
+}
 
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.ProcessKeyboard(BACKWORD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.ProcessKeyboard(LEFT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-		camera.ProcessKeyboard(PITCHUP, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-		camera.ProcessKeyboard(PITCHDOWN, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-		camera.ProcessKeyboard(TURNLEFT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-		camera.ProcessKeyboard(TURNRIGHT, deltaTime);
-	
+// movement keys become timestamped events, the simulation applies them at the tick they arrived in
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action == GLFW_REPEAT)
+		return;
+	const int movementKeys[8][2] = {
+		{ GLFW_KEY_W, FORWARD }, { GLFW_KEY_S, BACKWORD }, { GLFW_KEY_A, LEFT }, { GLFW_KEY_D, RIGHT },
+		{ GLFW_KEY_UP, PITCHUP }, { GLFW_KEY_DOWN, PITCHDOWN }, { GLFW_KEY_LEFT, TURNLEFT }, { GLFW_KEY_RIGHT, TURNRIGHT }
+	};
+	for (int i = 0; i < 8; i++)
+	{
+		if (key == movementKeys[i][0])
+			inputEvents.push(action == GLFW_PRESS ? INPUT_KEY_DOWN : INPUT_KEY_UP, (uint8_t)movementKeys[i][1]);
+	}
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
+	viewportWidth = width;
+	viewportHeight = height;
 	glViewport(0, 0, width, height);
 }
 
@@ -424,10 +1210,10 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
 	lastX = xpos;
 	lastY = ypos;
 
-	camera.ProcessMouseMovement(xoffset, yoffset);
+	inputEvents.push(INPUT_MOUSE_MOVE, 0, xoffset, yoffset);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-	camera.ProcessMouseScroll(static_cast<float>(yoffset));
+	inputEvents.push(INPUT_SCROLL, 0, 0.0f, static_cast<float>(yoffset));
 }
 
@@ -0,0 +1,195 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "mapped_file.h"
+
+// Packed asset archive (.pack) written by the assetcook tool. Every asset is stored in the form the
+// runtime consumes it (cooked textures, .mesh blobs, preprocessed shader sources), so loading is a
+// memory mapping and a table lookup.
+//
+//   PackHeader | table of contents (PackEntry, sorted by name) | padding | blob | padding | blob ...
+//
+// Blobs start at PACK_ALIGNMENT byte offsets, which keeps the .mesh alignment guarantees. Little endian.
+const char PACK_MAGIC[4] = { 'P', 'A', 'C', 'K' };
+const uint32_t PACK_VERSION = 1;
+const uint64_t PACK_ALIGNMENT = 64;
+const size_t PACK_NAME_LENGTH = 64;
+
+enum PackAssetType : uint32_t
+{
+	PACK_TEXTURE = 1,
+	PACK_MESH = 2,
+	PACK_SHADER = 3
+};
+
+struct PackHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t tocOffset;
+	uint64_t tocBytes;
+};
+static_assert(sizeof(PackHeader) == 32, "PackHeader layout is part of the file format");
+
+struct PackEntry
+{
+	// path relative to the asset directory with '/' separators, zero padded
+	char name[PACK_NAME_LENGTH];
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+	// hash of the source bytes and the cook settings, the cooker skips assets whose hash is unchanged
+	uint64_t sourceHash;
+};
+static_assert(sizeof(PackEntry) == 96, "PackEntry layout is part of the file format");
+
+inline uint64_t alignPackOffset(uint64_t offset)
+{
+	return (offset + PACK_ALIGNMENT - 1) & ~(PACK_ALIGNMENT - 1);
+}
+
+// an asset to be written: its table entry (offset and size are filled in by writeAssetPack) and its bytes
+struct PackBlob
+{
+	PackEntry entry;
+	std::string data;
+};
+
+inline PackEntry makePackEntry(const std::string& name, PackAssetType type, uint64_t sourceHash)
+{
+	PackEntry entry = {};
+	strncpy(entry.name, name.c_str(), PACK_NAME_LENGTH - 1);
+	entry.type = type;
+	entry.sourceHash = sourceHash;
+	return entry;
+}
+
+// writes the archive to `path`, going through a temporary file so a failed write never leaves a broken pack
+inline bool writeAssetPack(const char* path, std::vector<PackBlob>& blobs)
+{
+	std::sort(blobs.begin(), blobs.end(), [](const PackBlob& a, const PackBlob& b) { return strcmp(a.entry.name, b.entry.name) < 0; });
+
+	PackHeader header = {};
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.version = PACK_VERSION;
+	header.entryCount = (uint32_t)blobs.size();
+	header.tocOffset = sizeof(PackHeader);
+	header.tocBytes = blobs.size() * sizeof(PackEntry);
+	uint64_t offset = header.tocOffset + header.tocBytes;
+	for (PackBlob& blob : blobs)
+	{
+		offset = alignPackOffset(offset);
+		blob.entry.offset = offset;
+		blob.entry.size = blob.data.size();
+		offset += blob.data.size();
+	}
+
+	std::string temporary = std::string(path) + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		if (!file)
+			return false;
+		const char zeros[PACK_ALIGNMENT] = {};
+		file.write((const char*)&header, sizeof(header));
+		for (const PackBlob& blob : blobs)
+			file.write((const char*)&blob.entry, sizeof(PackEntry));
+		uint64_t written = header.tocOffset + header.tocBytes;
+		for (const PackBlob& blob : blobs)
+		{
+			file.write(zeros, blob.entry.offset - written);
+			file.write(blob.data.data(), blob.data.size());
+			written = blob.entry.offset + blob.entry.size;
+		}
+		if (!file)
+			return false;
+	}
+	std::remove(path);
+	return std::rename(temporary.c_str(), path) == 0;
+}
+
+// A .pack file mapped into memory. Entries and blob pointers stay valid until the pack is closed.
+class AssetPack
+{
+public:
+	bool open(const char* path)
+	{
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(PackHeader))
+			return fail("ERROR::ASSET_PACK::TRUNCATED");
+		memcpy(&header, file.data(), sizeof(PackHeader));
+		if (memcmp(header.magic, PACK_MAGIC, sizeof(header.magic)) != 0)
+			return fail("ERROR::ASSET_PACK::BAD_MAGIC");
+		if (header.version != PACK_VERSION)
+			return fail("ERROR::ASSET_PACK::UNSUPPORTED_VERSION");
+		if (header.tocBytes != (uint64_t)header.entryCount * sizeof(PackEntry) || header.tocOffset > file.size()
+			|| header.tocBytes > file.size() - header.tocOffset)
+			return fail("ERROR::ASSET_PACK::BAD_TABLE_OF_CONTENTS");
+		entries.resize(header.entryCount);
+		memcpy(entries.data(), file.data() + header.tocOffset, header.tocBytes);
+		for (PackEntry& entry : entries)
+		{
+			entry.name[PACK_NAME_LENGTH - 1] = 0;
+			if (entry.offset > file.size() || entry.size > file.size() - entry.offset)
+				return fail("ERROR::ASSET_PACK::BAD_BLOB_RANGE");
+		}
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		entries.clear();
+	}
+
+	bool isOpen() const
+	{
+		return file.data() != NULL;
+	}
+
+	// the entry for `name` (and `type`), NULL when the pack doesn't have it
+	const PackEntry* find(const char* name, PackAssetType type) const
+	{
+		auto found = std::lower_bound(entries.begin(), entries.end(), name,
+			[](const PackEntry& entry, const char* key) { return strcmp(entry.name, key) < 0; });
+		if (found == entries.end() || strcmp(found->name, name) != 0 || found->type != (uint32_t)type)
+			return NULL;
+		return &*found;
+	}
+
+	const unsigned char* data(const PackEntry& entry) const
+	{
+		return file.data() + entry.offset;
+	}
+
+	const std::vector<PackEntry>& contents() const
+	{
+		return entries;
+	}
+
+private:
+	MappedFile file;
+	PackHeader header = {};
+	std::vector<PackEntry> entries;
+
+	bool fail(const char* message)
+	{
+		std::cout << message << std::endl;
+		close();
+		return false;
+	}
+};
+
+#endif
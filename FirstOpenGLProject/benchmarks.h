@@ -0,0 +1,556 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+#include <glm-1.0.1/glm/gtc/matrix_transform.hpp>
+
+#include <ostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+#include "frame_stats.h"
+#include "thread_pool.h"
+#include "culling.h"
+#include "mesh.h"
+#include "mesh_file.h"
+#include "render_queue.h"
+#include "scene_graph.h"
+#include "soft_raster.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "texture_array.h"
+#include "clustered_lighting.h"
+#include "voxel_world.h"
+
+// CPU micro-benchmarks of engine hot paths. They need no GL context and print one JSON object each.
+
+// frustum culling throughput over `objectCount` random boxes scattered around the camera
+inline void runCullBenchmark(std::ostream& out, ThreadPool& pool, size_t objectCount, int iterations)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.25f, 1.0f);
+	ObjectStore store;
+	store.reserve(objectCount);
+	for (size_t i = 0; i < objectCount; i++)
+		store.add(glm::vec3(position(rng), position(rng), position(rng)), glm::vec3(size(rng)));
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::fromMatrix(projection * view);
+
+	// one thread, straight through the kernel
+	std::vector<uint32_t> visible(objectCount);
+	size_t visibleCount = 0;
+	double start = nowMs();
+	for (int i = 0; i < iterations; i++)
+		visibleCount = cullBoxes(store, frustum, 0, objectCount, visible.data());
+	double singleMs = (nowMs() - start) / iterations;
+
+	// chunked over the pool
+	FrustumCuller culler;
+	culler.cull(store, frustum, pool);
+	start = nowMs();
+	for (int i = 0; i < iterations; i++)
+		culler.cull(store, frustum, pool);
+	double pooledMs = (nowMs() - start) / iterations;
+
+	out << "{ \"benchmark\": \"frustum_cull\", \"kernel\": \"" << CULLING_KERNEL << "\", ";
+	out << "\"objects\": " << objectCount << ", \"visible\": " << visibleCount << ", ";
+	out << "\"threads\": " << pool.size() + 1 << ", ";
+	out << "\"single_thread_ms\": " << singleMs << ", \"single_thread_objects_per_s\": " << objectCount / (singleMs / 1000.0) << ", ";
+	out << "\"pooled_ms\": " << pooledMs << ", \"pooled_objects_per_s\": " << objectCount / (pooledMs / 1000.0) << " }\n";
+}
+
+static void writeMeshReport(std::ostream& out, const char* name, size_t expandedVertices, const Mesh& original, const Mesh& optimized)
+{
+	size_t triangles = original.indices.size() / 3;
+	size_t indexSize = optimized.vertices.size() <= 65536 ? 2 : 4;
+	out << "{ \"benchmark\": \"mesh_packing\", \"mesh\": \"" << name << "\", \"triangles\": " << triangles << ", ";
+	// a plain triangle list never reuses a vertex, so every triangle transforms 3 of them
+	out << "\"before\": { \"vertices\": " << expandedVertices << ", \"bytes_per_vertex\": " << sizeof(MeshVertex) << ", ";
+	out << "\"bytes\": " << expandedVertices * sizeof(MeshVertex) << ", \"acmr\": 3.0 }, ";
+	out << "\"indexed\": { \"vertices\": " << original.vertices.size() << ", \"acmr\": " << computeACMR(original.indices, original.vertices.size()) << " }, ";
+	out << "\"after\": { \"vertices\": " << optimized.vertices.size() << ", \"bytes_per_vertex\": " << sizeof(PackedVertex) << ", ";
+	out << "\"bytes\": " << optimized.vertices.size() * sizeof(PackedVertex) + optimized.indices.size() * indexSize << ", ";
+	out << "\"acmr\": " << computeACMR(optimized.indices, optimized.vertices.size()) << " } }\n";
+}
+
+// vertex count, bytes per vertex and ACMR (16 entry FIFO) of a triangle list before and after the mesh building stage.
+// Runs on the cube and on a grid with shuffled triangles, where the cache ordering actually has something to fix.
+inline void runMeshBenchmark(std::ostream& out, const float* cubeVertices, size_t cubeVertexCount)
+{
+	Mesh cube = buildIndexedMesh(cubeVertices, cubeVertexCount, 6);
+	Mesh cubeOptimized = buildOptimizedMesh(cubeVertices, cubeVertexCount, 6);
+	writeMeshReport(out, "cube", cubeVertexCount, cube, cubeOptimized);
+
+	const int GRID = 128;
+	std::vector<float> grid;
+	std::vector<int> quads(GRID * GRID);
+	for (int i = 0; i < GRID * GRID; i++)
+		quads[i] = i;
+	std::shuffle(quads.begin(), quads.end(), std::mt19937(42));
+	for (int quad : quads)
+	{
+		int x = quad % GRID, z = quad / GRID;
+		const int corners[6][2] = { {0, 0}, {1, 0}, {1, 1}, {1, 1}, {0, 1}, {0, 0} };
+		for (const int* corner : corners)
+		{
+			float vertex[6] = { (float)(x + corner[0]) / GRID, 0.0f, (float)(z + corner[1]) / GRID, 0.0f, 1.0f, 0.0f };
+			grid.insert(grid.end(), vertex, vertex + 6);
+		}
+	}
+	size_t gridVertexCount = grid.size() / 6;
+	Mesh gridIndexed = buildIndexedMesh(grid.data(), gridVertexCount, 6);
+	double start = nowMs();
+	Mesh gridOptimized = buildOptimizedMesh(grid.data(), gridVertexCount, 6);
+	double buildMs = nowMs() - start;
+	writeMeshReport(out, "shuffled_grid_128", gridVertexCount, gridIndexed, gridOptimized);
+	out << "{ \"benchmark\": \"mesh_build\", \"mesh\": \"shuffled_grid_128\", \"ms\": " << buildMs << " }\n";
+}
+
+// Opening a large .mesh file: parse-and-copy through ifstream into vectors versus mapping it and touching
+// every page once (what the GL upload does). Both runs hit the page cache, so this compares the CPU work.
+inline void runMeshLoadBenchmark(std::ostream& out, const char* path)
+{
+	const int GRID = 512;
+	Mesh mesh;
+	for (int z = 0; z <= GRID; z++)
+		for (int x = 0; x <= GRID; x++)
+			mesh.vertices.push_back({ glm::vec3((float)x / GRID, 0.0f, (float)z / GRID), glm::vec3(0.0f, 1.0f, 0.0f) });
+	for (int z = 0; z < GRID; z++)
+	{
+		for (int x = 0; x < GRID; x++)
+		{
+			uint32_t i = z * (GRID + 1) + x;
+			uint32_t quad[6] = { i, i + 1, i + GRID + 2, i + GRID + 2, i + GRID + 1, i };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	if (!writeMeshFile(path, mesh))
+	{
+		out << "{ \"benchmark\": \"mesh_load\", \"error\": \"could not write " << path << "\" }\n";
+		return;
+	}
+
+	// parse and copy
+	double start = nowMs();
+	std::ifstream file(path, std::ios::binary);
+	MeshFileHeader header;
+	file.read((char*)&header, sizeof(header));
+	std::vector<PackedVertex> vertices(header.vertexCount);
+	std::vector<char> indices(header.indexBytes);
+	file.seekg(header.vertexOffset);
+	file.read((char*)vertices.data(), header.vertexBytes);
+	file.seekg(header.indexOffset);
+	file.read(indices.data(), header.indexBytes);
+	double streamMs = nowMs() - start;
+
+	// mapped, checksum stands in for the copy into GL
+	start = nowMs();
+	MeshFile mapped;
+	mapped.open(path);
+	uint64_t checksum = 0;
+	const uint64_t* words = (const uint64_t*)mapped.vertexData();
+	for (size_t i = 0; i < mapped.header.vertexBytes / sizeof(uint64_t); i++)
+		checksum += words[i];
+	double mappedMs = nowMs() - start;
+
+	double megabytes = (header.vertexBytes + header.indexBytes) / (1024.0 * 1024.0);
+	out << "{ \"benchmark\": \"mesh_load\", \"megabytes\": " << megabytes << ", ";
+	out << "\"stream_copy_ms\": " << streamMs << ", \"mapped_ms\": " << mappedMs << ", ";
+	out << "\"mapped_mb_per_s\": " << megabytes / (mappedMs / 1000.0) << ", \"checksum\": " << (checksum & 0xffff) << " }\n";
+	std::remove(path);
+}
+
+// sort key ordering over `packetCount` draws spread across a few programs, vertex arrays and materials
+// (drawing from a few texture arrays), submitted in random order. Reports the state changes before and
+// after sorting and the sort cost.
+inline void runRenderQueueBenchmark(std::ostream& out, size_t packetCount, int iterations)
+{
+	const unsigned int PROGRAMS = 8, VERTEX_ARRAYS = 16, MATERIALS = 64, TEXTURE_ARRAYS = 4;
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<unsigned int> program(1, PROGRAMS);
+	std::uniform_int_distribution<unsigned int> vao(1, VERTEX_ARRAYS);
+	std::uniform_int_distribution<unsigned int> material(0, MATERIALS - 1);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+	RenderQueue queue;
+	for (unsigned int i = 0; i < MATERIALS; i++)
+		queue.addMaterial(-1, glm::vec3((float)i / MATERIALS), 1 + i % TEXTURE_ARRAYS, -1, (int)(i / TEXTURE_ARRAYS));
+	queue.begin();
+	for (size_t i = 0; i < packetCount; i++)
+		queue.submit(0, program(rng), vao(rng), (uint16_t)material(rng), depth(rng), GL_TRIANGLES, 36, GL_UNSIGNED_SHORT);
+
+	RenderQueue::Stats unsorted = queue.countStateChanges(NULL);
+	double start = nowMs();
+	for (int i = 0; i < iterations; i++)
+		queue.sort();
+	double sortMs = (nowMs() - start) / iterations;
+	RenderQueue::Stats sorted = queue.countStateChanges(&queue.sort());
+
+	out << "{ \"benchmark\": \"render_queue\", \"packets\": " << packetCount << ", ";
+	out << "\"unsorted\": { \"program_binds\": " << unsorted.programBinds << ", \"vertex_array_binds\": " << unsorted.vertexArrayBinds
+		<< ", \"texture_binds\": " << unsorted.textureBinds << ", \"material_changes\": " << unsorted.materialChanges << ", \"state_changes\": " << unsorted.stateChanges() << " }, ";
+	out << "\"sorted\": { \"program_binds\": " << sorted.programBinds << ", \"vertex_array_binds\": " << sorted.vertexArrayBinds
+		<< ", \"texture_binds\": " << sorted.textureBinds << ", \"material_changes\": " << sorted.materialChanges << ", \"state_changes\": " << sorted.stateChanges() << " }, ";
+	out << "\"sort_ms\": " << sortMs << ", \"packets_per_s\": " << packetCount / (sortMs / 1000.0) << " }\n";
+}
+
+static void buildBenchmarkTree(SceneGraph& scene, SceneNode parent, int depth, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+	for (int child = 0; child < 4; child++)
+	{
+		SceneNode node = scene.add(parent, glm::vec3(offset(rng), offset(rng), offset(rng)));
+		if (depth > 1)
+			buildBenchmarkTree(scene, node, depth - 1, rng);
+	}
+}
+
+// world matrix updates of a deep hierarchy (`roots` trees of fanout 4, depth 6) where 1% of the
+// nodes move per frame: full recomputation against the dirty-flag update, single threaded and pooled
+inline void runSceneGraphBenchmark(std::ostream& out, ThreadPool& pool, int roots, int iterations)
+{
+	std::mt19937 rng(1234);
+	SceneGraph scene;
+	for (int i = 0; i < roots; i++)
+		buildBenchmarkTree(scene, scene.add(SceneGraph::NO_PARENT, glm::vec3((float)i, 0.0f, 0.0f)), 6, rng);
+	scene.update();
+	size_t nodeCount = scene.size();
+	std::uniform_int_distribution<uint32_t> pick(0, (uint32_t)nodeCount - 1);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	const glm::vec3 axis(0.0f, 1.0f, 0.0f);
+
+	// every node dirty, what rebuilding every matrix each frame costs
+	double start = nowMs();
+	for (int i = 0; i < iterations; i++)
+	{
+		for (uint32_t node = 0; node < nodeCount; node++)
+			scene.setRotation(node, glm::angleAxis(angle(rng), axis));
+		scene.update(&pool);
+	}
+	double fullMs = (nowMs() - start) / iterations;
+
+	size_t moving = nodeCount / 100;
+	double incrementalMs[2];
+	size_t updated = 0;
+	for (int pooled = 0; pooled < 2; pooled++)
+	{
+		start = nowMs();
+		for (int i = 0; i < iterations; i++)
+		{
+			for (size_t j = 0; j < moving; j++)
+				scene.setRotation(pick(rng), glm::angleAxis(angle(rng), axis));
+			scene.update(pooled ? &pool : NULL);
+			updated = scene.lastUpdatedCount;
+		}
+		incrementalMs[pooled] = (nowMs() - start) / iterations;
+	}
+
+	out << "{ \"benchmark\": \"scene_graph\", \"nodes\": " << nodeCount << ", \"moving_per_frame\": " << moving << ", ";
+	out << "\"updated_per_frame\": " << updated << ", \"threads\": " << pool.size() + 1 << ", ";
+	out << "\"full_update_ms\": " << fullMs << ", \"dirty_update_ms\": " << incrementalMs[0] << ", ";
+	out << "\"dirty_update_pooled_ms\": " << incrementalMs[1] << " }\n";
+}
+
+// software rasterizer on a grid of 1000 rotated, lit cubes filling a `width` x `height` target.
+// Reports the frame time and the triangles, target pixels and shaded fragments per second.
+inline void runSoftRasterBenchmark(std::ostream& out, ThreadPool& pool, const float* cubeVertices, size_t cubeVertexCount, int width, int height, int iterations)
+{
+	Mesh cube = buildOptimizedMesh(cubeVertices, cubeVertexCount, 6);
+	std::vector<InstanceData> instances;
+	const int SIDE = 10;
+	for (int i = 0; i < SIDE * SIDE * SIDE; i++)
+	{
+		glm::vec3 position((i % SIDE - SIDE / 2) * 1.6f, (i / SIDE % SIDE - SIDE / 2) * 1.6f, -(i / (SIDE * SIDE)) * 1.6f);
+		InstanceData instance;
+		instance.model = SceneGraph::localMatrix(position, glm::angleAxis(0.3f * i, glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f))), glm::vec3(1.0f));
+		computeNormalMatrix(instance.model, instance.normal);
+		instances.push_back(instance);
+	}
+	std::vector<SoftDraw> draws;
+	SoftDraw cubes = { &cube, instances.data(), instances.size(), glm::vec3(0.0f, 0.2f, 1.0f), true };
+	draws.push_back(cubes);
+
+	SoftFrameParams params;
+	params.projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 100.0f);
+	params.viewPos = glm::vec3(0.0f, 0.0f, 12.0f);
+	params.view = glm::lookAt(params.viewPos, glm::vec3(0.0f, 0.0f, -6.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	params.lightPos = glm::vec3(2.0f, 4.0f, 6.0f);
+	params.lightColor = glm::vec3(1.0f);
+
+	SoftFramebuffer target(width, height);
+	SoftRasterizer rasterizer;
+	double start = nowMs();
+	for (int i = 0; i < iterations; i++)
+	{
+		target.clear(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+		rasterizer.draw(target, params, draws, pool);
+	}
+	double frameMs = (nowMs() - start) / iterations;
+	double seconds = frameMs / 1000.0;
+
+	out << "{ \"benchmark\": \"soft_raster\", \"kernel\": \"" << SOFT_RASTER_KERNEL << "\", \"threads\": " << pool.size()
+		<< ", \"width\": " << width << ", \"height\": " << height << ", \"triangles\": " << rasterizer.triangleCount
+		<< ", \"fragments\": " << rasterizer.fragmentCount << ", \"frame_ms\": " << frameMs
+		<< ", \"triangles_per_s\": " << rasterizer.triangleCount / seconds << ", \"pixels_per_s\": " << (double)width * height / seconds
+		<< ", \"fragments_per_s\": " << rasterizer.fragmentCount / seconds << " }\n";
+}
+
+// LOD chain of a UV sphere (`rings` x 2*`rings` quads): build time, triangles and error per level, and
+// the triangles `objectCount` spheres spread from 2 to 100 units away cost without and with LOD selection
+inline void runLodBenchmark(std::ostream& out, int rings, size_t objectCount, int viewportHeight)
+{
+	std::vector<float> interleaved;
+	int segments = rings * 2;
+	for (int r = 0; r < rings; r++)
+	{
+		for (int c = 0; c < segments; c++)
+		{
+			glm::vec3 corners[4];
+			for (int k = 0; k < 4; k++)
+			{
+				float theta = 3.14159265f * (r + (k == 1 || k == 2)) / rings;
+				float phi = 6.2831853f * (c + (k >= 2)) / segments;
+				corners[k] = glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			}
+			const int order[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int k = 0; k < 6; k++)
+			{
+				// the unit sphere's normal is its position
+				const glm::vec3& p = corners[order[k]];
+				const float vertex[6] = { p.x, p.y, p.z, p.x, p.y, p.z };
+				interleaved.insert(interleaved.end(), vertex, vertex + 6);
+			}
+		}
+	}
+	Mesh sphere = buildOptimizedMesh(interleaved.data(), interleaved.size() / 6, 6);
+
+	double start = nowMs();
+	std::vector<LodLevel> levels = buildLodChain(sphere, 6);
+	double buildMs = nowMs() - start;
+	std::vector<float> errors;
+	for (const LodLevel& level : levels)
+		errors.push_back(level.error);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> distance(2.0f, 100.0f);
+	LodSelector selector;
+	selector.reset(objectCount, (int)levels.size());
+	float projectionScale = LodSelector::projectionScale(45.0f, viewportHeight);
+	size_t fullTriangles = 0, lodTriangles = 0;
+	start = nowMs();
+	for (size_t i = 0; i < objectCount; i++)
+	{
+		int level = selector.select(i, errors.data(), (int)levels.size(), projectionScale, distance(rng) - 1.0f, 1.0f);
+		lodTriangles += levels[level].mesh.indices.size() / 3;
+		fullTriangles += sphere.indices.size() / 3;
+	}
+	double selectMs = nowMs() - start;
+
+	out << "{ \"benchmark\": \"lod\", \"build_ms\": " << buildMs << ", \"levels\": [";
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		out << (i ? ", " : "") << "{ \"triangles\": " << levels[i].mesh.indices.size() / 3 << ", \"vertices\": " << levels[i].mesh.vertices.size()
+			<< ", \"error\": " << levels[i].error << ", \"objects\": " << selector.levelCounts[i] << " }";
+	}
+	out << "], \"objects\": " << objectCount << ", \"triangles_full\": " << fullTriangles << ", \"triangles_lod\": " << lodTriangles
+		<< ", \"select_ms\": " << selectMs << " }\n";
+}
+
+// occlusion culling in a dense interior: a `side`^3 grid of unit boxes with the camera inside it.
+// Reports how many frustum visible boxes the 32 nearest occluders hide, and the cost of each stage
+inline void runOcclusionBenchmark(std::ostream& out, ThreadPool& pool, int side, const float* cubeVertices, size_t cubeVertexCount, int iterations)
+{
+	Mesh cube = buildOptimizedMesh(cubeVertices, cubeVertexCount, 6);
+	ObjectStore boxes;
+	std::vector<glm::mat4> models;
+	float offset = (side - 1) * 1.5f;
+	for (int i = 0; i < side * side * side; i++)
+	{
+		glm::vec3 center((i % side) * 3.0f - offset, (i / side % side) * 3.0f - offset, (i / (side * side)) * 3.0f - offset);
+		models.push_back(glm::translate(glm::mat4(1.0f), center));
+		boxes.addTransformed(models.back(), glm::vec3(0.5f));
+	}
+	glm::vec3 eye(1.5f, 1.5f, 1.5f);
+	glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+		* glm::lookAt(eye, eye + glm::vec3(0.3f, 0.2f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	FrustumCuller frustumCuller;
+	OcclusionCuller occlusion;
+	std::vector<uint32_t> occluders;
+	double frustumMs = 0.0, rasterMs = 0.0, testMs = 0.0;
+	for (int i = 0; i < iterations; i++)
+	{
+		double start = nowMs();
+		frustumCuller.cull(boxes, Frustum::fromMatrix(viewProjection), pool);
+		double culled = nowMs();
+		occlusion.begin(viewProjection);
+		occlusion.chooseOccluders(boxes, frustumCuller.visible, eye, occluders);
+		for (uint32_t occluder : occluders)
+			occlusion.addOccluder(cube, models[occluder]);
+		occlusion.build(pool);
+		double built = nowMs();
+		occlusion.test(boxes, frustumCuller.visible, pool);
+		double tested = nowMs();
+		frustumMs += culled - start;
+		rasterMs += built - culled;
+		testMs += tested - built;
+	}
+	size_t candidates = frustumCuller.visible.size();
+	out << "{ \"benchmark\": \"occlusion\", \"boxes\": " << boxes.size() << ", \"frustum_visible\": " << candidates
+		<< ", \"occluders\": " << occluders.size() << ", \"occluded\": " << occlusion.occludedCount
+		<< ", \"occluded_fraction\": " << (candidates ? (double)occlusion.occludedCount / candidates : 0.0)
+		<< ", \"frustum_ms\": " << frustumMs / iterations << ", \"occluder_raster_ms\": " << rasterMs / iterations
+		<< ", \"test_ms\": " << testMs / iterations << ", \"boxes_tested_per_s\": " << candidates / (testMs / iterations / 1000.0) << " }\n";
+}
+
+// BC1 compression of every mip level of the given images on the pool: throughput, size and the RMSE of
+// the decoded top level against the source (opaque texels only)
+inline void runTextureBenchmark(std::ostream& out, ThreadPool& pool, const std::vector<std::string>& paths, int iterations)
+{
+	std::vector<DecodedImage> images(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		images[i].path = paths[i];
+		decodeImage(images[i], true);
+	}
+
+	double texels = 0.0, squaredError = 0.0, errorSamples = 0.0;
+	size_t rawBytes = 0, compressedBytes = 0;
+	double start = nowMs();
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		for (const DecodedImage& image : images)
+		{
+			if (image.failed)
+				continue;
+			bool alpha = false;
+			for (size_t t = 3; t < image.pixels.size() && !alpha; t += 4)
+				alpha = image.pixels[t] < 128;
+			for (size_t level = 0; level < image.levelOffsets.size(); level++)
+			{
+				int width = image.levelWidths[level], height = image.levelHeights[level];
+				std::vector<uint8_t> blocks(bc1Size(width, height));
+				const uint8_t* source = &image.pixels[image.levelOffsets[level]];
+				int rows = (height + 3) / 4;
+				pool.parallelFor(rows, 8, [&](size_t begin, size_t end)
+				{
+					compressBC1Rows(source, width, height, alpha, (int)begin, (int)end, blocks.data());
+				});
+				if (iteration > 0)
+					continue;
+				texels += (double)width * height;
+				rawBytes += (size_t)width * height * 4;
+				compressedBytes += blocks.size();
+				if (level != 0)
+					continue;
+				uint8_t decoded[64];
+				for (int by = 0; by < rows; by++)
+				{
+					for (int bx = 0; bx < (width + 3) / 4; bx++)
+					{
+						decodeBC1Block(&blocks[((size_t)by * ((width + 3) / 4) + bx) * BC1_BLOCK_BYTES], decoded);
+						for (int i = 0; i < 16; i++)
+						{
+							int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+							const uint8_t* texel = &source[((size_t)y * width + x) * 4];
+							if (x >= width || y >= height || (alpha && texel[3] < 128))
+								continue;
+							for (int c = 0; c < 3; c++)
+								squaredError += (double)(texel[c] - decoded[i * 4 + c]) * (texel[c] - decoded[i * 4 + c]);
+							errorSamples += 3.0;
+						}
+					}
+				}
+			}
+		}
+	}
+	double ms = (nowMs() - start) / iterations;
+	out << "{ \"benchmark\": \"texture_bc1\", \"images\": " << images.size() << ", \"texels\": " << texels << ", \"ms\": " << ms
+		<< ", \"mtexels_per_s\": " << texels / (ms * 1000.0) << ", \"raw_bytes\": " << rawBytes << ", \"bc1_bytes\": " << compressedBytes
+		<< ", \"rmse\": " << (errorSamples > 0.0 ? sqrt(squaredError / errorSamples) : 0.0) << " }\n";
+}
+
+// light clustering on the pool: `lightCount` orbiting lights in a 20 unit box seen from outside it,
+// animated and binned into the cluster grid every iteration
+inline void runLightClusterBenchmark(std::ostream& out, ThreadPool& pool, size_t lightCount, int iterations)
+{
+	LightField field;
+	field.scatter(lightCount, glm::vec3(-10.0f), glm::vec3(10.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, 25.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	LightClusterer clusterer;
+
+	double animateMs = 0.0, buildMs = 0.0;
+	size_t lightRefs = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		double start = nowMs();
+		field.animate(i * (1.0f / 60.0f), pool);
+		double animated = nowMs();
+		clusterer.build(field.lights.data(), field.lights.size(), view, projection, pool);
+		animateMs += animated - start;
+		buildMs += nowMs() - animated;
+		lightRefs += clusterer.lightRefs;
+	}
+	size_t occupied = 0;
+	for (const glm::uvec2& range : clusterer.ranges)
+		occupied += range.y > 0;
+	out << "{ \"benchmark\": \"light_clusters\", \"lights\": " << lightCount << ", \"clusters\": " << LightClusterer::CLUSTER_COUNT
+		<< ", \"visible_lights\": " << clusterer.visibleLights << ", \"occupied_clusters\": " << occupied
+		<< ", \"light_refs\": " << lightRefs / iterations << ", \"max_cluster_lights\": " << clusterer.maxClusterLights
+		<< ", \"animate_ms\": " << animateMs / iterations << ", \"build_ms\": " << buildMs / iterations << " }\n";
+}
+
+// voxel chunk pipeline over a `side` x `side` area of terrain, the three chunk rows VoxelWorld streams:
+// generate, palette pack and greedy mesh on the pool, compared with one quad per visible face and
+// with one byte per block
+inline void runVoxelBenchmark(std::ostream& out, ThreadPool& pool, int side)
+{
+	TerrainGenerator generator;
+	const int ROWS = 3;
+	size_t chunkCount = (size_t)side * side * ROWS;
+	std::vector<PaletteChunk> chunks(chunkCount);
+	std::vector<VoxelMesh> meshes(chunkCount);
+	std::vector<double> meshMs(chunkCount);
+	double start = nowMs();
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		std::vector<BlockType> dense(CHUNK_VOLUME), padded(PADDED_CHUNK_VOLUME);
+		const PaletteChunk* neighbours[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::ivec3 coord((int)(i % side), -(int)(i / ((size_t)side * side)), (int)(i / side % side));
+			double chunkStart = nowMs();
+			generator.fillChunk(coord, dense.data());
+			chunks[i] = PaletteChunk::fromDense(dense.data());
+			buildPaddedChunk(coord, chunks[i], neighbours, generator, padded.data());
+			greedyMeshChunk(padded.data(), meshes[i]);
+			meshMs[i] = nowMs() - chunkStart;
+		}
+	});
+	double totalMs = nowMs() - start;
+
+	size_t triangles = 0, naiveTriangles = 0, vertexBytes = 0, paletteBytes = 0, uniform = 0;
+	double workerMs = 0.0;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		triangles += meshes[i].triangleCount();
+		naiveTriangles += meshes[i].visibleFaces * 2;
+		vertexBytes += meshes[i].vertices.size() * sizeof(VoxelVertex);
+		paletteBytes += chunks[i].memoryBytes();
+		uniform += chunks[i].isUniform();
+		workerMs += meshMs[i];
+	}
+	out << "{ \"benchmark\": \"voxel_chunks\", \"chunks\": " << chunkCount << ", \"threads\": " << pool.size() + 1
+		<< ", \"chunks_per_s\": " << chunkCount * 1000.0 / std::max(totalMs, 1e-3) << ", \"ms_per_chunk\": " << workerMs / chunkCount
+		<< ", \"triangles\": " << triangles << ", \"naive_triangles\": " << naiveTriangles << ", \"vertex_bytes\": " << vertexBytes
+		<< ", \"uniform_chunks\": " << uniform << ", \"palette_bytes\": " << paletteBytes << ", \"dense_bytes\": " << chunkCount * CHUNK_VOLUME << " }\n";
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef BUFFER_UPLOAD_H
+#define BUFFER_UPLOAD_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+// Creates static GPU buffers from data the caller already has in memory (typically a memory mapped file).
+// With GL 4.4 / ARB_buffer_storage the bytes go through a persistently mapped staging ring and
+// glCopyBufferSubData into an immutable buffer, so the only CPU copy is from the source straight
+// into driver memory. Older contexts fall back to glBufferData from the same pointer.
+class BufferUploader
+{
+public:
+	static const size_t SEGMENT_SIZE = 4 * 1024 * 1024;
+	static const int SEGMENT_COUNT = 4;
+
+	// true when the persistently mapped path is in use
+	bool persistent = false;
+
+	BufferUploader()
+	{
+#if defined(GL_VERSION_4_4)
+		persistent = GLAD_GL_VERSION_4_4 != 0;
+#endif
+#if defined(GL_ARB_buffer_storage)
+		persistent = persistent || GLAD_GL_ARB_buffer_storage != 0;
+#endif
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glGenBuffers(1, &staging);
+			glBindBuffer(GL_COPY_READ_BUFFER, staging);
+			glBufferStorage(GL_COPY_READ_BUFFER, SEGMENT_SIZE * SEGMENT_COUNT, NULL, flags);
+			mapped = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, SEGMENT_SIZE * SEGMENT_COUNT, flags);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			if (!mapped)
+			{
+				glDeleteBuffers(1, &staging);
+				staging = 0;
+				persistent = false;
+			}
+		}
+#endif
+	}
+
+	~BufferUploader()
+	{
+		for (int i = 0; i < SEGMENT_COUNT; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+		}
+		if (staging)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, staging);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glDeleteBuffers(1, &staging);
+		}
+	}
+
+	BufferUploader(const BufferUploader&) = delete;
+	BufferUploader& operator=(const BufferUploader&) = delete;
+
+	// returns a new buffer object holding `bytes` bytes copied from `data`
+	unsigned int createBuffer(const void* data, size_t bytes)
+	{
+		unsigned int buffer;
+		glGenBuffers(1, &buffer);
+		// the copy targets keep VAO element bindings and GL_ARRAY_BUFFER untouched
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		if (persistent)
+		{
+			glBufferStorage(GL_COPY_WRITE_BUFFER, std::max<size_t>(bytes, 1), NULL, 0);
+			glBindBuffer(GL_COPY_READ_BUFFER, staging);
+			const char* source = (const char*)data;
+			for (size_t done = 0; done < bytes; )
+			{
+				size_t chunk = bytes - done < SEGMENT_SIZE ? bytes - done : SEGMENT_SIZE;
+				char* segment = acquireSegment();
+				memcpy(segment, source + done, chunk);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)(segment - mapped), (GLintptr)done, (GLsizeiptr)chunk);
+				releaseSegment();
+				done += chunk;
+			}
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			return buffer;
+		}
+#endif
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+
+private:
+	unsigned int staging = 0;
+	char* mapped = NULL;
+	int segment = 0;
+	GLsync fences[SEGMENT_COUNT] = {};
+
+	// waits until the GPU has finished copying out of the next segment
+	char* acquireSegment()
+	{
+		if (fences[segment])
+		{
+			glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fences[segment]);
+			fences[segment] = 0;
+		}
+		return mapped + segment * SEGMENT_SIZE;
+	}
+
+	// fences the copy that reads the current segment and moves on to the next one
+	void releaseSegment()
+	{
+		fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		segment = (segment + 1) % SEGMENT_COUNT;
+	}
+};
+
+#endif
@@ -55,7 +55,7 @@ public:
 	}
 
 	// constructor with scalar values
-	Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(Zoom)
+	Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM), Omega(OMEGA)
 	{
 		Position = glm::vec3(posX, posY, posZ);
 		WorldUp = glm::vec3(upX, upY, upZ);
@@ -69,6 +69,14 @@ public:
 		return glm::lookAt(Position, Position + Front, Up);
 	}
 
+	// turns the camera towards a point in world space, used by scripted camera paths
+	void LookAt(glm::vec3 target) {
+		glm::vec3 direction = glm::normalize(target - Position);
+		Pitch = glm::degrees(asin(direction.y));
+		Yaw = glm::degrees(atan2(direction.z, direction.x));
+		updateCameraVectors();
+	}
+
 	// process input recieved from any keyboard like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it form windowing systems)
 	void ProcessKeyboard(Camera_Movement direction, float deltaTime) {
 		float velocity = MovementSpeed * deltaTime;
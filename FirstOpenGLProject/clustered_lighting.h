@@ -0,0 +1,444 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "shader_s.h"
+#include "thread_pool.h"
+
+// Clustered forward shading for thousands of point lights. The view frustum is cut into TILES_X x TILES_Y
+// screen tiles and SLICES exponentially spaced depth slices. Every frame the workers bin each light into
+// the clusters its sphere touches, and lighting.frag only loops over the lights of the fragment's own
+// cluster, so shading cost follows the local light density instead of the total light count.
+
+// a point light as lighting.frag fetches it, two RGBA32F texels
+struct PointLight
+{
+	// xyz world position, w the radius beyond which the light contributes nothing
+	glm::vec4 positionRadius;
+	glm::vec4 color;
+};
+static_assert(sizeof(PointLight) == 32, "PointLight must match the two texels lighting.frag reads per light");
+
+// Point lights circling anchors scattered through a box, each on its own orbit, speed and phase,
+// moving like the scene's main light. Positions are a function of the simulation time only.
+class LightField
+{
+public:
+	std::vector<PointLight> lights;
+
+	void scatter(size_t count, glm::vec3 boundsMin, glm::vec3 boundsMax, float minRadius = 0.75f, float maxRadius = 2.0f, uint32_t seed = 1)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		lights.resize(count);
+		orbits.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			Orbit& orbit = orbits[i];
+			orbit.anchor = glm::mix(boundsMin, boundsMax, glm::vec3(unit(rng), unit(rng), unit(rng)));
+			orbit.size = 0.25f + unit(rng);
+			orbit.speed = (unit(rng) < 0.5f ? -1.0f : 1.0f) * (0.3f + unit(rng));
+			orbit.phase = 6.2831853f * unit(rng);
+			// saturated colour of a random hue, dimmed so overlapping lights don't wash the scene out
+			float hue = unit(rng) * 6.0f;
+			glm::vec3 color = glm::clamp(glm::abs(glm::mod(glm::vec3(hue) + glm::vec3(0.0f, 4.0f, 2.0f), 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+			lights[i].positionRadius = glm::vec4(orbit.anchor, minRadius + (maxRadius - minRadius) * unit(rng));
+			lights[i].color = glm::vec4(color * 0.6f, 0.0f);
+		}
+	}
+
+	void animate(float time, ThreadPool& pool)
+	{
+		pool.parallelFor(lights.size(), 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const Orbit& orbit = orbits[i];
+				float angle = orbit.speed * time + orbit.phase;
+				glm::vec3 offset = orbit.size * glm::vec3(cosf(angle), 0.5f * cosf(angle), sinf(angle));
+				lights[i].positionRadius = glm::vec4(orbit.anchor + offset, lights[i].positionRadius.w);
+			}
+		});
+	}
+
+private:
+	struct Orbit
+	{
+		glm::vec3 anchor;
+		float size;
+		float speed;
+		float phase;
+	};
+
+	std::vector<Orbit> orbits;
+};
+
+// CPU side of the clustering: light spheres in, a light index list per cluster out. Clusters are
+// numbered (slice * TILES_Y + tileY) * TILES_X + tileX with tile (0, 0) at the bottom left of the
+// viewport, and a depth d falls into slice floor(log(d) * sliceScale() + sliceBias()).
+class LightClusterer
+{
+public:
+	static const int TILES_X = 16;
+	static const int TILES_Y = 9;
+	static const int SLICES = 24;
+	static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+	static const int SLICE_CLUSTERS = TILES_X * TILES_Y;
+
+	float nearPlane;
+	float farPlane;
+	// per cluster: its first entry in the index list and how many lights it has, valid after build
+	std::vector<glm::uvec2> ranges;
+	size_t lightRefs = 0;
+	size_t visibleLights = 0;
+	uint32_t maxClusterLights = 0;
+
+	LightClusterer(float nearPlane = 0.1f, float farPlane = 100.0f) : nearPlane(nearPlane), farPlane(farPlane)
+	{
+		ranges.resize(CLUSTER_COUNT);
+		clusterMin.resize(CLUSTER_COUNT);
+		clusterMax.resize(CLUSTER_COUNT);
+		sliceIndices.resize(SLICES);
+		sliceLights.resize(SLICES);
+	}
+
+	float sliceScale() const
+	{
+		return SLICES / logf(farPlane / nearPlane);
+	}
+
+	float sliceBias() const
+	{
+		return -logf(nearPlane) * sliceScale();
+	}
+
+	// bins `lights` into the clusters of a symmetric perspective `projection` (as from glm::perspective).
+	// Lights are bounded on their own first and listed under the slices they reach, then each slice is
+	// filled by one task, so no two tasks ever write the same cluster
+	void build(const PointLight* lights, size_t count, const glm::mat4& view, const glm::mat4& projection, ThreadPool& pool)
+	{
+		if (projection[0][0] != projectionX || projection[1][1] != projectionY)
+			buildClusterBounds(projection[0][0], projection[1][1]);
+
+		bounds.resize(count);
+		pool.parallelFor(count, 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				bounds[i] = boundLight(view, lights[i]);
+		});
+		visibleLights = 0;
+		for (std::vector<uint32_t>& candidates : sliceLights)
+			candidates.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!bounds[i].visible)
+				continue;
+			visibleLights++;
+			for (int slice = bounds[i].z0; slice <= bounds[i].z1; slice++)
+				sliceLights[slice].push_back((uint32_t)i);
+		}
+
+		pool.parallelFor(SLICES, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t slice = begin; slice < end; slice++)
+				binSlice((int)slice);
+		});
+
+		// slices were filled independently, make their offsets global
+		lightRefs = 0;
+		maxClusterLights = 0;
+		for (int slice = 0; slice < SLICES; slice++)
+		{
+			for (int i = slice * SLICE_CLUSTERS; i < (slice + 1) * SLICE_CLUSTERS; i++)
+			{
+				ranges[i].x += (uint32_t)lightRefs;
+				maxClusterLights = std::max(maxClusterLights, ranges[i].y);
+			}
+			lightRefs += sliceIndices[slice].size();
+		}
+	}
+
+	// writes the light indices of every cluster in cluster order, `lightRefs` entries
+	void copyIndices(uint32_t* destination) const
+	{
+		for (const std::vector<uint32_t>& indices : sliceIndices)
+		{
+			if (indices.empty())
+				continue;
+			memcpy(destination, indices.data(), indices.size() * sizeof(uint32_t));
+			destination += indices.size();
+		}
+	}
+
+private:
+	// a light's view space sphere and the inclusive cluster range its bounding box projects to
+	struct LightBounds
+	{
+		glm::vec3 center;
+		float radius;
+		uint8_t x0, x1, y0, y1, z0, z1;
+		bool visible;
+	};
+
+	std::vector<LightBounds> bounds;
+	// view space box of every cluster, rebuilt when the projection changes
+	std::vector<glm::vec3> clusterMin, clusterMax;
+	std::vector<std::vector<uint32_t>> sliceIndices;
+	// lights whose depth range reaches each slice
+	std::vector<std::vector<uint32_t>> sliceLights;
+	float projectionX = 0.0f, projectionY = 0.0f;
+
+	float sliceDepth(int slice) const
+	{
+		return nearPlane * powf(farPlane / nearPlane, (float)slice / SLICES);
+	}
+
+	int depthSlice(float depth) const
+	{
+		return std::min(std::max((int)floorf(logf(depth) * sliceScale() + sliceBias()), 0), SLICES - 1);
+	}
+
+	static int tile(float ndc, int tiles)
+	{
+		return std::min(std::max((int)floorf((ndc * 0.5f + 0.5f) * tiles), 0), tiles - 1);
+	}
+
+	void buildClusterBounds(float scaleX, float scaleY)
+	{
+		projectionX = scaleX;
+		projectionY = scaleY;
+		for (int slice = 0; slice < SLICES; slice++)
+		{
+			float nearDepth = sliceDepth(slice), farDepth = sliceDepth(slice + 1);
+			for (int y = 0; y < TILES_Y; y++)
+			{
+				for (int x = 0; x < TILES_X; x++)
+				{
+					// the tile's edges in NDC, scaled out to both depths of the slice
+					glm::vec2 ndcMin(2.0f * x / TILES_X - 1.0f, 2.0f * y / TILES_Y - 1.0f);
+					glm::vec2 ndcMax(2.0f * (x + 1) / TILES_X - 1.0f, 2.0f * (y + 1) / TILES_Y - 1.0f);
+					glm::vec2 scale(1.0f / scaleX, 1.0f / scaleY);
+					glm::vec2 nearMin = ndcMin * scale * nearDepth, nearMax = ndcMax * scale * nearDepth;
+					glm::vec2 farMin = ndcMin * scale * farDepth, farMax = ndcMax * scale * farDepth;
+					int cluster = (slice * TILES_Y + y) * TILES_X + x;
+					clusterMin[cluster] = glm::vec3(glm::min(nearMin, farMin), -farDepth);
+					clusterMax[cluster] = glm::vec3(glm::max(nearMax, farMax), -nearDepth);
+				}
+			}
+		}
+	}
+
+	// clusters under the light's view space bounding box. x / depth over the box is smallest at its
+	// nearest depth when x < 0 and at its farthest otherwise, which bounds the projection even when
+	// the box reaches behind the near plane
+	LightBounds boundLight(const glm::mat4& view, const PointLight& light) const
+	{
+		LightBounds result = {};
+		result.center = glm::vec3(view * glm::vec4(glm::vec3(light.positionRadius), 1.0f));
+		result.radius = light.positionRadius.w;
+		float nearest = -result.center.z - result.radius, farthest = -result.center.z + result.radius;
+		if (farthest < nearPlane || nearest > farPlane)
+			return result;
+		nearest = std::max(nearest, nearPlane);
+		farthest = std::min(farthest, farPlane);
+
+		float ndc[4];
+		const float scales[2] = { projectionX, projectionY };
+		for (int axis = 0; axis < 2; axis++)
+		{
+			float low = result.center[axis] - result.radius, high = result.center[axis] + result.radius;
+			ndc[axis * 2] = low * scales[axis] / (low < 0.0f ? nearest : farthest);
+			ndc[axis * 2 + 1] = high * scales[axis] / (high < 0.0f ? farthest : nearest);
+			if (ndc[axis * 2] > 1.0f || ndc[axis * 2 + 1] < -1.0f)
+				return result;
+		}
+		result.x0 = (uint8_t)tile(ndc[0], TILES_X);
+		result.x1 = (uint8_t)tile(ndc[1], TILES_X);
+		result.y0 = (uint8_t)tile(ndc[2], TILES_Y);
+		result.y1 = (uint8_t)tile(ndc[3], TILES_Y);
+		result.z0 = (uint8_t)depthSlice(nearest);
+		result.z1 = (uint8_t)depthSlice(farthest);
+		result.visible = true;
+		return result;
+	}
+
+	bool touches(const LightBounds& light, int cluster) const
+	{
+		glm::vec3 closest = glm::clamp(light.center, clusterMin[cluster], clusterMax[cluster]);
+		glm::vec3 offset = closest - light.center;
+		return glm::dot(offset, offset) <= light.radius * light.radius;
+	}
+
+	// counts the slice's lights per cluster, then writes them grouped by cluster. Offsets are relative
+	// to the slice until build makes them global
+	void binSlice(int slice)
+	{
+		glm::uvec2* sliceRanges = &ranges[slice * SLICE_CLUSTERS];
+		for (int i = 0; i < SLICE_CLUSTERS; i++)
+			sliceRanges[i] = glm::uvec2(0);
+		for (uint32_t index : sliceLights[slice])
+		{
+			const LightBounds& light = bounds[index];
+			for (int y = light.y0; y <= light.y1; y++)
+			{
+				for (int x = light.x0; x <= light.x1; x++)
+				{
+					if (touches(light, slice * SLICE_CLUSTERS + y * TILES_X + x))
+						sliceRanges[y * TILES_X + x].y++;
+				}
+			}
+		}
+
+		uint32_t offset = 0;
+		for (int i = 0; i < SLICE_CLUSTERS; i++)
+		{
+			sliceRanges[i].x = offset;
+			offset += sliceRanges[i].y;
+			sliceRanges[i].y = 0;
+		}
+		std::vector<uint32_t>& indices = sliceIndices[slice];
+		indices.resize(offset);
+		for (uint32_t index : sliceLights[slice])
+		{
+			const LightBounds& light = bounds[index];
+			for (int y = light.y0; y <= light.y1; y++)
+			{
+				for (int x = light.x0; x <= light.x1; x++)
+				{
+					glm::uvec2& range = sliceRanges[y * TILES_X + x];
+					if (touches(light, slice * SLICE_CLUSTERS + y * TILES_X + x))
+						indices[range.x + range.y++] = index;
+				}
+			}
+		}
+	}
+};
+
+// GPU side: the lights, the cluster ranges and the index list as buffer textures (core since GL 3.1,
+// storage buffers would need 4.3), bound once to their own texture units. glTexBuffer takes whole
+// buffers on 3.3, so instead of the frame ring each buffer is invalidated and rewritten every frame.
+class ClusteredLighting
+{
+public:
+	static const int LIGHT_TEXTURE_UNIT = 1;
+	static const int RANGE_TEXTURE_UNIT = 2;
+	static const int INDEX_TEXTURE_UNIT = 3;
+
+	LightClusterer clusterer;
+	// lights the shader loops over this frame, 0 when the upload failed
+	int lightCount = 0;
+	size_t uploadFailures = 0;
+
+	ClusteredLighting(float nearPlane, float farPlane) : clusterer(nearPlane, farPlane)
+	{
+		createTextureBuffer(lightBuffer, LIGHT_TEXTURE_UNIT, GL_RGBA32F);
+		createTextureBuffer(rangeBuffer, RANGE_TEXTURE_UNIT, GL_RG32UI);
+		createTextureBuffer(indexBuffer, INDEX_TEXTURE_UNIT, GL_R32UI);
+	}
+
+	~ClusteredLighting()
+	{
+		TextureBuffer* buffers[3] = { &lightBuffer, &rangeBuffer, &indexBuffer };
+		for (TextureBuffer* buffer : buffers)
+		{
+			glDeleteTextures(1, &buffer->texture);
+			glDeleteBuffers(1, &buffer->buffer);
+		}
+	}
+
+	ClusteredLighting(const ClusteredLighting&) = delete;
+	ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+	// points the program's light samplers at their units. Needed even without lights, samplers of
+	// different types may not share the default unit 0 with the material textures
+	void attach(Shader& shader)
+	{
+		shader.use();
+		shader.setInt("pointLights", LIGHT_TEXTURE_UNIT);
+		shader.setInt("clusterRanges", RANGE_TEXTURE_UNIT);
+		shader.setInt("clusterLightIndices", INDEX_TEXTURE_UNIT);
+	}
+
+	// bins this frame's lights and uploads them with their cluster lists
+	void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, ThreadPool& pool)
+	{
+		clusterer.build(lights.data(), lights.size(), view, projection, pool);
+		bool uploaded = upload(lightBuffer, lights.size() * sizeof(PointLight), [&](void* data) { memcpy(data, lights.data(), lights.size() * sizeof(PointLight)); })
+			&& upload(rangeBuffer, clusterer.ranges.size() * sizeof(glm::uvec2), [&](void* data) { memcpy(data, clusterer.ranges.data(), clusterer.ranges.size() * sizeof(glm::uvec2)); })
+			&& upload(indexBuffer, clusterer.lightRefs * sizeof(uint32_t), [&](void* data) { clusterer.copyIndices((uint32_t*)data); });
+		lightCount = uploaded ? (int)lights.size() : 0;
+	}
+
+	// PerFrame clusterScale: tiles per pixel of a `width` x `height` viewport, then the depth slice scale and bias
+	glm::vec4 clusterScale(int width, int height) const
+	{
+		return glm::vec4((float)LightClusterer::TILES_X / width, (float)LightClusterer::TILES_Y / height, clusterer.sliceScale(), clusterer.sliceBias());
+	}
+
+	// PerFrame clusterSize: the grid, and the light count that switches the loop on
+	glm::ivec4 clusterSize() const
+	{
+		return glm::ivec4(LightClusterer::TILES_X, LightClusterer::TILES_Y, LightClusterer::SLICES, lightCount);
+	}
+
+private:
+	struct TextureBuffer
+	{
+		unsigned int buffer = 0;
+		unsigned int texture = 0;
+		size_t capacity = 0;
+	};
+
+	TextureBuffer lightBuffer, rangeBuffer, indexBuffer;
+
+	static void createTextureBuffer(TextureBuffer& target, int unit, GLenum format)
+	{
+		target.capacity = 64 * 1024;
+		glGenBuffers(1, &target.buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+		glBufferData(GL_TEXTURE_BUFFER, target.capacity, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glGenTextures(1, &target.texture);
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, target.texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, target.buffer);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// invalidating the whole buffer lets the driver hand out fresh storage while the GPU still reads last frame's
+	template <typename Fn>
+	bool upload(TextureBuffer& target, size_t bytes, Fn write)
+	{
+		if (bytes == 0)
+			return true;
+		glBindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+		if (bytes > target.capacity)
+		{
+			target.capacity = std::max(bytes, target.capacity * 2);
+			glBufferData(GL_TEXTURE_BUFFER, target.capacity, NULL, GL_STREAM_DRAW);
+		}
+		void* data = glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		bool mapped = data != NULL;
+		if (mapped)
+		{
+			write(data);
+			mapped = glUnmapBuffer(GL_TEXTURE_BUFFER) == GL_TRUE;
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		if (!mapped && uploadFailures++ == 0)
+			std::cout << "ERROR::CLUSTERED_LIGHTING::UPLOAD_FAILED " << bytes << " bytes" << std::endl;
+		return mapped;
+	}
+};
+
+#endif
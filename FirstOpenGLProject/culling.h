@@ -0,0 +1,240 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "thread_pool.h"
+
+#if defined(__AVX2__)
+#define CULLING_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// name of the kernel variant compiled in, reported by the benchmarks
+#if defined(CULLING_AVX2)
+#define CULLING_KERNEL "avx2"
+#elif defined(CULLING_SSE2)
+#define CULLING_KERNEL "sse2"
+#else
+#define CULLING_KERNEL "scalar"
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, mask must not be zero
+inline unsigned int lowestSetBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned int)index;
+#else
+	return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+// The six clip planes of a view-projection matrix, as (normal, distance) with unit normals.
+// A point p is inside a plane when dot(normal, p) + distance >= 0.
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// Gribb/Hartmann extraction from projection * view
+	static Frustum fromMatrix(const glm::mat4& viewProjection)
+	{
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++)
+			row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		Frustum frustum;
+		frustum.planes[0] = row[3] + row[0];	// left
+		frustum.planes[1] = row[3] - row[0];	// right
+		frustum.planes[2] = row[3] + row[1];	// bottom
+		frustum.planes[3] = row[3] - row[1];	// top
+		frustum.planes[4] = row[3] + row[2];	// near
+		frustum.planes[5] = row[3] - row[2];	// far
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec4& p = frustum.planes[i];
+			p = p * (1.0f / glm::length(glm::vec3(p)));
+		}
+		return frustum;
+	}
+};
+
+// Axis aligned bounding boxes stored as structure-of-arrays (center and half extents per axis)
+// so the culling kernel can load 4 or 8 objects per SIMD register.
+class ObjectStore
+{
+public:
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	size_t size() const
+	{
+		return centerX.size();
+	}
+
+	void clear()
+	{
+		centerX.clear(); centerY.clear(); centerZ.clear();
+		extentX.clear(); extentY.clear(); extentZ.clear();
+	}
+
+	void reserve(size_t count)
+	{
+		centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count);
+		extentX.reserve(count); extentY.reserve(count); extentZ.reserve(count);
+	}
+
+	// adds a box and returns its index, which is what the culling output refers to
+	uint32_t add(const glm::vec3& center, const glm::vec3& extent)
+	{
+		centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+		extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+		return (uint32_t)(centerX.size() - 1);
+	}
+
+	// world space box of a model-space box [-halfSize, halfSize] transformed by `model`
+	uint32_t addTransformed(const glm::mat4& model, const glm::vec3& halfSize)
+	{
+		glm::vec3 extent;
+		for (int axis = 0; axis < 3; axis++)
+			extent[axis] = fabs(model[0][axis]) * halfSize.x + fabs(model[1][axis]) * halfSize.y + fabs(model[2][axis]) * halfSize.z;
+		return add(glm::vec3(model[3]), extent);
+	}
+};
+
+// Tests boxes [begin, end) of the store against the frustum and writes the indices of the ones that are
+// at least partially inside to `visible`. Returns how many were written (at most end - begin).
+inline size_t cullBoxes(const ObjectStore& store, const Frustum& frustum, size_t begin, size_t end, uint32_t* visible)
+{
+	const float* cx = store.centerX.data();
+	const float* cy = store.centerY.data();
+	const float* cz = store.centerZ.data();
+	const float* ex = store.extentX.data();
+	const float* ey = store.extentY.data();
+	const float* ez = store.extentZ.data();
+	size_t written = 0;
+	size_t i = begin;
+
+#if defined(CULLING_AVX2)
+	// a box is outside a plane when dot(n, c) + d < -dot(|n|, e).
+	// The bounds test what is left rather than i + 8, which would wrap for a range ending near SIZE_MAX
+	for (; end - i >= 8; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+		__m256 hx = _mm256_loadu_ps(ex + i), hy = _mm256_loadu_ps(ey + i), hz = _mm256_loadu_ps(ez + i);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			// mul + add rather than FMA, which AVX2 doesn't imply (-mavx2 alone, MSVC /arch:AVX2)
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(hx, _mm256_set1_ps(fabs(plane.x))), _mm256_mul_ps(hy, _mm256_set1_ps(fabs(plane.y)))),
+				_mm256_mul_ps(hz, _mm256_set1_ps(fabs(plane.z))));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), radius), _CMP_GE_OQ));
+		}
+		unsigned int mask = (unsigned int)_mm256_movemask_ps(inside);
+		while (mask)
+		{
+			unsigned int lane = lowestSetBit(mask);
+			visible[written++] = (uint32_t)(i + lane);
+			mask &= mask - 1;
+		}
+	}
+#elif defined(CULLING_SSE2)
+	for (; end - i >= 4; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+		__m128 hx = _mm_loadu_ps(ex + i), hy = _mm_loadu_ps(ey + i), hz = _mm_loadu_ps(ez + i);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(hx, _mm_set1_ps(fabs(plane.x))), _mm_mul_ps(hy, _mm_set1_ps(fabs(plane.y)))),
+				_mm_mul_ps(hz, _mm_set1_ps(fabs(plane.z))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+				visible[written++] = (uint32_t)(i + lane);
+		}
+	}
+#endif
+
+	// scalar tail, and the whole range on targets without SIMD
+	for (; i < end; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = cx[i] * plane.x + cy[i] * plane.y + cz[i] * plane.z + plane.w;
+			float radius = ex[i] * fabs(plane.x) + ey[i] * fabs(plane.y) + ez[i] * fabs(plane.z);
+			inside = distance >= -radius;
+		}
+		if (inside)
+			visible[written++] = (uint32_t)i;
+	}
+	return written;
+}
+
+// Culls the whole store on the thread pool. Every chunk writes its survivors to its own slice of the
+// output, then the slices are packed together in order so the result is deterministic.
+class FrustumCuller
+{
+public:
+	static const size_t CHUNK_SIZE = 16384;
+
+	// indices of the visible objects, valid after cull
+	std::vector<uint32_t> visible;
+
+	void cull(const ObjectStore& store, const Frustum& frustum, ThreadPool& pool)
+	{
+		size_t count = store.size();
+		size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		scratch.resize(count);
+		chunkVisible.assign(chunkCount, 0);
+
+		uint32_t* out = scratch.data();
+		size_t* counts = chunkVisible.data();
+		pool.parallelFor(count, CHUNK_SIZE, [&store, &frustum, out, counts](size_t begin, size_t end)
+		{
+			counts[begin / CHUNK_SIZE] = cullBoxes(store, frustum, begin, end, out + begin);
+		});
+
+		size_t total = 0;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			total += chunkVisible[chunk];
+		visible.resize(total);
+		size_t offset = 0;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			if (chunkVisible[chunk])
+				memcpy(visible.data() + offset, scratch.data() + chunk * CHUNK_SIZE, chunkVisible[chunk] * sizeof(uint32_t));
+			offset += chunkVisible[chunk];
+		}
+	}
+
+private:
+	std::vector<uint32_t> scratch;
+	std::vector<size_t> chunkVisible;
+};
+
+#endif
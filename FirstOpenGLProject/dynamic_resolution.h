@@ -0,0 +1,198 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "framebuffer.h"
+#include "frame_stats.h"
+#include "shader_s.h"
+
+// Picks the 3D pass's resolution scale from measured GPU frame time, so an expensive stretch of frames
+// renders fewer pixels instead of missing the frame budget. The GPU time of a frame is roughly
+// proportional to its pixel count, so the controller works on the area (scale squared): a velocity form
+// PID moves it by the error between the measured time and `headroom` of the budget, as a fraction of that
+// target. Results arrive GpuFrameTimer::QUERY_LATENCY frames late, so after every change the frames still
+// rendered at the old scale are ignored, and errors inside the dead band leave the scale alone. A single
+// sample far above the recent average is a driver hiccup rather than load and is dropped before the PID
+// sees it; only when such samples keep coming are they treated as the new frame time.
+class ResolutionController
+{
+public:
+	float budgetMs;
+	// share of the budget the frame should take, the rest absorbs noise
+	float headroom = 0.9f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	// scale changes in steps of this size, so a slightly noisy time doesn't resize every frame
+	float step = 1.0f / 32.0f;
+	float deadBand = 0.05f;
+	float kp = 0.15f;
+	float ki = 0.25f;
+	float kd = 0.05f;
+	// a sample this many times above the recent average (or the target, if larger) is an outlier
+	float outlierFactor = 4.0f;
+	// consecutive outliers after which they are taken as real
+	int outlierPersistence = 3;
+
+	float scale;
+	// stats
+	int changes = 0;
+	int measuredFrames = 0;
+	int framesOverBudget = 0;
+	int outliers = 0;
+	double scaleSum = 0.0;
+	float lowestScale;
+
+	ResolutionController(float budgetMs) : budgetMs(budgetMs)
+	{
+		scale = lowestScale = maxScale;
+		area = maxScale * maxScale;
+	}
+
+	// GPU time of `resultFrame`, read back while `frame` is about to be rendered. Returns whether the scale changed
+	bool update(int frame, int resultFrame, double gpuMs)
+	{
+		float target = budgetMs * headroom;
+		float reference = std::max(averageMs > 0.0f ? averageMs : target, target);
+		if ((float)gpuMs > outlierFactor * reference && outlierRun < outlierPersistence)
+		{
+			outlierRun++;
+			outliers++;
+			return false;
+		}
+		outlierRun = 0;
+		averageMs = averageMs > 0.0f ? averageMs + 0.1f * ((float)gpuMs - averageMs) : (float)gpuMs;
+
+		measuredFrames++;
+		if (gpuMs > budgetMs)
+			framesOverBudget++;
+		// rendered before the last change, says nothing about the current scale
+		if (resultFrame < settleFrame)
+			return false;
+
+		// a stall far over the budget counts as twice the target, one bad frame shouldn't floor the scale
+		float error = std::max((target - (float)gpuMs) / target, -1.0f);
+		float delta = kp * (error - previousError) + ki * error + kd * (error - 2.0f * previousError + olderError);
+		olderError = previousError;
+		previousError = error;
+		if (std::fabs(error) < deadBand)
+			return false;
+
+		// the clamp stops the integral from winding up while the scale sits at a limit
+		area = std::min(std::max(area + delta, minScale * minScale), maxScale * maxScale);
+		float newScale = std::min(std::max(std::round(std::sqrt(area) / step) * step, minScale), maxScale);
+		if (newScale == scale)
+			return false;
+		scale = newScale;
+		lowestScale = std::min(lowestScale, scale);
+		settleFrame = frame;
+		changes++;
+		return true;
+	}
+
+	// call once per rendered frame for the mean scale
+	void frameRendered()
+	{
+		scaleSum += scale;
+		renderedFrames++;
+	}
+
+	float meanScale() const
+	{
+		return renderedFrames ? (float)(scaleSum / renderedFrames) : scale;
+	}
+
+private:
+	float area;
+	float previousError = 0.0f;
+	float olderError = 0.0f;
+	// moving average of the accepted samples, 0 until the first one
+	float averageMs = 0.0f;
+	int outlierRun = 0;
+	// the first frames' results say nothing about steady state, GpuFrameTimer doesn't report them either
+	int settleFrame = GpuFrameTimer::QUERY_LATENCY;
+	int renderedFrames = 0;
+};
+
+// Offscreen target for the scaled 3D pass and the pass that puts it on the output. The target is
+// allocated once at the output size times the largest scale and each frame renders into its bottom
+// left corner, so a scale change is only a viewport change. present() upscales that corner bilinearly
+// and sharpens it, which wins back some of the detail lost to the lower resolution.
+class DynamicResolution
+{
+public:
+	// its own unit so the render queue's material texture binding stays valid across frames
+	static const int SCENE_TEXTURE_UNIT = 4;
+
+	Framebuffer* target = NULL;
+	Shader upscaleShader;
+	// size of the scaled scene this frame
+	int renderWidth = 0;
+	int renderHeight = 0;
+	// sharpening at the lowest scale, it fades out towards native resolution
+	float sharpness = 0.5f;
+
+	DynamicResolution(const AssetPack* pack = NULL) : upscaleShader("upscale.vert", "upscale.frag", pack)
+	{
+		// the full screen triangle is generated from gl_VertexID, but core profile draws need a vertex array
+		glGenVertexArrays(1, &emptyVAO);
+		upscaleShader.use();
+		upscaleShader.setInt("scene", SCENE_TEXTURE_UNIT);
+		uvScaleLoc = upscaleShader.getUniformLocation("uvScale");
+		texelSizeLoc = upscaleShader.getUniformLocation("texelSize");
+		sharpnessLoc = upscaleShader.getUniformLocation("sharpness");
+	}
+
+	~DynamicResolution()
+	{
+		delete target;
+		glDeleteVertexArrays(1, &emptyVAO);
+	}
+
+	DynamicResolution(const DynamicResolution&) = delete;
+	DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+	// binds the target with the viewport at `scale` of the output, resizing it when the output changed size
+	void beginScene(int outputWidth, int outputHeight, float scale, float maxScale)
+	{
+		int width = std::max((int)std::ceil(outputWidth * maxScale), 1);
+		int height = std::max((int)std::ceil(outputHeight * maxScale), 1);
+		if (!target)
+			target = new Framebuffer(width, height);
+		else if (target->width != width || target->height != height)
+			target->resize(width, height);
+		renderWidth = std::min(std::max((int)(outputWidth * scale + 0.5f), 1), width);
+		renderHeight = std::min(std::max((int)(outputHeight * scale + 0.5f), 1), height);
+		glBindFramebuffer(GL_FRAMEBUFFER, target->ID);
+		glViewport(0, 0, renderWidth, renderHeight);
+	}
+
+	// draws the scene into `framebuffer` (0 for the window) at its full size
+	void present(unsigned int framebuffer, int outputWidth, int outputHeight, float minScale)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, outputWidth, outputHeight);
+		glDisable(GL_DEPTH_TEST);
+		upscaleShader.use();
+		glUniform2f(uvScaleLoc, (float)renderWidth / target->width, (float)renderHeight / target->height);
+		glUniform2f(texelSizeLoc, 1.0f / target->width, 1.0f / target->height);
+		float upscale = 1.0f - (float)renderWidth / std::max(outputWidth, 1);
+		glUniform1f(sharpnessLoc, minScale < 1.0f ? sharpness * std::min(std::max(upscale / (1.0f - minScale), 0.0f), 1.0f) : 0.0f);
+		glActiveTexture(GL_TEXTURE0 + SCENE_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, target->colorTexture);
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+private:
+	unsigned int emptyVAO = 0;
+	int uvScaleLoc = -1;
+	int texelSizeLoc = -1;
+	int sharpnessLoc = -1;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef FRAME_MEMORY_H
+#define FRAME_MEMORY_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+// Transient memory for data that only lives for one frame: a CPU bump allocator and a GPU ring of
+// per-frame regions. Neither frees anything individually, a frame's memory is reclaimed all at once.
+
+// Bump allocator reset every frame. Allocations come out of one block; when a frame needs more, another
+// block is taken from the heap and at the next reset the blocks are replaced by one that fits the
+// whole frame, so after the first frames the hot loop does no heap allocations at all.
+// Nothing is destructed, only trivially destructible types belong in here.
+class FrameArena
+{
+public:
+	// since the last reset()
+	size_t allocations = 0;
+	size_t bytesUsed = 0;
+	// since construction: blocks taken from the heap, and the most one frame used
+	size_t heapAllocations = 0;
+	size_t highWater = 0;
+
+	explicit FrameArena(size_t capacity = 256 * 1024)
+	{
+		blocks.reserve(8);
+		addBlock(capacity);
+	}
+
+	~FrameArena()
+	{
+		for (Block& block : blocks)
+			::operator delete(block.data);
+	}
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// `alignment` must be a power of two
+	void* allocate(size_t bytes, size_t alignment = 16)
+	{
+		allocations++;
+		Block* block = &blocks.back();
+		size_t offset = alignOffset(*block, alignment);
+		if (offset + bytes > block->size)
+		{
+			addBlock(std::max(bytes + alignment, block->size * 2));
+			block = &blocks.back();
+			offset = alignOffset(*block, alignment);
+		}
+		block->used = offset + bytes;
+		bytesUsed += bytes;
+		return block->data + offset;
+	}
+
+	template <typename T>
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+	}
+
+	// frees everything allocated since the last reset
+	void reset()
+	{
+		highWater = std::max(highWater, bytesUsed);
+		if (blocks.size() > 1)
+		{
+			size_t total = 0;
+			for (Block& block : blocks)
+			{
+				total += block.size;
+				::operator delete(block.data);
+			}
+			blocks.clear();
+			addBlock(total);
+		}
+		blocks.back().used = 0;
+		allocations = 0;
+		bytesUsed = 0;
+	}
+
+private:
+	struct Block
+	{
+		char* data;
+		size_t size;
+		size_t used;
+	};
+
+	std::vector<Block> blocks;
+
+	void addBlock(size_t size)
+	{
+		Block block = { (char*)::operator new(size), size, 0 };
+		blocks.push_back(block);
+		heapAllocations++;
+	}
+
+	static size_t alignOffset(const Block& block, size_t alignment)
+	{
+		uintptr_t address = (uintptr_t)(block.data + block.used);
+		return block.used + (((address + alignment - 1) & ~(uintptr_t)(alignment - 1)) - address);
+	}
+};
+
+// A sub-allocation of the ring: where to write it, and where the GPU will read it
+struct GpuAllocation
+{
+	void* data;
+	GLintptr offset;
+	size_t size;
+};
+
+// One buffer object split into FRAME_COUNT regions, one per frame in flight. A frame writes its
+// transient vertex, instance and uniform data into its region and fences it after the draws; the
+// region is reused FRAME_COUNT frames later, after that fence, so writes never race the GPU and the
+// driver never has to orphan or reallocate anything. The buffer stays persistently mapped with
+// GL 4.4 / ARB_buffer_storage; older contexts map the frame's region unsynchronized (the fence is the
+// synchronization) and unmap it in flush().
+class GpuRingBuffer
+{
+public:
+	static const int FRAME_COUNT = 3;
+
+	unsigned int ID = 0;
+	size_t regionSize;
+	// true when the persistently mapped path is in use
+	bool persistent = false;
+	// since beginFrame()
+	size_t allocations = 0;
+	size_t bytesUsed = 0;
+	// since construction: frames that had to wait for the GPU to release their region, and
+	// allocations that did not fit in a region
+	size_t fenceWaits = 0;
+	size_t overflows = 0;
+
+	explicit GpuRingBuffer(size_t regionSize) : regionSize(regionSize)
+	{
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		uniformAlignment = std::max<size_t>((size_t)alignment, 16);
+		// regions start on a uniform offset boundary
+		this->regionSize = (regionSize + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+		size_t totalSize = this->regionSize * FRAME_COUNT;
+
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+#if defined(GL_VERSION_4_4)
+		persistent = GLAD_GL_VERSION_4_4 != 0;
+#endif
+#if defined(GL_ARB_buffer_storage)
+		persistent = persistent || GLAD_GL_ARB_buffer_storage != 0;
+#endif
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, NULL, flags);
+			mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+			if (!mapped)
+			{
+				// immutable storage can't be respecified, start over with a new buffer
+				glDeleteBuffers(1, &ID);
+				glGenBuffers(1, &ID);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+				persistent = false;
+			}
+		}
+#endif
+		if (!persistent)
+			glBufferData(GL_COPY_WRITE_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	~GpuRingBuffer()
+	{
+		for (int i = 0; i < FRAME_COUNT; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+		}
+		if (mapped || (!persistent && frameData))
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &ID);
+	}
+
+	GpuRingBuffer(const GpuRingBuffer&) = delete;
+	GpuRingBuffer& operator=(const GpuRingBuffer&) = delete;
+
+	// waits for the GPU to finish with this frame's region (used FRAME_COUNT frames ago) and opens it
+	void beginFrame()
+	{
+		GLsync& fence = fences[region];
+		if (fence)
+		{
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			{
+				fenceWaits++;
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			}
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		used = 0;
+		allocations = 0;
+		bytesUsed = 0;
+		if (persistent)
+			frameData = mapped + region * regionSize;
+		else
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+			frameData = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, region * regionSize, regionSize,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+	}
+
+	// `bytes` from this frame's region, `data` is NULL when the region is full or already flushed
+	GpuAllocation allocate(size_t bytes, size_t alignment = 16)
+	{
+		GpuAllocation allocation = { NULL, 0, bytes };
+		size_t offset = (used + alignment - 1) / alignment * alignment;
+		if (!frameData || offset + bytes > regionSize)
+		{
+			if (overflows++ == 0)
+				std::cout << "ERROR::GPU_RING_BUFFER::OUT_OF_SPACE " << bytes << " bytes requested, region is " << regionSize << std::endl;
+			return allocation;
+		}
+		used = offset + bytes;
+		allocations++;
+		bytesUsed += bytes;
+		allocation.data = frameData + offset;
+		allocation.offset = (GLintptr)(region * regionSize + offset);
+		return allocation;
+	}
+
+	// aligned for glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+	GpuAllocation allocateUniform(size_t bytes)
+	{
+		return allocate(bytes, uniformAlignment);
+	}
+
+	// makes this frame's writes visible to the GPU, call before the draws that read them. The region
+	// takes no more allocations afterwards (the mapping is coherent, but the other path unmaps here)
+	void flush()
+	{
+		if (!persistent && frameData)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		frameData = NULL;
+	}
+
+	// fences the region behind this frame's draws and moves on to the next one
+	void endFrame()
+	{
+		flush();
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region + 1) % FRAME_COUNT;
+	}
+
+private:
+	char* mapped = NULL;
+	// start of the current frame's region while it is writable
+	char* frameData = NULL;
+	size_t uniformAlignment = 256;
+	size_t used = 0;
+	int region = 0;
+	GLsync fences[FRAME_COUNT] = {};
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <ostream>
+#include <chrono>
+#include <utility>
+
+// Wall clock in milliseconds, independent of GLFW so it also works in headless runs
+inline double nowMs()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Measures GPU time per frame with GL_TIME_ELAPSED queries. Queries are kept in a ring and read
+// back QUERY_LATENCY frames later, so reading a result never waits on the GPU mid-run.
+// The first QUERY_LATENCY frames are not reported: some drivers (llvmpipe) return a meaningless
+// elapsed time for the very first query, and those frames time startup work anyway.
+class GpuFrameTimer
+{
+public:
+	static const int QUERY_LATENCY = 4;
+	// a frame's GPU time above this is a bogus result, not a slow frame
+	static const int MAX_PLAUSIBLE_MS = 10000;
+
+	// results dropped as implausible
+	int rejectedSamples = 0;
+
+	GpuFrameTimer()
+	{
+		glGenQueries(QUERY_LATENCY, queries);
+	}
+
+	~GpuFrameTimer()
+	{
+		glDeleteQueries(QUERY_LATENCY, queries);
+	}
+
+	GpuFrameTimer(const GpuFrameTimer&) = delete;
+	GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+	void begin(int frame)
+	{
+		int slot = frame % QUERY_LATENCY;
+		queryFrame[slot] = frame;
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+	}
+
+	void end()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+
+	// reads back the query that is about to be reused by `frame`. Returns false if that slot was never used,
+	// holds a warm-up frame or an implausible result.
+	bool collect(int frame, int& resultFrame, double& gpuMs)
+	{
+		int slot = frame % QUERY_LATENCY;
+		if (queryFrame[slot] < 0)
+			return false;
+		resultFrame = queryFrame[slot];
+		queryFrame[slot] = -1;
+		if (resultFrame < QUERY_LATENCY)
+			return false;
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+		gpuMs = elapsed / 1.0e6;
+		if (gpuMs > MAX_PLAUSIBLE_MS)
+		{
+			rejectedSamples++;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	unsigned int queries[QUERY_LATENCY];
+	int queryFrame[QUERY_LATENCY] = { -1, -1, -1, -1 };
+};
+
+// Per-frame timings of a benchmark run and their summary as JSON
+class FrameStats
+{
+public:
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	std::vector<double> frameMs;
+	// whether gpuMs of a frame was measured, the GPU summary only covers those
+	std::vector<bool> gpuMeasured;
+	// one-off measurements of the run (startup costs etc.), written as top level fields
+	std::vector<std::pair<std::string, double>> metrics;
+
+	void addFrame(double cpu, double frame)
+	{
+		cpuMs.push_back(cpu);
+		frameMs.push_back(frame);
+		gpuMs.push_back(0.0);
+		gpuMeasured.push_back(false);
+	}
+
+	void setGpu(int frame, double gpu)
+	{
+		if (frame >= 0 && frame < (int)gpuMs.size())
+		{
+			gpuMs[frame] = gpu;
+			gpuMeasured[frame] = true;
+		}
+	}
+
+	// nearest-rank percentile, p in [0, 100]
+	static double percentile(std::vector<double> values, double p)
+	{
+		if (values.empty())
+			return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t rank = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+		return values[std::min(rank, values.size() - 1)];
+	}
+
+	void writeJson(std::ostream& out, const std::string& renderer, int width, int height) const
+	{
+		out << "{\n";
+		out << "  \"renderer\": \"" << renderer << "\",\n";
+		out << "  \"width\": " << width << ",\n";
+		out << "  \"height\": " << height << ",\n";
+		out << "  \"frames\": " << cpuMs.size() << ",\n";
+		for (const std::pair<std::string, double>& metric : metrics)
+			out << "  \"" << metric.first << "\": " << metric.second << ",\n";
+		writeSummary(out, "cpu_ms", cpuMs);
+		std::vector<double> measuredGpuMs;
+		for (size_t i = 0; i < gpuMs.size(); i++)
+		{
+			if (gpuMeasured[i])
+				measuredGpuMs.push_back(gpuMs[i]);
+		}
+		out << "  \"gpu_frames\": " << measuredGpuMs.size() << ",\n";
+		writeSummary(out, "gpu_ms", measuredGpuMs);
+		writeSummary(out, "frame_ms", frameMs);
+		out << "  \"per_frame\": [\n";
+		for (size_t i = 0; i < cpuMs.size(); i++)
+		{
+			out << "    { \"cpu_ms\": " << cpuMs[i] << ", \"gpu_ms\": ";
+			if (gpuMeasured[i])
+				out << gpuMs[i];
+			else
+				out << "null";
+			out << ", \"frame_ms\": " << frameMs[i] << " }";
+			out << (i + 1 < cpuMs.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n";
+		out << "}\n";
+	}
+
+private:
+	static void writeSummary(std::ostream& out, const char* name, const std::vector<double>& values)
+	{
+		double sum = 0.0, maximum = 0.0;
+		for (double v : values)
+		{
+			sum += v;
+			maximum = std::max(maximum, v);
+		}
+		out << "  \"" << name << "\": { ";
+		out << "\"mean\": " << (values.empty() ? 0.0 : sum / values.size()) << ", ";
+		out << "\"p50\": " << percentile(values, 50.0) << ", ";
+		out << "\"p95\": " << percentile(values, 95.0) << ", ";
+		out << "\"p99\": " << percentile(values, 99.0) << ", ";
+		out << "\"max\": " << maximum << " },\n";
+	}
+};
+
+#endif
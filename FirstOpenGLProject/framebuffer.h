@@ -0,0 +1,70 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+// Offscreen render target with a sampleable color texture and a depth/stencil renderbuffer
+class Framebuffer
+{
+public:
+	unsigned int ID = 0;
+	unsigned int colorTexture = 0;
+	unsigned int depthRenderbuffer = 0;
+	int width = 0;
+	int height = 0;
+
+	Framebuffer(int width, int height)
+	{
+		glGenFramebuffers(1, &ID);
+		glGenTextures(1, &colorTexture);
+		glGenRenderbuffers(1, &depthRenderbuffer);
+		resize(width, height);
+	}
+
+	~Framebuffer()
+	{
+		glDeleteFramebuffers(1, &ID);
+		glDeleteTextures(1, &colorTexture);
+		glDeleteRenderbuffers(1, &depthRenderbuffer);
+	}
+
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	// (re)allocates the attachments, the previous contents are lost
+	void resize(int newWidth, int newHeight)
+	{
+		width = newWidth;
+		height = newHeight;
+
+		glBindTexture(GL_TEXTURE_2D, colorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, ID);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER::NOT_COMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// render into this target
+	void bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, ID);
+		glViewport(0, 0, width, height);
+	}
+};
+
+#endif
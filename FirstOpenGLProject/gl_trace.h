@@ -0,0 +1,2108 @@
+#ifndef GL_TRACE_H
+#define GL_TRACE_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+
+#include "frame_stats.h"
+#include "mapped_file.h"
+#include "framebuffer.h"
+
+// GL call stream traces: GLCapture sits between the engine and glad and writes every GL call the
+// engine makes, with the buffer, texture and shader data it passes, to a binary trace. GLTraceReplayer
+// issues a trace again in another context as fast as it can, timing every frame.
+//
+// A trace is a GLTraceHeader followed by the calls. A call is its GLTraceCall id in one byte and its
+// arguments at fixed widths in the order of the GL signature: 32 bits for enums, names, integers and
+// floats, 64 bits for offsets and sizes, 8 bits for booleans. Data passed by pointer is a 32 bit
+// length (NO_DATA for NULL) and the bytes. Object names, uniform locations and syncs are stored as
+// the capturing driver returned them and mapped to the replaying driver's on replay.
+// TRACE_FRAME_END ends a frame, the calls before the first one are the load (setup, uploads).
+
+// append only, the values are the file format
+enum GLTraceCall : uint8_t
+{
+	TRACE_FRAME_END,
+	TRACE_ACTIVE_TEXTURE,
+	TRACE_ATTACH_SHADER,
+	TRACE_BEGIN_QUERY,
+	TRACE_BIND_BUFFER,
+	TRACE_BIND_BUFFER_RANGE,
+	TRACE_BIND_FRAMEBUFFER,
+	TRACE_BIND_RENDERBUFFER,
+	TRACE_BIND_TEXTURE,
+	TRACE_BIND_VERTEX_ARRAY,
+	TRACE_BUFFER_DATA,
+	TRACE_BUFFER_STORAGE,
+	TRACE_BUFFER_SUB_DATA,
+	TRACE_CHECK_FRAMEBUFFER_STATUS,
+	TRACE_CLEAR,
+	TRACE_CLEAR_COLOR,
+	TRACE_CLIENT_WAIT_SYNC,
+	TRACE_COMPILE_SHADER,
+	TRACE_COMPRESSED_TEX_IMAGE_3D,
+	TRACE_COPY_BUFFER_SUB_DATA,
+	TRACE_CREATE_PROGRAM,
+	TRACE_CREATE_SHADER,
+	TRACE_DELETE_BUFFERS,
+	TRACE_DELETE_FRAMEBUFFERS,
+	TRACE_DELETE_PROGRAM,
+	TRACE_DELETE_QUERIES,
+	TRACE_DELETE_RENDERBUFFERS,
+	TRACE_DELETE_SHADER,
+	TRACE_DELETE_SYNC,
+	TRACE_DELETE_TEXTURES,
+	TRACE_DELETE_VERTEX_ARRAYS,
+	TRACE_DISABLE,
+	TRACE_DRAW_ARRAYS,
+	TRACE_DRAW_ARRAYS_INSTANCED,
+	TRACE_DRAW_ELEMENTS,
+	TRACE_DRAW_ELEMENTS_INSTANCED,
+	TRACE_ENABLE,
+	TRACE_ENABLE_VERTEX_ATTRIB_ARRAY,
+	TRACE_END_QUERY,
+	TRACE_FENCE_SYNC,
+	TRACE_FLUSH,
+	TRACE_FRAMEBUFFER_RENDERBUFFER,
+	TRACE_FRAMEBUFFER_TEXTURE_2D,
+	TRACE_GEN_BUFFERS,
+	TRACE_GEN_FRAMEBUFFERS,
+	TRACE_GEN_QUERIES,
+	TRACE_GEN_RENDERBUFFERS,
+	TRACE_GEN_TEXTURES,
+	TRACE_GEN_VERTEX_ARRAYS,
+	TRACE_GENERATE_MIPMAP,
+	TRACE_GET_ACTIVE_UNIFORM,
+	TRACE_GET_INTEGER64_V,
+	TRACE_GET_INTEGER_V,
+	TRACE_GET_PROGRAM_INFO_LOG,
+	TRACE_GET_PROGRAM_IV,
+	TRACE_GET_QUERY_OBJECT_IV,
+	TRACE_GET_QUERY_OBJECT_UI64V,
+	TRACE_GET_SHADER_INFO_LOG,
+	TRACE_GET_SHADER_IV,
+	TRACE_GET_STRING,
+	TRACE_GET_UNIFORM_BLOCK_INDEX,
+	TRACE_GET_UNIFORM_LOCATION,
+	TRACE_LINK_PROGRAM,
+	TRACE_MAP_BUFFER_RANGE,
+	TRACE_PIXEL_STOREI,
+	TRACE_POLYGON_MODE,
+	TRACE_PROGRAM_PARAMETERI,
+	TRACE_QUERY_COUNTER,
+	TRACE_RENDERBUFFER_STORAGE,
+	TRACE_SHADER_SOURCE,
+	TRACE_TEX_BUFFER,
+	TRACE_TEX_IMAGE_2D,
+	TRACE_TEX_IMAGE_3D,
+	TRACE_TEX_PARAMETERI,
+	TRACE_UNIFORM_1F,
+	TRACE_UNIFORM_1I,
+	TRACE_UNIFORM_2F,
+	TRACE_UNIFORM_3F,
+	TRACE_UNIFORM_3FV,
+	TRACE_UNIFORM_BLOCK_BINDING,
+	TRACE_UNIFORM_MATRIX_4FV,
+	TRACE_UNMAP_BUFFER,
+	TRACE_USE_PROGRAM,
+	TRACE_VERTEX_ATTRIB_DIVISOR,
+	TRACE_VERTEX_ATTRIB_I_POINTER,
+	TRACE_VERTEX_ATTRIB_POINTER,
+	TRACE_VIEWPORT,
+	TRACE_CALL_COUNT
+};
+
+const char* const GL_TRACE_CALL_NAMES[TRACE_CALL_COUNT] = {
+	"frame_end", "glActiveTexture", "glAttachShader", "glBeginQuery", "glBindBuffer", "glBindBufferRange",
+	"glBindFramebuffer", "glBindRenderbuffer", "glBindTexture", "glBindVertexArray", "glBufferData",
+	"glBufferStorage", "glBufferSubData", "glCheckFramebufferStatus", "glClear", "glClearColor",
+	"glClientWaitSync", "glCompileShader", "glCompressedTexImage3D", "glCopyBufferSubData", "glCreateProgram",
+	"glCreateShader", "glDeleteBuffers", "glDeleteFramebuffers", "glDeleteProgram", "glDeleteQueries",
+	"glDeleteRenderbuffers", "glDeleteShader", "glDeleteSync", "glDeleteTextures", "glDeleteVertexArrays",
+	"glDisable", "glDrawArrays", "glDrawArraysInstanced", "glDrawElements", "glDrawElementsInstanced",
+	"glEnable", "glEnableVertexAttribArray", "glEndQuery", "glFenceSync", "glFlush",
+	"glFramebufferRenderbuffer", "glFramebufferTexture2D", "glGenBuffers", "glGenFramebuffers", "glGenQueries",
+	"glGenRenderbuffers", "glGenTextures", "glGenVertexArrays", "glGenerateMipmap", "glGetActiveUniform",
+	"glGetInteger64v", "glGetIntegerv", "glGetProgramInfoLog", "glGetProgramiv", "glGetQueryObjectiv",
+	"glGetQueryObjectui64v", "glGetShaderInfoLog", "glGetShaderiv", "glGetString", "glGetUniformBlockIndex",
+	"glGetUniformLocation", "glLinkProgram", "glMapBufferRange", "glPixelStorei", "glPolygonMode",
+	"glProgramParameteri", "glQueryCounter", "glRenderbufferStorage", "glShaderSource", "glTexBuffer",
+	"glTexImage2D", "glTexImage3D", "glTexParameteri", "glUniform1f", "glUniform1i", "glUniform2f", "glUniform3f",
+	"glUniform3fv", "glUniformBlockBinding", "glUniformMatrix4fv", "glUnmapBuffer", "glUseProgram",
+	"glVertexAttribDivisor", "glVertexAttribIPointer", "glVertexAttribPointer", "glViewport"
+};
+
+struct GLTraceHeader
+{
+	static const uint32_t MAGIC = 0x52544c47; // "GLTR"
+	static const uint32_t VERSION = 1;
+	static const uint32_t NO_DATA = 0xffffffffu;
+
+	uint32_t magic = MAGIC;
+	uint32_t version = VERSION;
+	// size of the default framebuffer when the capture started
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// filled in when the capture stops, 0 if it never did
+	uint32_t frames = 0;
+	uint32_t reserved = 0;
+	uint64_t calls = 0;
+};
+
+// Records the engine's GL calls. start() saves glad's function pointers for every call the engine
+// makes and points them at wrappers that call the driver and then append the call to the trace, so a
+// GL call the engine starts making has to be added here (and to the replayer) to be captured.
+// While capturing, persistently mapped buffers and program binaries are hidden from the engine:
+// every write into a mapping then ends with glUnmapBuffer, where the written bytes are recorded, and
+// programs are compiled from source, so the trace replays on any driver.
+class GLCapture
+{
+public:
+	static inline bool active = false;
+	static inline uint64_t calls = 0;
+	static inline uint64_t bytes = 0;
+	static inline uint32_t frames = 0;
+
+	// starts writing `path`, call right after loading glad, before anything else touches GL
+	static bool start(const char* path, int width, int height)
+	{
+		file.open(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			std::cout << "ERROR::GL_CAPTURE::OPEN_FAILED " << path << std::endl;
+			return false;
+		}
+		header = GLTraceHeader();
+		header.width = (uint32_t)width;
+		header.height = (uint32_t)height;
+		file.write((const char*)&header, sizeof(header));
+		bytes = sizeof(header);
+		buffer.reserve(FLUSH_BYTES + 4096);
+		install();
+#if defined(GL_VERSION_4_4)
+		GLAD_GL_VERSION_4_4 = 0;
+#endif
+#if defined(GL_ARB_buffer_storage)
+		GLAD_GL_ARB_buffer_storage = 0;
+#endif
+		active = true;
+		return true;
+	}
+
+	// ends a frame, the first call ends the load
+	static void endFrame()
+	{
+		if (!active)
+			return;
+		record(TRACE_FRAME_END);
+		frames++;
+		if (buffer.size() >= FLUSH_BYTES)
+			flush();
+	}
+
+	// writes out the rest and the final header. The driver's function pointers stay installed
+	static void stop()
+	{
+		if (!active)
+			return;
+		flush();
+		header.frames = frames;
+		header.calls = calls;
+		file.seekp(0);
+		file.write((const char*)&header, sizeof(header));
+		file.close();
+		if (!file)
+			std::cout << "ERROR::GL_CAPTURE::WRITE_FAILED" << std::endl;
+		uninstall();
+		active = false;
+	}
+
+private:
+	static const size_t FLUSH_BYTES = 1 << 20;
+
+	static inline std::ofstream file;
+	static inline GLTraceHeader header;
+	static inline std::vector<uint8_t> buffer;
+	// what the engine believes is bound, to find the buffer behind a mapping and the unpack buffer
+	static inline std::unordered_map<GLenum, GLuint> boundBuffers;
+	static inline GLint unpackAlignment = 4;
+	// mapped buffers: the driver's pointer and the zeroed copy the engine writes into instead
+	struct Mapping
+	{
+		void* driver = NULL;
+		std::vector<uint8_t> shadow;
+	};
+	static inline std::unordered_map<GLuint, Mapping> mappings;
+	static inline std::unordered_map<GLsync, uint32_t> syncIds;
+	static inline uint32_t nextSyncId = 1;
+
+	// the driver's entry points
+	struct Driver
+	{
+		PFNGLACTIVETEXTUREPROC ActiveTexture;
+		PFNGLATTACHSHADERPROC AttachShader;
+		PFNGLBEGINQUERYPROC BeginQuery;
+		PFNGLBINDBUFFERPROC BindBuffer;
+		PFNGLBINDBUFFERRANGEPROC BindBufferRange;
+		PFNGLBINDFRAMEBUFFERPROC BindFramebuffer;
+		PFNGLBINDRENDERBUFFERPROC BindRenderbuffer;
+		PFNGLBINDTEXTUREPROC BindTexture;
+		PFNGLBINDVERTEXARRAYPROC BindVertexArray;
+		PFNGLBUFFERDATAPROC BufferData;
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		PFNGLBUFFERSTORAGEPROC BufferStorage;
+#endif
+		PFNGLBUFFERSUBDATAPROC BufferSubData;
+		PFNGLCHECKFRAMEBUFFERSTATUSPROC CheckFramebufferStatus;
+		PFNGLCLEARPROC Clear;
+		PFNGLCLEARCOLORPROC ClearColor;
+		PFNGLCLIENTWAITSYNCPROC ClientWaitSync;
+		PFNGLCOMPILESHADERPROC CompileShader;
+		PFNGLCOMPRESSEDTEXIMAGE3DPROC CompressedTexImage3D;
+		PFNGLCOPYBUFFERSUBDATAPROC CopyBufferSubData;
+		PFNGLCREATEPROGRAMPROC CreateProgram;
+		PFNGLCREATESHADERPROC CreateShader;
+		PFNGLDELETEBUFFERSPROC DeleteBuffers;
+		PFNGLDELETEFRAMEBUFFERSPROC DeleteFramebuffers;
+		PFNGLDELETEPROGRAMPROC DeleteProgram;
+		PFNGLDELETEQUERIESPROC DeleteQueries;
+		PFNGLDELETERENDERBUFFERSPROC DeleteRenderbuffers;
+		PFNGLDELETESHADERPROC DeleteShader;
+		PFNGLDELETESYNCPROC DeleteSync;
+		PFNGLDELETETEXTURESPROC DeleteTextures;
+		PFNGLDELETEVERTEXARRAYSPROC DeleteVertexArrays;
+		PFNGLDISABLEPROC Disable;
+		PFNGLDRAWARRAYSPROC DrawArrays;
+		PFNGLDRAWARRAYSINSTANCEDPROC DrawArraysInstanced;
+		PFNGLDRAWELEMENTSPROC DrawElements;
+		PFNGLDRAWELEMENTSINSTANCEDPROC DrawElementsInstanced;
+		PFNGLENABLEPROC Enable;
+		PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+		PFNGLENDQUERYPROC EndQuery;
+		PFNGLFENCESYNCPROC FenceSync;
+		PFNGLFLUSHPROC Flush;
+		PFNGLFRAMEBUFFERRENDERBUFFERPROC FramebufferRenderbuffer;
+		PFNGLFRAMEBUFFERTEXTURE2DPROC FramebufferTexture2D;
+		PFNGLGENBUFFERSPROC GenBuffers;
+		PFNGLGENFRAMEBUFFERSPROC GenFramebuffers;
+		PFNGLGENQUERIESPROC GenQueries;
+		PFNGLGENRENDERBUFFERSPROC GenRenderbuffers;
+		PFNGLGENTEXTURESPROC GenTextures;
+		PFNGLGENVERTEXARRAYSPROC GenVertexArrays;
+		PFNGLGENERATEMIPMAPPROC GenerateMipmap;
+		PFNGLGETACTIVEUNIFORMPROC GetActiveUniform;
+		PFNGLGETINTEGER64VPROC GetInteger64v;
+		PFNGLGETINTEGERVPROC GetIntegerv;
+		PFNGLGETPROGRAMINFOLOGPROC GetProgramInfoLog;
+		PFNGLGETPROGRAMIVPROC GetProgramiv;
+		PFNGLGETQUERYOBJECTIVPROC GetQueryObjectiv;
+		PFNGLGETQUERYOBJECTUI64VPROC GetQueryObjectui64v;
+		PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog;
+		PFNGLGETSHADERIVPROC GetShaderiv;
+		PFNGLGETSTRINGPROC GetString;
+		PFNGLGETUNIFORMBLOCKINDEXPROC GetUniformBlockIndex;
+		PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+		PFNGLLINKPROGRAMPROC LinkProgram;
+		PFNGLMAPBUFFERRANGEPROC MapBufferRange;
+		PFNGLPIXELSTOREIPROC PixelStorei;
+		PFNGLPOLYGONMODEPROC PolygonMode;
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+		PFNGLPROGRAMPARAMETERIPROC ProgramParameteri;
+#endif
+		PFNGLQUERYCOUNTERPROC QueryCounter;
+		PFNGLRENDERBUFFERSTORAGEPROC RenderbufferStorage;
+		PFNGLSHADERSOURCEPROC ShaderSource;
+		PFNGLTEXBUFFERPROC TexBuffer;
+		PFNGLTEXIMAGE2DPROC TexImage2D;
+		PFNGLTEXIMAGE3DPROC TexImage3D;
+		PFNGLTEXPARAMETERIPROC TexParameteri;
+		PFNGLUNIFORM1FPROC Uniform1f;
+		PFNGLUNIFORM1IPROC Uniform1i;
+		PFNGLUNIFORM2FPROC Uniform2f;
+		PFNGLUNIFORM3FPROC Uniform3f;
+		PFNGLUNIFORM3FVPROC Uniform3fv;
+		PFNGLUNIFORMBLOCKBINDINGPROC UniformBlockBinding;
+		PFNGLUNIFORMMATRIX4FVPROC UniformMatrix4fv;
+		PFNGLUNMAPBUFFERPROC UnmapBuffer;
+		PFNGLUSEPROGRAMPROC UseProgram;
+		PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+		PFNGLVERTEXATTRIBIPOINTERPROC VertexAttribIPointer;
+		PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+		PFNGLVIEWPORTPROC Viewport;
+	};
+	static inline Driver gl;
+
+// swaps glad's pointer for `name` with the wrapper of the same name (or back, with the arguments reversed)
+#define GL_CAPTURE_HOOK(name) gl.name = glad_gl##name; glad_gl##name = name
+#define GL_CAPTURE_UNHOOK(name) glad_gl##name = gl.name
+
+	static void install()
+	{
+		GL_CAPTURE_HOOK(ActiveTexture);
+		GL_CAPTURE_HOOK(AttachShader);
+		GL_CAPTURE_HOOK(BeginQuery);
+		GL_CAPTURE_HOOK(BindBuffer);
+		GL_CAPTURE_HOOK(BindBufferRange);
+		GL_CAPTURE_HOOK(BindFramebuffer);
+		GL_CAPTURE_HOOK(BindRenderbuffer);
+		GL_CAPTURE_HOOK(BindTexture);
+		GL_CAPTURE_HOOK(BindVertexArray);
+		GL_CAPTURE_HOOK(BufferData);
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		GL_CAPTURE_HOOK(BufferStorage);
+#endif
+		GL_CAPTURE_HOOK(BufferSubData);
+		GL_CAPTURE_HOOK(CheckFramebufferStatus);
+		GL_CAPTURE_HOOK(Clear);
+		GL_CAPTURE_HOOK(ClearColor);
+		GL_CAPTURE_HOOK(ClientWaitSync);
+		GL_CAPTURE_HOOK(CompileShader);
+		GL_CAPTURE_HOOK(CompressedTexImage3D);
+		GL_CAPTURE_HOOK(CopyBufferSubData);
+		GL_CAPTURE_HOOK(CreateProgram);
+		GL_CAPTURE_HOOK(CreateShader);
+		GL_CAPTURE_HOOK(DeleteBuffers);
+		GL_CAPTURE_HOOK(DeleteFramebuffers);
+		GL_CAPTURE_HOOK(DeleteProgram);
+		GL_CAPTURE_HOOK(DeleteQueries);
+		GL_CAPTURE_HOOK(DeleteRenderbuffers);
+		GL_CAPTURE_HOOK(DeleteShader);
+		GL_CAPTURE_HOOK(DeleteSync);
+		GL_CAPTURE_HOOK(DeleteTextures);
+		GL_CAPTURE_HOOK(DeleteVertexArrays);
+		GL_CAPTURE_HOOK(Disable);
+		GL_CAPTURE_HOOK(DrawArrays);
+		GL_CAPTURE_HOOK(DrawArraysInstanced);
+		GL_CAPTURE_HOOK(DrawElements);
+		GL_CAPTURE_HOOK(DrawElementsInstanced);
+		GL_CAPTURE_HOOK(Enable);
+		GL_CAPTURE_HOOK(EnableVertexAttribArray);
+		GL_CAPTURE_HOOK(EndQuery);
+		GL_CAPTURE_HOOK(FenceSync);
+		GL_CAPTURE_HOOK(Flush);
+		GL_CAPTURE_HOOK(FramebufferRenderbuffer);
+		GL_CAPTURE_HOOK(FramebufferTexture2D);
+		GL_CAPTURE_HOOK(GenBuffers);
+		GL_CAPTURE_HOOK(GenFramebuffers);
+		GL_CAPTURE_HOOK(GenQueries);
+		GL_CAPTURE_HOOK(GenRenderbuffers);
+		GL_CAPTURE_HOOK(GenTextures);
+		GL_CAPTURE_HOOK(GenVertexArrays);
+		GL_CAPTURE_HOOK(GenerateMipmap);
+		GL_CAPTURE_HOOK(GetActiveUniform);
+		GL_CAPTURE_HOOK(GetInteger64v);
+		GL_CAPTURE_HOOK(GetIntegerv);
+		GL_CAPTURE_HOOK(GetProgramInfoLog);
+		GL_CAPTURE_HOOK(GetProgramiv);
+		GL_CAPTURE_HOOK(GetQueryObjectiv);
+		GL_CAPTURE_HOOK(GetQueryObjectui64v);
+		GL_CAPTURE_HOOK(GetShaderInfoLog);
+		GL_CAPTURE_HOOK(GetShaderiv);
+		GL_CAPTURE_HOOK(GetString);
+		GL_CAPTURE_HOOK(GetUniformBlockIndex);
+		GL_CAPTURE_HOOK(GetUniformLocation);
+		GL_CAPTURE_HOOK(LinkProgram);
+		GL_CAPTURE_HOOK(MapBufferRange);
+		GL_CAPTURE_HOOK(PixelStorei);
+		GL_CAPTURE_HOOK(PolygonMode);
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+		GL_CAPTURE_HOOK(ProgramParameteri);
+#endif
+		GL_CAPTURE_HOOK(QueryCounter);
+		GL_CAPTURE_HOOK(RenderbufferStorage);
+		GL_CAPTURE_HOOK(ShaderSource);
+		GL_CAPTURE_HOOK(TexBuffer);
+		GL_CAPTURE_HOOK(TexImage2D);
+		GL_CAPTURE_HOOK(TexImage3D);
+		GL_CAPTURE_HOOK(TexParameteri);
+		GL_CAPTURE_HOOK(Uniform1f);
+		GL_CAPTURE_HOOK(Uniform1i);
+		GL_CAPTURE_HOOK(Uniform2f);
+		GL_CAPTURE_HOOK(Uniform3f);
+		GL_CAPTURE_HOOK(Uniform3fv);
+		GL_CAPTURE_HOOK(UniformBlockBinding);
+		GL_CAPTURE_HOOK(UniformMatrix4fv);
+		GL_CAPTURE_HOOK(UnmapBuffer);
+		GL_CAPTURE_HOOK(UseProgram);
+		GL_CAPTURE_HOOK(VertexAttribDivisor);
+		GL_CAPTURE_HOOK(VertexAttribIPointer);
+		GL_CAPTURE_HOOK(VertexAttribPointer);
+		GL_CAPTURE_HOOK(Viewport);
+	}
+
+	static void uninstall()
+	{
+		GL_CAPTURE_UNHOOK(ActiveTexture);
+		GL_CAPTURE_UNHOOK(AttachShader);
+		GL_CAPTURE_UNHOOK(BeginQuery);
+		GL_CAPTURE_UNHOOK(BindBuffer);
+		GL_CAPTURE_UNHOOK(BindBufferRange);
+		GL_CAPTURE_UNHOOK(BindFramebuffer);
+		GL_CAPTURE_UNHOOK(BindRenderbuffer);
+		GL_CAPTURE_UNHOOK(BindTexture);
+		GL_CAPTURE_UNHOOK(BindVertexArray);
+		GL_CAPTURE_UNHOOK(BufferData);
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		GL_CAPTURE_UNHOOK(BufferStorage);
+#endif
+		GL_CAPTURE_UNHOOK(BufferSubData);
+		GL_CAPTURE_UNHOOK(CheckFramebufferStatus);
+		GL_CAPTURE_UNHOOK(Clear);
+		GL_CAPTURE_UNHOOK(ClearColor);
+		GL_CAPTURE_UNHOOK(ClientWaitSync);
+		GL_CAPTURE_UNHOOK(CompileShader);
+		GL_CAPTURE_UNHOOK(CompressedTexImage3D);
+		GL_CAPTURE_UNHOOK(CopyBufferSubData);
+		GL_CAPTURE_UNHOOK(CreateProgram);
+		GL_CAPTURE_UNHOOK(CreateShader);
+		GL_CAPTURE_UNHOOK(DeleteBuffers);
+		GL_CAPTURE_UNHOOK(DeleteFramebuffers);
+		GL_CAPTURE_UNHOOK(DeleteProgram);
+		GL_CAPTURE_UNHOOK(DeleteQueries);
+		GL_CAPTURE_UNHOOK(DeleteRenderbuffers);
+		GL_CAPTURE_UNHOOK(DeleteShader);
+		GL_CAPTURE_UNHOOK(DeleteSync);
+		GL_CAPTURE_UNHOOK(DeleteTextures);
+		GL_CAPTURE_UNHOOK(DeleteVertexArrays);
+		GL_CAPTURE_UNHOOK(Disable);
+		GL_CAPTURE_UNHOOK(DrawArrays);
+		GL_CAPTURE_UNHOOK(DrawArraysInstanced);
+		GL_CAPTURE_UNHOOK(DrawElements);
+		GL_CAPTURE_UNHOOK(DrawElementsInstanced);
+		GL_CAPTURE_UNHOOK(Enable);
+		GL_CAPTURE_UNHOOK(EnableVertexAttribArray);
+		GL_CAPTURE_UNHOOK(EndQuery);
+		GL_CAPTURE_UNHOOK(FenceSync);
+		GL_CAPTURE_UNHOOK(Flush);
+		GL_CAPTURE_UNHOOK(FramebufferRenderbuffer);
+		GL_CAPTURE_UNHOOK(FramebufferTexture2D);
+		GL_CAPTURE_UNHOOK(GenBuffers);
+		GL_CAPTURE_UNHOOK(GenFramebuffers);
+		GL_CAPTURE_UNHOOK(GenQueries);
+		GL_CAPTURE_UNHOOK(GenRenderbuffers);
+		GL_CAPTURE_UNHOOK(GenTextures);
+		GL_CAPTURE_UNHOOK(GenVertexArrays);
+		GL_CAPTURE_UNHOOK(GenerateMipmap);
+		GL_CAPTURE_UNHOOK(GetActiveUniform);
+		GL_CAPTURE_UNHOOK(GetInteger64v);
+		GL_CAPTURE_UNHOOK(GetIntegerv);
+		GL_CAPTURE_UNHOOK(GetProgramInfoLog);
+		GL_CAPTURE_UNHOOK(GetProgramiv);
+		GL_CAPTURE_UNHOOK(GetQueryObjectiv);
+		GL_CAPTURE_UNHOOK(GetQueryObjectui64v);
+		GL_CAPTURE_UNHOOK(GetShaderInfoLog);
+		GL_CAPTURE_UNHOOK(GetShaderiv);
+		GL_CAPTURE_UNHOOK(GetString);
+		GL_CAPTURE_UNHOOK(GetUniformBlockIndex);
+		GL_CAPTURE_UNHOOK(GetUniformLocation);
+		GL_CAPTURE_UNHOOK(LinkProgram);
+		GL_CAPTURE_UNHOOK(MapBufferRange);
+		GL_CAPTURE_UNHOOK(PixelStorei);
+		GL_CAPTURE_UNHOOK(PolygonMode);
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+		GL_CAPTURE_UNHOOK(ProgramParameteri);
+#endif
+		GL_CAPTURE_UNHOOK(QueryCounter);
+		GL_CAPTURE_UNHOOK(RenderbufferStorage);
+		GL_CAPTURE_UNHOOK(ShaderSource);
+		GL_CAPTURE_UNHOOK(TexBuffer);
+		GL_CAPTURE_UNHOOK(TexImage2D);
+		GL_CAPTURE_UNHOOK(TexImage3D);
+		GL_CAPTURE_UNHOOK(TexParameteri);
+		GL_CAPTURE_UNHOOK(Uniform1f);
+		GL_CAPTURE_UNHOOK(Uniform1i);
+		GL_CAPTURE_UNHOOK(Uniform2f);
+		GL_CAPTURE_UNHOOK(Uniform3f);
+		GL_CAPTURE_UNHOOK(Uniform3fv);
+		GL_CAPTURE_UNHOOK(UniformBlockBinding);
+		GL_CAPTURE_UNHOOK(UniformMatrix4fv);
+		GL_CAPTURE_UNHOOK(UnmapBuffer);
+		GL_CAPTURE_UNHOOK(UseProgram);
+		GL_CAPTURE_UNHOOK(VertexAttribDivisor);
+		GL_CAPTURE_UNHOOK(VertexAttribIPointer);
+		GL_CAPTURE_UNHOOK(VertexAttribPointer);
+		GL_CAPTURE_UNHOOK(Viewport);
+	}
+
+#undef GL_CAPTURE_HOOK
+#undef GL_CAPTURE_UNHOOK
+
+	static void flush()
+	{
+		file.write((const char*)buffer.data(), buffer.size());
+		buffer.clear();
+	}
+
+	static void put(const void* data, size_t size)
+	{
+		const uint8_t* bytesIn = (const uint8_t*)data;
+		buffer.insert(buffer.end(), bytesIn, bytesIn + size);
+		bytes += size;
+	}
+
+	template<typename T>
+	static void put(T value)
+	{
+		put(&value, sizeof(T));
+	}
+
+	// the call id, then each argument at the width of its type
+	template<typename... T>
+	static void record(GLTraceCall call, T... arguments)
+	{
+		calls++;
+		put((uint8_t)call);
+		(put(arguments), ...);
+	}
+
+	static void putData(const void* data, size_t size)
+	{
+		put(data ? (uint32_t)size : GLTraceHeader::NO_DATA);
+		if (data)
+			put(data, size);
+	}
+
+	static void putNames(GLsizei n, const GLuint* names)
+	{
+		put((uint32_t)n);
+		put(names, n * sizeof(GLuint));
+	}
+
+	// texture data comes from the bound unpack buffer at an offset, or from client memory
+	static void putPixels(const void* pixels, size_t size)
+	{
+		if (boundBuffers[GL_PIXEL_UNPACK_BUFFER] != 0)
+		{
+			put((uint8_t)1);
+			put((int64_t)(intptr_t)pixels);
+		}
+		else
+		{
+			put((uint8_t)0);
+			putData(pixels, size);
+		}
+	}
+
+	// bytes of a width x height x depth upload in client memory, rows padded to GL_UNPACK_ALIGNMENT
+	static size_t pixelBytes(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth)
+	{
+		size_t pixel;
+		switch (type)
+		{
+		case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_10F_11F_11F_REV:
+			pixel = 4;
+			break;
+		case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_5_5_5_1:
+			pixel = 2;
+			break;
+		default:
+		{
+			size_t components = 1;
+			if (format == GL_RG || format == GL_RG_INTEGER)
+				components = 2;
+			else if (format == GL_RGB || format == GL_BGR || format == GL_RGB_INTEGER)
+				components = 3;
+			else if (format == GL_RGBA || format == GL_BGRA || format == GL_RGBA_INTEGER)
+				components = 4;
+			size_t component = 1;
+			if (type == GL_SHORT || type == GL_UNSIGNED_SHORT || type == GL_HALF_FLOAT)
+				component = 2;
+			else if (type == GL_INT || type == GL_UNSIGNED_INT || type == GL_FLOAT)
+				component = 4;
+			pixel = components * component;
+		}
+		}
+		size_t row = (width * pixel + unpackAlignment - 1) / unpackAlignment * unpackAlignment;
+		return row * height * depth;
+	}
+
+	static GLuint mappedBuffer(GLenum target)
+	{
+		auto it = boundBuffers.find(target);
+		return it != boundBuffers.end() ? it->second : 0;
+	}
+
+	static uint32_t syncId(GLsync sync)
+	{
+		auto it = syncIds.find(sync);
+		return it != syncIds.end() ? it->second : 0;
+	}
+
+	// wrappers, each calls the driver and then records the call
+
+	static void APIENTRY ActiveTexture(GLenum texture)
+	{
+		gl.ActiveTexture(texture);
+		record(TRACE_ACTIVE_TEXTURE, texture);
+	}
+
+	static void APIENTRY AttachShader(GLuint program, GLuint shader)
+	{
+		gl.AttachShader(program, shader);
+		record(TRACE_ATTACH_SHADER, program, shader);
+	}
+
+	static void APIENTRY BeginQuery(GLenum target, GLuint id)
+	{
+		gl.BeginQuery(target, id);
+		record(TRACE_BEGIN_QUERY, target, id);
+	}
+
+	static void APIENTRY BindBuffer(GLenum target, GLuint buffer)
+	{
+		gl.BindBuffer(target, buffer);
+		boundBuffers[target] = buffer;
+		record(TRACE_BIND_BUFFER, target, buffer);
+	}
+
+	static void APIENTRY BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+	{
+		gl.BindBufferRange(target, index, buffer, offset, size);
+		// also binds the generic binding point
+		boundBuffers[target] = buffer;
+		record(TRACE_BIND_BUFFER_RANGE, target, index, buffer, (int64_t)offset, (int64_t)size);
+	}
+
+	static void APIENTRY BindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		gl.BindFramebuffer(target, framebuffer);
+		record(TRACE_BIND_FRAMEBUFFER, target, framebuffer);
+	}
+
+	static void APIENTRY BindRenderbuffer(GLenum target, GLuint renderbuffer)
+	{
+		gl.BindRenderbuffer(target, renderbuffer);
+		record(TRACE_BIND_RENDERBUFFER, target, renderbuffer);
+	}
+
+	static void APIENTRY BindTexture(GLenum target, GLuint texture)
+	{
+		gl.BindTexture(target, texture);
+		record(TRACE_BIND_TEXTURE, target, texture);
+	}
+
+	static void APIENTRY BindVertexArray(GLuint array)
+	{
+		gl.BindVertexArray(array);
+		record(TRACE_BIND_VERTEX_ARRAY, array);
+	}
+
+	static void APIENTRY BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		gl.BufferData(target, size, data, usage);
+		record(TRACE_BUFFER_DATA, target, (int64_t)size);
+		putData(data, (size_t)size);
+		put(usage);
+	}
+
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+	static void APIENTRY BufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+	{
+		gl.BufferStorage(target, size, data, flags);
+		record(TRACE_BUFFER_STORAGE, target, (int64_t)size);
+		putData(data, (size_t)size);
+		put(flags);
+	}
+#endif
+
+	static void APIENTRY BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		gl.BufferSubData(target, offset, size, data);
+		record(TRACE_BUFFER_SUB_DATA, target, (int64_t)offset, (int64_t)size);
+		putData(data, (size_t)size);
+	}
+
+	static GLenum APIENTRY CheckFramebufferStatus(GLenum target)
+	{
+		GLenum status = gl.CheckFramebufferStatus(target);
+		record(TRACE_CHECK_FRAMEBUFFER_STATUS, target);
+		return status;
+	}
+
+	static void APIENTRY Clear(GLbitfield mask)
+	{
+		gl.Clear(mask);
+		record(TRACE_CLEAR, mask);
+	}
+
+	static void APIENTRY ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+	{
+		gl.ClearColor(red, green, blue, alpha);
+		record(TRACE_CLEAR_COLOR, red, green, blue, alpha);
+	}
+
+	static GLenum APIENTRY ClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+	{
+		GLenum result = gl.ClientWaitSync(sync, flags, timeout);
+		record(TRACE_CLIENT_WAIT_SYNC, syncId(sync), flags, (uint64_t)timeout);
+		return result;
+	}
+
+	static void APIENTRY CompileShader(GLuint shader)
+	{
+		gl.CompileShader(shader);
+		record(TRACE_COMPILE_SHADER, shader);
+	}
+
+	static void APIENTRY CompressedTexImage3D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const void* data)
+	{
+		gl.CompressedTexImage3D(target, level, internalformat, width, height, depth, border, imageSize, data);
+		record(TRACE_COMPRESSED_TEX_IMAGE_3D, target, level, internalformat, width, height, depth, border, imageSize);
+		putPixels(data, (size_t)imageSize);
+	}
+
+	static void APIENTRY CopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
+	{
+		gl.CopyBufferSubData(readTarget, writeTarget, readOffset, writeOffset, size);
+		record(TRACE_COPY_BUFFER_SUB_DATA, readTarget, writeTarget, (int64_t)readOffset, (int64_t)writeOffset, (int64_t)size);
+	}
+
+	static GLuint APIENTRY CreateProgram()
+	{
+		GLuint program = gl.CreateProgram();
+		record(TRACE_CREATE_PROGRAM, program);
+		return program;
+	}
+
+	static GLuint APIENTRY CreateShader(GLenum type)
+	{
+		GLuint shader = gl.CreateShader(type);
+		record(TRACE_CREATE_SHADER, type, shader);
+		return shader;
+	}
+
+	static void APIENTRY DeleteBuffers(GLsizei n, const GLuint* buffers)
+	{
+		gl.DeleteBuffers(n, buffers);
+		record(TRACE_DELETE_BUFFERS);
+		putNames(n, buffers);
+		for (GLsizei i = 0; i < n; i++)
+			mappings.erase(buffers[i]);
+	}
+
+	static void APIENTRY DeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+	{
+		gl.DeleteFramebuffers(n, framebuffers);
+		record(TRACE_DELETE_FRAMEBUFFERS);
+		putNames(n, framebuffers);
+	}
+
+	static void APIENTRY DeleteProgram(GLuint program)
+	{
+		gl.DeleteProgram(program);
+		record(TRACE_DELETE_PROGRAM, program);
+	}
+
+	static void APIENTRY DeleteQueries(GLsizei n, const GLuint* ids)
+	{
+		gl.DeleteQueries(n, ids);
+		record(TRACE_DELETE_QUERIES);
+		putNames(n, ids);
+	}
+
+	static void APIENTRY DeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+	{
+		gl.DeleteRenderbuffers(n, renderbuffers);
+		record(TRACE_DELETE_RENDERBUFFERS);
+		putNames(n, renderbuffers);
+	}
+
+	static void APIENTRY DeleteShader(GLuint shader)
+	{
+		gl.DeleteShader(shader);
+		record(TRACE_DELETE_SHADER, shader);
+	}
+
+	static void APIENTRY DeleteSync(GLsync sync)
+	{
+		gl.DeleteSync(sync);
+		record(TRACE_DELETE_SYNC, syncId(sync));
+		syncIds.erase(sync);
+	}
+
+	static void APIENTRY DeleteTextures(GLsizei n, const GLuint* textures)
+	{
+		gl.DeleteTextures(n, textures);
+		record(TRACE_DELETE_TEXTURES);
+		putNames(n, textures);
+	}
+
+	static void APIENTRY DeleteVertexArrays(GLsizei n, const GLuint* arrays)
+	{
+		gl.DeleteVertexArrays(n, arrays);
+		record(TRACE_DELETE_VERTEX_ARRAYS);
+		putNames(n, arrays);
+	}
+
+	static void APIENTRY Disable(GLenum cap)
+	{
+		gl.Disable(cap);
+		record(TRACE_DISABLE, cap);
+	}
+
+	static void APIENTRY DrawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		gl.DrawArrays(mode, first, count);
+		record(TRACE_DRAW_ARRAYS, mode, first, count);
+	}
+
+	static void APIENTRY DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount)
+	{
+		gl.DrawArraysInstanced(mode, first, count, instancecount);
+		record(TRACE_DRAW_ARRAYS_INSTANCED, mode, first, count, instancecount);
+	}
+
+	// core profile indices always come from the bound element buffer, the pointer is an offset
+	static void APIENTRY DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+	{
+		gl.DrawElements(mode, count, type, indices);
+		record(TRACE_DRAW_ELEMENTS, mode, count, type, (int64_t)(intptr_t)indices);
+	}
+
+	static void APIENTRY DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount)
+	{
+		gl.DrawElementsInstanced(mode, count, type, indices, instancecount);
+		record(TRACE_DRAW_ELEMENTS_INSTANCED, mode, count, type, (int64_t)(intptr_t)indices, instancecount);
+	}
+
+	static void APIENTRY Enable(GLenum cap)
+	{
+		gl.Enable(cap);
+		record(TRACE_ENABLE, cap);
+	}
+
+	static void APIENTRY EnableVertexAttribArray(GLuint index)
+	{
+		gl.EnableVertexAttribArray(index);
+		record(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY, index);
+	}
+
+	static void APIENTRY EndQuery(GLenum target)
+	{
+		gl.EndQuery(target);
+		record(TRACE_END_QUERY, target);
+	}
+
+	static GLsync APIENTRY FenceSync(GLenum condition, GLbitfield flags)
+	{
+		GLsync sync = gl.FenceSync(condition, flags);
+		uint32_t id = nextSyncId++;
+		syncIds[sync] = id;
+		record(TRACE_FENCE_SYNC, condition, flags, id);
+		return sync;
+	}
+
+	static void APIENTRY Flush()
+	{
+		gl.Flush();
+		record(TRACE_FLUSH);
+	}
+
+	static void APIENTRY FramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
+	{
+		gl.FramebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer);
+		record(TRACE_FRAMEBUFFER_RENDERBUFFER, target, attachment, renderbuffertarget, renderbuffer);
+	}
+
+	static void APIENTRY FramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+	{
+		gl.FramebufferTexture2D(target, attachment, textarget, texture, level);
+		record(TRACE_FRAMEBUFFER_TEXTURE_2D, target, attachment, textarget, texture, level);
+	}
+
+	static void APIENTRY GenBuffers(GLsizei n, GLuint* buffers)
+	{
+		gl.GenBuffers(n, buffers);
+		record(TRACE_GEN_BUFFERS);
+		putNames(n, buffers);
+	}
+
+	static void APIENTRY GenFramebuffers(GLsizei n, GLuint* framebuffers)
+	{
+		gl.GenFramebuffers(n, framebuffers);
+		record(TRACE_GEN_FRAMEBUFFERS);
+		putNames(n, framebuffers);
+	}
+
+	static void APIENTRY GenQueries(GLsizei n, GLuint* ids)
+	{
+		gl.GenQueries(n, ids);
+		record(TRACE_GEN_QUERIES);
+		putNames(n, ids);
+	}
+
+	static void APIENTRY GenRenderbuffers(GLsizei n, GLuint* renderbuffers)
+	{
+		gl.GenRenderbuffers(n, renderbuffers);
+		record(TRACE_GEN_RENDERBUFFERS);
+		putNames(n, renderbuffers);
+	}
+
+	static void APIENTRY GenTextures(GLsizei n, GLuint* textures)
+	{
+		gl.GenTextures(n, textures);
+		record(TRACE_GEN_TEXTURES);
+		putNames(n, textures);
+	}
+
+	static void APIENTRY GenVertexArrays(GLsizei n, GLuint* arrays)
+	{
+		gl.GenVertexArrays(n, arrays);
+		record(TRACE_GEN_VERTEX_ARRAYS);
+		putNames(n, arrays);
+	}
+
+	static void APIENTRY GenerateMipmap(GLenum target)
+	{
+		gl.GenerateMipmap(target);
+		record(TRACE_GENERATE_MIPMAP, target);
+	}
+
+	static void APIENTRY GetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+	{
+		gl.GetActiveUniform(program, index, bufSize, length, size, type, name);
+		record(TRACE_GET_ACTIVE_UNIFORM, program, index);
+	}
+
+	static void APIENTRY GetInteger64v(GLenum pname, GLint64* data)
+	{
+		gl.GetInteger64v(pname, data);
+		record(TRACE_GET_INTEGER64_V, pname);
+	}
+
+	static void APIENTRY GetIntegerv(GLenum pname, GLint* data)
+	{
+		gl.GetIntegerv(pname, data);
+		// no binary formats turns the program binary cache off
+		if (pname == GL_NUM_PROGRAM_BINARY_FORMATS)
+			*data = 0;
+		record(TRACE_GET_INTEGER_V, pname);
+	}
+
+	static void APIENTRY GetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+	{
+		gl.GetProgramInfoLog(program, bufSize, length, infoLog);
+		record(TRACE_GET_PROGRAM_INFO_LOG, program);
+	}
+
+	static void APIENTRY GetProgramiv(GLuint program, GLenum pname, GLint* params)
+	{
+		gl.GetProgramiv(program, pname, params);
+		record(TRACE_GET_PROGRAM_IV, program, pname);
+	}
+
+	static void APIENTRY GetQueryObjectiv(GLuint id, GLenum pname, GLint* params)
+	{
+		gl.GetQueryObjectiv(id, pname, params);
+		record(TRACE_GET_QUERY_OBJECT_IV, id, pname);
+	}
+
+	static void APIENTRY GetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params)
+	{
+		gl.GetQueryObjectui64v(id, pname, params);
+		record(TRACE_GET_QUERY_OBJECT_UI64V, id, pname);
+	}
+
+	static void APIENTRY GetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+	{
+		gl.GetShaderInfoLog(shader, bufSize, length, infoLog);
+		record(TRACE_GET_SHADER_INFO_LOG, shader);
+	}
+
+	static void APIENTRY GetShaderiv(GLuint shader, GLenum pname, GLint* params)
+	{
+		gl.GetShaderiv(shader, pname, params);
+		record(TRACE_GET_SHADER_IV, shader, pname);
+	}
+
+	static const GLubyte* APIENTRY GetString(GLenum name)
+	{
+		const GLubyte* string = gl.GetString(name);
+		record(TRACE_GET_STRING, name);
+		return string;
+	}
+
+	// the name and what the driver returned, the replay maps the returned index to its own
+	static GLuint APIENTRY GetUniformBlockIndex(GLuint program, const GLchar* uniformBlockName)
+	{
+		GLuint index = gl.GetUniformBlockIndex(program, uniformBlockName);
+		record(TRACE_GET_UNIFORM_BLOCK_INDEX, program, index);
+		putData(uniformBlockName, strlen(uniformBlockName));
+		return index;
+	}
+
+	static GLint APIENTRY GetUniformLocation(GLuint program, const GLchar* name)
+	{
+		GLint location = gl.GetUniformLocation(program, name);
+		record(TRACE_GET_UNIFORM_LOCATION, program, location);
+		putData(name, strlen(name));
+		return location;
+	}
+
+	static void APIENTRY LinkProgram(GLuint program)
+	{
+		gl.LinkProgram(program);
+		record(TRACE_LINK_PROGRAM, program);
+	}
+
+	// the engine writes into a zeroed copy, glUnmapBuffer moves it into the driver's mapping
+	static void* APIENTRY MapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+	{
+		void* mapped = gl.MapBufferRange(target, offset, length, access);
+		record(TRACE_MAP_BUFFER_RANGE, target, (int64_t)offset, (int64_t)length, access);
+		if (!mapped)
+			return NULL;
+		Mapping& mapping = mappings[mappedBuffer(target)];
+		mapping.driver = mapped;
+		mapping.shadow.assign((size_t)length, 0);
+		return mapping.shadow.data();
+	}
+
+	static void APIENTRY PixelStorei(GLenum pname, GLint param)
+	{
+		gl.PixelStorei(pname, param);
+		if (pname == GL_UNPACK_ALIGNMENT)
+			unpackAlignment = param;
+		record(TRACE_PIXEL_STOREI, pname, param);
+	}
+
+	static void APIENTRY PolygonMode(GLenum face, GLenum mode)
+	{
+		gl.PolygonMode(face, mode);
+		record(TRACE_POLYGON_MODE, face, mode);
+	}
+
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+	static void APIENTRY ProgramParameteri(GLuint program, GLenum pname, GLint value)
+	{
+		gl.ProgramParameteri(program, pname, value);
+		record(TRACE_PROGRAM_PARAMETERI, program, pname, value);
+	}
+#endif
+
+	static void APIENTRY QueryCounter(GLuint id, GLenum target)
+	{
+		gl.QueryCounter(id, target);
+		record(TRACE_QUERY_COUNTER, id, target);
+	}
+
+	static void APIENTRY RenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+	{
+		gl.RenderbufferStorage(target, internalformat, width, height);
+		record(TRACE_RENDERBUFFER_STORAGE, target, internalformat, width, height);
+	}
+
+	// the strings are joined into one source
+	static void APIENTRY ShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)
+	{
+		gl.ShaderSource(shader, count, string, length);
+		std::string source;
+		for (GLsizei i = 0; i < count; i++)
+			source.append(string[i], length && length[i] >= 0 ? (size_t)length[i] : strlen(string[i]));
+		record(TRACE_SHADER_SOURCE, shader);
+		putData(source.data(), source.size());
+	}
+
+	static void APIENTRY TexBuffer(GLenum target, GLenum internalformat, GLuint buffer)
+	{
+		gl.TexBuffer(target, internalformat, buffer);
+		record(TRACE_TEX_BUFFER, target, internalformat, buffer);
+	}
+
+	static void APIENTRY TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		gl.TexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+		record(TRACE_TEX_IMAGE_2D, target, level, internalformat, width, height, border, format, type);
+		putPixels(pixels, pixelBytes(format, type, width, height, 1));
+	}
+
+	static void APIENTRY TexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		gl.TexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+		record(TRACE_TEX_IMAGE_3D, target, level, internalformat, width, height, depth, border, format, type);
+		putPixels(pixels, pixelBytes(format, type, width, height, depth));
+	}
+
+	static void APIENTRY TexParameteri(GLenum target, GLenum pname, GLint param)
+	{
+		gl.TexParameteri(target, pname, param);
+		record(TRACE_TEX_PARAMETERI, target, pname, param);
+	}
+
+	static void APIENTRY Uniform1f(GLint location, GLfloat v0)
+	{
+		gl.Uniform1f(location, v0);
+		record(TRACE_UNIFORM_1F, location, v0);
+	}
+
+	static void APIENTRY Uniform1i(GLint location, GLint v0)
+	{
+		gl.Uniform1i(location, v0);
+		record(TRACE_UNIFORM_1I, location, v0);
+	}
+
+	static void APIENTRY Uniform2f(GLint location, GLfloat v0, GLfloat v1)
+	{
+		gl.Uniform2f(location, v0, v1);
+		record(TRACE_UNIFORM_2F, location, v0, v1);
+	}
+
+	static void APIENTRY Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+	{
+		gl.Uniform3f(location, v0, v1, v2);
+		record(TRACE_UNIFORM_3F, location, v0, v1, v2);
+	}
+
+	static void APIENTRY Uniform3fv(GLint location, GLsizei count, const GLfloat* value)
+	{
+		gl.Uniform3fv(location, count, value);
+		record(TRACE_UNIFORM_3FV, location, count);
+		put(value, count * 3 * sizeof(GLfloat));
+	}
+
+	static void APIENTRY UniformBlockBinding(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding)
+	{
+		gl.UniformBlockBinding(program, uniformBlockIndex, uniformBlockBinding);
+		record(TRACE_UNIFORM_BLOCK_BINDING, program, uniformBlockIndex, uniformBlockBinding);
+	}
+
+	static void APIENTRY UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+	{
+		gl.UniformMatrix4fv(location, count, transpose, value);
+		record(TRACE_UNIFORM_MATRIX_4FV, location, count, (uint8_t)transpose);
+		put(value, count * 16 * sizeof(GLfloat));
+	}
+
+	// records what was written, up to the last non-zero byte of the copy: the rest is still zero and
+	// replays from the buffer's own contents
+	static GLboolean APIENTRY UnmapBuffer(GLenum target)
+	{
+		auto it = mappings.find(mappedBuffer(target));
+		size_t written = 0;
+		if (it != mappings.end() && it->second.driver)
+		{
+			const std::vector<uint8_t>& shadow = it->second.shadow;
+			written = shadow.size();
+			while (written > 0 && shadow[written - 1] == 0)
+				written--;
+			memcpy(it->second.driver, shadow.data(), shadow.size());
+			it->second.driver = NULL;
+		}
+		GLboolean result = gl.UnmapBuffer(target);
+		record(TRACE_UNMAP_BUFFER, target);
+		putData(it != mappings.end() ? it->second.shadow.data() : NULL, written);
+		return result;
+	}
+
+	static void APIENTRY UseProgram(GLuint program)
+	{
+		gl.UseProgram(program);
+		record(TRACE_USE_PROGRAM, program);
+	}
+
+	static void APIENTRY VertexAttribDivisor(GLuint index, GLuint divisor)
+	{
+		gl.VertexAttribDivisor(index, divisor);
+		record(TRACE_VERTEX_ATTRIB_DIVISOR, index, divisor);
+	}
+
+	static void APIENTRY VertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer)
+	{
+		gl.VertexAttribIPointer(index, size, type, stride, pointer);
+		record(TRACE_VERTEX_ATTRIB_I_POINTER, index, size, type, stride, (int64_t)(intptr_t)pointer);
+	}
+
+	static void APIENTRY VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+	{
+		gl.VertexAttribPointer(index, size, type, normalized, stride, pointer);
+		record(TRACE_VERTEX_ATTRIB_POINTER, index, size, type, (uint8_t)normalized, stride, (int64_t)(intptr_t)pointer);
+	}
+
+	static void APIENTRY Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		gl.Viewport(x, y, width, height);
+		record(TRACE_VIEWPORT, x, y, width, height);
+	}
+};
+
+// Issues a captured trace again, as fast as the driver takes it. Names, uniform locations, uniform block
+// indices and syncs are mapped from the capture's to this context's, and the capture's default
+// framebuffer is an offscreen target of the size recorded in the header. Every frame is timed on the
+// CPU, and on the GPU between timestamp queries at the frame ends. Needs a current context.
+// The engine's query result reads and fence waits block until the GPU catches up, which would serialize
+// the replay, so they are skipped unless `pace` asks to wait like the capture did. The fence waits are
+// what made the capture's unsynchronized maps (the frame ring) safe, so without pace those maps lose
+// GL_MAP_UNSYNCHRONIZED_BIT and the driver keeps the GPU's reads ahead of the writes instead.
+class GLTraceReplayer
+{
+public:
+	GLTraceHeader header;
+	// re-issue query result reads and client waits, the replay then keeps the engine's pacing
+	bool pace = false;
+	// reads and waits left out because pace is off
+	uint64_t skippedWaits = 0;
+	// load: everything before the first frame end
+	double loadMs = 0.0;
+	uint64_t loadCalls = 0;
+	// calls of each type in the frames, the load not included
+	uint64_t frameCalls[TRACE_CALL_COUNT] = {};
+	std::vector<uint64_t> callsPerFrame;
+	// after the last frame end: the engine's shutdown, replayed but not timed
+	uint64_t shutdownCalls = 0;
+	// shaders and programs that failed to compile or link here, and GL errors at the end
+	int buildFailures = 0;
+	int glErrors = 0;
+
+	bool open(const char* path)
+	{
+		if (!trace.open(path) || trace.size() < sizeof(GLTraceHeader))
+		{
+			std::cout << "ERROR::GL_REPLAY::OPEN_FAILED " << path << std::endl;
+			return false;
+		}
+		memcpy(&header, trace.data(), sizeof(header));
+		if (header.magic != GLTraceHeader::MAGIC || header.version != GLTraceHeader::VERSION)
+		{
+			std::cout << "ERROR::GL_REPLAY::NOT_A_TRACE " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	size_t traceBytes() const
+	{
+		return trace.size();
+	}
+
+	// replays the whole trace, one addFrame per captured frame
+	bool run(FrameStats& stats)
+	{
+		defaultFramebuffer = new Framebuffer(std::max((int)header.width, 1), std::max((int)header.height, 1));
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer->ID);
+		cursor = trace.data() + sizeof(GLTraceHeader);
+		end = trace.data() + trace.size();
+
+		std::vector<unsigned int> stamps;
+		bool loading = true;
+		uint64_t calls = 0;
+		uint64_t segmentCalls[TRACE_CALL_COUNT] = {};
+		double frameStart = nowMs();
+		while (cursor < end)
+		{
+			GLTraceCall call = (GLTraceCall)get<uint8_t>();
+			if (call >= TRACE_CALL_COUNT)
+			{
+				std::cout << "ERROR::GL_REPLAY::UNKNOWN_CALL " << (int)call << std::endl;
+				break;
+			}
+			if (call != TRACE_FRAME_END)
+			{
+				calls++;
+				segmentCalls[call]++;
+				if (!replay(call))
+					break;
+				continue;
+			}
+
+			double frameEnd = nowMs();
+			unsigned int stamp;
+			glGenQueries(1, &stamp);
+			glQueryCounter(stamp, GL_TIMESTAMP);
+			stamps.push_back(stamp);
+			if (loading)
+			{
+				loadMs = frameEnd - frameStart;
+				loadCalls = calls;
+				loading = false;
+			}
+			else
+			{
+				stats.addFrame(frameEnd - frameStart, frameEnd - frameStart);
+				callsPerFrame.push_back(calls);
+				for (int i = 0; i < TRACE_CALL_COUNT; i++)
+					frameCalls[i] += segmentCalls[i];
+			}
+			calls = 0;
+			memset(segmentCalls, 0, sizeof(segmentCalls));
+			frameStart = nowMs();
+		}
+		shutdownCalls = calls;
+		if (overrun)
+			std::cout << "ERROR::GL_REPLAY::TRUNCATED_TRACE" << std::endl;
+
+		// the GPU time of a frame is the time between the timestamps at its two ends
+		for (size_t i = 1; i < stamps.size(); i++)
+		{
+			GLuint64 begin = 0, finish = 0;
+			glGetQueryObjectui64v(stamps[i - 1], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(stamps[i], GL_QUERY_RESULT, &finish);
+			stats.setGpu((int)i - 1, (finish - begin) / 1.0e6);
+		}
+		if (!stamps.empty())
+			glDeleteQueries((GLsizei)stamps.size(), stamps.data());
+		while (glGetError() != GL_NO_ERROR && glErrors < 1000)
+			glErrors++;
+		if (glErrors > 0)
+			std::cout << "ERROR::GL_REPLAY::GL_ERRORS " << glErrors << std::endl;
+		delete defaultFramebuffer;
+		defaultFramebuffer = NULL;
+		return !overrun;
+	}
+
+private:
+	MappedFile trace;
+	const uint8_t* cursor = NULL;
+	const uint8_t* end = NULL;
+	bool overrun = false;
+	Framebuffer* defaultFramebuffer = NULL;
+
+	// capture's name -> this context's, per kind of object
+	std::unordered_map<uint32_t, GLuint> buffers, textures, vertexArrays, framebuffers, renderbuffers, queries, shaders, programs;
+	std::unordered_map<uint32_t, GLsync> syncs;
+	// (program, capture's location or block index) -> this context's
+	std::unordered_map<uint64_t, GLint> locations;
+	std::unordered_map<uint64_t, GLuint> blockIndices;
+	std::unordered_map<GLenum, GLuint> boundBuffers;
+	// this context's mappings, the capture's writes are copied into them on unmap
+	struct Mapping
+	{
+		void* pointer = NULL;
+		size_t length = 0;
+	};
+	std::unordered_map<GLuint, Mapping> mapped;
+	GLuint currentProgram = 0;
+	std::vector<GLuint> scratchNames;
+
+	template<typename T>
+	T get()
+	{
+		T value = T();
+		if (cursor + sizeof(T) > end)
+		{
+			overrun = true;
+			cursor = end;
+			return value;
+		}
+		memcpy(&value, cursor, sizeof(T));
+		cursor += sizeof(T);
+		return value;
+	}
+
+	// a call's arguments in order, braced initialization evaluates them left to right
+	template<typename... T>
+	std::tuple<T...> args()
+	{
+		return std::tuple<T...>{ get<T>()... };
+	}
+
+	// data passed by pointer, NULL if the capture passed NULL
+	const void* data(uint32_t& size)
+	{
+		size = get<uint32_t>();
+		if (size == GLTraceHeader::NO_DATA)
+		{
+			size = 0;
+			return NULL;
+		}
+		if (cursor + size > end)
+		{
+			overrun = true;
+			cursor = end;
+			return NULL;
+		}
+		const void* bytes = cursor;
+		cursor += size;
+		return bytes;
+	}
+
+	const void* data()
+	{
+		uint32_t size;
+		return data(size);
+	}
+
+	// an offset into the bound unpack buffer, or the pixels
+	const void* pixels()
+	{
+		if (get<uint8_t>())
+			return (const void*)(intptr_t)get<int64_t>();
+		return data();
+	}
+
+	// the names of a Gen or Delete call, mapped to this context's for deletes
+	GLsizei names(std::unordered_map<uint32_t, GLuint>& map, bool generate)
+	{
+		uint32_t n = get<uint32_t>();
+		if (cursor + n * sizeof(GLuint) > end)
+		{
+			overrun = true;
+			cursor = end;
+			return 0;
+		}
+		scratchNames.resize(n);
+		for (uint32_t i = 0; i < n; i++)
+		{
+			uint32_t captured = get<uint32_t>();
+			if (generate)
+				scratchNames[i] = captured;
+			else
+			{
+				scratchNames[i] = name(map, captured);
+				map.erase(captured);
+			}
+		}
+		return (GLsizei)n;
+	}
+
+	void generated(std::unordered_map<uint32_t, GLuint>& map, const std::vector<GLuint>& captured, const GLuint* created)
+	{
+		for (size_t i = 0; i < captured.size(); i++)
+			map[captured[i]] = created[i];
+	}
+
+	static GLuint name(const std::unordered_map<uint32_t, GLuint>& map, uint32_t captured)
+	{
+		if (captured == 0)
+			return 0;
+		auto it = map.find(captured);
+		return it != map.end() ? it->second : 0;
+	}
+
+	GLuint framebuffer(uint32_t captured)
+	{
+		return captured == 0 ? defaultFramebuffer->ID : name(framebuffers, captured);
+	}
+
+	// a location this context doesn't know (an array element past [0], -1) is passed through
+	GLint location(GLint captured)
+	{
+		auto it = locations.find(((uint64_t)currentProgram << 32) | (uint32_t)captured);
+		return it != locations.end() ? it->second : captured;
+	}
+
+	template<typename Gen>
+	void generate(std::unordered_map<uint32_t, GLuint>& map, Gen gen)
+	{
+		GLsizei n = names(map, true);
+		std::vector<GLuint> captured(scratchNames.begin(), scratchNames.begin() + n);
+		gen(n, scratchNames.data());
+		generated(map, captured, scratchNames.data());
+	}
+
+	template<typename Delete>
+	void remove(std::unordered_map<uint32_t, GLuint>& map, Delete del)
+	{
+		GLsizei n = names(map, false);
+		del(n, scratchNames.data());
+	}
+
+	bool replay(GLTraceCall call)
+	{
+		switch (call)
+		{
+		case TRACE_ACTIVE_TEXTURE:
+		{
+			auto [texture] = args<GLenum>();
+			glActiveTexture(texture);
+			break;
+		}
+		case TRACE_ATTACH_SHADER:
+		{
+			auto [program, shader] = args<GLuint, GLuint>();
+			glAttachShader(name(programs, program), name(shaders, shader));
+			break;
+		}
+		case TRACE_BEGIN_QUERY:
+		{
+			auto [target, id] = args<GLenum, GLuint>();
+			glBeginQuery(target, name(queries, id));
+			break;
+		}
+		case TRACE_BIND_BUFFER:
+		{
+			auto [target, buffer] = args<GLenum, GLuint>();
+			boundBuffers[target] = name(buffers, buffer);
+			glBindBuffer(target, boundBuffers[target]);
+			break;
+		}
+		case TRACE_BIND_BUFFER_RANGE:
+		{
+			auto [target, index, buffer, offset, size] = args<GLenum, GLuint, GLuint, int64_t, int64_t>();
+			boundBuffers[target] = name(buffers, buffer);
+			glBindBufferRange(target, index, boundBuffers[target], (GLintptr)offset, (GLsizeiptr)size);
+			break;
+		}
+		case TRACE_BIND_FRAMEBUFFER:
+		{
+			auto [target, id] = args<GLenum, GLuint>();
+			glBindFramebuffer(target, framebuffer(id));
+			break;
+		}
+		case TRACE_BIND_RENDERBUFFER:
+		{
+			auto [target, renderbuffer] = args<GLenum, GLuint>();
+			glBindRenderbuffer(target, name(renderbuffers, renderbuffer));
+			break;
+		}
+		case TRACE_BIND_TEXTURE:
+		{
+			auto [target, texture] = args<GLenum, GLuint>();
+			glBindTexture(target, name(textures, texture));
+			break;
+		}
+		case TRACE_BIND_VERTEX_ARRAY:
+		{
+			auto [array] = args<GLuint>();
+			glBindVertexArray(name(vertexArrays, array));
+			break;
+		}
+		case TRACE_BUFFER_DATA:
+		{
+			auto [target, size] = args<GLenum, int64_t>();
+			const void* bytes = data();
+			GLenum usage = get<GLenum>();
+			glBufferData(target, (GLsizeiptr)size, bytes, usage);
+			break;
+		}
+		case TRACE_BUFFER_STORAGE:
+		{
+			auto [target, size] = args<GLenum, int64_t>();
+			const void* bytes = data();
+			GLbitfield flags = get<GLbitfield>();
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+			if (glBufferStorage)
+				glBufferStorage(target, (GLsizeiptr)size, bytes, flags);
+			else
+#endif
+				glBufferData(target, (GLsizeiptr)size, bytes, GL_STREAM_DRAW);
+			(void)flags;
+			break;
+		}
+		case TRACE_BUFFER_SUB_DATA:
+		{
+			auto [target, offset, size] = args<GLenum, int64_t, int64_t>();
+			glBufferSubData(target, (GLintptr)offset, (GLsizeiptr)size, data());
+			break;
+		}
+		case TRACE_CHECK_FRAMEBUFFER_STATUS:
+		{
+			auto [target] = args<GLenum>();
+			if (glCheckFramebufferStatus(target) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "ERROR::GL_REPLAY::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+			break;
+		}
+		case TRACE_CLEAR:
+		{
+			auto [mask] = args<GLbitfield>();
+			glClear(mask);
+			break;
+		}
+		case TRACE_CLEAR_COLOR:
+		{
+			auto [red, green, blue, alpha] = args<GLfloat, GLfloat, GLfloat, GLfloat>();
+			glClearColor(red, green, blue, alpha);
+			break;
+		}
+		case TRACE_CLIENT_WAIT_SYNC:
+		{
+			auto [sync, flags, timeout] = args<uint32_t, GLbitfield, uint64_t>();
+			auto it = syncs.find(sync);
+			if (!pace)
+				skippedWaits++;
+			else if (it != syncs.end())
+				glClientWaitSync(it->second, flags, timeout);
+			break;
+		}
+		case TRACE_COMPILE_SHADER:
+		{
+			auto [shader] = args<GLuint>();
+			glCompileShader(name(shaders, shader));
+			break;
+		}
+		case TRACE_COMPRESSED_TEX_IMAGE_3D:
+		{
+			auto [target, level, internalformat, width, height, depth, border, imageSize] = args<GLenum, GLint, GLenum, GLsizei, GLsizei, GLsizei, GLint, GLsizei>();
+			glCompressedTexImage3D(target, level, internalformat, width, height, depth, border, imageSize, pixels());
+			break;
+		}
+		case TRACE_COPY_BUFFER_SUB_DATA:
+		{
+			auto [readTarget, writeTarget, readOffset, writeOffset, size] = args<GLenum, GLenum, int64_t, int64_t, int64_t>();
+			glCopyBufferSubData(readTarget, writeTarget, (GLintptr)readOffset, (GLintptr)writeOffset, (GLsizeiptr)size);
+			break;
+		}
+		case TRACE_CREATE_PROGRAM:
+		{
+			auto [program] = args<GLuint>();
+			programs[program] = glCreateProgram();
+			break;
+		}
+		case TRACE_CREATE_SHADER:
+		{
+			auto [type, shader] = args<GLenum, GLuint>();
+			shaders[shader] = glCreateShader(type);
+			break;
+		}
+		case TRACE_DELETE_BUFFERS:
+		{
+			GLsizei n = names(buffers, false);
+			for (GLsizei i = 0; i < n; i++)
+				mapped.erase(scratchNames[i]);
+			glDeleteBuffers(n, scratchNames.data());
+			break;
+		}
+		case TRACE_DELETE_FRAMEBUFFERS:
+			remove(framebuffers, [](GLsizei n, const GLuint* ids) { glDeleteFramebuffers(n, ids); });
+			break;
+		case TRACE_DELETE_PROGRAM:
+		{
+			auto [program] = args<GLuint>();
+			glDeleteProgram(name(programs, program));
+			programs.erase(program);
+			break;
+		}
+		case TRACE_DELETE_QUERIES:
+			remove(queries, [](GLsizei n, const GLuint* ids) { glDeleteQueries(n, ids); });
+			break;
+		case TRACE_DELETE_RENDERBUFFERS:
+			remove(renderbuffers, [](GLsizei n, const GLuint* ids) { glDeleteRenderbuffers(n, ids); });
+			break;
+		case TRACE_DELETE_SHADER:
+		{
+			auto [shader] = args<GLuint>();
+			glDeleteShader(name(shaders, shader));
+			shaders.erase(shader);
+			break;
+		}
+		case TRACE_DELETE_SYNC:
+		{
+			auto [sync] = args<uint32_t>();
+			auto it = syncs.find(sync);
+			if (it != syncs.end())
+			{
+				glDeleteSync(it->second);
+				syncs.erase(it);
+			}
+			break;
+		}
+		case TRACE_DELETE_TEXTURES:
+			remove(textures, [](GLsizei n, const GLuint* ids) { glDeleteTextures(n, ids); });
+			break;
+		case TRACE_DELETE_VERTEX_ARRAYS:
+			remove(vertexArrays, [](GLsizei n, const GLuint* ids) { glDeleteVertexArrays(n, ids); });
+			break;
+		case TRACE_DISABLE:
+		{
+			auto [cap] = args<GLenum>();
+			glDisable(cap);
+			break;
+		}
+		case TRACE_DRAW_ARRAYS:
+		{
+			auto [mode, first, count] = args<GLenum, GLint, GLsizei>();
+			glDrawArrays(mode, first, count);
+			break;
+		}
+		case TRACE_DRAW_ARRAYS_INSTANCED:
+		{
+			auto [mode, first, count, instances] = args<GLenum, GLint, GLsizei, GLsizei>();
+			glDrawArraysInstanced(mode, first, count, instances);
+			break;
+		}
+		case TRACE_DRAW_ELEMENTS:
+		{
+			auto [mode, count, type, offset] = args<GLenum, GLsizei, GLenum, int64_t>();
+			glDrawElements(mode, count, type, (const void*)(intptr_t)offset);
+			break;
+		}
+		case TRACE_DRAW_ELEMENTS_INSTANCED:
+		{
+			auto [mode, count, type, offset, instances] = args<GLenum, GLsizei, GLenum, int64_t, GLsizei>();
+			glDrawElementsInstanced(mode, count, type, (const void*)(intptr_t)offset, instances);
+			break;
+		}
+		case TRACE_ENABLE:
+		{
+			auto [cap] = args<GLenum>();
+			glEnable(cap);
+			break;
+		}
+		case TRACE_ENABLE_VERTEX_ATTRIB_ARRAY:
+		{
+			auto [index] = args<GLuint>();
+			glEnableVertexAttribArray(index);
+			break;
+		}
+		case TRACE_END_QUERY:
+		{
+			auto [target] = args<GLenum>();
+			glEndQuery(target);
+			break;
+		}
+		case TRACE_FENCE_SYNC:
+		{
+			auto [condition, flags, sync] = args<GLenum, GLbitfield, uint32_t>();
+			syncs[sync] = glFenceSync(condition, flags);
+			break;
+		}
+		case TRACE_FLUSH:
+			glFlush();
+			break;
+		case TRACE_FRAMEBUFFER_RENDERBUFFER:
+		{
+			auto [target, attachment, renderbufferTarget, renderbuffer] = args<GLenum, GLenum, GLenum, GLuint>();
+			glFramebufferRenderbuffer(target, attachment, renderbufferTarget, name(renderbuffers, renderbuffer));
+			break;
+		}
+		case TRACE_FRAMEBUFFER_TEXTURE_2D:
+		{
+			auto [target, attachment, textureTarget, texture, level] = args<GLenum, GLenum, GLenum, GLuint, GLint>();
+			glFramebufferTexture2D(target, attachment, textureTarget, name(textures, texture), level);
+			break;
+		}
+		case TRACE_GEN_BUFFERS:
+			generate(buffers, [](GLsizei n, GLuint* ids) { glGenBuffers(n, ids); });
+			break;
+		case TRACE_GEN_FRAMEBUFFERS:
+			generate(framebuffers, [](GLsizei n, GLuint* ids) { glGenFramebuffers(n, ids); });
+			break;
+		case TRACE_GEN_QUERIES:
+			generate(queries, [](GLsizei n, GLuint* ids) { glGenQueries(n, ids); });
+			break;
+		case TRACE_GEN_RENDERBUFFERS:
+			generate(renderbuffers, [](GLsizei n, GLuint* ids) { glGenRenderbuffers(n, ids); });
+			break;
+		case TRACE_GEN_TEXTURES:
+			generate(textures, [](GLsizei n, GLuint* ids) { glGenTextures(n, ids); });
+			break;
+		case TRACE_GEN_VERTEX_ARRAYS:
+			generate(vertexArrays, [](GLsizei n, GLuint* ids) { glGenVertexArrays(n, ids); });
+			break;
+		case TRACE_GENERATE_MIPMAP:
+		{
+			auto [target] = args<GLenum>();
+			glGenerateMipmap(target);
+			break;
+		}
+		case TRACE_GET_ACTIVE_UNIFORM:
+		{
+			auto [program, index] = args<GLuint, GLuint>();
+			GLchar uniform[256];
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(name(programs, program), index, sizeof(uniform), &length, &size, &type, uniform);
+			break;
+		}
+		case TRACE_GET_INTEGER64_V:
+		{
+			auto [pname] = args<GLenum>();
+			GLint64 value[4] = {};
+			glGetInteger64v(pname, value);
+			break;
+		}
+		case TRACE_GET_INTEGER_V:
+		{
+			auto [pname] = args<GLenum>();
+			// room for the queries that return several values
+			GLint value[16] = {};
+			if (pname != GL_PROGRAM_BINARY_FORMATS && pname != GL_COMPRESSED_TEXTURE_FORMATS)
+				glGetIntegerv(pname, value);
+			break;
+		}
+		case TRACE_GET_PROGRAM_INFO_LOG:
+		{
+			auto [program] = args<GLuint>();
+			GLchar log[512];
+			glGetProgramInfoLog(name(programs, program), sizeof(log), NULL, log);
+			break;
+		}
+		case TRACE_GET_PROGRAM_IV:
+		{
+			auto [program, pname] = args<GLuint, GLenum>();
+			GLint value = 0;
+			glGetProgramiv(name(programs, program), pname, &value);
+			if (pname == GL_LINK_STATUS && !value)
+			{
+				buildFailures++;
+				std::cout << "ERROR::GL_REPLAY::LINK_FAILED program " << program << std::endl;
+			}
+			break;
+		}
+		// the engine's own timing, nothing the replay draws depends on the values
+		case TRACE_GET_QUERY_OBJECT_IV:
+		{
+			auto [id, pname] = args<GLuint, GLenum>();
+			GLint value = 0;
+			if (!pace)
+				skippedWaits++;
+			else
+				glGetQueryObjectiv(name(queries, id), pname, &value);
+			break;
+		}
+		case TRACE_GET_QUERY_OBJECT_UI64V:
+		{
+			auto [id, pname] = args<GLuint, GLenum>();
+			GLuint64 value = 0;
+			if (!pace)
+				skippedWaits++;
+			else
+				glGetQueryObjectui64v(name(queries, id), pname, &value);
+			break;
+		}
+		case TRACE_GET_SHADER_INFO_LOG:
+		{
+			auto [shader] = args<GLuint>();
+			GLchar log[512];
+			glGetShaderInfoLog(name(shaders, shader), sizeof(log), NULL, log);
+			break;
+		}
+		case TRACE_GET_SHADER_IV:
+		{
+			auto [shader, pname] = args<GLuint, GLenum>();
+			GLint value = 0;
+			glGetShaderiv(name(shaders, shader), pname, &value);
+			if (pname == GL_COMPILE_STATUS && !value)
+			{
+				buildFailures++;
+				std::cout << "ERROR::GL_REPLAY::COMPILE_FAILED shader " << shader << std::endl;
+			}
+			break;
+		}
+		case TRACE_GET_STRING:
+		{
+			auto [stringName] = args<GLenum>();
+			glGetString(stringName);
+			break;
+		}
+		case TRACE_GET_UNIFORM_BLOCK_INDEX:
+		{
+			auto [program, index] = args<GLuint, GLuint>();
+			uint32_t size;
+			const char* block = (const char*)data(size);
+			GLuint replayed = name(programs, program);
+			blockIndices[((uint64_t)replayed << 32) | index] = glGetUniformBlockIndex(replayed, std::string(block ? block : "", size).c_str());
+			break;
+		}
+		case TRACE_GET_UNIFORM_LOCATION:
+		{
+			auto [program, captured] = args<GLuint, GLint>();
+			uint32_t size;
+			const char* uniform = (const char*)data(size);
+			GLuint replayed = name(programs, program);
+			locations[((uint64_t)replayed << 32) | (uint32_t)captured] = glGetUniformLocation(replayed, std::string(uniform ? uniform : "", size).c_str());
+			break;
+		}
+		case TRACE_LINK_PROGRAM:
+		{
+			auto [program] = args<GLuint>();
+			glLinkProgram(name(programs, program));
+			break;
+		}
+		case TRACE_MAP_BUFFER_RANGE:
+		{
+			auto [target, offset, length, access] = args<GLenum, int64_t, int64_t, GLbitfield>();
+			Mapping& mapping = mapped[boundBuffers[target]];
+			// the waits that guarded the region were skipped
+			if (!pace)
+				access &= ~GL_MAP_UNSYNCHRONIZED_BIT;
+			mapping.pointer = glMapBufferRange(target, (GLintptr)offset, (GLsizeiptr)length, access);
+			mapping.length = (size_t)length;
+			break;
+		}
+		case TRACE_PIXEL_STOREI:
+		{
+			auto [pname, param] = args<GLenum, GLint>();
+			glPixelStorei(pname, param);
+			break;
+		}
+		case TRACE_POLYGON_MODE:
+		{
+			auto [face, mode] = args<GLenum, GLenum>();
+			glPolygonMode(face, mode);
+			break;
+		}
+		case TRACE_PROGRAM_PARAMETERI:
+		{
+			auto [program, pname, value] = args<GLuint, GLenum, GLint>();
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+			if (glProgramParameteri)
+				glProgramParameteri(name(programs, program), pname, value);
+#endif
+			(void)program; (void)pname; (void)value;
+			break;
+		}
+		case TRACE_QUERY_COUNTER:
+		{
+			auto [id, target] = args<GLuint, GLenum>();
+			glQueryCounter(name(queries, id), target);
+			break;
+		}
+		case TRACE_RENDERBUFFER_STORAGE:
+		{
+			auto [target, internalformat, width, height] = args<GLenum, GLenum, GLsizei, GLsizei>();
+			glRenderbufferStorage(target, internalformat, width, height);
+			break;
+		}
+		case TRACE_SHADER_SOURCE:
+		{
+			auto [shader] = args<GLuint>();
+			uint32_t size;
+			const GLchar* source = (const GLchar*)data(size);
+			GLint length = (GLint)size;
+			glShaderSource(name(shaders, shader), 1, &source, &length);
+			break;
+		}
+		case TRACE_TEX_BUFFER:
+		{
+			auto [target, internalformat, buffer] = args<GLenum, GLenum, GLuint>();
+			glTexBuffer(target, internalformat, name(buffers, buffer));
+			break;
+		}
+		case TRACE_TEX_IMAGE_2D:
+		{
+			auto [target, level, internalformat, width, height, border, format, type] = args<GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum>();
+			glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels());
+			break;
+		}
+		case TRACE_TEX_IMAGE_3D:
+		{
+			auto [target, level, internalformat, width, height, depth, border, format, type] = args<GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum>();
+			glTexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels());
+			break;
+		}
+		case TRACE_TEX_PARAMETERI:
+		{
+			auto [target, pname, param] = args<GLenum, GLenum, GLint>();
+			glTexParameteri(target, pname, param);
+			break;
+		}
+		case TRACE_UNIFORM_1F:
+		{
+			auto [captured, v0] = args<GLint, GLfloat>();
+			glUniform1f(location(captured), v0);
+			break;
+		}
+		case TRACE_UNIFORM_1I:
+		{
+			auto [captured, v0] = args<GLint, GLint>();
+			glUniform1i(location(captured), v0);
+			break;
+		}
+		case TRACE_UNIFORM_2F:
+		{
+			auto [captured, v0, v1] = args<GLint, GLfloat, GLfloat>();
+			glUniform2f(location(captured), v0, v1);
+			break;
+		}
+		case TRACE_UNIFORM_3F:
+		{
+			auto [captured, v0, v1, v2] = args<GLint, GLfloat, GLfloat, GLfloat>();
+			glUniform3f(location(captured), v0, v1, v2);
+			break;
+		}
+		case TRACE_UNIFORM_3FV:
+		{
+			auto [captured, count] = args<GLint, GLsizei>();
+			const GLfloat* values = floats((size_t)count * 3);
+			glUniform3fv(location(captured), count, values);
+			break;
+		}
+		case TRACE_UNIFORM_BLOCK_BINDING:
+		{
+			auto [program, index, binding] = args<GLuint, GLuint, GLuint>();
+			GLuint replayed = name(programs, program);
+			auto it = blockIndices.find(((uint64_t)replayed << 32) | index);
+			glUniformBlockBinding(replayed, it != blockIndices.end() ? it->second : index, binding);
+			break;
+		}
+		case TRACE_UNIFORM_MATRIX_4FV:
+		{
+			auto [captured, count, transpose] = args<GLint, GLsizei, uint8_t>();
+			const GLfloat* values = floats((size_t)count * 16);
+			glUniformMatrix4fv(location(captured), count, (GLboolean)transpose, values);
+			break;
+		}
+		case TRACE_UNMAP_BUFFER:
+		{
+			auto [target] = args<GLenum>();
+			uint32_t size;
+			const void* written = data(size);
+			auto it = mapped.find(boundBuffers[target]);
+			// the capture wrote zeros past what was recorded
+			if (it != mapped.end() && it->second.pointer)
+			{
+				size = (uint32_t)std::min((size_t)size, it->second.length);
+				if (written)
+					memcpy(it->second.pointer, written, size);
+				memset((uint8_t*)it->second.pointer + size, 0, it->second.length - size);
+				it->second.pointer = NULL;
+			}
+			glUnmapBuffer(target);
+			break;
+		}
+		case TRACE_USE_PROGRAM:
+		{
+			auto [program] = args<GLuint>();
+			currentProgram = name(programs, program);
+			glUseProgram(currentProgram);
+			break;
+		}
+		case TRACE_VERTEX_ATTRIB_DIVISOR:
+		{
+			auto [index, divisor] = args<GLuint, GLuint>();
+			glVertexAttribDivisor(index, divisor);
+			break;
+		}
+		case TRACE_VERTEX_ATTRIB_I_POINTER:
+		{
+			auto [index, size, type, stride, offset] = args<GLuint, GLint, GLenum, GLsizei, int64_t>();
+			glVertexAttribIPointer(index, size, type, stride, (const void*)(intptr_t)offset);
+			break;
+		}
+		case TRACE_VERTEX_ATTRIB_POINTER:
+		{
+			auto [index, size, type, normalized, stride, offset] = args<GLuint, GLint, GLenum, uint8_t, GLsizei, int64_t>();
+			glVertexAttribPointer(index, size, type, (GLboolean)normalized, stride, (const void*)(intptr_t)offset);
+			break;
+		}
+		case TRACE_VIEWPORT:
+		{
+			auto [x, y, width, height] = args<GLint, GLint, GLsizei, GLsizei>();
+			glViewport(x, y, width, height);
+			break;
+		}
+		default:
+			break;
+		}
+		return !overrun;
+	}
+
+	// uniform values, copied out since the trace gives no alignment
+	const GLfloat* floats(size_t count)
+	{
+		scratchFloats.resize(count);
+		if (cursor + count * sizeof(GLfloat) > end)
+		{
+			overrun = true;
+			cursor = end;
+			return scratchFloats.data();
+		}
+		memcpy(scratchFloats.data(), cursor, count * sizeof(GLfloat));
+		cursor += count * sizeof(GLfloat);
+		return scratchFloats.data();
+	}
+	std::vector<GLfloat> scratchFloats;
+};
+
+#endif
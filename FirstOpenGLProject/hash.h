@@ -0,0 +1,34 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <cstdio>
+
+// 64 bit FNV-1a, used as a content hash for cache keys. Pass the previous result as `hash` to chain inputs.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline uint64_t hashString(const std::string& text, uint64_t hash = 14695981039346656037ull)
+{
+	// include the terminator so ("ab", "c") and ("a", "bc") hash differently
+	return hashBytes(text.c_str(), text.size() + 1, hash);
+}
+
+inline std::string hashToHex(uint64_t hash)
+{
+	char text[17];
+	snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+	return text;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef INPUT_EVENTS_H
+#define INPUT_EVENTS_H
+
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include "frame_stats.h"
+
+enum InputEventType : uint8_t {
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+	INPUT_MOUSE_MOVE,
+	INPUT_SCROLL
+};
+
+// key events index a 32 bit mask of held keys, anything from here on is not a key
+const uint32_t INPUT_KEY_LIMIT = 32;
+
+// One input event as it arrived from the window system. Keys are Camera_Movement values,
+// mouse and scroll events carry offsets in x/y.
+struct InputEvent
+{
+	// steady clock time in milliseconds (nowMs) when the event arrived
+	double timeMs;
+	InputEventType type;
+	uint8_t key;
+	float x;
+	float y;
+};
+
+// Single producer, single consumer ring of input events: the window callbacks push, the simulation
+// thread pops. Lock free, events are dropped (and counted) if the simulation falls a whole ring behind.
+class InputEventQueue
+{
+public:
+	static const uint32_t CAPACITY = 1024;
+
+	// events lost because the ring was full
+	std::atomic<uint32_t> dropped{ 0 };
+
+	bool push(InputEventType type, uint8_t key = 0, float x = 0.0f, float y = 0.0f)
+	{
+		uint32_t head = writeIndex.load(std::memory_order_relaxed);
+		if (head - readIndex.load(std::memory_order_acquire) == CAPACITY)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		InputEvent& event = events[head & (CAPACITY - 1)];
+		event.timeMs = nowMs();
+		event.type = type;
+		event.key = key;
+		event.x = x;
+		event.y = y;
+		writeIndex.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// pops the oldest event if it arrived before `timeMs`
+	bool popBefore(double timeMs, InputEvent& event)
+	{
+		uint32_t tail = readIndex.load(std::memory_order_relaxed);
+		if (tail == writeIndex.load(std::memory_order_acquire))
+			return false;
+		const InputEvent& next = events[tail & (CAPACITY - 1)];
+		if (next.timeMs >= timeMs)
+			return false;
+		event = next;
+		readIndex.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	InputEvent events[CAPACITY];
+	std::atomic<uint32_t> writeIndex{ 0 };
+	std::atomic<uint32_t> readIndex{ 0 };
+};
+
+// An event together with the simulation tick that consumed it, which is all a replay needs
+struct RecordedInputEvent
+{
+	uint64_t tick;
+	InputEventType type;
+	uint8_t key;
+	uint8_t reserved[2];
+	float x;
+	float y;
+	// tail padding made explicit so it is written as zeros
+	uint32_t reserved2;
+};
+static_assert(sizeof(RecordedInputEvent) == 24, "RecordedInputEvent layout is part of the file format");
+
+const char INPUT_RECORDING_MAGIC[4] = { 'I', 'N', 'P', 'T' };
+const uint32_t INPUT_RECORDING_VERSION = 1;
+
+// recording file: "INPT", version, event count, then the events in tick order
+inline bool writeInputRecording(const char* path, const std::vector<RecordedInputEvent>& events)
+{
+	std::ofstream file(path, std::ios::binary);
+	uint32_t header[2] = { INPUT_RECORDING_VERSION, (uint32_t)events.size() };
+	file.write(INPUT_RECORDING_MAGIC, 4);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)events.data(), events.size() * sizeof(RecordedInputEvent));
+	if (!file)
+	{
+		std::cout << "ERROR::INPUT::RECORDING_WRITE_FAILED " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+inline bool readInputRecording(const char* path, std::vector<RecordedInputEvent>& events)
+{
+	std::ifstream file(path, std::ios::binary);
+	char magic[4];
+	uint32_t header[2];
+	if (!file.read(magic, 4) || memcmp(magic, INPUT_RECORDING_MAGIC, 4) != 0
+		|| !file.read((char*)header, sizeof(header)) || header[0] != INPUT_RECORDING_VERSION)
+	{
+		std::cout << "ERROR::INPUT::RECORDING_NOT_VALID " << path << std::endl;
+		return false;
+	}
+	events.resize(header[1]);
+	if (!file.read((char*)events.data(), events.size() * sizeof(RecordedInputEvent)))
+	{
+		std::cout << "ERROR::INPUT::RECORDING_TRUNCATED " << path << std::endl;
+		events.clear();
+		return false;
+	}
+	for (const RecordedInputEvent& event : events)
+	{
+		bool keyEvent = event.type == INPUT_KEY_DOWN || event.type == INPUT_KEY_UP;
+		if (event.type > INPUT_SCROLL || (keyEvent && event.key >= INPUT_KEY_LIMIT))
+		{
+			std::cout << "ERROR::INPUT::RECORDING_NOT_VALID " << path << " has an event of type " << (int)event.type
+				<< " with key " << (int)event.key << std::endl;
+			events.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
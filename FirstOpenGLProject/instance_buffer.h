@@ -0,0 +1,41 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <cstddef>
+
+#include "normal_matrix.h"
+
+// What every instance carries: its model matrix and the normal matrix computed from it on the CPU
+struct InstanceData
+{
+	glm::mat4 model;
+	NormalMatrix normal;
+};
+
+// points the instance attributes of a vertex array at InstanceData records starting `offset` bytes into
+// `buffer`. The mat4 model matrix takes four consecutive locations from `firstLocation`, one vec4 column
+// each, the mat3 normal matrix the three after that, all advancing once per instance. The VAO stays
+// bound afterwards
+inline void attachInstanceAttributes(unsigned int vao, unsigned int buffer, unsigned int firstLocation, GLintptr offset)
+{
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (unsigned int column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(firstLocation + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(firstLocation + column);
+		glVertexAttribDivisor(firstLocation + column, 1);
+	}
+	for (unsigned int column = 0; column < 3; column++)
+	{
+		unsigned int location = firstLocation + 4 + column;
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, normal) + column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+}
+
+#endif
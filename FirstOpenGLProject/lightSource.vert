@@ -2,8 +2,18 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+	vec4 lightPos;
+	vec4 lightColor;
+	// clustered point lights: tiles per pixel in xy, depth slice = log(depth) * z + w
+	vec4 clusterScale;
+	// tiles x, tiles y, depth slices, point light count
+	ivec4 clusterSize;
+};
 
 void main()
 {
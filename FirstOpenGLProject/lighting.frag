@@ -3,30 +3,84 @@ out vec4 FragColor;
 
 in vec3 Normal;
 in vec3 FragPos;
+in vec3 LocalPos;
+in vec3 LocalNormal;
+in float ViewDepth;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
 uniform vec3 objectColor;
-uniform vec3 lightColor;
+// layer of the material's texture array, -1 for untextured materials
+uniform int materialLayer;
+uniform sampler2DArray materialTextures;
+// clustered point lights (see clustered_lighting.h): two texels per light, then per cluster the
+// first index and count of its lights in clusterLightIndices
+uniform samplerBuffer pointLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLightIndices;
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+	vec4 lightPos;
+	vec4 lightColor;
+	// clustered point lights: tiles per pixel in xy, depth slice = log(depth) * z + w
+	vec4 clusterScale;
+	// tiles x, tiles y, depth slices, point light count
+	ivec4 clusterSize;
+};
+
+// diffuse and specular of the point lights in this fragment's cluster
+vec3 clusterLighting(vec3 norm, vec3 viewDir) {
+	vec3 light = vec3(0.0);
+	if (clusterSize.w == 0)
+		return light;
+	ivec3 cell = ivec3(vec3(gl_FragCoord.xy * clusterScale.xy, log(max(ViewDepth, 1e-4)) * clusterScale.z + clusterScale.w));
+	cell = clamp(cell, ivec3(0), clusterSize.xyz - 1);
+	uvec2 range = texelFetch(clusterRanges, (cell.z * clusterSize.y + cell.y) * clusterSize.x + cell.x).xy;
+	for (uint i = 0u; i < range.y; i++) {
+		int index = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+		vec4 positionRadius = texelFetch(pointLights, index * 2);
+		vec3 color = texelFetch(pointLights, index * 2 + 1).rgb;
+		vec3 toLight = positionRadius.xyz - FragPos;
+		float distance = length(toLight);
+		// inverse square falloff, windowed to reach zero at the radius the light was binned with
+		float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+		float attenuation = window * window / (1.0 + distance * distance);
+		vec3 lightDir = toLight / max(distance, 1e-4);
+		float diff = max(dot(norm, lightDir), 0.0);
+		float spec = pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), 32);
+		light += (diff + 0.5 * spec) * attenuation * color;
+	}
+	return light;
+}
 
 void main() {
 	float specularStrength = 0.5;
 
 	vec3 norm = normalize(Normal);
-	vec3 lightDir = normalize(lightPos - FragPos);
+	vec3 lightDir = normalize(lightPos.xyz - FragPos);
 
-	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 viewDir = normalize(viewPos.xyz - FragPos);
 	vec3 reflectDir = reflect(-lightDir, norm);
 
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-	vec3 specular = specularStrength * spec * lightColor;
+	vec3 specular = specularStrength * spec * lightColor.rgb;
 
 	float diff = max(dot(norm, lightDir), 0.0);
-	vec3 diffuse = diff * lightColor;
+	vec3 diffuse = diff * lightColor.rgb;
 
 	float ambientStrength = 0.3;
-	vec3 ambient = ambientStrength * lightColor;
+	vec3 ambient = ambientStrength * lightColor.rgb;
+
+	vec3 albedo = objectColor;
+	if (materialLayer >= 0) {
+		// box mapping along the dominant object space axis, the meshes carry no texture coordinates
+		vec3 axis = abs(LocalNormal);
+		vec2 uv = axis.x > axis.y && axis.x > axis.z ? LocalPos.zy : (axis.y > axis.z ? LocalPos.xz : LocalPos.xy);
+		vec4 texel = texture(materialTextures, vec3(uv + 0.5, float(materialLayer)));
+		albedo *= mix(vec3(1.0), texel.rgb, texel.a);
+	}
 
-	vec3 result = (ambient + diffuse + specular) * objectColor;
+	vec3 result = (ambient + diffuse + specular + clusterLighting(norm, viewDir)) * albedo;
 	FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
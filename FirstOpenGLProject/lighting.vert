@@ -1,16 +1,39 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal; 
+// positions arrive as half floats with w = 1, normals as GL_INT_2_10_10_10_REV that the
+// vertex fetch already normalized to [-1, 1]
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec4 aNormal;
+// per-instance model matrix, takes locations 2 to 5, and its normal matrix (inverse transpose,
+// computed on the CPU) in locations 6 to 8
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in mat3 aNormalMatrix;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+	vec4 lightPos;
+	vec4 lightColor;
+	// clustered point lights: tiles per pixel in xy, depth slice = log(depth) * z + w
+	vec4 clusterScale;
+	// tiles x, tiles y, depth slices, point light count
+	ivec4 clusterSize;
+};
 
 out vec3 Normal;
 out vec3 FragPos;
+// object space position and normal, textured materials map the texture from them
+out vec3 LocalPos;
+out vec3 LocalNormal;
+// distance in front of the camera, picks the depth slice of the light clusters
+out float ViewDepth;
 
 void main() {
-	gl_Position = projection * view * model	* vec4(aPos, 1.0);
-	FragPos = vec3(model * vec4(aPos, 1.0));
-	Normal = mat3(transpose(inverse(model))) * aNormal;
+	vec4 worldPos = aModel * aPos;
+	gl_Position = projection * view * worldPos;
+	FragPos = vec3(worldPos);
+	ViewDepth = -(view * worldPos).z;
+	Normal = aNormalMatrix * aNormal.xyz;
+	LocalPos = aPos.xyz;
+	LocalNormal = aNormal.xyz;
 }
@@ -0,0 +1,437 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "mesh.h"
+
+// Level of detail: quadric error simplification (Garland & Heckbert) builds a chain of coarser meshes,
+// each with the geometric error it introduced, and LodSelector picks a level per object by projecting
+// that error to pixels.
+
+// Symmetric 4x4 error quadric, the sum of squared distances to a set of planes, weighted by area.
+// The weight sum is kept so the error can be turned back into a distance.
+struct Quadric
+{
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+	double weight = 0;
+
+	// the plane n.p + d = 0, n unit length
+	void addPlane(const glm::vec3& n, float d, double w)
+	{
+		a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+		a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+		a22 += w * n.z * n.z; a23 += w * n.z * d;
+		a33 += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+		weight += q.weight;
+	}
+
+	double error(double x, double y, double z) const
+	{
+		double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+			+ a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+			+ a22 * z * z + 2 * a23 * z + a33;
+		return e > 0.0 ? e : 0.0;
+	}
+
+	// position with the smallest error, false when the system is singular (flat or straight neighborhoods)
+	bool optimum(glm::vec3& p) const
+	{
+		double c00 = a11 * a22 - a12 * a12, c01 = a02 * a12 - a01 * a22, c02 = a01 * a12 - a02 * a11;
+		double det = a00 * c00 + a01 * c01 + a02 * c02;
+		if (fabs(det) < 1e-12 * (weight * weight * weight + 1e-30))
+			return false;
+		double c11 = a00 * a22 - a02 * a02, c12 = a01 * a02 - a00 * a12, c22 = a00 * a11 - a01 * a01;
+		double inv = 1.0 / det;
+		p.x = (float)(-(c00 * a03 + c01 * a13 + c02 * a23) * inv);
+		p.y = (float)(-(c01 * a03 + c11 * a13 + c12 * a23) * inv);
+		p.z = (float)(-(c02 * a03 + c12 * a13 + c22 * a23) * inv);
+		return true;
+	}
+};
+
+struct LodLevel
+{
+	Mesh mesh;
+	// object space error of the worst collapse behind this level: the area-weighted RMS distance from the
+	// merged vertex to the planes of the original faces it stands for (sqrt of quadric error over weight).
+	// An estimate of how far the surface moved, not a bound on the largest distance
+	float error;
+};
+
+// Collapses edges cheapest first until at most `targetTriangles` remain or nothing can collapse
+// without flipping a face or pinching the surface. Vertices are welded by position first so normal
+// seams don't stop collapses; normals are rebuilt afterwards by averaging the faces around each
+// corner that lie within `creaseAngle` degrees, so hard edges stay hard. Returns the error in `error`,
+// see LodLevel::error.
+inline Mesh simplifyMesh(const Mesh& mesh, size_t targetTriangles, float& error, float creaseAngle = 60.0f)
+{
+	// weld
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> remap(mesh.vertices.size());
+	{
+		std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+		{
+			const glm::vec3& p = mesh.vertices[i].position;
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			uint64_t key = ((uint64_t)bits[0] * 73856093u) ^ ((uint64_t)bits[1] * 19349663u) ^ ((uint64_t)bits[2] * 83492791u);
+			std::vector<uint32_t>& bucket = buckets[key];
+			uint32_t found = 0xffffffff;
+			for (uint32_t candidate : bucket)
+			{
+				if (positions[candidate] == p)
+					found = candidate;
+			}
+			if (found == 0xffffffff)
+			{
+				found = (uint32_t)positions.size();
+				positions.push_back(p);
+				bucket.push_back(found);
+			}
+			remap[i] = found;
+		}
+	}
+	size_t vertexCount = positions.size();
+
+	std::vector<uint32_t> triangles;
+	triangles.reserve(mesh.indices.size());
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		uint32_t a = remap[mesh.indices[i]], b = remap[mesh.indices[i + 1]], c = remap[mesh.indices[i + 2]];
+		if (a != b && b != c && a != c)
+		{
+			triangles.push_back(a);
+			triangles.push_back(b);
+			triangles.push_back(c);
+		}
+	}
+	size_t triangleCount = triangles.size() / 3;
+	std::vector<bool> triangleAlive(triangleCount, true);
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			vertexTriangles[triangles[t * 3 + k]].push_back((uint32_t)t);
+
+	// face planes, plus planes along open boundaries (at right angles to the face) so they keep their outline
+	std::vector<Quadric> quadrics(vertexCount);
+	std::unordered_map<uint64_t, int> edgeUses;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+			edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+		}
+	}
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3& p0 = positions[triangles[t * 3]];
+		glm::vec3 cross = glm::cross(positions[triangles[t * 3 + 1]] - p0, positions[triangles[t * 3 + 2]] - p0);
+		float doubleArea = glm::length(cross);
+		if (doubleArea == 0.0f)
+			continue;
+		glm::vec3 n = cross / doubleArea;
+		Quadric face;
+		face.addPlane(n, -glm::dot(n, p0), 0.5 * doubleArea);
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+			quadrics[a].add(face);
+			if (edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)] == 1)
+			{
+				glm::vec3 edge = positions[b] - positions[a];
+				glm::vec3 side = glm::cross(edge, n);
+				float length = glm::length(side);
+				if (length == 0.0f)
+					continue;
+				side = side / length;
+				Quadric boundary;
+				boundary.addPlane(side, -glm::dot(side, positions[a]), 10.0 * glm::dot(edge, edge));
+				quadrics[a].add(boundary);
+				quadrics[b].add(boundary);
+			}
+		}
+	}
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t keep, remove;
+		uint32_t keepVersion, removeVersion;
+		glm::vec3 position;
+		bool operator<(const Collapse& other) const { return cost > other.cost; }
+	};
+	std::vector<uint32_t> versions(vertexCount, 0);
+	std::vector<bool> removed(vertexCount, false);
+	std::priority_queue<Collapse> heap;
+
+	auto plan = [&](uint32_t a, uint32_t b) {
+		Quadric q = quadrics[a];
+		q.add(quadrics[b]);
+		Collapse collapse;
+		collapse.keep = a;
+		collapse.remove = b;
+		collapse.keepVersion = versions[a];
+		collapse.removeVersion = versions[b];
+		// the optimum when there is one, otherwise the best of the endpoints and the midpoint
+		glm::vec3 candidates[4] = { positions[a], positions[b], (positions[a] + positions[b]) * 0.5f, glm::vec3(0.0f) };
+		int candidateCount = q.optimum(candidates[3]) ? 4 : 3;
+		collapse.cost = -1.0;
+		for (int i = 0; i < candidateCount; i++)
+		{
+			double cost = q.error(candidates[i].x, candidates[i].y, candidates[i].z);
+			if (collapse.cost < 0.0 || cost < collapse.cost)
+			{
+				collapse.cost = cost;
+				collapse.position = candidates[i];
+			}
+		}
+		heap.push(collapse);
+	};
+	for (auto& edge : edgeUses)
+		plan((uint32_t)(edge.first >> 32), (uint32_t)edge.first);
+
+	// a collapse is refused if it turns a face around, or if the two vertices share more neighbors
+	// than the faces on their edge account for (the link condition), which would pinch the surface
+	std::vector<uint32_t> neighborStamp(vertexCount, 0);
+	uint32_t stamp = 0;
+	auto allowed = [&](const Collapse& c) -> bool {
+		stamp++;
+		for (uint32_t t : vertexTriangles[c.keep])
+			for (int k = 0; k < 3; k++)
+				neighborStamp[triangles[t * 3 + k]] = stamp;
+		int sharedFaces = 0, sharedNeighbors = 0;
+		for (uint32_t t : vertexTriangles[c.remove])
+		{
+			bool hasKeep = false;
+			for (int k = 0; k < 3; k++)
+				hasKeep = hasKeep || triangles[t * 3 + k] == c.keep;
+			if (hasKeep)
+				sharedFaces++;
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = triangles[t * 3 + k];
+				if (v != c.keep && v != c.remove && neighborStamp[v] == stamp)
+				{
+					sharedNeighbors++;
+					neighborStamp[v] = 0;
+				}
+			}
+		}
+		if (sharedNeighbors > sharedFaces)
+			return false;
+
+		for (int side = 0; side < 2; side++)
+		{
+			for (uint32_t t : vertexTriangles[side == 0 ? c.keep : c.remove])
+			{
+				uint32_t* tri = &triangles[t * 3];
+				bool collapses = false;
+				glm::vec3 before[3], after[3];
+				for (int k = 0; k < 3; k++)
+				{
+					collapses = collapses || tri[k] == (side == 0 ? c.remove : c.keep);
+					before[k] = positions[tri[k]];
+					after[k] = (tri[k] == c.keep || tri[k] == c.remove) ? c.position : before[k];
+				}
+				if (collapses)
+					continue;
+				glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+					return false;
+			}
+		}
+		return true;
+	};
+
+	size_t liveTriangles = triangleCount;
+	double worstError = 0.0;
+	while (liveTriangles > targetTriangles && !heap.empty())
+	{
+		Collapse c = heap.top();
+		heap.pop();
+		if (removed[c.keep] || removed[c.remove] || versions[c.keep] != c.keepVersion || versions[c.remove] != c.removeVersion)
+			continue;
+		if (!allowed(c))
+			continue;
+
+		Quadric& q = quadrics[c.keep];
+		q.add(quadrics[c.remove]);
+		worstError = std::max(worstError, q.weight > 0.0 ? c.cost / q.weight : 0.0);
+		positions[c.keep] = c.position;
+		removed[c.remove] = true;
+		versions[c.keep]++;
+
+		for (uint32_t t : vertexTriangles[c.remove])
+		{
+			uint32_t* tri = &triangles[t * 3];
+			if (tri[0] == c.keep || tri[1] == c.keep || tri[2] == c.keep)
+			{
+				triangleAlive[t] = false;
+				liveTriangles--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				if (tri[k] == c.remove)
+					tri[k] = c.keep;
+			}
+			vertexTriangles[c.keep].push_back(t);
+		}
+		vertexTriangles[c.remove].clear();
+
+		// drop the dead faces from the neighbors' lists and plan their edges to the moved vertex again
+		std::vector<uint32_t>& around = vertexTriangles[c.keep];
+		around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return !triangleAlive[t]; }), around.end());
+		stamp++;
+		for (uint32_t t : around)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = triangles[t * 3 + k];
+				if (v == c.keep || neighborStamp[v] == stamp)
+					continue;
+				neighborStamp[v] = stamp;
+				std::vector<uint32_t>& list = vertexTriangles[v];
+				list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t u) { return !triangleAlive[u]; }), list.end());
+				plan(c.keep, v);
+			}
+		}
+	}
+	error = (float)sqrt(worstError);
+
+	// rebuild corners with crease aware normals, then index and optimize like any other mesh
+	std::vector<glm::vec3> faceNormals(triangleCount, glm::vec3(0.0f));
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!triangleAlive[t])
+			continue;
+		const glm::vec3& p0 = positions[triangles[t * 3]];
+		faceNormals[t] = glm::cross(positions[triangles[t * 3 + 1]] - p0, positions[triangles[t * 3 + 2]] - p0);
+	}
+	float creaseCos = cosf(glm::radians(creaseAngle));
+	std::vector<float> interleaved;
+	interleaved.reserve(liveTriangles * 18);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!triangleAlive[t] || faceNormals[t] == glm::vec3(0.0f))
+			continue;
+		glm::vec3 faceDirection = glm::normalize(faceNormals[t]);
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = triangles[t * 3 + k];
+			glm::vec3 normal(0.0f);
+			for (uint32_t other : vertexTriangles[v])
+			{
+				if (faceNormals[other] != glm::vec3(0.0f) && glm::dot(glm::normalize(faceNormals[other]), faceDirection) >= creaseCos)
+					normal += faceNormals[other];
+			}
+			normal = glm::normalize(normal);
+			const float corner[6] = { positions[v].x, positions[v].y, positions[v].z, normal.x, normal.y, normal.z };
+			interleaved.insert(interleaved.end(), corner, corner + 6);
+		}
+	}
+	return buildOptimizedMesh(interleaved.data(), interleaved.size() / 6, 6);
+}
+
+// LOD chain of a mesh: level 0 is the mesh itself, every further level aims at `ratio` of the
+// previous one's triangles. Stops at `maxLevels`, at `minTriangles`, or when simplification stalls.
+inline std::vector<LodLevel> buildLodChain(const Mesh& mesh, int maxLevels = 4, float ratio = 0.5f, size_t minTriangles = 4)
+{
+	std::vector<LodLevel> levels(1);
+	levels[0].mesh = mesh;
+	levels[0].error = 0.0f;
+	while ((int)levels.size() < maxLevels)
+	{
+		size_t previous = levels.back().mesh.indices.size() / 3;
+		size_t target = std::max(minTriangles, (size_t)(previous * ratio));
+		if (target >= previous)
+			break;
+		LodLevel level;
+		// always from the full mesh, so errors don't compound through the chain
+		level.mesh = simplifyMesh(mesh, target, level.error);
+		size_t triangles = level.mesh.indices.size() / 3;
+		if (triangles == 0 || triangles > previous * 0.9f)
+			break;
+		level.error = std::max(level.error, levels.back().error);
+		levels.push_back(level);
+	}
+	return levels;
+}
+
+// Picks a level per object from the projected screen space error. A level is good enough when its
+// error covers at most `pixelError` pixels; to stop objects near a threshold from flickering between
+// levels, moving to a coarser level also requires the error to be `hysteresis` below the threshold.
+class LodSelector
+{
+public:
+	float pixelError = 1.0f;
+	float hysteresis = 0.25f;
+	// objects drawn at each level by the last select() calls since reset()
+	std::vector<size_t> levelCounts;
+
+	// pixels per unit of error at distance 1: viewport height over the height of the view at distance 1
+	static float projectionScale(float fovyDegrees, int viewportHeight)
+	{
+		return viewportHeight / (2.0f * tanf(glm::radians(fovyDegrees) * 0.5f));
+	}
+
+	// call every frame before select(), remembered levels survive it
+	void reset(size_t objectCount, int levelCount)
+	{
+		levels.resize(objectCount, 0);
+		levelCounts.assign(levelCount, 0);
+	}
+
+	// `errors` per level, increasing; `distance` from the eye to the object's nearest point, and
+	// `scale` its largest world scale. Remembers the level for the next frame.
+	int select(size_t object, const float* errors, int levelCount, float projectionScale, float distance, float scale)
+	{
+		float pixelsPerUnit = projectionScale * scale / std::max(distance, 1e-3f);
+		int fine = 0, coarse = 0;
+		for (int level = 1; level < levelCount; level++)
+		{
+			float pixels = errors[level] * pixelsPerUnit;
+			if (pixels <= pixelError)
+				fine = level;
+			if (pixels <= pixelError * (1.0f - hysteresis))
+				coarse = level;
+		}
+		int current = levels[object] < levelCount ? levels[object] : 0;
+		if (current > fine)
+			current = fine;
+		else if (coarse > current)
+			current = coarse;
+		levels[object] = (uint8_t)current;
+		levelCounts[current]++;
+		return current;
+	}
+
+private:
+	std::vector<uint8_t> levels;
+};
+
+#endif
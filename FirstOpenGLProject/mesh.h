@@ -0,0 +1,386 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "buffer_upload.h"
+
+// Mesh building stage: turns expanded triangle lists into compact indexed meshes that are
+// ordered for the post-transform vertex cache and quantized for upload.
+
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+struct Mesh
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Quantized vertex as it is stored in the vertex buffer, 12 bytes instead of 24:
+// position as three half floats (plus one of padding) and the normal as snorm GL_INT_2_10_10_10_REV
+struct PackedVertex
+{
+	uint16_t position[4];
+	uint32_t normal;
+};
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must stay tightly packed");
+
+// builds an indexed mesh from a triangle list of interleaved position/normal floats,
+// identical vertices are merged into one
+inline Mesh buildIndexedMesh(const float* interleaved, size_t vertexCount, size_t strideFloats)
+{
+	Mesh mesh;
+	std::unordered_map<std::string, uint32_t> unique;
+	mesh.indices.reserve(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const float* v = interleaved + i * strideFloats;
+		MeshVertex vertex;
+		vertex.position = glm::vec3(v[0], v[1], v[2]);
+		vertex.normal = glm::vec3(v[3], v[4], v[5]);
+		// bitwise key so -0.0 and 0.0 only merge when they are really the same bits
+		std::string key((const char*)&vertex, sizeof(MeshVertex));
+		auto found = unique.find(key);
+		if (found == unique.end())
+		{
+			uint32_t index = (uint32_t)mesh.vertices.size();
+			unique.emplace(key, index);
+			mesh.vertices.push_back(vertex);
+			mesh.indices.push_back(index);
+		}
+		else
+			mesh.indices.push_back(found->second);
+	}
+	return mesh;
+}
+
+// average cache miss ratio: transformed vertices per triangle with a FIFO post-transform cache.
+// 3.0 is the worst case (no reuse), 0.5 is the limit for large regular grids.
+inline float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+	if (indices.empty())
+		return 0.0f;
+	std::vector<uint32_t> cacheStamp(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	for (uint32_t index : indices)
+	{
+		// in cache if it entered less than cacheSize misses ago
+		if (time - cacheStamp[index] > cacheSize)
+		{
+			cacheStamp[index] = time++;
+			misses++;
+		}
+	}
+	return (float)misses / (indices.size() / 3);
+}
+
+// Tom Forsyth's linear-speed vertex cache optimization: greedily emits the triangle with the
+// highest score, where vertices score higher the more recently they were used and the fewer
+// triangles still need them.
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	const int CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRI_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// triangles that use each vertex, as offsets into one flat array
+	std::vector<uint32_t> valence(vertexCount, 0);
+	for (uint32_t index : indices)
+		valence[index]++;
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + valence[v];
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<uint32_t> remaining(valence);
+	std::vector<float> vertexScore(vertexCount, 0.0f);
+	std::vector<float> triangleScore(triangleCount, 0.0f);
+	std::vector<bool> emitted(triangleCount, false);
+
+	auto scoreVertex = [&](uint32_t v) -> float
+	{
+		if (remaining[v] == 0)
+			return -1.0f;
+		float score = 0.0f;
+		int position = cachePosition[v];
+		if (position >= 0)
+		{
+			if (position < 3)
+				score = LAST_TRI_SCORE;
+			else
+				score = powf(1.0f - (position - 3) * (1.0f / (CACHE_SIZE - 3)), CACHE_DECAY_POWER);
+		}
+		return score + VALENCE_BOOST_SCALE * powf((float)remaining[v], -VALENCE_BOOST_POWER);
+	};
+
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = scoreVertex((uint32_t)v);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::vector<uint32_t> cache;
+	cache.reserve(CACHE_SIZE + 3);
+	size_t scanFrom = 0;
+	int best = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (best < 0)
+		{
+			// nothing in the cache connects to unemitted triangles, take the best one left anywhere
+			float bestScore = -1.0f;
+			while (scanFrom < triangleCount && emitted[scanFrom])
+				scanFrom++;
+			for (size_t t = scanFrom; t < triangleCount; t++)
+			{
+				if (!emitted[t] && triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = (int)t;
+				}
+			}
+		}
+
+		uint32_t tri = (uint32_t)best;
+		emitted[tri] = true;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = indices[tri * 3 + k];
+			output.push_back(v);
+			remaining[v]--;
+			// remove the triangle from the vertex's list of pending triangles
+			uint32_t* first = &adjacency[adjacencyStart[v]];
+			uint32_t* last = first + remaining[v] + 1;
+			*std::find(first, last, tri) = *(last - 1);
+
+			// move the vertex to the front of the LRU cache
+			auto inCache = std::find(cache.begin(), cache.end(), v);
+			if (inCache != cache.end())
+				cache.erase(inCache);
+			cache.insert(cache.begin(), v);
+		}
+
+		// vertices pushed out of the cache lose their cache score
+		for (size_t i = CACHE_SIZE; i < cache.size(); i++)
+			cachePosition[cache[i]] = -1;
+		if (cache.size() > (size_t)CACHE_SIZE)
+			cache.resize(CACHE_SIZE);
+		for (size_t i = 0; i < cache.size(); i++)
+			cachePosition[cache[i]] = (int)i;
+
+		// rescore everything in the cache and pick the best triangle touching it
+		best = -1;
+		float bestScore = -1.0f;
+		for (uint32_t v : cache)
+			vertexScore[v] = scoreVertex(v);
+		for (uint32_t v : cache)
+		{
+			for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v] + remaining[v]; a++)
+			{
+				uint32_t t = adjacency[a];
+				triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = (int)t;
+				}
+			}
+		}
+	}
+	indices.swap(output);
+}
+
+// renumbers vertices in the order the index buffer first touches them, so fetches walk memory forwards
+inline void optimizeVertexFetch(Mesh& mesh)
+{
+	std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+	std::vector<MeshVertex> ordered;
+	ordered.reserve(mesh.vertices.size());
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = (uint32_t)ordered.size();
+			ordered.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(ordered);
+}
+
+// IEEE 754 half from float, round to nearest even, overflow goes to infinity
+inline uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	int exponent = (int)((bits >> 23) & 0xffu) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffffu;
+
+	if (((bits >> 23) & 0xffu) == 0xffu)
+		return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+	if (exponent >= 31)
+		return (uint16_t)(sign | 0x7c00u);
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return (uint16_t)sign;
+		// subnormal half
+		mantissa |= 0x800000u;
+		uint32_t shift = (uint32_t)(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1u)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fffu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+		half++;
+	return (uint16_t)half;
+}
+
+// packs a unit vector into signed normalized 10:10:10:2 (x in the low bits, w left at 0)
+inline uint32_t packNormal2101010(const glm::vec3& normal)
+{
+	uint32_t packed = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float c = std::min(std::max(normal[axis], -1.0f), 1.0f);
+		int value = (int)lroundf(c * 511.0f);
+		packed |= ((uint32_t)value & 0x3ffu) << (10 * axis);
+	}
+	return packed;
+}
+
+// positions must stay within half float range and precision, i.e. this is for mesh-local coordinates
+inline std::vector<PackedVertex> packVertices(const std::vector<MeshVertex>& vertices)
+{
+	std::vector<PackedVertex> packed(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+			packed[i].position[axis] = floatToHalf(vertices[i].position[axis]);
+		packed[i].position[3] = floatToHalf(1.0f);
+		packed[i].normal = packNormal2101010(vertices[i].normal);
+	}
+	return packed;
+}
+
+// dedupes, orders for the vertex cache and for fetch locality, all the steps the renderer wants
+inline Mesh buildOptimizedMesh(const float* interleaved, size_t vertexCount, size_t strideFloats)
+{
+	Mesh mesh = buildIndexedMesh(interleaved, vertexCount, strideFloats);
+	optimizeVertexCache(mesh.indices, mesh.vertices.size());
+	optimizeVertexFetch(mesh);
+	return mesh;
+}
+
+// Packed vertex buffer and 16 or 32 bit element buffer of a mesh on the GPU
+class GpuMesh
+{
+public:
+	unsigned int VBO = 0;
+	unsigned int EBO = 0;
+	GLsizei indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_SHORT;
+	size_t vertexCount = 0;
+
+	// packs and uploads a mesh built on the CPU
+	GpuMesh(const Mesh& mesh, BufferUploader* uploader = NULL)
+	{
+		std::vector<PackedVertex> packed = packVertices(mesh.vertices);
+		if (packed.size() <= 65536)
+		{
+			std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+			upload(packed.data(), packed.size(), shortIndices.data(), shortIndices.size(), GL_UNSIGNED_SHORT, uploader);
+		}
+		else
+			upload(packed.data(), packed.size(), mesh.indices.data(), mesh.indices.size(), GL_UNSIGNED_INT, uploader);
+	}
+
+	// uploads vertex and index data that is already in the PackedVertex layout, e.g. straight out of a mapped mesh file
+	GpuMesh(const void* packedVertices, size_t vertexCount, const void* indices, size_t indexCount, GLenum indexType, BufferUploader* uploader = NULL)
+	{
+		upload(packedVertices, vertexCount, indices, indexCount, indexType, uploader);
+	}
+
+	~GpuMesh()
+	{
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+
+	GpuMesh(const GpuMesh&) = delete;
+	GpuMesh& operator=(const GpuMesh&) = delete;
+
+	// binds the buffers to a vertex array: position at location 0, and the normal at location 1 if asked for
+	void attach(unsigned int vao, bool withNormal = true)
+	{
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+		glEnableVertexAttribArray(0);
+		if (withNormal)
+		{
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+			glEnableVertexAttribArray(1);
+		}
+	}
+
+private:
+	void upload(const void* packedVertices, size_t vertices, const void* indices, size_t indexTotal, GLenum type, BufferUploader* uploader)
+	{
+		vertexCount = vertices;
+		indexCount = (GLsizei)indexTotal;
+		indexType = type;
+		size_t indexSize = type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+		VBO = createBuffer(packedVertices, vertices * sizeof(PackedVertex), uploader);
+		EBO = createBuffer(indices, indexTotal * indexSize, uploader);
+	}
+
+	static unsigned int createBuffer(const void* data, size_t bytes, BufferUploader* uploader)
+	{
+		if (uploader)
+			return uploader->createBuffer(data, bytes);
+		unsigned int buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+};
+
+#endif
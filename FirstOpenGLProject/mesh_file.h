@@ -0,0 +1,162 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "mesh.h"
+#include "mapped_file.h"
+
+// Binary mesh container (.mesh). The vertex and index blobs are stored exactly as the GPU consumes them
+// (PackedVertex with 16 or 32 bit indices), so loading is a memory mapping plus one copy into GL.
+//
+//   MeshFileHeader | padding | vertex blob | padding | index blob
+//
+// Blobs start at MESH_FILE_ALIGNMENT byte offsets. All fields are little endian.
+const char MESH_FILE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+const uint32_t MESH_FILE_VERSION = 1;
+const uint64_t MESH_FILE_ALIGNMENT = 64;
+
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t indexType;
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexBytes;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader layout is part of the file format");
+
+inline uint64_t alignMeshOffset(uint64_t offset)
+{
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~(MESH_FILE_ALIGNMENT - 1);
+}
+
+// packs a mesh and writes it in the .mesh layout, to a file or into an asset pack blob
+inline bool writeMeshFile(std::ostream& file, const Mesh& mesh)
+{
+	std::vector<PackedVertex> packed = packVertices(mesh.vertices);
+	bool shortIndices = packed.size() <= 65536;
+	std::vector<uint16_t> indices16;
+	if (shortIndices)
+		indices16.assign(mesh.indices.begin(), mesh.indices.end());
+
+	MeshFileHeader header = {};
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+	header.version = MESH_FILE_VERSION;
+	header.vertexCount = (uint32_t)packed.size();
+	header.vertexStride = sizeof(PackedVertex);
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	header.vertexOffset = alignMeshOffset(sizeof(MeshFileHeader));
+	header.vertexBytes = packed.size() * sizeof(PackedVertex);
+	header.indexOffset = alignMeshOffset(header.vertexOffset + header.vertexBytes);
+	header.indexBytes = mesh.indices.size() * (shortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		boundsMin = i == 0 ? mesh.vertices[i].position : glm::min(boundsMin, mesh.vertices[i].position);
+		boundsMax = i == 0 ? mesh.vertices[i].position : glm::max(boundsMax, mesh.vertices[i].position);
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		header.boundsMin[axis] = boundsMin[axis];
+		header.boundsMax[axis] = boundsMax[axis];
+	}
+
+	const char zeros[MESH_FILE_ALIGNMENT] = {};
+	file.write((const char*)&header, sizeof(header));
+	file.write(zeros, header.vertexOffset - sizeof(header));
+	file.write((const char*)packed.data(), header.vertexBytes);
+	file.write(zeros, header.indexOffset - (header.vertexOffset + header.vertexBytes));
+	if (shortIndices)
+		file.write((const char*)indices16.data(), header.indexBytes);
+	else
+		file.write((const char*)mesh.indices.data(), header.indexBytes);
+	return (bool)file;
+}
+
+inline bool writeMeshFile(const char* path, const Mesh& mesh)
+{
+	std::ofstream file(path, std::ios::binary);
+	return file && writeMeshFile(file, mesh);
+}
+
+// A .mesh file mapped into memory, or a .mesh blob inside an asset pack. The blob pointers point into
+// the mapping and stay valid until the file (or the pack) is closed.
+class MeshFile
+{
+public:
+	MeshFileHeader header = {};
+
+	bool open(const char* path)
+	{
+		if (!file.open(path))
+			return false;
+		return open(file.data(), file.size());
+	}
+
+	// uses `size` bytes that the caller keeps alive, e.g. AssetPack::data()
+	bool open(const unsigned char* data, size_t size)
+	{
+		bytes = data;
+		if (size < sizeof(MeshFileHeader))
+			return fail("ERROR::MESH_FILE::TRUNCATED");
+		memcpy(&header, bytes, sizeof(MeshFileHeader));
+		if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0)
+			return fail("ERROR::MESH_FILE::BAD_MAGIC");
+		if (header.version != MESH_FILE_VERSION)
+			return fail("ERROR::MESH_FILE::UNSUPPORTED_VERSION");
+		if (header.vertexStride != sizeof(PackedVertex))
+			return fail("ERROR::MESH_FILE::UNSUPPORTED_VERTEX_LAYOUT");
+		if (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT)
+			return fail("ERROR::MESH_FILE::UNSUPPORTED_INDEX_TYPE");
+		uint64_t indexSize = header.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		if (header.vertexBytes != (uint64_t)header.vertexCount * header.vertexStride || header.indexBytes != header.indexCount * indexSize
+			|| header.vertexOffset > size || header.vertexBytes > size - header.vertexOffset
+			|| header.indexOffset > size || header.indexBytes > size - header.indexOffset)
+			return fail("ERROR::MESH_FILE::BAD_BLOB_RANGE");
+		return true;
+	}
+
+	const void* vertexData() const
+	{
+		return bytes + header.vertexOffset;
+	}
+
+	const void* indexData() const
+	{
+		return bytes + header.indexOffset;
+	}
+
+	// creates the GPU buffers straight from the mapping
+	GpuMesh* createGpuMesh(BufferUploader* uploader) const
+	{
+		return new GpuMesh(vertexData(), header.vertexCount, indexData(), header.indexCount, header.indexType, uploader);
+	}
+
+private:
+	MappedFile file;
+	const unsigned char* bytes = NULL;
+
+	bool fail(const char* message)
+	{
+		std::cout << message << std::endl;
+		file.close();
+		bytes = NULL;
+		return false;
+	}
+};
+
+#endif
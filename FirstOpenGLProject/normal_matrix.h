@@ -0,0 +1,118 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMAL_MATRIX_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Inverse transpose of the upper 3x3 of a model matrix, stored as three vec4 columns (w unused)
+// so it can be loaded and stored as whole SIMD registers and streamed as an instance attribute.
+struct NormalMatrix
+{
+	glm::vec4 columns[3];
+};
+
+// relative tolerance for treating column lengths as equal and columns as perpendicular
+const float UNIFORM_SCALE_EPSILON = 1e-4f;
+
+#if defined(NORMAL_MATRIX_SSE2)
+inline __m128 normalMatrixCross(__m128 a, __m128 b)
+{
+	// a.yzx * b.zxy - a.zxy * b.yzx
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// dot product of the xyz parts, broadcast to every lane
+inline __m128 normalMatrixDot(__m128 a, __m128 b)
+{
+	__m128 product = _mm_mul_ps(a, b);
+	__m128 sum = _mm_add_ps(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(3, 0, 2, 1)));
+	sum = _mm_add_ps(sum, _mm_shuffle_ps(product, product, _MM_SHUFFLE(3, 1, 0, 2)));
+	return _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+}
+#endif
+
+// Normal matrix of one model matrix. Rotation with uniform scale s (columns of equal length and at
+// right angles) only needs the columns divided by s^2; anything else goes through the cofactors,
+// whose columns are cross products of the model's columns, divided by the determinant.
+// Returns true when the uniform scale path was taken.
+inline bool computeNormalMatrix(const glm::mat4& model, NormalMatrix& normal)
+{
+#if defined(NORMAL_MATRIX_SSE2)
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	__m128 c0 = _mm_and_ps(_mm_loadu_ps(&model[0][0]), xyzMask);
+	__m128 c1 = _mm_and_ps(_mm_loadu_ps(&model[1][0]), xyzMask);
+	__m128 c2 = _mm_and_ps(_mm_loadu_ps(&model[2][0]), xyzMask);
+
+	float l0 = _mm_cvtss_f32(normalMatrixDot(c0, c0));
+	float l1 = _mm_cvtss_f32(normalMatrixDot(c1, c1));
+	float l2 = _mm_cvtss_f32(normalMatrixDot(c2, c2));
+	float tolerance = UNIFORM_SCALE_EPSILON * l0;
+	bool uniform = fabs(l0 - l1) <= tolerance && fabs(l0 - l2) <= tolerance
+		&& fabs(_mm_cvtss_f32(normalMatrixDot(c0, c1))) <= tolerance
+		&& fabs(_mm_cvtss_f32(normalMatrixDot(c0, c2))) <= tolerance
+		&& fabs(_mm_cvtss_f32(normalMatrixDot(c1, c2))) <= tolerance;
+	if (uniform && l0 > 0.0f)
+	{
+		__m128 inverseScale = _mm_set1_ps(1.0f / l0);
+		_mm_storeu_ps(&normal.columns[0][0], _mm_mul_ps(c0, inverseScale));
+		_mm_storeu_ps(&normal.columns[1][0], _mm_mul_ps(c1, inverseScale));
+		_mm_storeu_ps(&normal.columns[2][0], _mm_mul_ps(c2, inverseScale));
+		return true;
+	}
+
+	__m128 n0 = normalMatrixCross(c1, c2);
+	__m128 n1 = normalMatrixCross(c2, c0);
+	__m128 n2 = normalMatrixCross(c0, c1);
+	__m128 determinant = normalMatrixDot(c0, n0);
+	__m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+	_mm_storeu_ps(&normal.columns[0][0], _mm_mul_ps(n0, inverseDeterminant));
+	_mm_storeu_ps(&normal.columns[1][0], _mm_mul_ps(n1, inverseDeterminant));
+	_mm_storeu_ps(&normal.columns[2][0], _mm_mul_ps(n2, inverseDeterminant));
+	return false;
+#else
+	glm::vec3 c0(model[0]), c1(model[1]), c2(model[2]);
+	float l0 = glm::dot(c0, c0), l1 = glm::dot(c1, c1), l2 = glm::dot(c2, c2);
+	float tolerance = UNIFORM_SCALE_EPSILON * l0;
+	bool uniform = fabs(l0 - l1) <= tolerance && fabs(l0 - l2) <= tolerance && fabs(glm::dot(c0, c1)) <= tolerance
+		&& fabs(glm::dot(c0, c2)) <= tolerance && fabs(glm::dot(c1, c2)) <= tolerance;
+	if (uniform && l0 > 0.0f)
+	{
+		normal.columns[0] = glm::vec4(c0 / l0, 0.0f);
+		normal.columns[1] = glm::vec4(c1 / l0, 0.0f);
+		normal.columns[2] = glm::vec4(c2 / l0, 0.0f);
+		return true;
+	}
+	glm::vec3 n0 = glm::cross(c1, c2), n1 = glm::cross(c2, c0), n2 = glm::cross(c0, c1);
+	float inverseDeterminant = 1.0f / glm::dot(c0, n0);
+	normal.columns[0] = glm::vec4(n0 * inverseDeterminant, 0.0f);
+	normal.columns[1] = glm::vec4(n1 * inverseDeterminant, 0.0f);
+	normal.columns[2] = glm::vec4(n2 * inverseDeterminant, 0.0f);
+	return false;
+#endif
+}
+
+// normal matrices for a batch of model matrices, `indices` picks the entries to compute (all `count`
+// from 0 when NULL). Returns how many took the uniform scale path.
+inline size_t computeNormalMatrices(const glm::mat4* models, NormalMatrix* normals, const uint32_t* indices, size_t count)
+{
+	size_t uniform = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = indices ? indices[i] : i;
+		uniform += computeNormalMatrix(models[index], normals[index]);
+	}
+	return uniform;
+}
+
+#endif
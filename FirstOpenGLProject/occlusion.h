@@ -0,0 +1,412 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "thread_pool.h"
+#include "culling.h"
+#include "mesh.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Software hierarchical-Z occlusion culling. A few large, near occluders are rasterized depth only
+// into a small buffer (rows split into bands, one pool task per band), which is reduced into a
+// pyramid of min and max depth. Candidate boxes are projected, and a box is occluded when its
+// nearest depth is behind the farthest occluder depth everywhere under its screen rectangle,
+// read from the pyramid level where that rectangle spans at most 4x4 texels.
+// Depth is window depth in [0, 1] like the GL depth buffer, 1 is the far plane.
+class OcclusionCuller
+{
+public:
+	static const int BAND_ROWS = 16;
+	static const size_t CHUNK_SIZE = 1024;
+
+	// occluders taken by chooseOccluders
+	size_t maxOccluders = 32;
+	// indices of the candidates that passed, valid after test
+	std::vector<uint32_t> visible;
+	size_t occludedCount = 0;
+	size_t occluderTriangles = 0;
+
+	OcclusionCuller(int width = 256, int height = 192)
+	{
+		for (int w = width, h = height; ; w = (w + 1) / 2, h = (h + 1) / 2)
+		{
+			Level level;
+			level.width = w;
+			level.height = h;
+			// room for a 4 wide load starting at the last texel
+			level.stride = ((w + 3) & ~3) + 4;
+			level.maxDepth.assign((size_t)level.stride * h, 1.0f);
+			level.minDepth.assign((size_t)level.stride * h, 1.0f);
+			levels.push_back(level);
+			if (w == 1 && h == 1)
+				break;
+		}
+	}
+
+	int width() const
+	{
+		return levels[0].width;
+	}
+
+	int height() const
+	{
+		return levels[0].height;
+	}
+
+	// farthest occluder depth of a level 0 texel after build(), for debugging views
+	float depthAt(int x, int y) const
+	{
+		return levels[0].maxDepth[(size_t)y * levels[0].stride + x];
+	}
+
+	// the `maxOccluders` candidates covering the most of the screen, judged by box size over distance
+	void chooseOccluders(const ObjectStore& store, const std::vector<uint32_t>& candidates, const glm::vec3& eye, std::vector<uint32_t>& occluders)
+	{
+		scored.clear();
+		for (uint32_t index : candidates)
+		{
+			glm::vec3 extent(store.extentX[index], store.extentY[index], store.extentZ[index]);
+			glm::vec3 offset = glm::vec3(store.centerX[index], store.centerY[index], store.centerZ[index]) - eye;
+			float score = glm::dot(extent, extent) / std::max(glm::dot(offset, offset), 1e-6f);
+			scored.push_back(std::make_pair(score, index));
+		}
+		size_t count = std::min(maxOccluders, scored.size());
+		std::partial_sort(scored.begin(), scored.begin() + count, scored.end(),
+			[](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+		occluders.resize(count);
+		for (size_t i = 0; i < count; i++)
+			occluders[i] = scored[i].second;
+	}
+
+	// starts a frame: clears the occluder list, depth goes back to the far plane in build()
+	void begin(const glm::mat4& projectionView)
+	{
+		viewProjection = projectionView;
+		triangles.clear();
+	}
+
+	// queues the triangles of a mesh placed with `model`. Triangles crossing the near plane are
+	// dropped, which only loses occlusion and never hides anything
+	void addOccluder(const Mesh& mesh, const glm::mat4& model)
+	{
+		glm::mat4 modelViewProjection = viewProjection * model;
+		projected.resize(mesh.vertices.size());
+		for (size_t v = 0; v < mesh.vertices.size(); v++)
+			projected[v] = modelViewProjection * glm::vec4(mesh.vertices[v].position, 1.0f);
+		const Level& base = levels[0];
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			float x[3], y[3], z[3];
+			bool nearClipped = false;
+			for (int k = 0; k < 3; k++)
+			{
+				const glm::vec4& clip = projected[mesh.indices[i + k]];
+				if (clip.z < -clip.w || clip.w <= 0.0f)
+					nearClipped = true;
+				float invW = 1.0f / clip.w;
+				x[k] = (clip.x * invW * 0.5f + 0.5f) * base.width;
+				y[k] = (0.5f - clip.y * invW * 0.5f) * base.height;
+				z[k] = clip.z * invW * 0.5f + 0.5f;
+			}
+			if (nearClipped)
+				continue;
+			setup(x, y, z);
+		}
+	}
+
+	// rasterizes the queued occluders and builds the pyramid
+	void build(ThreadPool& pool)
+	{
+		const Level& base = levels[0];
+		int bandCount = (base.height + BAND_ROWS - 1) / BAND_ROWS;
+		bands.resize(bandCount);
+		for (std::vector<uint32_t>& band : bands)
+			band.clear();
+		for (uint32_t t = 0; t < triangles.size(); t++)
+		{
+			for (int band = triangles[t].minY / BAND_ROWS; band <= triangles[t].maxY / BAND_ROWS; band++)
+				bands[band].push_back(t);
+		}
+		occluderTriangles = triangles.size();
+
+		pool.parallelFor(bands.size(), 1, [this](size_t begin, size_t end) {
+			for (size_t band = begin; band < end; band++)
+				rasterBand((int)band);
+		});
+
+		// every texel of a level holds the min and max of the 2x2 (fewer at odd edges) below it
+		for (size_t l = 1; l < levels.size(); l++)
+		{
+			const Level& below = levels[l - 1];
+			Level& level = levels[l];
+			for (int y = 0; y < level.height; y++)
+			{
+				int y0 = y * 2, y1 = std::min(y * 2 + 1, below.height - 1);
+				for (int x = 0; x < level.width; x++)
+				{
+					int x0 = x * 2, x1 = std::min(x * 2 + 1, below.width - 1);
+					size_t a = (size_t)y0 * below.stride + x0, b = (size_t)y0 * below.stride + x1;
+					size_t c = (size_t)y1 * below.stride + x0, d = (size_t)y1 * below.stride + x1;
+					level.maxDepth[(size_t)y * level.stride + x] = std::max(std::max(below.maxDepth[a], below.maxDepth[b]), std::max(below.maxDepth[c], below.maxDepth[d]));
+					level.minDepth[(size_t)y * level.stride + x] = std::min(std::min(below.minDepth[a], below.minDepth[b]), std::min(below.minDepth[c], below.minDepth[d]));
+				}
+			}
+		}
+	}
+
+	// tests `candidates` (indices into `store`) on the pool, survivors keep their order in `visible`
+	void test(const ObjectStore& store, const std::vector<uint32_t>& candidates, ThreadPool& pool)
+	{
+		size_t count = candidates.size();
+		size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		scratch.resize(count);
+		chunkVisible.assign(chunkCount, 0);
+		pool.parallelFor(count, CHUNK_SIZE, [this, &store, &candidates](size_t begin, size_t end) {
+			size_t written = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t index = candidates[i];
+				if (boxVisible(glm::vec3(store.centerX[index], store.centerY[index], store.centerZ[index]),
+					glm::vec3(store.extentX[index], store.extentY[index], store.extentZ[index])))
+					scratch[begin + written++] = index;
+			}
+			chunkVisible[begin / CHUNK_SIZE] = written;
+		});
+
+		size_t total = 0;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			total += chunkVisible[chunk];
+		visible.resize(total);
+		size_t offset = 0;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			if (chunkVisible[chunk])
+				memcpy(visible.data() + offset, scratch.data() + chunk * CHUNK_SIZE, chunkVisible[chunk] * sizeof(uint32_t));
+			offset += chunkVisible[chunk];
+		}
+		occludedCount = count - total;
+	}
+
+	// true unless the box is certainly behind the occluders
+	bool boxVisible(const glm::vec3& center, const glm::vec3& extent) const
+	{
+		float minX, maxX, minY, maxY, nearDepth, farDepth;
+		if (!projectBox(center, extent, minX, maxX, minY, maxY, nearDepth, farDepth))
+			return true;
+
+		const Level& base = levels[0];
+		int x0 = std::max(0, (int)floorf((minX * 0.5f + 0.5f) * base.width));
+		int x1 = std::min(base.width - 1, (int)floorf((maxX * 0.5f + 0.5f) * base.width));
+		int y0 = std::max(0, (int)floorf((0.5f - maxY * 0.5f) * base.height));
+		int y1 = std::min(base.height - 1, (int)floorf((0.5f - minY * 0.5f) * base.height));
+		if (x0 > x1 || y0 > y1)
+			return true;
+
+		size_t l = 0;
+		while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) >= 4 || (y1 >> l) - (y0 >> l) >= 4))
+			l++;
+		const Level& level = levels[l];
+		int lx0 = x0 >> l, lx1 = x1 >> l, ly0 = y0 >> l, ly1 = y1 >> l;
+
+		// entirely in front of every occluder under it, no need to look at the far depths
+		bool inFront = true;
+		for (int y = ly0; y <= ly1 && inFront; y++)
+			for (int x = lx0; x <= lx1; x++)
+				inFront = inFront && farDepth < level.minDepth[(size_t)y * level.stride + x];
+		if (inFront)
+			return true;
+
+#if defined(OCCLUSION_SSE2)
+		// at most 4 texels per row, lanes past the rectangle are masked off
+		const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+		__m128 columnMask = _mm_castsi128_ps(_mm_cmplt_epi32(lane, _mm_set1_epi32(lx1 - lx0 + 1)));
+		__m128 nearVector = _mm_set1_ps(nearDepth);
+		for (int y = ly0; y <= ly1; y++)
+		{
+			__m128 depths = _mm_loadu_ps(&level.maxDepth[(size_t)y * level.stride + lx0]);
+			if (_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(depths, nearVector), columnMask)))
+				return true;
+		}
+		return false;
+#else
+		for (int y = ly0; y <= ly1; y++)
+		{
+			for (int x = lx0; x <= lx1; x++)
+			{
+				if (level.maxDepth[(size_t)y * level.stride + x] >= nearDepth)
+					return true;
+			}
+		}
+		return false;
+#endif
+	}
+
+private:
+	struct Level
+	{
+		int width, height, stride;
+		std::vector<float> maxDepth;
+		std::vector<float> minDepth;
+	};
+
+	// edge functions scaled by 1/area give the barycentric weights at a pixel center
+	struct Triangle
+	{
+		float a[3], b[3], c[3];
+		float z[3];
+		int minX, minY, maxX, maxY;
+	};
+
+	std::vector<Level> levels;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	std::vector<glm::vec4> projected;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bands;
+	std::vector<std::pair<float, uint32_t>> scored;
+	std::vector<uint32_t> scratch;
+	std::vector<size_t> chunkVisible;
+
+	void setup(const float x[3], const float y[3], const float z[3])
+	{
+		float area = (x[2] - x[1]) * (y[0] - y[1]) - (y[2] - y[1]) * (x[0] - x[1]);
+		if (area == 0.0f)
+			return;
+		Triangle t;
+		float invArea = 1.0f / area;
+		for (int i = 0; i < 3; i++)
+		{
+			int j = (i + 1) % 3, k = (i + 2) % 3;
+			t.a[i] = -(y[k] - y[j]) * invArea;
+			t.b[i] = (x[k] - x[j]) * invArea;
+			t.c[i] = ((y[k] - y[j]) * x[j] - (x[k] - x[j]) * y[j]) * invArea;
+			t.z[i] = z[i];
+		}
+		const Level& base = levels[0];
+		t.minX = std::max(0, (int)ceilf(std::min(x[0], std::min(x[1], x[2])) - 0.5f));
+		t.minY = std::max(0, (int)ceilf(std::min(y[0], std::min(y[1], y[2])) - 0.5f));
+		t.maxX = std::min(base.width - 1, (int)floorf(std::max(x[0], std::max(x[1], x[2])) - 0.5f));
+		t.maxY = std::min(base.height - 1, (int)floorf(std::max(y[0], std::max(y[1], y[2])) - 0.5f));
+		if (t.minX <= t.maxX && t.minY <= t.maxY)
+			triangles.push_back(t);
+	}
+
+	void rasterBand(int band)
+	{
+		Level& base = levels[0];
+		int bandY0 = band * BAND_ROWS, bandY1 = std::min(bandY0 + BAND_ROWS, base.height) - 1;
+		for (int y = bandY0; y <= bandY1; y++)
+			std::fill(base.maxDepth.begin() + (size_t)y * base.stride, base.maxDepth.begin() + (size_t)(y + 1) * base.stride, 1.0f);
+		for (uint32_t index : bands[band])
+		{
+			const Triangle& t = triangles[index];
+			for (int y = std::max(t.minY, bandY0); y <= std::min(t.maxY, bandY1); y++)
+			{
+				float py = y + 0.5f;
+				float* row = &base.maxDepth[(size_t)y * base.stride];
+				for (int x = t.minX; x <= t.maxX; x++)
+				{
+					float px = x + 0.5f;
+					float l0 = t.a[0] * px + t.b[0] * py + t.c[0];
+					float l1 = t.a[1] * px + t.b[1] * py + t.c[1];
+					float l2 = t.a[2] * px + t.b[2] * py + t.c[2];
+					if (l0 < 0.0f || l1 < 0.0f || l2 < 0.0f)
+						continue;
+					row[x] = std::min(row[x], l0 * t.z[0] + l1 * t.z[1] + l2 * t.z[2]);
+				}
+			}
+		}
+		// a single depth per texel at the finest level
+		for (int y = bandY0; y <= bandY1; y++)
+			memcpy(&base.minDepth[(size_t)y * base.stride], &base.maxDepth[(size_t)y * base.stride], base.stride * sizeof(float));
+	}
+
+	// NDC bounds and window depth range of the box's 8 corners. False when a corner is behind the near
+	// plane, such boxes are always visible
+	bool projectBox(const glm::vec3& center, const glm::vec3& extent, float& minX, float& maxX, float& minY, float& maxY, float& nearDepth, float& farDepth) const
+	{
+		const glm::mat4& m = viewProjection;
+#if defined(OCCLUSION_SSE2)
+		// corners as two groups of 4 (z - extent and z + extent), one corner per lane
+		__m128 signX = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+		__m128 signY = _mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+		__m128 cx = _mm_add_ps(_mm_set1_ps(center.x), _mm_mul_ps(signX, _mm_set1_ps(extent.x)));
+		__m128 cy = _mm_add_ps(_mm_set1_ps(center.y), _mm_mul_ps(signY, _mm_set1_ps(extent.y)));
+		__m128 lowX = _mm_set1_ps(1e30f), highX = _mm_set1_ps(-1e30f);
+		__m128 lowY = lowX, highY = highX, lowZ = lowX, highZ = highX;
+		__m128 behind = _mm_setzero_ps();
+		for (int side = 0; side < 2; side++)
+		{
+			float z = side == 0 ? center.z - extent.z : center.z + extent.z;
+			__m128 cz = _mm_set1_ps(z);
+			__m128 clip[4];
+			for (int row = 0; row < 4; row++)
+			{
+				clip[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][row]), cx), _mm_mul_ps(_mm_set1_ps(m[1][row]), cy)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][row]), cz), _mm_set1_ps(m[3][row])));
+			}
+			// in front of the near plane means z >= -w, and w > 0
+			behind = _mm_or_ps(behind, _mm_or_ps(_mm_cmplt_ps(clip[2], _mm_sub_ps(_mm_setzero_ps(), clip[3])), _mm_cmple_ps(clip[3], _mm_setzero_ps())));
+			__m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+			__m128 x = _mm_mul_ps(clip[0], invW), y = _mm_mul_ps(clip[1], invW), depth = _mm_mul_ps(clip[2], invW);
+			lowX = _mm_min_ps(lowX, x); highX = _mm_max_ps(highX, x);
+			lowY = _mm_min_ps(lowY, y); highY = _mm_max_ps(highY, y);
+			lowZ = _mm_min_ps(lowZ, depth); highZ = _mm_max_ps(highZ, depth);
+		}
+		if (_mm_movemask_ps(behind))
+			return false;
+		minX = horizontalMin(lowX); maxX = horizontalMax(highX);
+		minY = horizontalMin(lowY); maxY = horizontalMax(highY);
+		nearDepth = horizontalMin(lowZ) * 0.5f + 0.5f;
+		farDepth = horizontalMax(highZ) * 0.5f + 0.5f;
+		return true;
+#else
+		minX = minY = nearDepth = 1e30f;
+		maxX = maxY = farDepth = -1e30f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 p(center.x + ((corner & 1) ? extent.x : -extent.x), center.y + ((corner & 2) ? extent.y : -extent.y),
+				center.z + ((corner & 4) ? extent.z : -extent.z));
+			glm::vec4 clip = m * glm::vec4(p, 1.0f);
+			if (clip.z < -clip.w || clip.w <= 0.0f)
+				return false;
+			float invW = 1.0f / clip.w;
+			minX = std::min(minX, clip.x * invW); maxX = std::max(maxX, clip.x * invW);
+			minY = std::min(minY, clip.y * invW); maxY = std::max(maxY, clip.y * invW);
+			nearDepth = std::min(nearDepth, clip.z * invW); farDepth = std::max(farDepth, clip.z * invW);
+		}
+		nearDepth = nearDepth * 0.5f + 0.5f;
+		farDepth = farDepth * 0.5f + 0.5f;
+		return true;
+#endif
+	}
+
+#if defined(OCCLUSION_SSE2)
+	static float horizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+
+	static float horizontalMax(__m128 v)
+	{
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+#endif
+};
+
+#endif
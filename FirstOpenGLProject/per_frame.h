@@ -0,0 +1,39 @@
+#ifndef PER_FRAME_H
+#define PER_FRAME_H
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <cstring>
+
+#include "shader_s.h"
+#include "frame_memory.h"
+
+// CPU side mirror of the std140 "PerFrame" uniform block declared in the shaders.
+// vec3s are stored as vec4 so the C++ layout matches std140 without padding tricks.
+struct PerFrameData
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec4 viewPos;
+	glm::vec4 lightPos;
+	glm::vec4 lightColor;
+	// see ClusteredLighting
+	glm::vec4 clusterScale = glm::vec4(0.0f);
+	glm::ivec4 clusterSize = glm::ivec4(0);
+};
+static_assert(sizeof(PerFrameData) == 208, "PerFrameData must match the std140 layout of the PerFrame block");
+
+// Uploads this frame's values into the frame's ring region and binds that range to PER_FRAME_BINDING,
+// which each Shader attaches its block to. Called once per frame before any draw.
+inline bool uploadPerFrame(GpuRingBuffer& ring, const PerFrameData& data)
+{
+	GpuAllocation slice = ring.allocateUniform(sizeof(PerFrameData));
+	if (!slice.data)
+		return false;
+	memcpy(slice.data, &data, sizeof(PerFrameData));
+	glBindBufferRange(GL_UNIFORM_BUFFER, PER_FRAME_BINDING, ring.ID, slice.offset, sizeof(PerFrameData));
+	return true;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+
+// Minimal PNG encoder for debug dumps: 8 bit RGBA, no filtering, and zlib "stored" (uncompressed)
+// deflate blocks, so it needs no compression library. Files are large but open anywhere.
+
+inline uint32_t pngCrc(const uint8_t* data, size_t length, uint32_t crc = 0xffffffffu)
+{
+	static uint32_t table[256];
+	static bool tableReady = false;
+	if (!tableReady)
+	{
+		for (uint32_t n = 0; n < 256; n++)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		tableReady = true;
+	}
+	for (size_t i = 0; i < length; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void pngPutBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back((uint8_t)(value >> 24));
+	out.push_back((uint8_t)(value >> 16));
+	out.push_back((uint8_t)(value >> 8));
+	out.push_back((uint8_t)value);
+}
+
+static void pngWriteChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> chunk;
+	pngPutBigEndian(chunk, (uint32_t)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	// the CRC covers the type and the data, not the length
+	pngPutBigEndian(chunk, pngCrc(chunk.data() + 4, chunk.size() - 4) ^ 0xffffffffu);
+	file.write((const char*)chunk.data(), chunk.size());
+}
+
+// writes `rgba` (rows top to bottom, 4 bytes per pixel) as a PNG file
+inline bool writePng(const char* path, int width, int height, const uint8_t* rgba)
+{
+	std::ofstream file(path, std::ios::binary);
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	file.write((const char*)signature, 8);
+
+	std::vector<uint8_t> header;
+	pngPutBigEndian(header, (uint32_t)width);
+	pngPutBigEndian(header, (uint32_t)height);
+	// bit depth 8, color type 6 (RGBA), deflate, no filter method, no interlace
+	const uint8_t format[5] = { 8, 6, 0, 0, 0 };
+	header.insert(header.end(), format, format + 5);
+	pngWriteChunk(file, "IHDR", header);
+
+	// every row starts with its filter type, 0 = none
+	size_t rowBytes = (size_t)width * 4;
+	std::vector<uint8_t> raw;
+	raw.reserve((rowBytes + 1) * height);
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+	}
+
+	// zlib stream of stored blocks of at most 65535 bytes, then the adler32 of the raw data
+	std::vector<uint8_t> zlib;
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		size_t length = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+		bool last = offset + length == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((uint8_t)length);
+		zlib.push_back((uint8_t)(length >> 8));
+		zlib.push_back((uint8_t)~length);
+		zlib.push_back((uint8_t)(~length >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+	uint32_t a = 1, b = 0;
+	for (uint8_t value : raw)
+	{
+		a = (a + value) % 65521;
+		b = (b + a) % 65521;
+	}
+	pngPutBigEndian(zlib, (b << 16) | a);
+	pngWriteChunk(file, "IDAT", zlib);
+	pngWriteChunk(file, "IEND", std::vector<uint8_t>());
+
+	if (!file)
+	{
+		std::cout << "ERROR::PNG::WRITE_FAILED " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+#endif
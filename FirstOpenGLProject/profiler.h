@@ -0,0 +1,395 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <iostream>
+#include <algorithm>
+
+#include "frame_stats.h"
+
+// One timed zone: a CPU scope on some thread, or a GPU range on the GPU track
+struct ProfileEvent
+{
+	// from Profiler::zoneId()
+	int zone;
+	double startMs;
+	double durationMs;
+	int thread;
+};
+
+// In-engine profiler for the hot path. CPU zones are timed with the steady clock from RAII scopes,
+// GPU zones with GL_TIMESTAMP queries read back two frames later, and only if they are already
+// available, so profiling never stalls the pipeline. Keeps a rolling trace for Chrome's about:tracing
+// (chrome://tracing, Perfetto) and a per-zone summary over the last SUMMARY_FRAMES frames.
+// Every zone site looks its name up once for a zone id, CPU zones then go to a buffer owned by the
+// recording thread and are only merged into the trace and the summary by endFrame(). GPU zones show up in the summary and budget reports of the frame that read them back.
+class Profiler
+{
+public:
+	// events kept for the trace, the oldest are dropped first
+	static const size_t MAX_TRACE_EVENTS = 200000;
+	static const int SUMMARY_FRAMES = 120;
+	// trace track of the GPU zones, CPU threads are numbered from 1 in order of their first zone
+	static const int GPU_TRACK = 0;
+
+	// frames slower than this (ms) are reported with their slowest zone, 0 turns it off
+	double frameBudgetMs = 0.0;
+	// GPU zones whose results were not ready when their queries came around again
+	int gpuResultsDropped = 0;
+
+	static Profiler& instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// call once a context is current, GPU zones are ignored until then
+	void initGpu()
+	{
+		// GPU timestamps run on their own clock, line them up with the CPU one for the trace
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuClockOffsetMs = nowMs() - gpuNow / 1.0e6;
+		gpuReady = true;
+	}
+
+	void releaseGpu()
+	{
+		for (GpuFrame& frame : gpuFrames)
+		{
+			if (!frame.queries.empty())
+				glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+			frame.queries.clear();
+			frame.zones.clear();
+		}
+		gpuReady = false;
+	}
+
+	// small stable index of the calling thread for the trace
+	int threadIndex()
+	{
+		static std::atomic<int> nextThread{ 1 };
+		thread_local int index = nextThread++;
+		return index;
+	}
+
+	// id of the zone called `name`, the same for every site using that name. Meant to be called once per
+	// site, the PROFILE_ macros keep it in a static
+	int zoneId(const char* name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = zoneIds.find(name);
+		if (found != zoneIds.end())
+			return found->second;
+		int id = (int)zones.size();
+		zoneIds[name] = id;
+		zoneNames.push_back(name);
+		zones.push_back(ZoneHistory());
+		return id;
+	}
+
+	void recordCpu(int zone, double startMs, double endMs)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		ProfileEvent event = { zone, startMs, endMs - startMs, buffer.thread };
+		// only contended while endFrame() takes the events
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+		if (buffer.events.size() < MAX_TRACE_EVENTS)
+			buffer.events.push_back(event);
+	}
+
+	void beginFrame()
+	{
+		frameStartMs = nowMs();
+		if (!gpuReady)
+			return;
+		// this buffer was last filled two frames ago, take what the GPU has finished and reuse it
+		GpuFrame& frame = gpuFrames[frameIndex % 2];
+		resolveGpu(frame);
+		frame.used = 0;
+		frame.zones.clear();
+		frame.open.clear();
+	}
+
+	void endFrame()
+	{
+		double frameMs = nowMs() - frameStartMs;
+		std::lock_guard<std::mutex> lock(mutex);
+		collectThreads();
+		const char* slowestZone = NULL;
+		double slowestMs = 0.0;
+		for (size_t id = 0; id < zones.size(); id++)
+		{
+			ZoneHistory& zone = zones[id];
+			zone.samples[zone.next] = zone.frameMs;
+			zone.next = (zone.next + 1) % SUMMARY_FRAMES;
+			if (zone.count < SUMMARY_FRAMES)
+				zone.count++;
+			if (zone.frameMs > slowestMs)
+			{
+				slowestMs = zone.frameMs;
+				slowestZone = zoneNames[id].c_str();
+			}
+			zone.frameMs = 0.0;
+		}
+		if (frameBudgetMs > 0.0 && frameMs > frameBudgetMs)
+		{
+			std::cout << "PROFILER::FRAME_OVER_BUDGET frame " << frameIndex << " took " << frameMs << " ms (budget "
+				<< frameBudgetMs << " ms), slowest zone " << (slowestZone ? slowestZone : "none") << " " << slowestMs << " ms" << std::endl;
+		}
+		frameIndex++;
+	}
+
+	void beginGpuZone(int zoneId)
+	{
+		if (!gpuReady)
+			return;
+		GpuFrame& frame = gpuFrames[frameIndex % 2];
+		if (frame.used + 2 > frame.queries.size())
+		{
+			size_t grown = frame.queries.size() + 16;
+			size_t first = frame.queries.size();
+			frame.queries.resize(grown);
+			glGenQueries((GLsizei)(grown - first), frame.queries.data() + first);
+		}
+		GpuZone zone = { zoneId, frame.used, frame.used + 1 };
+		frame.used += 2;
+		glQueryCounter(frame.queries[zone.beginQuery], GL_TIMESTAMP);
+		frame.open.push_back(frame.zones.size());
+		frame.zones.push_back(zone);
+	}
+
+	void endGpuZone()
+	{
+		if (!gpuReady)
+			return;
+		GpuFrame& frame = gpuFrames[frameIndex % 2];
+		if (frame.open.empty())
+			return;
+		glQueryCounter(frame.queries[frame.zones[frame.open.back()].endQuery], GL_TIMESTAMP);
+		frame.open.pop_back();
+	}
+
+	// rolling summary over the last SUMMARY_FRAMES frames, time per frame spent in each zone
+	void writeSummary(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		out << "zone                      mean ms      max ms\n";
+		for (auto& entry : zoneIds)
+		{
+			double mean, maximum;
+			summarize(zones[entry.second], mean, maximum);
+			std::string name = entry.first;
+			name.resize(std::max<size_t>(name.size(), 24), ' ');
+			out << name << " " << mean << "  " << maximum << "\n";
+		}
+	}
+
+	// adds "zone_<name>_ms" (rolling mean) for every zone to a benchmark's metrics
+	void addMetrics(std::vector<std::pair<std::string, double>>& metrics)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& entry : zoneIds)
+		{
+			double mean, maximum;
+			summarize(zones[entry.second], mean, maximum);
+			std::string name = entry.first;
+			std::replace(name.begin(), name.end(), ':', '_');
+			metrics.push_back(std::make_pair("zone_" + name + "_ms", mean));
+		}
+	}
+
+	// trace in the Chrome trace event format, complete ("X") events in microseconds
+	void writeChromeTrace(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		collectThreads();
+		out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		out << "  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << GPU_TRACK << ", \"args\": { \"name\": \"GPU\" } }";
+		for (const ProfileEvent& event : events)
+		{
+			out << ",\n  { \"name\": \"" << zoneNames[event.zone] << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread;
+			out << ", \"ts\": " << (event.startMs - startMs) * 1000.0 << ", \"dur\": " << event.durationMs * 1000.0 << " }";
+		}
+		out << "\n] }\n";
+	}
+
+private:
+	struct ZoneHistory
+	{
+		double samples[SUMMARY_FRAMES] = {};
+		int next = 0;
+		int count = 0;
+		double frameMs = 0.0;
+	};
+
+	struct GpuZone
+	{
+		int zone;
+		size_t beginQuery;
+		size_t endQuery;
+	};
+
+	struct GpuFrame
+	{
+		std::vector<GLuint> queries;
+		size_t used = 0;
+		std::vector<GpuZone> zones;
+		// zones begun but not ended yet, innermost last
+		std::vector<size_t> open;
+	};
+
+	// CPU zones recorded by one thread since the last endFrame()
+	struct ThreadBuffer
+	{
+		std::mutex mutex;
+		std::vector<ProfileEvent> events;
+		int thread = 0;
+	};
+
+	std::mutex mutex;
+	std::deque<ProfileEvent> events;
+	// by zone id
+	std::vector<ZoneHistory> zones;
+	std::vector<std::string> zoneNames;
+	// name -> zone id, also the order of the summary
+	std::map<std::string, int> zoneIds;
+	// one per thread that ever recorded, kept after the thread exits
+	std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+	std::vector<ProfileEvent> collected;
+	GpuFrame gpuFrames[2];
+	bool gpuReady = false;
+	double gpuClockOffsetMs = 0.0;
+	double startMs = nowMs();
+	double frameStartMs = 0.0;
+	uint64_t frameIndex = 0;
+
+	Profiler() = default;
+
+	ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = NULL;
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			threadBuffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+			buffer = threadBuffers.back().get();
+			buffer->thread = threadIndex();
+		}
+		return *buffer;
+	}
+
+	// caller holds the mutex
+	void record(const ProfileEvent& event)
+	{
+		if (events.size() == MAX_TRACE_EVENTS)
+			events.pop_front();
+		events.push_back(event);
+		zones[event.zone].frameMs += event.durationMs;
+	}
+
+	// moves the events of every thread buffer into the trace and the zones, caller holds the mutex
+	void collectThreads()
+	{
+		for (std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+		{
+			{
+				std::lock_guard<std::mutex> lock(buffer->mutex);
+				collected.swap(buffer->events);
+			}
+			for (const ProfileEvent& event : collected)
+				record(event);
+			collected.clear();
+		}
+	}
+
+	void resolveGpu(GpuFrame& frame)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const GpuZone& zone : frame.zones)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(frame.queries[zone.endQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+			{
+				gpuResultsDropped++;
+				continue;
+			}
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[zone.beginQuery], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[zone.endQuery], GL_QUERY_RESULT, &end);
+			ProfileEvent event = { zone.zone, begin / 1.0e6 + gpuClockOffsetMs, (end - begin) / 1.0e6, GPU_TRACK };
+			record(event);
+		}
+	}
+
+	static void summarize(const ZoneHistory& zone, double& mean, double& maximum)
+	{
+		double sum = 0.0;
+		maximum = 0.0;
+		for (int i = 0; i < zone.count; i++)
+		{
+			sum += zone.samples[i];
+			maximum = std::max(maximum, zone.samples[i]);
+		}
+		mean = zone.count > 0 ? sum / zone.count : 0.0;
+	}
+};
+
+// Times the enclosing scope as a CPU zone
+class ProfileScope
+{
+public:
+	ProfileScope(int zoneId) : zoneId(zoneId), startMs(nowMs())
+	{
+	}
+
+	~ProfileScope()
+	{
+		Profiler::instance().recordCpu(zoneId, startMs, nowMs());
+	}
+
+private:
+	int zoneId;
+	double startMs;
+};
+
+// Times the GL commands issued in the enclosing scope as a GPU zone
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(int zoneId)
+	{
+		Profiler::instance().beginGpuZone(zoneId);
+	}
+
+	~GpuProfileScope()
+	{
+		Profiler::instance().endGpuZone();
+	}
+};
+
+// zone names must be string literals. Each site looks its zone id up on first use and keeps it in a
+// static. Define PROFILER_DISABLED to compile the zones out.
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifndef PROFILER_DISABLED
+#define PROFILE_SCOPE(name) static const int PROFILE_CONCAT(profileZone, __LINE__) = Profiler::instance().zoneId(name); \
+	ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__))
+#define PROFILE_GPU_SCOPE(name) static const int PROFILE_CONCAT(gpuProfileZone, __LINE__) = Profiler::instance().zoneId("gpu:" name); \
+	GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(PROFILE_CONCAT(gpuProfileZone, __LINE__))
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#endif
+
+#endif
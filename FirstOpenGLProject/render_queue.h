@@ -0,0 +1,304 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// A draw recorded into the command buffer. Everything needed to issue it is in the packet or in the
+// queue's side tables, so packets can be sorted freely before execution.
+struct DrawPacket
+{
+	uint64_t key;
+	unsigned int program;
+	unsigned int vao;
+	uint16_t material;
+	GLenum mode;
+	GLsizei count;
+	// 0 for glDrawArrays, otherwise the element type of the bound element buffer
+	GLenum indexType;
+	GLsizei instanceCount;
+	// per draw model matrix uniform, -1 when the program takes its transforms from instance data
+	int modelLocation;
+	uint32_t modelIndex;
+};
+
+// Material state applied between draws: a color uniform, and optionally a layer of a texture array
+// (see texture_array.h) that is bound to MATERIAL_TEXTURE_UNIT
+struct Material
+{
+	int colorLocation;
+	glm::vec3 color;
+	unsigned int textureArray;
+	int layerLocation;
+	int layer;
+};
+
+// Sort key layout, most significant first, so sorting groups draws by the most expensive state:
+//   pass (4) | program (12) | texture array (8) | vertex array (12) | material (12) | depth (16)
+namespace SortKey
+{
+	const int PASS_SHIFT = 60;
+	const int PROGRAM_SHIFT = 48;
+	const int TEXTURE_SHIFT = 40;
+	const int VAO_SHIFT = 28;
+	const int MATERIAL_SHIFT = 16;
+	const uint64_t FIELD_MASK = 0xfff;
+	const uint64_t TEXTURE_MASK = 0xff;
+	const uint64_t DEPTH_MASK = 0xffff;
+
+	// depth is normalized to [0, 1] and quantized, front to back within equal state
+	inline uint64_t make(unsigned int pass, unsigned int programSlot, unsigned int textureSlot, unsigned int vaoSlot, unsigned int material, float depth)
+	{
+		if (depth < 0.0f) depth = 0.0f;
+		if (depth > 1.0f) depth = 1.0f;
+		uint64_t quantized = (uint64_t)(depth * (float)DEPTH_MASK);
+		return ((uint64_t)(pass & 0xf) << PASS_SHIFT) | (((uint64_t)programSlot & FIELD_MASK) << PROGRAM_SHIFT)
+			| (((uint64_t)textureSlot & TEXTURE_MASK) << TEXTURE_SHIFT) | (((uint64_t)vaoSlot & FIELD_MASK) << VAO_SHIFT)
+			| (((uint64_t)material & FIELD_MASK) << MATERIAL_SHIFT) | (quantized & DEPTH_MASK);
+	}
+}
+
+// LSD radix sort of 64 bit keys, 8 bits per pass. Passes where every key has the same byte are skipped,
+// which is most of them when only a few state fields vary. Returns the sorted order as indices.
+inline void radixSortKeys(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order, std::vector<uint32_t>& scratch)
+{
+	size_t count = keys.size();
+	order.resize(count);
+	scratch.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+
+	uint32_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (uint64_t key : keys)
+		for (int pass = 0; pass < 8; pass++)
+			histograms[pass][(key >> (pass * 8)) & 0xff]++;
+
+	for (int pass = 0; pass < 8; pass++)
+	{
+		uint32_t* histogram = histograms[pass];
+		if (count == 0 || histogram[(keys[0] >> (pass * 8)) & 0xff] == count)
+			continue;
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t size = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += size;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t index = order[i];
+			scratch[histogram[(keys[index] >> (pass * 8)) & 0xff]++] = index;
+		}
+		order.swap(scratch);
+	}
+}
+
+// Records draws as packets with sort keys, sorts them, and executes them skipping binds that would not
+// change any state. Call begin() each frame, submit() the draws in any order, then execute().
+class RenderQueue
+{
+public:
+	// state changes issued by one execute()
+	struct Stats
+	{
+		int programBinds = 0;
+		int vertexArrayBinds = 0;
+		int materialChanges = 0;
+		int textureBinds = 0;
+		int draws = 0;
+
+		int stateChanges() const
+		{
+			return programBinds + vertexArrayBinds + materialChanges + textureBinds;
+		}
+	};
+
+	// what the last execute() did, and what the same packets would have cost in submission order
+	Stats sortedStats;
+	Stats unsortedStats;
+
+	// texture unit material texture arrays are bound to
+	static const int MATERIAL_TEXTURE_UNIT = 0;
+
+	// materials are registered once and referred to by index in packets. Materials sharing a texture
+	// array only differ by the layer uniform, the array stays bound
+	uint16_t addMaterial(int colorLocation, const glm::vec3& color, unsigned int textureArray = 0, int layerLocation = -1, int layer = -1)
+	{
+		Material material = { colorLocation, color, textureArray, layerLocation, layer };
+		materials.push_back(material);
+		return (uint16_t)(materials.size() - 1);
+	}
+
+	void begin()
+	{
+		packets.clear();
+		keys.clear();
+		models.clear();
+		// slots only have to agree within one frame, so GL names deleted since don't pile up
+		programSlots.clear();
+		vaoSlots.clear();
+		textureSlots.clear();
+	}
+
+	// records a draw. depth is the view depth of the object normalized to [0, 1], used to order equal state front to back
+	void submit(unsigned int pass, unsigned int program, unsigned int vao, uint16_t material, float depth,
+		GLenum mode, GLsizei count, GLenum indexType, GLsizei instanceCount = 1, int modelLocation = -1, const glm::mat4* model = NULL)
+	{
+		DrawPacket packet;
+		packet.program = program;
+		packet.vao = vao;
+		packet.material = material;
+		packet.mode = mode;
+		packet.count = count;
+		packet.indexType = indexType;
+		packet.instanceCount = instanceCount;
+		packet.modelLocation = model ? modelLocation : -1;
+		packet.modelIndex = 0;
+		if (model)
+		{
+			packet.modelIndex = (uint32_t)models.size();
+			models.push_back(*model);
+		}
+		unsigned int texture = materials[material].textureArray;
+		packet.key = SortKey::make(pass, slot(programSlots, program, SortKey::FIELD_MASK), slot(textureSlots, texture, SortKey::TEXTURE_MASK),
+			slot(vaoSlots, vao, SortKey::FIELD_MASK), std::min<unsigned int>(material, SortKey::FIELD_MASK), depth);
+		packets.push_back(packet);
+		keys.push_back(packet.key);
+	}
+
+	size_t size() const
+	{
+		return packets.size();
+	}
+
+	// sorts the recorded packets and issues them
+	void execute()
+	{
+		radixSortKeys(keys, order, scratch);
+		unsortedStats = countStateChanges(NULL);
+		sortedStats = Stats();
+
+		unsigned int currentProgram = 0, currentVao = 0, currentTexture = 0;
+		int currentMaterial = -1;
+		for (uint32_t index : order)
+		{
+			const DrawPacket& packet = packets[index];
+			if (packet.program != currentProgram)
+			{
+				glUseProgram(packet.program);
+				currentProgram = packet.program;
+				// uniforms are per program, the material has to be applied again
+				currentMaterial = -1;
+				sortedStats.programBinds++;
+			}
+			if (packet.vao != currentVao)
+			{
+				glBindVertexArray(packet.vao);
+				currentVao = packet.vao;
+				sortedStats.vertexArrayBinds++;
+			}
+			if ((int)packet.material != currentMaterial)
+			{
+				const Material& material = materials[packet.material];
+				if (material.colorLocation >= 0)
+					glUniform3fv(material.colorLocation, 1, &material.color[0]);
+				if (material.layerLocation >= 0)
+					glUniform1i(material.layerLocation, material.layer);
+				if (material.textureArray != 0 && material.textureArray != currentTexture)
+				{
+					glActiveTexture(GL_TEXTURE0 + MATERIAL_TEXTURE_UNIT);
+					glBindTexture(GL_TEXTURE_2D_ARRAY, material.textureArray);
+					currentTexture = material.textureArray;
+					sortedStats.textureBinds++;
+				}
+				currentMaterial = packet.material;
+				sortedStats.materialChanges++;
+			}
+			if (packet.modelLocation >= 0)
+				glUniformMatrix4fv(packet.modelLocation, 1, GL_FALSE, &models[packet.modelIndex][0][0]);
+
+			if (packet.indexType == 0)
+				glDrawArraysInstanced(packet.mode, 0, packet.count, packet.instanceCount);
+			else
+				glDrawElementsInstanced(packet.mode, packet.count, packet.indexType, 0, packet.instanceCount);
+			sortedStats.draws++;
+		}
+	}
+
+	// state changes the packets would need in the given order (NULL for submission order), without touching GL
+	Stats countStateChanges(const std::vector<uint32_t>* executionOrder) const
+	{
+		Stats stats;
+		unsigned int currentProgram = 0, currentVao = 0, currentTexture = 0;
+		int currentMaterial = -1;
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			const DrawPacket& packet = packets[executionOrder ? (*executionOrder)[i] : i];
+			if (packet.program != currentProgram)
+			{
+				currentProgram = packet.program;
+				currentMaterial = -1;
+				stats.programBinds++;
+			}
+			if (packet.vao != currentVao)
+			{
+				currentVao = packet.vao;
+				stats.vertexArrayBinds++;
+			}
+			if ((int)packet.material != currentMaterial)
+			{
+				const Material& material = materials[packet.material];
+				if (material.textureArray != 0 && material.textureArray != currentTexture)
+				{
+					currentTexture = material.textureArray;
+					stats.textureBinds++;
+				}
+				currentMaterial = packet.material;
+				stats.materialChanges++;
+			}
+			stats.draws++;
+		}
+		return stats;
+	}
+
+	// sorts without executing, for tools and benchmarks that have no GL context
+	const std::vector<uint32_t>& sort()
+	{
+		radixSortKeys(keys, order, scratch);
+		return order;
+	}
+
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<uint64_t> keys;
+	std::vector<glm::mat4> models;
+	std::vector<Material> materials;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> scratch;
+	// GL names mapped to dense slots for the sort key, in order of first use since begin()
+	std::unordered_map<unsigned int, unsigned int> programSlots;
+	std::unordered_map<unsigned int, unsigned int> textureSlots;
+	std::unordered_map<unsigned int, unsigned int> vaoSlots;
+
+	// names past what the field holds all share its last slot, they still draw correctly but are no
+	// longer grouped with each other
+	static unsigned int slot(std::unordered_map<unsigned int, unsigned int>& slots, unsigned int name, uint64_t fieldMask)
+	{
+		auto found = slots.find(name);
+		if (found != slots.end())
+			return found->second;
+		unsigned int next = (unsigned int)std::min<uint64_t>(slots.size(), fieldMask);
+		slots[name] = next;
+		return next;
+	}
+};
+
+#endif
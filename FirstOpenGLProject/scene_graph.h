@@ -0,0 +1,271 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+#include <glm-1.0.1/glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "thread_pool.h"
+#include "normal_matrix.h"
+
+// Transform hierarchy. Local transforms (position, rotation, scale) live in SoA arrays in depth first
+// order, so a parent always comes before its children and every subtree is one contiguous range.
+// Changing a node marks it dirty and flags its ancestors, update() then recomputes world matrices only
+// for dirty nodes and their descendants, skipping clean subtrees whole, with runs of sibling subtrees
+// updated in parallel. Normal matrices are kept next to the world matrices and recomputed with them.
+// Nodes are addressed by a stable SceneNode handle since adding nodes moves others.
+typedef uint32_t SceneNode;
+
+class SceneGraph
+{
+public:
+	static const uint32_t NO_PARENT = 0xffffffff;
+
+	// per node, depth first order
+	std::vector<uint32_t> parents;
+	// number of nodes in the subtree rooted here, including the node itself
+	std::vector<uint32_t> subtreeSizes;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<NormalMatrix> normalMatrices;
+	// world matrices recomputed by the last update()
+	size_t lastUpdatedCount = 0;
+
+	size_t size() const
+	{
+		return parents.size();
+	}
+
+	// adds a node as the last child of `parent` (NO_PARENT for a new top level node)
+	SceneNode add(SceneNode parent, const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f))
+	{
+		uint32_t parentIndex = parent == NO_PARENT ? NO_PARENT : nodeIndices[parent];
+		uint32_t index = parentIndex == NO_PARENT ? (uint32_t)size() : parentIndex + subtreeSizes[parentIndex];
+
+		// everything from `index` on moves up one slot. Building a hierarchy depth first always appends, which skips this
+		if (index < size())
+		{
+			for (uint32_t& p : parents)
+			{
+				if (p != NO_PARENT && p >= index)
+					p++;
+			}
+			for (uint32_t& i : nodeIndices)
+			{
+				if (i >= index)
+					i++;
+			}
+		}
+		SceneNode node = (SceneNode)nodeIndices.size();
+		nodeIndices.push_back(index);
+		parents.insert(parents.begin() + index, parentIndex);
+		subtreeSizes.insert(subtreeSizes.begin() + index, 1);
+		positions.insert(positions.begin() + index, position);
+		rotations.insert(rotations.begin() + index, rotation);
+		scales.insert(scales.begin() + index, scale);
+		worldMatrices.insert(worldMatrices.begin() + index, glm::mat4(1.0f));
+		normalMatrices.insert(normalMatrices.begin() + index, NormalMatrix());
+		flags.insert(flags.begin() + index, (uint8_t)0);
+		for (uint32_t ancestor = parentIndex; ancestor != NO_PARENT; ancestor = parents[ancestor])
+			subtreeSizes[ancestor]++;
+		markDirty(index);
+		return node;
+	}
+
+	void setPosition(SceneNode node, const glm::vec3& position)
+	{
+		uint32_t index = nodeIndices[node];
+		positions[index] = position;
+		markDirty(index);
+	}
+
+	void setRotation(SceneNode node, const glm::quat& rotation)
+	{
+		uint32_t index = nodeIndices[node];
+		rotations[index] = rotation;
+		markDirty(index);
+	}
+
+	void setScale(SceneNode node, const glm::vec3& scale)
+	{
+		uint32_t index = nodeIndices[node];
+		scales[index] = scale;
+		markDirty(index);
+	}
+
+	// valid after the update() that followed the last change to the node or its ancestors
+	const glm::mat4& worldMatrix(SceneNode node) const
+	{
+		return worldMatrices[nodeIndices[node]];
+	}
+
+	const NormalMatrix& normalMatrix(SceneNode node) const
+	{
+		return normalMatrices[nodeIndices[node]];
+	}
+
+	// position of a node in the SoA arrays, changes when nodes are added before it
+	uint32_t indexOf(SceneNode node) const
+	{
+		return nodeIndices[node];
+	}
+
+	// brings every world matrix up to date. With a pool, subtrees bigger than SPLIT_NODES have their top
+	// node updated here and their children cut into runs of sibling subtrees of about SPLIT_NODES nodes,
+	// which are independent once the parent is done and go to the pool in parallel.
+	void update(ThreadPool* pool = NULL)
+	{
+		ranges.clear();
+		splitChanged.clear();
+		if (pool && pool->size() > 0 && size() > SPLIT_NODES)
+			splitChildren(NO_PARENT, 0, (uint32_t)size());
+		else
+			ranges.push_back(std::make_pair(0u, (uint32_t)size()));
+		computeNormalMatrices(worldMatrices.data(), normalMatrices.data(), splitChanged.data(), splitChanged.size());
+
+		std::atomic<size_t> updated{ splitChanged.size() };
+		if (ranges.size() > 1)
+		{
+			// scratch per range, kept between updates
+			if (rangeChanged.size() < ranges.size())
+				rangeChanged.resize(ranges.size());
+			pool->parallelFor(ranges.size(), 1, [this, &updated](size_t begin, size_t end) {
+				size_t count = 0;
+				for (size_t i = begin; i < end; i++)
+					count += updateRange(ranges[i].first, ranges[i].second, rangeChanged[i]);
+				updated += count;
+			});
+		}
+		else if (ranges.size() == 1)
+			updated += updateRange(ranges[0].first, ranges[0].second, changedScratch);
+
+		// the split nodes keep WORLD_CHANGED until their children are done
+		for (uint32_t index : splitChanged)
+			flags[index] = 0;
+		lastUpdatedCount = updated;
+	}
+
+	// local matrix of a node: translate * rotate * scale
+	static glm::mat4 localMatrix(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		glm::mat3 basis = glm::mat3_cast(rotation);
+		glm::mat4 local(1.0f);
+		local[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+		local[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+		local[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+		local[3] = glm::vec4(position, 1.0f);
+		return local;
+	}
+
+private:
+	// the node's own transform changed
+	static const uint8_t LOCAL_DIRTY = 1;
+	// something below the node changed
+	static const uint8_t DESCENDANT_DIRTY = 2;
+	// world matrix was recomputed in the running update, so the children have to follow
+	static const uint8_t WORLD_CHANGED = 4;
+
+	// subtrees bigger than this are split for the pool, and the runs of siblings handed out are about this big
+	static const uint32_t SPLIT_NODES = 2048;
+
+	std::vector<uint8_t> flags;
+	// handle -> index
+	std::vector<uint32_t> nodeIndices;
+	// [begin, end) runs of whole sibling subtrees whose parents are up to date
+	std::vector<std::pair<uint32_t, uint32_t> > ranges;
+	// nodes above the ranges recomputed serially by splitChildren()
+	std::vector<uint32_t> splitChanged;
+	std::vector<uint32_t> changedScratch;
+	std::vector<std::vector<uint32_t> > rangeChanged;
+
+	void markDirty(uint32_t index)
+	{
+		flags[index] |= LOCAL_DIRTY;
+		for (uint32_t ancestor = parents[index]; ancestor != NO_PARENT && !(flags[ancestor] & DESCENDANT_DIRTY); ancestor = parents[ancestor])
+			flags[ancestor] |= DESCENDANT_DIRTY;
+	}
+
+	// cuts the children of `parent` (the top level nodes for NO_PARENT), which occupy [begin, end), into
+	// ranges. A child too big for one range is updated on its own and split further. Runs without any
+	// dirty node are left out.
+	void splitChildren(uint32_t parent, uint32_t begin, uint32_t end)
+	{
+		bool parentChanged = parent != NO_PARENT && (flags[parent] & WORLD_CHANGED);
+		uint32_t rangeBegin = begin;
+		bool rangeDirty = false;
+		for (uint32_t child = begin; child < end; child += subtreeSizes[child])
+		{
+			uint32_t childEnd = child + subtreeSizes[child];
+			if (!parentChanged && flags[child] == 0)
+				continue;
+			if (subtreeSizes[child] > SPLIT_NODES)
+			{
+				if (rangeDirty)
+					ranges.push_back(std::make_pair(rangeBegin, child));
+				if (parentChanged || (flags[child] & LOCAL_DIRTY))
+				{
+					glm::mat4 local = localMatrix(positions[child], rotations[child], scales[child]);
+					worldMatrices[child] = parent == NO_PARENT ? local : worldMatrices[parent] * local;
+					flags[child] = WORLD_CHANGED;
+					splitChanged.push_back(child);
+				}
+				else
+					flags[child] = 0;
+				splitChildren(child, child + 1, childEnd);
+				rangeBegin = childEnd;
+				rangeDirty = false;
+				continue;
+			}
+			rangeDirty = true;
+			if (childEnd - rangeBegin >= SPLIT_NODES)
+			{
+				ranges.push_back(std::make_pair(rangeBegin, childEnd));
+				rangeBegin = childEnd;
+				rangeDirty = false;
+			}
+		}
+		if (rangeDirty)
+			ranges.push_back(std::make_pair(rangeBegin, end));
+	}
+
+	// walks [begin, end), a run of whole sibling subtrees, in order, recomputing dirty nodes and everything
+	// under them, returns how many
+	size_t updateRange(uint32_t begin, uint32_t end, std::vector<uint32_t>& changed)
+	{
+		changed.clear();
+		uint32_t i = begin;
+		while (i < end)
+		{
+			uint32_t parent = parents[i];
+			bool parentChanged = parent != NO_PARENT && (flags[parent] & WORLD_CHANGED);
+			if (!parentChanged && flags[i] == 0)
+			{
+				// nothing in here changed
+				i += subtreeSizes[i];
+				continue;
+			}
+			if (parentChanged || (flags[i] & LOCAL_DIRTY))
+			{
+				glm::mat4 local = localMatrix(positions[i], rotations[i], scales[i]);
+				worldMatrices[i] = parent == NO_PARENT ? local : worldMatrices[parent] * local;
+				flags[i] = WORLD_CHANGED;
+				changed.push_back(i);
+			}
+			else
+				flags[i] = 0;
+			i++;
+		}
+		computeNormalMatrices(worldMatrices.data(), normalMatrices.data(), changed.data(), changed.size());
+		for (uint32_t index : changed)
+			flags[index] = 0;
+		return changed.size();
+	}
+};
+
+#endif
@@ -4,25 +4,199 @@
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
 #include <glm-1.0.1/glm/glm.hpp>
 #include <glm-1.0.1/glm/gtc/matrix_transform.hpp>
 #include <glm-1.0.1/glm/gtc/type_ptr.hpp>
 
+#include "hash.h"
+#include "asset_pack.h"
+
+// linked program binaries are kept here between runs, keyed by a hash of the sources and the driver
+const char* const SHADER_CACHE_DIR = "shadercache";
+
+// uniform buffer binding point of the std140 "PerFrame" block, shared by every program
+const unsigned int PER_FRAME_BINDING = 0;
+
 class Shader
 {
 public:
 	// the program ID
 	unsigned int ID;
+	// locations of the active uniforms, reflected once after linking
+	std::unordered_map<std::string, int> uniformLocations;
+	// true when the program came out of the binary cache instead of being compiled
+	bool loadedFromCache = false;
 
-	// constructor reads and builds the shader 
-	Shader(const char* vertexPath, const char* fragmentPath)
+	// constructor reads and builds the shader. The sources come from `pack` when it has both of them
+	// (preprocessed and checked by assetcook), otherwise from the files
+	Shader(const char* vertexPath, const char* fragmentPath, const AssetPack* pack = NULL)
 	{
-		// read the shader source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
+		const PackEntry* vertexEntry = pack ? pack->find(vertexPath, PACK_SHADER) : NULL;
+		const PackEntry* fragmentEntry = pack ? pack->find(fragmentPath, PACK_SHADER) : NULL;
+		if (vertexEntry && fragmentEntry)
+		{
+			vertexCode.assign((const char*)pack->data(*vertexEntry), vertexEntry->size);
+			fragmentCode.assign((const char*)pack->data(*fragmentEntry), fragmentEntry->size);
+		}
+		else
+			readSourceFiles(vertexPath, fragmentPath, vertexCode, fragmentCode);
+		const char* vShaderCode = vertexCode.c_str();
+		const char* fShaderCode = fragmentCode.c_str();
+
+		// try the program binary from an earlier run first, compile and link is what makes startup slow
+		ID = glCreateProgram();
+		bool useCache = binaryCacheSupported();
+		uint64_t cacheKey = programCacheKey(vertexCode, fragmentCode);
+		loadedFromCache = useCache && loadProgramBinary(cacheKey);
+		if (!loadedFromCache)
+		{
+			// compile shaders
+			unsigned int vertex, fragment;
+			int success;
+			char infoLog[512];
+
+			// vertex Shader
+			vertex = glCreateShader(GL_VERTEX_SHADER);
+			glShaderSource(vertex, 1, &vShaderCode, NULL);
+			glCompileShader(vertex);
+			// check for errors
+			glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+				std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+			}
+
+			// fragment Shader
+			fragment = glCreateShader(GL_FRAGMENT_SHADER);
+			glShaderSource(fragment, 1, &fShaderCode, NULL);
+			glCompileShader(fragment);
+			// check for errors
+			glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+				std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+			}
+
+			// shader Program
+			glAttachShader(ID, vertex);
+			glAttachShader(ID, fragment);
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+			if (useCache)
+				glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+			glLinkProgram(ID);
+			// check for linking errors 
+			glGetProgramiv(ID, GL_LINK_STATUS, &success);
+			if (!success)
+			{
+				glGetProgramInfoLog(ID, 512, NULL, infoLog);
+				std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			}
+			else if (useCache)
+				saveProgramBinary(cacheKey);
+
+			// delete the shaders
+			glDeleteShader(vertex);
+			glDeleteShader(fragment);
+		}
+
+		reflectUniforms();
+		bindUniformBlock("PerFrame", PER_FRAME_BINDING);
+	}
+	// use/activate the shader
+	void use()
+	{
+		glUseProgram(ID);
+	}
+	
+	// returns the cached location of a uniform, or -1 if the program doesn't use it
+	int getUniformLocation(const std::string& name) const
+	{
+		auto it = uniformLocations.find(name);
+		return it != uniformLocations.end() ? it->second : -1;
+	}
+
+	// attaches a uniform block (if the program declares it) to a uniform buffer binding point
+	void bindUniformBlock(const char* blockName, unsigned int binding)
+	{
+		unsigned int blockIndex = glGetUniformBlockIndex(ID, blockName);
+		if (blockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, blockIndex, binding);
+	}
+
+	// utility uniform funvtions
+	void setBool(const std::string& name, bool value) const
+	{
+		glUniform1i(getUniformLocation(name), (int)value);
+	}
+
+	void setInt(const std::string &name, int value) const
+	{
+		glUniform1i(getUniformLocation(name), value);
+	}
+	
+	void setFloat(const std::string &name, float value) const
+	{
+		glUniform1f(getUniformLocation(name), value);
+	}
+
+	void setMat4(const std::string& name, const glm::mat4 &mat) const
+	{
+		setMat4(getUniformLocation(name), mat);
+	}
+
+	void setVec3(const std::string& name, float x, float y, float z) const
+	{
+		glUniform3f(getUniformLocation(name), x, y, z);
+	}
+
+	void setVec3(const std::string& name, const glm::vec3 &vec) const
+	{
+		setVec3(getUniformLocation(name), vec);
+	}
+
+	// same setters for a location fetched once with getUniformLocation, for use in the draw loop
+	void setInt(int location, int value) const
+	{
+		glUniform1i(location, value);
+	}
+
+	void setFloat(int location, float value) const
+	{
+		glUniform1f(location, value);
+	}
+
+	void setMat4(int location, const glm::mat4& mat) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	void setVec3(int location, float x, float y, float z) const
+	{
+		glUniform3f(location, x, y, z);
+	}
+
+	void setVec3(int location, const glm::vec3& vec) const
+	{
+		glUniform3fv(location, 1, &vec[0]);
+	}
+
+private:
+	static void readSourceFiles(const char* vertexPath, const char* fragmentPath, std::string& vertexCode, std::string& fragmentCode)
+	{
+		// read the shader source code from filePath
 		std::ifstream vShaderFile;
 		std::ifstream fShaderFile;
 		// ensure ifstram objects can throw exceptions
@@ -44,91 +218,131 @@ public:
 			vertexCode = vShaderStream.str();
 			fragmentCode = fShaderStream.str();
 		}
-		catch (std::ifstream::failure e)
+		catch (const std::ifstream::failure& e)
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-
-		// compile shaders
-		unsigned int vertex, fragment;
-		int success;
-		char infoLog[512];
-
-		// vertex Shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		// check for errors
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-		if (!success)
-		{
-			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-		}
+	}
 
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		// check for errors
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-		if (!success)
-		{
-			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-		}
+	// program binaries need GL 4.1 or ARB_get_program_binary, and a driver that exposes at least one format
+	static bool binaryCacheSupported()
+	{
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+		bool available = false;
+#if defined(GL_VERSION_4_1)
+		available = GLAD_GL_VERSION_4_1 != 0;
+#endif
+#if defined(GL_ARB_get_program_binary)
+		available = available || GLAD_GL_ARB_get_program_binary != 0;
+#endif
+		int formats = 0;
+		if (available)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+#else
+		return false;
+#endif
+	}
 
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
-		// check for linking errors 
-		glGetProgramiv(ID, GL_LINK_STATUS, &success);
-		if (!success)
+	// binaries are only valid for the exact sources and driver that produced them
+	static uint64_t programCacheKey(const std::string& vertexCode, const std::string& fragmentCode)
+	{
+		uint64_t key = hashString(vertexCode);
+		key = hashString(fragmentCode, key);
+		const GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (GLenum name : driverStrings)
 		{
-			glGetProgramInfoLog(ID, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			const char* value = (const char*)glGetString(name);
+			key = hashString(value ? value : "", key);
 		}
-
-		// delete the shaders
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-	}
-	// use/activate the shader
-	void use()
-	{
-		glUseProgram(ID);
+		return key;
 	}
-	
-	// utility uniform funvtions
-	void setBool(const std::string& name, bool value) const
+
+	static std::string programCachePath(uint64_t key)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		return std::string(SHADER_CACHE_DIR) + "/" + hashToHex(key) + ".bin";
 	}
 
-	void setInt(const std::string &name, int value) const
+	// cache file: "PBIN", binary format, key, length, then the binary itself
+	struct ProgramBinaryHeader
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-	}
-	
-	void setFloat(const std::string &name, float value) const
+		char magic[4];
+		uint32_t format;
+		uint64_t key;
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	bool loadProgramBinary(uint64_t key)
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-	}
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+		std::ifstream file(programCachePath(key), std::ios::binary);
+		ProgramBinaryHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, "PBIN", 4) != 0 || header.key != key)
+			return false;
+		std::vector<char> binary(header.length);
+		if (!file.read(binary.data(), binary.size()))
+			return false;
 
-	void setMat4(const std::string& name, glm::mat4 &mat) {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glProgramBinary(ID, header.format, binary.data(), (GLsizei)binary.size());
+		int success = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			// stale or rejected by the driver, start over with a clean program and compile
+			glDeleteProgram(ID);
+			ID = glCreateProgram();
+			return false;
+		}
+		return true;
+#else
+		return false;
+#endif
 	}
 
-	void setVec3(const std::string& name, float x, float y, float z) {
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+	void saveProgramBinary(uint64_t key)
+	{
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+		int length = 0;
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+		std::error_code error;
+		std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+		std::ofstream file(programCachePath(key), std::ios::binary);
+		ProgramBinaryHeader header = { { 'P', 'B', 'I', 'N' }, format, key, (uint32_t)length, 0 };
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), length);
+		if (!file)
+			std::cout << "ERROR::SHADER::CACHE_WRITE_FAILED" << std::endl;
+#endif
 	}
 
-	void setVec3(const std::string& name, glm::vec3 &vec) {
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &vec[0]);
+	// fills uniformLocations with every active uniform of the linked program
+	void reflectUniforms()
+	{
+		int count = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		char name[256];
+		for (int i = 0; i < count; i++)
+		{
+			int length = 0, size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, (GLuint)i, sizeof(name), &length, &size, &type, name);
+			int location = glGetUniformLocation(ID, name);
+			// members of uniform blocks have no location
+			if (location < 0)
+				continue;
+			std::string uniformName(name, length);
+			uniformLocations[uniformName] = location;
+			// arrays are reported as "name[0]", also make them reachable as "name"
+			if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+				uniformLocations[uniformName.substr(0, uniformName.size() - 3)] = location;
+		}
 	}
 };
 
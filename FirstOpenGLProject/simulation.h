@@ -0,0 +1,300 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+#include <glm-1.0.1/glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include "camera.h"
+#include "instance_buffer.h"
+#include "frame_stats.h"
+#include "input_events.h"
+#include "profiler.h"
+
+// Three slots shared by one writer and one reader without locks. The writer fills the back slot and
+// publishes it by swapping it with the middle one, the reader swaps the middle slot into the front when
+// something new was published. Neither side ever waits and the reader always gets the newest complete slot.
+template <typename T>
+class TripleBuffer
+{
+public:
+	// slot the writer fills, never seen by the reader until publish()
+	T& writeBuffer()
+	{
+		return slots[backIndex];
+	}
+
+	void publish()
+	{
+		backIndex = middle.exchange((uint8_t)(backIndex | DIRTY), std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// takes the newest published slot, returns false when nothing new arrived since the last call
+	bool consume()
+	{
+		if (!(middle.load(std::memory_order_acquire) & DIRTY))
+			return false;
+		frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	// slot the reader works from, stays valid until the next consume()
+	const T& readBuffer() const
+	{
+		return slots[frontIndex];
+	}
+
+private:
+	static const uint8_t INDEX_MASK = 3;
+	static const uint8_t DIRTY = 4;
+
+	T slots[3];
+	std::atomic<uint8_t> middle{ 1 };
+	uint8_t backIndex = 0;
+	uint8_t frontIndex = 2;
+};
+
+// simulation advances in fixed steps of this many seconds, independent of the frame rate
+const double SIM_TIMESTEP = 1.0 / 120.0;
+
+// The part of the world that moves every tick and is interpolated between ticks when drawn
+struct WorldState
+{
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+	glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+	float cameraZoom = ZOOM;
+	glm::vec3 lightPos = glm::vec3(0.0f);
+	// simulation time in seconds, what the point lights are animated by
+	float time = 0.0f;
+
+	glm::mat4 viewMatrix() const
+	{
+		return glm::lookAt(cameraPosition, cameraPosition + cameraFront, cameraUp);
+	}
+};
+
+// Immutable view of the world after one simulation tick, everything the renderer needs to draw it
+struct FrameSnapshot
+{
+	uint64_t tick = 0;
+	// simulation time of `current` in seconds, `previous` is one SIM_TIMESTEP earlier
+	double time = 0.0;
+	WorldState previous;
+	WorldState current;
+	// object transforms with their normal matrices, only copied into a slot when they changed since
+	// that slot was last written
+	std::vector<InstanceData> instances;
+	uint64_t instancesVersion = 0;
+
+	// state between the last two ticks, alpha 0 is `previous` and 1 is `current`
+	WorldState interpolate(float alpha) const
+	{
+		alpha = glm::clamp(alpha, 0.0f, 1.0f);
+		WorldState state;
+		state.cameraPosition = glm::mix(previous.cameraPosition, current.cameraPosition, alpha);
+		state.cameraFront = glm::normalize(glm::mix(previous.cameraFront, current.cameraFront, alpha));
+		state.cameraUp = glm::normalize(glm::mix(previous.cameraUp, current.cameraUp, alpha));
+		state.cameraZoom = glm::mix(previous.cameraZoom, current.cameraZoom, alpha);
+		state.lightPos = glm::mix(previous.lightPos, current.lightPos, alpha);
+		state.time = glm::mix(previous.time, current.time, alpha);
+		return state;
+	}
+};
+
+// Owns the world state (camera, light, object transforms) and advances it in fixed SIM_TIMESTEP ticks,
+// publishing a snapshot after each advance. Input is applied at the tick it arrived in, so the same
+// input gives the same motion at any frame rate, and consumed events can be recorded and replayed.
+// advanceTo() can be driven directly (headless runs) or from its own thread with start()/stop().
+class Simulation
+{
+public:
+	Camera& camera;
+	std::vector<InstanceData> instances;
+	TripleBuffer<FrameSnapshot> snapshots;
+	// optional scripted camera, called with the time of every tick instead of relying on input
+	void (*cameraScript)(float time) = NULL;
+	// when not empty, events are taken from here at their recorded ticks instead of from the queue
+	std::vector<RecordedInputEvent> replay;
+	// every event taken from the queue with the tick that applied it, kept when `recording` is set
+	bool recording = false;
+	std::vector<RecordedInputEvent> recorded;
+
+	Simulation(Camera& camera, const std::vector<InstanceData>& instances) : camera(camera), instances(instances)
+	{
+	}
+
+	~Simulation()
+	{
+		stop();
+	}
+
+	// call after changing instances so the next snapshots pick them up
+	void instancesChanged()
+	{
+		instancesVersion++;
+	}
+
+	// sets up the state at time 0 and publishes it, call once before advancing
+	void begin()
+	{
+		if (cameraScript)
+			cameraScript(0.0f);
+		updateLight();
+		current = capture();
+		previous = current;
+		publish();
+	}
+
+	// runs every tick up to `time` seconds (taking live input from `queue` if there is one) and
+	// publishes the result, returns the number of ticks run
+	int advanceTo(double time, InputEventQueue* queue = NULL)
+	{
+		uint64_t target = (uint64_t)floor(time / SIM_TIMESTEP + 1e-4);
+		int ticks = 0;
+		while (tick < target)
+		{
+			step(queue);
+			ticks++;
+		}
+		if (ticks > 0)
+			publish();
+		return ticks;
+	}
+
+	// seconds since start() on the simulation clock, for interpolating between ticks while rendering
+	double elapsed() const
+	{
+		return (nowMs() - startMs) / 1000.0;
+	}
+
+	// runs the simulation on its own thread, waking up for every tick
+	void start(InputEventQueue& queue)
+	{
+		startMs = nowMs();
+		running = true;
+		thread = std::thread([this, &queue]() {
+			auto startTime = std::chrono::steady_clock::now();
+			while (running.load(std::memory_order_relaxed))
+			{
+				advanceTo(elapsed(), &queue);
+				std::this_thread::sleep_until(startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>((tick + 1) * SIM_TIMESTEP)));
+			}
+		});
+	}
+
+	void stop()
+	{
+		running = false;
+		if (thread.joinable())
+			thread.join();
+	}
+
+private:
+	WorldState previous;
+	WorldState current;
+	glm::vec3 lightPos = glm::vec3(0.0f);
+	uint64_t tick = 0;
+	uint64_t instancesVersion = 1;
+	// movement keys held down, one bit per Camera_Movement
+	uint32_t movementKeys = 0;
+	size_t replayIndex = 0;
+	double startMs = nowMs();
+	std::atomic<bool> running{ false };
+	std::thread thread;
+
+	// one fixed tick: apply the input that arrived during it, then move everything by SIM_TIMESTEP
+	void step(InputEventQueue* queue)
+	{
+		PROFILE_SCOPE("sim_tick");
+		if (!replay.empty())
+		{
+			for (; replayIndex < replay.size() && replay[replayIndex].tick <= tick; replayIndex++)
+				apply(replay[replayIndex].type, replay[replayIndex].key, replay[replayIndex].x, replay[replayIndex].y);
+		}
+		else if (queue)
+		{
+			double tickEndMs = startMs + (tick + 1) * SIM_TIMESTEP * 1000.0;
+			InputEvent event;
+			while (queue->popBefore(tickEndMs, event))
+			{
+				apply(event.type, event.key, event.x, event.y);
+				if (recording)
+				{
+					RecordedInputEvent record = { tick, event.type, event.key, { 0, 0 }, event.x, event.y, 0 };
+					recorded.push_back(record);
+				}
+			}
+		}
+
+		for (int movement = FORWARD; movement <= TURNRIGHT; movement++)
+		{
+			if (movementKeys & (1u << movement))
+				camera.ProcessKeyboard((Camera_Movement)movement, (float)SIM_TIMESTEP);
+		}
+
+		tick++;
+		if (cameraScript)
+			cameraScript((float)(tick * SIM_TIMESTEP));
+		updateLight();
+		previous = current;
+		current = capture();
+	}
+
+	void apply(InputEventType type, uint8_t key, float x, float y)
+	{
+		// keys past the mask can't be held
+		if ((type == INPUT_KEY_DOWN || type == INPUT_KEY_UP) && key >= INPUT_KEY_LIMIT)
+			return;
+		if (type == INPUT_KEY_DOWN)
+			movementKeys |= 1u << key;
+		else if (type == INPUT_KEY_UP)
+			movementKeys &= ~(1u << key);
+		else if (type == INPUT_MOUSE_MOVE)
+			camera.ProcessMouseMovement(x, y);
+		else if (type == INPUT_SCROLL)
+			camera.ProcessMouseScroll(y);
+	}
+
+	void updateLight()
+	{
+		float time = (float)(tick * SIM_TIMESTEP);
+		lightPos = glm::vec3(2 * cos(time), 2 * cos(time), 2 * sin(time));
+	}
+
+	WorldState capture() const
+	{
+		WorldState state;
+		state.cameraPosition = camera.Position;
+		state.cameraFront = camera.Front;
+		state.cameraUp = camera.Up;
+		state.cameraZoom = camera.Zoom;
+		state.lightPos = lightPos;
+		state.time = (float)(tick * SIM_TIMESTEP);
+		return state;
+	}
+
+	void publish()
+	{
+		FrameSnapshot& snapshot = snapshots.writeBuffer();
+		snapshot.tick = tick;
+		snapshot.time = tick * SIM_TIMESTEP;
+		snapshot.previous = previous;
+		snapshot.current = current;
+		if (snapshot.instancesVersion != instancesVersion)
+		{
+			snapshot.instances = instances;
+			snapshot.instancesVersion = instancesVersion;
+		}
+		snapshots.publish();
+	}
+};
+
+#endif
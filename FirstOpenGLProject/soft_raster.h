@@ -0,0 +1,444 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <glm-1.0.1/glm/glm.hpp>
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "mesh.h"
+#include "instance_buffer.h"
+#include "thread_pool.h"
+#include "png_writer.h"
+
+#if defined(__AVX2__)
+#define SOFT_RASTER_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_RASTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// name of the edge function kernel compiled in, reported by the benchmarks
+#if defined(SOFT_RASTER_AVX2)
+#define SOFT_RASTER_KERNEL "avx2"
+#elif defined(SOFT_RASTER_SSE2)
+#define SOFT_RASTER_KERNEL "sse2"
+#else
+#define SOFT_RASTER_KERNEL "scalar"
+#endif
+
+// Color (RGBA8) and depth target of the software rasterizer, rows top to bottom
+class SoftFramebuffer
+{
+public:
+	int width;
+	int height;
+	// pixels per row, padded to a multiple of 8 so SIMD loads and stores never run past a row
+	int stride;
+	std::vector<uint32_t> color;
+	std::vector<float> depth;
+
+	SoftFramebuffer(int width, int height) : width(width), height(height), stride((width + 7) & ~7)
+	{
+		color.resize((size_t)stride * height);
+		depth.resize((size_t)stride * height);
+	}
+
+	void clear(const glm::vec4& clearColor)
+	{
+		std::fill(color.begin(), color.end(), packColor(clearColor));
+		std::fill(depth.begin(), depth.end(), 1.0f);
+	}
+
+	// converts like GL does for a unorm8 target: clamp, scale and round
+	static uint32_t packColor(const glm::vec4& c)
+	{
+		uint32_t r = (uint32_t)(glm::clamp(c.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+		uint32_t g = (uint32_t)(glm::clamp(c.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+		uint32_t b = (uint32_t)(glm::clamp(c.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+		uint32_t a = (uint32_t)(glm::clamp(c.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+		return r | (g << 8) | (b << 16) | (a << 24);
+	}
+
+	bool writePng(const char* path) const
+	{
+		std::vector<uint8_t> rgba((size_t)width * height * 4);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				uint32_t c = color[(size_t)y * stride + x];
+				uint8_t* out = &rgba[((size_t)y * width + x) * 4];
+				out[0] = (uint8_t)c;
+				out[1] = (uint8_t)(c >> 8);
+				out[2] = (uint8_t)(c >> 16);
+				out[3] = (uint8_t)(c >> 24);
+			}
+		}
+		return ::writePng(path, width, height, rgba.data());
+	}
+};
+
+// One instanced draw: every instance of `mesh`, shaded with the Phong model of lighting.frag in
+// `color`, or flat `color` like lightSource.frag when `lit` is false
+struct SoftDraw
+{
+	const Mesh* mesh;
+	const InstanceData* instances;
+	size_t instanceCount;
+	glm::vec3 color;
+	bool lit;
+};
+
+// the PerFrame block of the GL renderer
+struct SoftFrameParams
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec3 viewPos;
+	glm::vec3 lightPos;
+	glm::vec3 lightColor;
+};
+
+// CPU implementation of the lighting pipeline. Triangles are transformed, clipped against the near
+// plane and set up on the calling thread, then binned into TILE_SIZE square tiles; every tile is
+// rasterized by its own pool task, so tiles never share pixels and need no locking. Edge functions,
+// the depth test and the depth write run 8 pixels at a time with AVX2 (4 with SSE2), covered pixels
+// are shaded one by one. Pixel centers are at +0.5 like GL; pixels exactly on a shared edge belong
+// to both triangles and the depth test (GL_LESS) keeps the first.
+class SoftRasterizer
+{
+public:
+	static const int TILE_SIZE = 64;
+
+	// triangles set up and fragments shaded by the last draw()
+	size_t triangleCount = 0;
+	size_t fragmentCount = 0;
+
+	void draw(SoftFramebuffer& target, const SoftFrameParams& frame, const std::vector<SoftDraw>& draws, ThreadPool& pool)
+	{
+		framebuffer = &target;
+		params = &frame;
+		drawList = &draws;
+		setupTriangles();
+
+		tilesX = (target.width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (target.height + TILE_SIZE - 1) / TILE_SIZE;
+		binTriangles();
+
+		std::atomic<size_t> fragments{ 0 };
+		pool.parallelFor(bins.size(), 1, [this, &fragments](size_t begin, size_t end) {
+			for (size_t tile = begin; tile < end; tile++)
+				fragments += rasterTile((int)tile);
+		});
+		triangleCount = triangles.size();
+		fragmentCount = fragments;
+	}
+
+private:
+	struct ClipVertex
+	{
+		glm::vec4 clip;
+		glm::vec3 world;
+		glm::vec3 normal;
+	};
+
+	// screen space triangle ready for rasterization
+	struct Triangle
+	{
+		// edge functions scaled by 1/area, so at a pixel they give the barycentric weight of vertex i directly
+		float a[3], b[3], c[3];
+		float z[3];
+		float invW[3];
+		// attributes divided by w for perspective correct interpolation
+		glm::vec3 worldOverW[3];
+		glm::vec3 normalOverW[3];
+		int minX, minY, maxX, maxY;
+		uint32_t draw;
+	};
+
+	SoftFramebuffer* framebuffer = NULL;
+	const SoftFrameParams* params = NULL;
+	const std::vector<SoftDraw>* drawList = NULL;
+	std::vector<ClipVertex> transformed;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bins;
+	int tilesX = 0;
+	int tilesY = 0;
+
+	void setupTriangles()
+	{
+		triangles.clear();
+		glm::mat4 viewProjection = params->projection * params->view;
+		for (uint32_t d = 0; d < drawList->size(); d++)
+		{
+			const SoftDraw& draw = (*drawList)[d];
+			const Mesh& mesh = *draw.mesh;
+			transformed.resize(mesh.vertices.size());
+			for (size_t instance = 0; instance < draw.instanceCount; instance++)
+			{
+				const InstanceData& data = draw.instances[instance];
+				glm::mat3 normalMatrix(glm::vec3(data.normal.columns[0]), glm::vec3(data.normal.columns[1]), glm::vec3(data.normal.columns[2]));
+				for (size_t v = 0; v < mesh.vertices.size(); v++)
+				{
+					glm::vec4 world = data.model * glm::vec4(mesh.vertices[v].position, 1.0f);
+					transformed[v].world = glm::vec3(world);
+					transformed[v].clip = viewProjection * world;
+					transformed[v].normal = normalMatrix * mesh.vertices[v].normal;
+				}
+				for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+				{
+					const ClipVertex* corners[3] = { &transformed[mesh.indices[i]], &transformed[mesh.indices[i + 1]], &transformed[mesh.indices[i + 2]] };
+					clipAndSetup(corners, d);
+				}
+			}
+		}
+	}
+
+	// clips against the near plane (z >= -w), which can leave a quad, and sets up the result as a fan
+	void clipAndSetup(const ClipVertex* const corners[3], uint32_t draw)
+	{
+		bool allInside = true;
+		for (int i = 0; i < 3; i++)
+			allInside = allInside && corners[i]->clip.z >= -corners[i]->clip.w;
+		if (allInside)
+		{
+			setup(*corners[0], *corners[1], *corners[2], draw);
+			return;
+		}
+
+		ClipVertex polygon[4];
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const ClipVertex& current = *corners[i];
+			const ClipVertex& next = *corners[(i + 1) % 3];
+			float currentDistance = current.clip.z + current.clip.w;
+			float nextDistance = next.clip.z + next.clip.w;
+			if (currentDistance >= 0.0f)
+				polygon[count++] = current;
+			if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			{
+				float t = currentDistance / (currentDistance - nextDistance);
+				ClipVertex& split = polygon[count++];
+				split.clip = glm::mix(current.clip, next.clip, t);
+				split.world = glm::mix(current.world, next.world, t);
+				split.normal = glm::mix(current.normal, next.normal, t);
+			}
+		}
+		for (int i = 1; i + 1 < count; i++)
+			setup(polygon[0], polygon[i], polygon[i + 1], draw);
+	}
+
+	void setup(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t draw)
+	{
+		const ClipVertex* vertices[3] = { &v0, &v1, &v2 };
+		Triangle triangle;
+		float x[3], y[3];
+		for (int i = 0; i < 3; i++)
+		{
+			const ClipVertex& v = *vertices[i];
+			float invW = 1.0f / v.clip.w;
+			x[i] = (v.clip.x * invW * 0.5f + 0.5f) * framebuffer->width;
+			y[i] = (0.5f - v.clip.y * invW * 0.5f) * framebuffer->height;
+			triangle.z[i] = v.clip.z * invW * 0.5f + 0.5f;
+			triangle.invW[i] = invW;
+			triangle.worldOverW[i] = v.world * invW;
+			triangle.normalOverW[i] = v.normal * invW;
+		}
+
+		float area = (x[2] - x[1]) * (y[0] - y[1]) - (y[2] - y[1]) * (x[0] - x[1]);
+		if (area == 0.0f)
+			return;
+		float invArea = 1.0f / area;
+		for (int i = 0; i < 3; i++)
+		{
+			int j = (i + 1) % 3, k = (i + 2) % 3;
+			triangle.a[i] = -(y[k] - y[j]) * invArea;
+			triangle.b[i] = (x[k] - x[j]) * invArea;
+			triangle.c[i] = ((y[k] - y[j]) * x[j] - (x[k] - x[j]) * y[j]) * invArea;
+		}
+
+		// pixels whose centers fall inside the bounds
+		float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+		float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+		triangle.minX = std::max(0, (int)ceil(minX - 0.5f));
+		triangle.minY = std::max(0, (int)ceil(minY - 0.5f));
+		triangle.maxX = std::min(framebuffer->width - 1, (int)floor(maxX - 0.5f));
+		triangle.maxY = std::min(framebuffer->height - 1, (int)floor(maxY - 0.5f));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			return;
+		triangle.draw = draw;
+		triangles.push_back(triangle);
+	}
+
+	void binTriangles()
+	{
+		bins.resize((size_t)tilesX * tilesY);
+		for (std::vector<uint32_t>& bin : bins)
+			bin.clear();
+		for (uint32_t t = 0; t < triangles.size(); t++)
+		{
+			const Triangle& triangle = triangles[t];
+			for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE; ty++)
+			{
+				for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE; tx++)
+					bins[(size_t)ty * tilesX + tx].push_back(t);
+			}
+		}
+	}
+
+	// rasterizes every triangle binned to a tile in submission order, returns the fragments shaded
+	size_t rasterTile(int tile)
+	{
+		int tileX = (tile % tilesX) * TILE_SIZE, tileY = (tile / tilesX) * TILE_SIZE;
+		size_t fragments = 0;
+		for (uint32_t index : bins[tile])
+		{
+			const Triangle& t = triangles[index];
+			int x0 = std::max(t.minX, tileX), x1 = std::min(t.maxX, tileX + TILE_SIZE - 1);
+			int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, tileY + TILE_SIZE - 1);
+			for (int y = y0; y <= y1; y++)
+				fragments += rasterSpan(t, x0, x1, y);
+		}
+		return fragments;
+	}
+
+	// one row of a triangle from x0 to x1 inclusive
+	size_t rasterSpan(const Triangle& t, int x0, int x1, int y)
+	{
+		float py = y + 0.5f;
+		float* depthRow = &framebuffer->depth[(size_t)y * framebuffer->stride];
+		size_t fragments = 0;
+		int x = x0;
+
+#if defined(SOFT_RASTER_AVX2)
+		// spans start on a multiple of 8 (tiles are 64 wide, rows padded), lanes outside [x0, x1] are masked
+		x = x0 & ~7;
+		const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256 row0 = _mm256_set1_ps(t.b[0] * py + t.c[0]);
+		__m256 row1 = _mm256_set1_ps(t.b[1] * py + t.c[1]);
+		__m256 row2 = _mm256_set1_ps(t.b[2] * py + t.c[2]);
+		__m256 first = _mm256_set1_ps((float)x0), last = _mm256_set1_ps((float)x1 + 1.0f);
+		__m256 zero = _mm256_setzero_ps();
+		for (; x <= x1; x += 8)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), laneOffsets);
+			// mul + add rather than FMA, which AVX2 doesn't imply (-mavx2 alone, MSVC /arch:AVX2)
+			__m256 l0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.a[0]), px), row0);
+			__m256 l1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.a[1]), px), row1);
+			__m256 l2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.a[2]), px), row2);
+			__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(l0, zero, _CMP_GE_OQ), _mm256_cmp_ps(l1, zero, _CMP_GE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(l2, zero, _CMP_GE_OQ), _mm256_and_ps(_mm256_cmp_ps(px, first, _CMP_GE_OQ), _mm256_cmp_ps(px, last, _CMP_LT_OQ))));
+			if (_mm256_movemask_ps(inside) == 0)
+				continue;
+			__m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(l0, _mm256_set1_ps(t.z[0])), _mm256_mul_ps(l1, _mm256_set1_ps(t.z[1]))), _mm256_mul_ps(l2, _mm256_set1_ps(t.z[2])));
+			__m256 depth = _mm256_loadu_ps(depthRow + x);
+			__m256 pass = _mm256_and_ps(inside, _mm256_cmp_ps(z, depth, _CMP_LT_OQ));
+			int mask = _mm256_movemask_ps(pass);
+			if (mask == 0)
+				continue;
+			_mm256_storeu_ps(depthRow + x, _mm256_blendv_ps(depth, z, pass));
+			float w0[8], w1[8], w2[8];
+			_mm256_storeu_ps(w0, l0);
+			_mm256_storeu_ps(w1, l1);
+			_mm256_storeu_ps(w2, l2);
+			for (int lane = 0; lane < 8; lane++)
+			{
+				if (mask & (1 << lane))
+				{
+					shade(t, x + lane, y, w0[lane], w1[lane], w2[lane]);
+					fragments++;
+				}
+			}
+		}
+		return fragments;
+#elif defined(SOFT_RASTER_SSE2)
+		x = x0 & ~3;
+		const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 row0 = _mm_set1_ps(t.b[0] * py + t.c[0]);
+		__m128 row1 = _mm_set1_ps(t.b[1] * py + t.c[1]);
+		__m128 row2 = _mm_set1_ps(t.b[2] * py + t.c[2]);
+		__m128 first = _mm_set1_ps((float)x0), last = _mm_set1_ps((float)x1 + 1.0f);
+		__m128 zero = _mm_setzero_ps();
+		for (; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+			__m128 l0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[0]), px), row0);
+			__m128 l1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[1]), px), row1);
+			__m128 l2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[2]), px), row2);
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(l0, zero), _mm_cmpge_ps(l1, zero)),
+				_mm_and_ps(_mm_cmpge_ps(l2, zero), _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmplt_ps(px, last))));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+			__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t.z[0])), _mm_mul_ps(l1, _mm_set1_ps(t.z[1]))), _mm_mul_ps(l2, _mm_set1_ps(t.z[2])));
+			__m128 depth = _mm_loadu_ps(depthRow + x);
+			__m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, depth));
+			int mask = _mm_movemask_ps(pass);
+			if (mask == 0)
+				continue;
+			_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, depth)));
+			float w0[4], w1[4], w2[4];
+			_mm_storeu_ps(w0, l0);
+			_mm_storeu_ps(w1, l1);
+			_mm_storeu_ps(w2, l2);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if (mask & (1 << lane))
+				{
+					shade(t, x + lane, y, w0[lane], w1[lane], w2[lane]);
+					fragments++;
+				}
+			}
+		}
+#else
+		for (; x <= x1; x++)
+		{
+			float px = x + 0.5f;
+			float l0 = t.a[0] * px + t.b[0] * py + t.c[0];
+			float l1 = t.a[1] * px + t.b[1] * py + t.c[1];
+			float l2 = t.a[2] * px + t.b[2] * py + t.c[2];
+			if (l0 < 0.0f || l1 < 0.0f || l2 < 0.0f)
+				continue;
+			float z = l0 * t.z[0] + l1 * t.z[1] + l2 * t.z[2];
+			if (!(z < depthRow[x]))
+				continue;
+			depthRow[x] = z;
+			shade(t, x, y, l0, l1, l2);
+			fragments++;
+		}
+#endif
+		return fragments;
+	}
+
+	// lighting.frag (or lightSource.frag for unlit draws) for one pixel with screen space weights l0..l2
+	void shade(const Triangle& t, int x, int y, float l0, float l1, float l2)
+	{
+		const SoftDraw& draw = (*drawList)[t.draw];
+		glm::vec4 result(draw.color, 1.0f);
+		if (draw.lit)
+		{
+			float perspective = 1.0f / (l0 * t.invW[0] + l1 * t.invW[1] + l2 * t.invW[2]);
+			glm::vec3 fragPos = (l0 * t.worldOverW[0] + l1 * t.worldOverW[1] + l2 * t.worldOverW[2]) * perspective;
+			glm::vec3 normal = (l0 * t.normalOverW[0] + l1 * t.normalOverW[1] + l2 * t.normalOverW[2]) * perspective;
+
+			glm::vec3 norm = glm::normalize(normal);
+			glm::vec3 lightDir = glm::normalize(params->lightPos - fragPos);
+			glm::vec3 viewDir = glm::normalize(params->viewPos - fragPos);
+			glm::vec3 reflectDir = glm::reflect(-lightDir, norm);
+			float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), 32.0f);
+			glm::vec3 specular = 0.5f * spec * params->lightColor;
+			float diff = std::max(glm::dot(norm, lightDir), 0.0f);
+			glm::vec3 diffuse = diff * params->lightColor;
+			glm::vec3 ambient = 0.3f * params->lightColor;
+			result = glm::vec4((ambient + diffuse + specular) * draw.color, 1.0f);
+		}
+		framebuffer->color[(size_t)y * framebuffer->stride + x] = SoftFramebuffer::packColor(result);
+	}
+};
+
+#endif
@@ -0,0 +1,703 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+#include "stb_image.h"
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+
+#include "thread_pool.h"
+#include "asset_pack.h"
+
+// Texture packing stage: images are resized to power of two sizes, grouped by size into
+// GL_TEXTURE_2D_ARRAY layers and get their mip chains built and BC1 (DXT1) compressed up front, so the
+// driver never runs glGenerateMipmap and a material only has to name a layer. Everything up to the
+// upload works without a context, assetcook runs it offline and stores the cooked textures in the pack.
+
+// 4x4 texels in 8 bytes: two RGB565 endpoints and 2 bit indices. With color0 > color1 the palette is
+// the endpoints and two thirds in between; otherwise it is the endpoints, their midpoint and
+// transparent black (opaque black for the RGB format)
+const int BC1_BLOCK_BYTES = 8;
+
+inline size_t bc1Size(int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BC1_BLOCK_BYTES;
+}
+
+inline uint16_t packRGB565(const float color[3])
+{
+	int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// expanded the way decoders do it, by replicating the high bits
+inline void unpackRGB565(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// the block's palette as a decoder sees it, entry 3 of a three color block is unused for opaque texels
+inline void bc1Palette(uint16_t color0, uint16_t color1, int palette[4][3])
+{
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// picks the nearest palette entry for every texel, returns the squared error of the opaque ones
+inline int bc1Assign(const uint8_t* texels, const bool* transparent, uint16_t color0, uint16_t color1, uint8_t indices[16])
+{
+	int palette[4][3];
+	bc1Palette(color0, color1, palette);
+	int choices = color0 > color1 ? 4 : 3;
+	int error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		if (transparent[i])
+		{
+			indices[i] = 3;
+			continue;
+		}
+		int best = 0, bestError = 1 << 30;
+		for (int p = 0; p < choices; p++)
+		{
+			int dr = texels[i * 4] - palette[p][0], dg = texels[i * 4 + 1] - palette[p][1], db = texels[i * 4 + 2] - palette[p][2];
+			int e = dr * dr + dg * dg + db * db;
+			if (e < bestError)
+			{
+				bestError = e;
+				best = p;
+			}
+		}
+		indices[i] = (uint8_t)best;
+		error += bestError;
+	}
+	return error;
+}
+
+// least squares endpoints for fixed indices; false when the indices don't constrain both endpoints
+inline bool bc1Refit(const uint8_t* texels, const bool* transparent, const uint8_t indices[16], bool fourColor, float end0[3], float end1[3])
+{
+	// weight of endpoint 0 for each index
+	const float fourWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	const float threeWeights[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+	const float* weights = fourColor ? fourWeights : threeWeights;
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		if (transparent[i])
+			continue;
+		float a = weights[indices[i]], b = 1.0f - a;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < 3; c++)
+		{
+			ax[c] += a * texels[i * 4 + c];
+			bx[c] += b * texels[i * 4 + c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+		return false;
+	for (int c = 0; c < 3; c++)
+	{
+		end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+		end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+	}
+	return true;
+}
+
+inline void bc1Write(uint16_t color0, uint16_t color1, const uint8_t indices[16], uint8_t* out)
+{
+	out[0] = (uint8_t)color0;
+	out[1] = (uint8_t)(color0 >> 8);
+	out[2] = (uint8_t)color1;
+	out[3] = (uint8_t)(color1 >> 8);
+	for (int row = 0; row < 4; row++)
+	{
+		out[4 + row] = (uint8_t)(indices[row * 4] | (indices[row * 4 + 1] << 2) | (indices[row * 4 + 2] << 4) | (indices[row * 4 + 3] << 6));
+	}
+}
+
+// Compresses 16 RGBA texels (row major). Endpoints start at the extremes along the principal axis of
+// the block's colors, then get one least squares refit that is kept when it lowers the error.
+// With `punchThrough` texels below half alpha become the three color mode's transparent entry.
+inline void encodeBC1Block(const uint8_t* texels, bool punchThrough, uint8_t* out)
+{
+	bool transparent[16];
+	int opaqueCount = 0;
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		transparent[i] = punchThrough && texels[i * 4 + 3] < 128;
+		if (transparent[i])
+			continue;
+		opaqueCount++;
+		for (int c = 0; c < 3; c++)
+			mean[c] += texels[i * 4 + c];
+	}
+	uint8_t indices[16];
+	if (opaqueCount == 0)
+	{
+		memset(indices, 3, sizeof(indices));
+		bc1Write(0, 0, indices, out);
+		return;
+	}
+	bool fourColor = opaqueCount == 16;
+	for (int c = 0; c < 3; c++)
+		mean[c] /= opaqueCount;
+
+	// covariance, then its dominant eigenvector by power iteration
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		if (transparent[i])
+			continue;
+		float r = texels[i * 4] - mean[0], g = texels[i * 4 + 1] - mean[1], b = texels[i * 4 + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+		if (length < 1e-6f)
+			break;
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+	float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float low = 0.0f, high = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		if (transparent[i])
+			continue;
+		float t = ((texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2]) / lengthSquared;
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+	// pull the extremes in a little, the palette spreads its entries between them
+	float inset = (high - low) / 16.0f;
+	float end0[3], end1[3];
+	for (int c = 0; c < 3; c++)
+	{
+		end0[c] = mean[c] + axis[c] * (high - inset);
+		end1[c] = mean[c] + axis[c] * (low + inset);
+	}
+
+	// four color blocks need color0 > color1, three color blocks color0 <= color1
+	uint16_t color0 = packRGB565(end0), color1 = packRGB565(end1);
+	if ((color0 < color1) == fourColor)
+		std::swap(color0, color1);
+	int error = bc1Assign(texels, transparent, color0, color1, indices);
+
+	uint8_t refitIndices[16];
+	if (error > 0 && bc1Refit(texels, transparent, indices, color0 > color1, end0, end1))
+	{
+		uint16_t refit0 = packRGB565(end0), refit1 = packRGB565(end1);
+		if ((refit0 < refit1) == fourColor)
+			std::swap(refit0, refit1);
+		int refitError = bc1Assign(texels, transparent, refit0, refit1, refitIndices);
+		if (refitError < error)
+		{
+			color0 = refit0;
+			color1 = refit1;
+			memcpy(indices, refitIndices, sizeof(indices));
+		}
+	}
+	bc1Write(color0, color1, indices, out);
+}
+
+// expands one block back to 16 RGBA texels, transparent entries come out as zero alpha
+inline void decodeBC1Block(const uint8_t* block, uint8_t* texels)
+{
+	uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8)), color1 = (uint16_t)(block[2] | (block[3] << 8));
+	int palette[4][3];
+	bc1Palette(color0, color1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		int index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+		for (int c = 0; c < 3; c++)
+			texels[i * 4 + c] = (uint8_t)palette[index][c];
+		texels[i * 4 + 3] = color0 <= color1 && index == 3 ? 0 : 255;
+	}
+}
+
+// compresses rows of blocks [firstRow, endRow) of an RGBA8 image, edge texels repeat to fill partial blocks
+inline void compressBC1Rows(const uint8_t* rgba, int width, int height, bool punchThrough, int firstRow, int endRow, uint8_t* out)
+{
+	int blocksWide = (width + 3) / 4;
+	uint8_t texels[64];
+	for (int by = firstRow; by < endRow; by++)
+	{
+		for (int bx = 0; bx < blocksWide; bx++)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(by * 4 + (i >> 2), height - 1);
+				memcpy(&texels[i * 4], &rgba[((size_t)y * width + x) * 4], 4);
+			}
+			encodeBC1Block(texels, punchThrough, out + ((size_t)by * blocksWide + bx) * BC1_BLOCK_BYTES);
+		}
+	}
+}
+
+// CPU side image with its whole mip chain, RGBA8, levels stored back to back
+struct DecodedImage
+{
+	std::string path;
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+	std::vector<size_t> levelOffsets;
+	std::vector<int> levelWidths;
+	std::vector<int> levelHeights;
+	bool failed = false;
+};
+
+// 2x2 box filter of one RGBA8 level into the next, odd edges reuse the last row/column
+inline void downsampleRGBA(const unsigned char* source, int width, int height, unsigned char* target, int targetWidth, int targetHeight)
+{
+	for (int y = 0; y < targetHeight; y++)
+	{
+		int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < targetWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = source[(y0 * width + x0) * 4 + c] + source[(y0 * width + x1) * 4 + c]
+					+ source[(y1 * width + x0) * 4 + c] + source[(y1 * width + x1) * 4 + c];
+				target[(y * targetWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+// lays out the mip chain after level 0, which must already be in `pixels`, and box filters every level
+inline void buildMipChain(DecodedImage& image)
+{
+	image.levelOffsets.clear();
+	image.levelWidths.clear();
+	image.levelHeights.clear();
+	size_t total = 0;
+	for (int w = image.width, h = image.height; ; w = std::max(1, w / 2), h = std::max(1, h / 2))
+	{
+		image.levelOffsets.push_back(total);
+		image.levelWidths.push_back(w);
+		image.levelHeights.push_back(h);
+		total += (size_t)w * h * 4;
+		if (w == 1 && h == 1)
+			break;
+	}
+	image.pixels.resize(total);
+
+	for (size_t level = 1; level < image.levelOffsets.size(); level++)
+	{
+		downsampleRGBA(&image.pixels[image.levelOffsets[level - 1]], image.levelWidths[level - 1], image.levelHeights[level - 1],
+			&image.pixels[image.levelOffsets[level]], image.levelWidths[level], image.levelHeights[level]);
+	}
+}
+
+// decodes a file and builds its mip chain, safe to run on any thread
+inline void decodeImage(DecodedImage& image, bool flip)
+{
+	int channels;
+	unsigned char* data = stbi_load(image.path.c_str(), &image.width, &image.height, &channels, 4);
+	if (!data)
+	{
+		image.failed = true;
+		return;
+	}
+
+	// stbi_set_flip_vertically_on_load is global state, so flip here instead
+	size_t rowBytes = (size_t)image.width * 4;
+	image.pixels.resize(rowBytes * image.height);
+	for (int y = 0; y < image.height; y++)
+	{
+		int sourceRow = flip ? image.height - 1 - y : y;
+		memcpy(&image.pixels[y * rowBytes], data + sourceRow * rowBytes, rowBytes);
+	}
+	stbi_image_free(data);
+	buildMipChain(image);
+}
+
+// bilinear resize of an RGBA8 image, used to bring images onto a power of two size before packing
+inline void resampleRGBA(const unsigned char* source, int width, int height, unsigned char* target, int targetWidth, int targetHeight)
+{
+	for (int y = 0; y < targetHeight; y++)
+	{
+		float sy = std::max((y + 0.5f) * height / targetHeight - 0.5f, 0.0f);
+		int y0 = std::min((int)sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+		float fy = sy - y0;
+		for (int x = 0; x < targetWidth; x++)
+		{
+			float sx = std::max((x + 0.5f) * width / targetWidth - 0.5f, 0.0f);
+			int x0 = std::min((int)sx, width - 1), x1 = std::min(x0 + 1, width - 1);
+			float fx = sx - x0;
+			for (int c = 0; c < 4; c++)
+			{
+				float top = source[(y0 * width + x0) * 4 + c] * (1.0f - fx) + source[(y0 * width + x1) * 4 + c] * fx;
+				float bottom = source[(y1 * width + x0) * 4 + c] * (1.0f - fx) + source[(y1 * width + x1) * 4 + c] * fx;
+				target[(y * targetWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+}
+
+// power of two closest to `size`, at most `maxSize`
+inline int packedTextureSize(int size, int maxSize)
+{
+	int result = 1;
+	while (result < maxSize && result * 3 < size * 2)
+		result *= 2;
+	return result;
+}
+
+// One image ready for the GPU: power of two size and its whole mip chain, each level either BC1 blocks or
+// RGBA8 texels. This is what the asset cooker stores and what texture arrays are assembled from.
+struct CookedTexture
+{
+	int width = 0;
+	int height = 0;
+	bool compressed = false;
+	// some texel is below half alpha, compressed levels then use punch through blocks
+	bool alpha = false;
+	std::vector<std::vector<uint8_t>> levels;
+};
+
+// decodes an image file, resizes it to a power of two and builds its mip chain. False when the file
+// can't be read. No GL calls, safe on any thread
+inline bool cookTexture(const std::string& path, bool flip, bool compress, int maxSize, CookedTexture& cooked)
+{
+	DecodedImage image;
+	image.path = path;
+	decodeImage(image, flip);
+	if (image.failed)
+		return false;
+	int width = packedTextureSize(image.width, maxSize), height = packedTextureSize(image.height, maxSize);
+	if (width != image.width || height != image.height)
+	{
+		std::vector<unsigned char> resized((size_t)width * height * 4);
+		resampleRGBA(image.pixels.data(), image.width, image.height, resized.data(), width, height);
+		image.width = width;
+		image.height = height;
+		image.pixels.swap(resized);
+		buildMipChain(image);
+	}
+
+	cooked.width = width;
+	cooked.height = height;
+	cooked.compressed = compress;
+	cooked.alpha = false;
+	size_t topBytes = (size_t)width * height * 4;
+	for (size_t t = 3; t < topBytes && !cooked.alpha; t += 4)
+		cooked.alpha = image.pixels[t] < 128;
+	cooked.levels.resize(image.levelOffsets.size());
+	for (size_t level = 0; level < cooked.levels.size(); level++)
+	{
+		int levelWidth = image.levelWidths[level], levelHeight = image.levelHeights[level];
+		const uint8_t* texels = &image.pixels[image.levelOffsets[level]];
+		if (compress)
+		{
+			cooked.levels[level].resize(bc1Size(levelWidth, levelHeight));
+			compressBC1Rows(texels, levelWidth, levelHeight, cooked.alpha, 0, (levelHeight + 3) / 4, cooked.levels[level].data());
+		}
+		else
+			cooked.levels[level].assign(texels, texels + (size_t)levelWidth * levelHeight * 4);
+	}
+	return true;
+}
+
+// expands BC1 levels to RGBA8, for contexts without S3TC
+inline void decompressCookedTexture(CookedTexture& cooked)
+{
+	if (!cooked.compressed)
+		return;
+	uint8_t texels[64];
+	for (size_t level = 0; level < cooked.levels.size(); level++)
+	{
+		int width = std::max(1, cooked.width >> level), height = std::max(1, cooked.height >> level);
+		int blocksWide = (width + 3) / 4;
+		std::vector<uint8_t> rgba((size_t)width * height * 4);
+		for (int by = 0; by < (height + 3) / 4; by++)
+		{
+			for (int bx = 0; bx < blocksWide; bx++)
+			{
+				decodeBC1Block(&cooked.levels[level][((size_t)by * blocksWide + bx) * BC1_BLOCK_BYTES], texels);
+				for (int i = 0; i < 16; i++)
+				{
+					int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+					if (x < width && y < height)
+						memcpy(&rgba[((size_t)y * width + x) * 4], &texels[i * 4], 4);
+				}
+			}
+		}
+		cooked.levels[level].swap(rgba);
+	}
+	cooked.compressed = false;
+}
+
+// Cooked texture blob as stored in an asset pack:
+//   CookedTextureHeader | uint32 byte size per level | level data back to back
+const char COOKED_TEXTURE_MAGIC[4] = { 'T', 'E', 'X', 'C' };
+const uint32_t COOKED_TEXTURE_COMPRESSED = 1;
+const uint32_t COOKED_TEXTURE_ALPHA = 2;
+
+struct CookedTextureHeader
+{
+	char magic[4];
+	uint32_t width;
+	uint32_t height;
+	uint32_t levels;
+	uint32_t flags;
+	uint32_t reserved;
+};
+static_assert(sizeof(CookedTextureHeader) == 24, "CookedTextureHeader layout is part of the file format");
+
+inline void writeCookedTexture(std::string& out, const CookedTexture& cooked)
+{
+	CookedTextureHeader header = {};
+	memcpy(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic));
+	header.width = (uint32_t)cooked.width;
+	header.height = (uint32_t)cooked.height;
+	header.levels = (uint32_t)cooked.levels.size();
+	header.flags = (cooked.compressed ? COOKED_TEXTURE_COMPRESSED : 0) | (cooked.alpha ? COOKED_TEXTURE_ALPHA : 0);
+	out.append((const char*)&header, sizeof(header));
+	for (const std::vector<uint8_t>& level : cooked.levels)
+	{
+		uint32_t size = (uint32_t)level.size();
+		out.append((const char*)&size, sizeof(size));
+	}
+	for (const std::vector<uint8_t>& level : cooked.levels)
+		out.append((const char*)level.data(), level.size());
+}
+
+inline bool readCookedTexture(const unsigned char* data, size_t size, CookedTexture& cooked)
+{
+	CookedTextureHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic)) != 0 || header.levels == 0 || header.levels > 32
+		|| size < sizeof(header) + header.levels * sizeof(uint32_t))
+		return false;
+	cooked.width = (int)header.width;
+	cooked.height = (int)header.height;
+	cooked.compressed = (header.flags & COOKED_TEXTURE_COMPRESSED) != 0;
+	cooked.alpha = (header.flags & COOKED_TEXTURE_ALPHA) != 0;
+	cooked.levels.resize(header.levels);
+	size_t offset = sizeof(header) + header.levels * sizeof(uint32_t);
+	for (uint32_t level = 0; level < header.levels; level++)
+	{
+		int width = std::max(1, cooked.width >> level), height = std::max(1, cooked.height >> level);
+		uint32_t levelSize;
+		memcpy(&levelSize, data + sizeof(header) + level * sizeof(uint32_t), sizeof(levelSize));
+		if (levelSize != (cooked.compressed ? bc1Size(width, height) : (size_t)width * height * 4) || levelSize > size - offset)
+			return false;
+		cooked.levels[level].assign(data + offset, data + offset + levelSize);
+		offset += levelSize;
+	}
+	return true;
+}
+
+// where a packed texture ended up, array -1 when it failed to load
+struct TextureLayer
+{
+	int array = -1;
+	int layer = -1;
+};
+
+// One texture array as it is handed to the driver: for every mip level, all layers back to back,
+// either BC1 blocks or RGBA8 texels
+struct PackedTextureArray
+{
+	int width = 0;
+	int height = 0;
+	int layers = 0;
+	int levels = 0;
+	bool compressed = false;
+	bool alpha = false;
+	std::vector<std::vector<uint8_t>> levelData;
+};
+
+// groups cooked textures of equal size and format into arrays, layers in input order. `layers` gets one
+// entry per texture, textures with no levels (failed to load) stay out
+inline void packTextures(const std::vector<CookedTexture>& textures, std::vector<PackedTextureArray>& arrays, std::vector<TextureLayer>& layers)
+{
+	arrays.clear();
+	layers.assign(textures.size(), TextureLayer());
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const CookedTexture& texture = textures[i];
+		if (texture.levels.empty())
+			continue;
+		size_t array = 0;
+		while (array < arrays.size() && (arrays[array].width != texture.width || arrays[array].height != texture.height
+			|| arrays[array].compressed != texture.compressed))
+			array++;
+		if (array == arrays.size())
+		{
+			arrays.push_back(PackedTextureArray());
+			arrays.back().width = texture.width;
+			arrays.back().height = texture.height;
+			arrays.back().levels = (int)texture.levels.size();
+			arrays.back().compressed = texture.compressed;
+			arrays.back().levelData.resize(texture.levels.size());
+		}
+		PackedTextureArray& packed = arrays[array];
+		// opaque images only use four color blocks, so they can share the punch through format
+		packed.alpha = packed.alpha || texture.alpha;
+		layers[i].array = (int)array;
+		layers[i].layer = packed.layers++;
+		for (int level = 0; level < packed.levels; level++)
+			packed.levelData[level].insert(packed.levelData[level].end(), texture.levels[level].begin(), texture.levels[level].end());
+	}
+}
+
+// true when the context takes BC1 data; glad only knows the extension when it was generated with it
+inline bool textureCompressionSupported()
+{
+#if defined(GL_EXT_texture_compression_s3tc)
+	return GLAD_GL_EXT_texture_compression_s3tc != 0;
+#else
+	return false;
+#endif
+}
+
+// A set of texture arrays built from image files. Materials refer to a TextureLayer, and drawing
+// anything in one array needs a single bind of that array however many textures it holds.
+class TextureAtlas
+{
+public:
+	// texture unit bound while uploading, so the units used for drawing keep their bindings
+	static const int UPLOAD_TEXTURE_UNIT = 15;
+
+	// texel data in video memory, and what it would take as uncompressed RGBA8 with the same mips
+	size_t bytes = 0;
+	size_t uncompressedBytes = 0;
+	bool compressed = false;
+	// textures that came cooked out of an asset pack
+	std::atomic<int> packedCount{ 0 };
+	std::vector<unsigned int> arrays;
+	// one per loaded path
+	std::vector<TextureLayer> layers;
+
+	TextureAtlas()
+	{
+	}
+
+	~TextureAtlas()
+	{
+		if (!arrays.empty())
+			glDeleteTextures((GLsizei)arrays.size(), arrays.data());
+	}
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	// packs and uploads the images, blocking until they are on the GPU. Images found in `pack` are read as
+	// the cooker left them, the rest are cooked here on the pool. Uses BC1 when the context has S3TC
+	void load(const std::vector<std::string>& paths, ThreadPool& pool, const AssetPack* pack = NULL, bool flip = true, int maxSize = 2048)
+	{
+		compressed = textureCompressionSupported();
+		std::vector<CookedTexture> cooked(paths.size());
+		pool.parallelFor(paths.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const PackEntry* entry = pack ? pack->find(paths[i].c_str(), PACK_TEXTURE) : NULL;
+				bool loaded = entry ? readCookedTexture(pack->data(*entry), entry->size, cooked[i])
+					: cookTexture(paths[i], flip, compressed, maxSize, cooked[i]);
+				if (!loaded)
+					cooked[i].levels.clear();
+				else if (!compressed)
+					decompressCookedTexture(cooked[i]);
+				if (entry)
+					packedCount++;
+			}
+		});
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			if (cooked[i].levels.empty())
+				std::cout << "ERROR::TEXTURE::FAILED_TO_LOAD " << paths[i] << std::endl;
+		}
+
+		std::vector<PackedTextureArray> packed;
+		packTextures(cooked, packed, layers);
+		for (const PackedTextureArray& array : packed)
+			arrays.push_back(upload(array));
+	}
+
+	// texture name for a layer, 0 when it failed to load
+	unsigned int texture(const TextureLayer& layer) const
+	{
+		return layer.array >= 0 ? arrays[layer.array] : 0;
+	}
+
+private:
+	unsigned int upload(const PackedTextureArray& array)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glActiveTexture(GL_TEXTURE0 + UPLOAD_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (int level = 0; level < array.levels; level++)
+		{
+			int width = std::max(1, array.width >> level), height = std::max(1, array.height >> level);
+			const std::vector<uint8_t>& data = array.levelData[level];
+#if defined(GL_EXT_texture_compression_s3tc)
+			if (array.compressed)
+			{
+				GLenum format = array.alpha ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, width, height, array.layers, 0, (GLsizei)data.size(), data.data());
+			}
+			else
+#endif
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, array.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+			bytes += data.size();
+			uncompressedBytes += (size_t)width * height * 4 * array.layers;
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levels - 1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		glActiveTexture(GL_TEXTURE0);
+		return texture;
+	}
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+// Fixed set of worker threads fed from a single job queue. Used for data parallel engine work
+// (culling, transform updates, meshing) through parallelFor, and for background jobs through submit.
+class ThreadPool
+{
+public:
+	// by default leaves one core for the thread that owns the pool
+	ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+		{
+			// 0 means the count is unknown, which must not wrap around to UINT_MAX threads
+			unsigned int cores = std::thread::hardware_concurrency();
+			threadCount = cores > 1 ? cores - 1 : 1;
+		}
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeup.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int size() const
+	{
+		return (unsigned int)workers.size();
+	}
+
+	// runs a job on a worker thread, the future becomes ready when it has finished
+	std::future<void> submit(std::function<void()> job)
+	{
+		std::shared_ptr<std::packaged_task<void()>> task = std::make_shared<std::packaged_task<void()>>(std::move(job));
+		std::future<void> done = task->get_future();
+		push([task] { (*task)(); });
+		return done;
+	}
+
+	// calls fn(begin, end) over [0, count) in chunks of `grain` items and returns once every chunk is done.
+	// The calling thread works on chunks too, so this never deadlocks when all workers are busy.
+	template <typename Fn>
+	void parallelFor(size_t count, size_t grain, Fn fn)
+	{
+		if (count == 0)
+			return;
+		grain = std::max<size_t>(grain, 1);
+		size_t chunkCount = (count + grain - 1) / grain;
+		if (chunkCount == 1 || workers.empty())
+		{
+			fn((size_t)0, count);
+			return;
+		}
+
+		// shared so helpers that only get scheduled after the loop finished still see valid state
+		struct Loop
+		{
+			std::atomic<size_t> nextChunk{ 0 };
+			std::atomic<size_t> doneChunks{ 0 };
+			std::mutex doneMutex;
+			std::condition_variable doneSignal;
+		};
+		std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+		std::function<void(size_t, size_t)> body = fn;
+
+		auto work = [loop, body, count, grain, chunkCount]
+		{
+			size_t chunk;
+			while ((chunk = loop->nextChunk.fetch_add(1)) < chunkCount)
+			{
+				size_t begin = chunk * grain;
+				body(begin, std::min(begin + grain, count));
+				if (loop->doneChunks.fetch_add(1) + 1 == chunkCount)
+				{
+					std::lock_guard<std::mutex> lock(loop->doneMutex);
+					loop->doneSignal.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min<size_t>(workers.size(), chunkCount - 1);
+		for (size_t i = 0; i < helpers; i++)
+			push(work);
+		work();
+
+		std::unique_lock<std::mutex> lock(loop->doneMutex);
+		loop->doneSignal.wait(lock, [&] { return loop->doneChunks.load() == chunkCount; });
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopping = false;
+
+	void push(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+		wakeup.notify_one();
+	}
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping && jobs.empty())
+					return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+};
+
+#endif
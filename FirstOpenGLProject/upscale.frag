@@ -0,0 +1,39 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// the scene only covers the bottom left uvScale of the texture
+uniform sampler2D scene;
+uniform vec2 uvScale;
+uniform vec2 texelSize;
+uniform float sharpness;
+
+// bilinear fetch that never reaches past the rendered corner, whatever is beyond it is stale
+vec3 fetch(vec2 uv)
+{
+	uv = clamp(uv, 0.5 * texelSize, uvScale - 0.5 * texelSize);
+	return texture(scene, uv).rgb;
+}
+
+void main()
+{
+	vec2 uv = TexCoords * uvScale;
+	vec3 center = fetch(uv);
+	if (sharpness <= 0.0)
+	{
+		FragColor = vec4(center, 1.0);
+		return;
+	}
+
+	// unsharp mask over the cross of source texels around the sample, clamped to their range so edges
+	// don't ring
+	vec3 north = fetch(uv + vec2(0.0, texelSize.y));
+	vec3 south = fetch(uv - vec2(0.0, texelSize.y));
+	vec3 east = fetch(uv + vec2(texelSize.x, 0.0));
+	vec3 west = fetch(uv - vec2(texelSize.x, 0.0));
+	vec3 lowest = min(center, min(min(north, south), min(east, west)));
+	vec3 highest = max(center, max(max(north, south), max(east, west)));
+	vec3 sharpened = center + sharpness * (4.0 * center - north - south - east - west);
+	FragColor = vec4(clamp(sharpened, lowest, highest), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec3 FragPos;
+flat in uint Block;
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+	vec4 lightPos;
+	vec4 lightColor;
+	// clustered point lights: tiles per pixel in xy, depth slice = log(depth) * z + w
+	vec4 clusterScale;
+	// tiles x, tiles y, depth slices, point light count
+	ivec4 clusterSize;
+};
+
+// colour per block type, indexed by BlockType
+uniform vec3 blockColors[32];
+// direction the sunlight travels, and the distance over which the terrain fades into the clear colour
+uniform vec3 sunDirection;
+uniform float fogDistance;
+
+void main() {
+	vec3 albedo = blockColors[Block];
+	float diffuse = max(dot(Normal, -sunDirection), 0.0);
+	vec3 color = albedo * (0.35 + 0.65 * diffuse);
+	float fog = clamp(length(FragPos - viewPos.xyz) / fogDistance, 0.0, 1.0);
+	FragColor = vec4(mix(color, vec3(0.1), fog * fog), 1.0);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+// chunk local corner position in xyz, face in the low 3 bits of w and the block type above them
+layout (location = 0) in uvec4 aVoxel;
+
+layout (std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+	vec4 lightPos;
+	vec4 lightColor;
+	// clustered point lights: tiles per pixel in xy, depth slice = log(depth) * z + w
+	vec4 clusterScale;
+	// tiles x, tiles y, depth slices, point light count
+	ivec4 clusterSize;
+};
+
+// moves the chunk to its place in the world
+uniform mat4 model;
+
+const vec3 FACE_NORMALS[6] = vec3[6](
+	vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+	vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0),
+	vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0)
+);
+
+out vec3 Normal;
+out vec3 FragPos;
+flat out uint Block;
+
+void main() {
+	vec4 worldPos = model * vec4(vec3(aVoxel.xyz), 1.0);
+	gl_Position = projection * view * worldPos;
+	FragPos = vec3(worldPos);
+	Normal = FACE_NORMALS[aVoxel.w & 7u];
+	Block = aVoxel.w >> 3;
+}
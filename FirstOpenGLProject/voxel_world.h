@@ -0,0 +1,926 @@
+#ifndef VOXEL_WORLD_H
+#define VOXEL_WORLD_H
+
+#include <glad/glad.h>
+#include <glm-1.0.1/glm/glm.hpp>
+#include <glm-1.0.1/glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <climits>
+
+#include "thread_pool.h"
+#include "culling.h"
+#include "render_queue.h"
+#include "frame_stats.h"
+
+// Chunked voxel world. Blocks live in CHUNK_SIZE^3 chunks stored as a palette plus bit packed indices,
+// chunks are meshed on the worker threads with greedy meshing (hidden faces skipped, coplanar faces of
+// the same block merged into one quad), and VoxelWorld streams the chunks around the camera in and out
+// within a fixed memory budget.
+
+const int CHUNK_SIZE = 32;
+const int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+// the chunk with a one block border taken from its neighbours, what the mesher reads
+const int PADDED_CHUNK_SIZE = CHUNK_SIZE + 2;
+const int PADDED_CHUNK_VOLUME = PADDED_CHUNK_SIZE * PADDED_CHUNK_SIZE * PADDED_CHUNK_SIZE;
+
+// block types index BLOCK_COLORS, the vertex format leaves 5 bits for them
+typedef uint8_t BlockType;
+enum : BlockType
+{
+	BLOCK_AIR = 0,
+	BLOCK_STONE,
+	BLOCK_DIRT,
+	BLOCK_GRASS,
+	BLOCK_SAND,
+	BLOCK_SNOW,
+	BLOCK_TYPE_COUNT
+};
+const int MAX_BLOCK_TYPES = 32;
+
+const glm::vec3 BLOCK_COLORS[BLOCK_TYPE_COUNT] = {
+	glm::vec3(0.0f),
+	glm::vec3(0.45f, 0.45f, 0.48f),
+	glm::vec3(0.45f, 0.3f, 0.18f),
+	glm::vec3(0.25f, 0.6f, 0.2f),
+	glm::vec3(0.85f, 0.8f, 0.55f),
+	glm::vec3(0.95f, 0.95f, 1.0f)
+};
+
+inline int chunkBlockIndex(int x, int y, int z)
+{
+	return (z * CHUNK_SIZE + y) * CHUNK_SIZE + x;
+}
+
+inline int paddedBlockIndex(int x, int y, int z)
+{
+	return ((z + 1) * PADDED_CHUNK_SIZE + (y + 1)) * PADDED_CHUNK_SIZE + (x + 1);
+}
+
+// Block storage of one chunk: the distinct block types in a palette, and per block its palette index in
+// 0, 1, 2, 4 or 8 bits, so indices never straddle a word. A chunk of a single type (all air, all stone)
+// stores no indices at all.
+class PaletteChunk
+{
+public:
+	std::vector<BlockType> palette;
+
+	explicit PaletteChunk(BlockType fill = BLOCK_AIR) : palette(1, fill)
+	{
+	}
+
+	// packs CHUNK_VOLUME blocks with the smallest palette that holds them
+	static PaletteChunk fromDense(const BlockType* blocks)
+	{
+		PaletteChunk chunk;
+		chunk.palette.clear();
+		int slots[256];
+		std::fill(slots, slots + 256, -1);
+		for (int i = 0; i < CHUNK_VOLUME; i++)
+		{
+			if (slots[blocks[i]] < 0)
+			{
+				slots[blocks[i]] = (int)chunk.palette.size();
+				chunk.palette.push_back(blocks[i]);
+			}
+		}
+		chunk.bits = bitsFor(chunk.palette.size());
+		if (chunk.bits > 0)
+		{
+			chunk.words.assign(CHUNK_VOLUME * chunk.bits / 32, 0);
+			for (int i = 0; i < CHUNK_VOLUME; i++)
+				chunk.write(i, (uint32_t)slots[blocks[i]]);
+		}
+		return chunk;
+	}
+
+	BlockType get(int x, int y, int z) const
+	{
+		return bits == 0 ? palette[0] : palette[read(chunkBlockIndex(x, y, z))];
+	}
+
+	void set(int x, int y, int z, BlockType block)
+	{
+		size_t slot = std::find(palette.begin(), palette.end(), block) - palette.begin();
+		if (slot == palette.size())
+		{
+			palette.push_back(block);
+			if (bitsFor(palette.size()) != bits)
+				repack(bitsFor(palette.size()));
+		}
+		if (bits > 0)
+			write(chunkBlockIndex(x, y, z), (uint32_t)slot);
+	}
+
+	// all blocks, chunkBlockIndex order
+	void unpack(BlockType* blocks) const
+	{
+		if (bits == 0)
+		{
+			memset(blocks, palette[0], CHUNK_VOLUME);
+			return;
+		}
+		for (int i = 0; i < CHUNK_VOLUME; i++)
+			blocks[i] = palette[read(i)];
+	}
+
+	bool isUniform() const
+	{
+		return bits == 0;
+	}
+
+	int bitsPerBlock() const
+	{
+		return bits;
+	}
+
+	size_t memoryBytes() const
+	{
+		return sizeof(PaletteChunk) + palette.capacity() * sizeof(BlockType) + words.capacity() * sizeof(uint32_t);
+	}
+
+private:
+	int bits = 0;
+	std::vector<uint32_t> words;
+
+	static int bitsFor(size_t paletteSize)
+	{
+		return paletteSize <= 1 ? 0 : paletteSize <= 2 ? 1 : paletteSize <= 4 ? 2 : paletteSize <= 16 ? 4 : 8;
+	}
+
+	uint32_t read(int index) const
+	{
+		size_t bit = (size_t)index * bits;
+		return (words[bit >> 5] >> (bit & 31)) & ((1u << bits) - 1);
+	}
+
+	void write(int index, uint32_t value)
+	{
+		size_t bit = (size_t)index * bits;
+		uint32_t mask = ((1u << bits) - 1) << (bit & 31);
+		words[bit >> 5] = (words[bit >> 5] & ~mask) | (value << (bit & 31));
+	}
+
+	void repack(int newBits)
+	{
+		std::vector<uint32_t> old;
+		old.swap(words);
+		int oldBits = bits;
+		bits = newBits;
+		words.assign(CHUNK_VOLUME * bits / 32, 0);
+		for (int i = 0; oldBits > 0 && i < CHUNK_VOLUME; i++)
+		{
+			size_t bit = (size_t)i * oldBits;
+			write(i, (old[bit >> 5] >> (bit & 31)) & ((1u << oldBits) - 1));
+		}
+	}
+};
+
+// Deterministic height map terrain: a few octaves of value noise, stone under dirt under grass, sand
+// low down and snow on the peaks. Any block can be evaluated on its own, which the mesher uses for the
+// border of neighbours that aren't loaded.
+struct TerrainGenerator
+{
+	uint32_t seed = 1;
+	float baseHeight = -14.0f;
+	float amplitude = 10.0f;
+	float featureSize = 48.0f;
+
+	int height(int x, int z) const
+	{
+		float total = 0.0f, weight = 1.0f, frequency = 1.0f / featureSize;
+		for (int octave = 0; octave < 3; octave++)
+		{
+			total += weight * (valueNoise(x * frequency, z * frequency, seed + octave) * 2.0f - 1.0f);
+			weight *= 0.5f;
+			frequency *= 2.0f;
+		}
+		return (int)floorf(baseHeight + amplitude * total);
+	}
+
+	BlockType block(int y, int surface) const
+	{
+		if (y >= surface)
+			return BLOCK_AIR;
+		if (y < surface - 4)
+			return BLOCK_STONE;
+		if (surface < baseHeight - amplitude * 0.5f)
+			return BLOCK_SAND;
+		if (y < surface - 1)
+			return BLOCK_DIRT;
+		return surface > baseHeight + amplitude * 0.6f ? BLOCK_SNOW : BLOCK_GRASS;
+	}
+
+	BlockType blockAt(int x, int y, int z) const
+	{
+		return block(y, height(x, z));
+	}
+
+	// the blocks of the chunk at `coord`, chunkBlockIndex order
+	void fillChunk(const glm::ivec3& coord, BlockType* blocks) const
+	{
+		for (int z = 0; z < CHUNK_SIZE; z++)
+		{
+			for (int x = 0; x < CHUNK_SIZE; x++)
+			{
+				int surface = height(coord.x * CHUNK_SIZE + x, coord.z * CHUNK_SIZE + z);
+				for (int y = 0; y < CHUNK_SIZE; y++)
+					blocks[chunkBlockIndex(x, y, z)] = block(coord.y * CHUNK_SIZE + y, surface);
+			}
+		}
+	}
+
+private:
+	static float lattice(int x, int z, uint32_t seed)
+	{
+		uint32_t h = (uint32_t)x * 374761393u + (uint32_t)z * 668265263u + seed * 2246822519u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		return (float)((h ^ (h >> 16)) & 0xffffffu) / 16777216.0f;
+	}
+
+	static float valueNoise(float x, float z, uint32_t seed)
+	{
+		int ix = (int)floorf(x), iz = (int)floorf(z);
+		float fx = x - ix, fz = z - iz;
+		fx = fx * fx * (3.0f - 2.0f * fx);
+		fz = fz * fz * (3.0f - 2.0f * fz);
+		float top = lattice(ix, iz, seed) + (lattice(ix + 1, iz, seed) - lattice(ix, iz, seed)) * fx;
+		float bottom = lattice(ix, iz + 1, seed) + (lattice(ix + 1, iz + 1, seed) - lattice(ix, iz + 1, seed)) * fx;
+		return top + (bottom - top) * fz;
+	}
+};
+
+// Quad corner as stored in the vertex buffer, 4 bytes: chunk local position (0 to CHUNK_SIZE) and the
+// face (0 -X, 1 +X, 2 -Y, 3 +Y, 4 -Z, 5 +Z) in the low 3 bits of faceBlock with the block type above it
+struct VoxelVertex
+{
+	uint8_t x, y, z;
+	uint8_t faceBlock;
+};
+static_assert(sizeof(VoxelVertex) == 4, "VoxelVertex must stay tightly packed");
+
+struct VoxelMesh
+{
+	std::vector<VoxelVertex> vertices;
+	std::vector<uint32_t> indices;
+	// block faces that are visible, what one quad per face would have drawn
+	size_t visibleFaces = 0;
+
+	size_t triangleCount() const
+	{
+		return indices.size() / 3;
+	}
+};
+
+// Greedy meshing of a padded chunk. For each of the 6 face directions and each slice along it, a mask
+// marks the blocks whose face there is exposed (the next block that way is air); runs of equal blocks
+// are then grown into the widest and tallest rectangles that fit, each becoming one quad.
+inline void greedyMeshChunk(const BlockType* padded, VoxelMesh& mesh)
+{
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.visibleFaces = 0;
+	BlockType mask[CHUNK_SIZE * CHUNK_SIZE];
+	for (int face = 0; face < 6; face++)
+	{
+		int d = face / 2, u = (d + 1) % 3, v = (d + 2) % 3;
+		int direction = (face & 1) ? 1 : -1;
+		int step[3] = { 0, 0, 0 };
+		step[d] = direction;
+		int neighbourOffset = (step[2] * PADDED_CHUNK_SIZE + step[1]) * PADDED_CHUNK_SIZE + step[0];
+		for (int slice = 0; slice < CHUNK_SIZE; slice++)
+		{
+			int position[3];
+			position[d] = slice;
+			for (int b = 0; b < CHUNK_SIZE; b++)
+			{
+				position[v] = b;
+				for (int a = 0; a < CHUNK_SIZE; a++)
+				{
+					position[u] = a;
+					int index = paddedBlockIndex(position[0], position[1], position[2]);
+					BlockType block = padded[index];
+					bool exposed = block != BLOCK_AIR && padded[index + neighbourOffset] == BLOCK_AIR;
+					mask[b * CHUNK_SIZE + a] = exposed ? block : BLOCK_AIR;
+					mesh.visibleFaces += exposed;
+				}
+			}
+
+			for (int b = 0; b < CHUNK_SIZE; b++)
+			{
+				for (int a = 0; a < CHUNK_SIZE; )
+				{
+					BlockType block = mask[b * CHUNK_SIZE + a];
+					if (block == BLOCK_AIR)
+					{
+						a++;
+						continue;
+					}
+					int width = 1;
+					while (a + width < CHUNK_SIZE && mask[b * CHUNK_SIZE + a + width] == block)
+						width++;
+					int height = 1;
+					for (; b + height < CHUNK_SIZE; height++)
+					{
+						const BlockType* row = &mask[(b + height) * CHUNK_SIZE + a];
+						int k = 0;
+						while (k < width && row[k] == block)
+							k++;
+						if (k < width)
+							break;
+					}
+					for (int row = 0; row < height; row++)
+						memset(&mask[(b + row) * CHUNK_SIZE + a], BLOCK_AIR, width);
+
+					// corners in order around the quad, counter-clockwise seen from the side the face points to
+					int corner[3];
+					corner[d] = slice + (direction > 0 ? 1 : 0);
+					const int spans[4][2] = { { 0, 0 }, { width, 0 }, { width, height }, { 0, height } };
+					uint32_t first = (uint32_t)mesh.vertices.size();
+					for (int i = 0; i < 4; i++)
+					{
+						const int* span = spans[direction > 0 ? i : 3 - i];
+						corner[u] = a + span[0];
+						corner[v] = b + span[1];
+						VoxelVertex vertex = { (uint8_t)corner[0], (uint8_t)corner[1], (uint8_t)corner[2], (uint8_t)(face | (block << 3)) };
+						mesh.vertices.push_back(vertex);
+					}
+					const uint32_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+					for (uint32_t index : quad)
+						mesh.indices.push_back(first + index);
+					a += width;
+				}
+			}
+		}
+	}
+}
+
+// fills the padded block array of the chunk at `coord`: the chunk itself, and its one block border from
+// the neighbours that are loaded (-X, +X, -Y, +Y, -Z, +Z) or from the generator for those that aren't
+inline void buildPaddedChunk(const glm::ivec3& coord, const PaletteChunk& chunk, const PaletteChunk* const neighbours[6],
+	const TerrainGenerator& generator, BlockType* padded)
+{
+	memset(padded, BLOCK_AIR, PADDED_CHUNK_VOLUME);
+	BlockType blocks[CHUNK_SIZE];
+	if (chunk.isUniform())
+	{
+		for (int z = 0; z < CHUNK_SIZE; z++)
+			for (int y = 0; y < CHUNK_SIZE; y++)
+				memset(&padded[paddedBlockIndex(0, y, z)], chunk.palette[0], CHUNK_SIZE);
+	}
+	else
+	{
+		for (int z = 0; z < CHUNK_SIZE; z++)
+		{
+			for (int y = 0; y < CHUNK_SIZE; y++)
+			{
+				for (int x = 0; x < CHUNK_SIZE; x++)
+					blocks[x] = chunk.get(x, y, z);
+				memcpy(&padded[paddedBlockIndex(0, y, z)], blocks, CHUNK_SIZE);
+			}
+		}
+	}
+
+	glm::ivec3 origin(coord.x * CHUNK_SIZE, coord.y * CHUNK_SIZE, coord.z * CHUNK_SIZE);
+	for (int face = 0; face < 6; face++)
+	{
+		int d = face / 2, u = (d + 1) % 3, v = (d + 2) % 3;
+		int outside = (face & 1) ? CHUNK_SIZE : -1;
+		int inside = (face & 1) ? 0 : CHUNK_SIZE - 1;
+		const PaletteChunk* neighbour = neighbours[face];
+		for (int b = 0; b < CHUNK_SIZE; b++)
+		{
+			for (int a = 0; a < CHUNK_SIZE; a++)
+			{
+				int position[3], source[3];
+				position[d] = outside;
+				source[d] = inside;
+				position[u] = source[u] = a;
+				position[v] = source[v] = b;
+				BlockType block;
+				if (neighbour)
+					block = neighbour->get(source[0], source[1], source[2]);
+				else
+					block = generator.blockAt(origin.x + position[0], origin.y + position[1], origin.z + position[2]);
+				padded[paddedBlockIndex(position[0], position[1], position[2])] = block;
+			}
+		}
+	}
+}
+
+// Streams chunks around the camera. Call update() once per frame on the GL thread: it evicts chunks that
+// left the view radius, starts generate/mesh jobs for missing chunks nearest first, remeshes edited ones,
+// and uploads finished meshes. When the blocks and meshes go over memoryBudget bytes the farthest chunks
+// are evicted, and chunks that far out aren't loaded, so the nearest ones stay resident.
+// Edits are kept while a chunk is resident, an evicted chunk comes back as the generator made it.
+class VoxelWorld
+{
+public:
+	TerrainGenerator generator;
+	// horizontal streaming radius in chunks, and the chunk rows that exist vertically
+	int viewRadius;
+	int minChunkY = -2;
+	int maxChunkY = 0;
+	size_t memoryBudget;
+	// mesh bytes uploaded per frame, always at least one chunk
+	size_t uploadBudget = 4 * 1024 * 1024;
+
+	// statistics: resident now, and totals since construction. meshMs is summed over the jobs, so
+	// chunksMeshed / meshMs is the throughput of one worker
+	size_t residentBytes = 0;
+	size_t residentTriangles = 0;
+	size_t chunksMeshed = 0;
+	size_t chunksEvicted = 0;
+	size_t budgetEvictions = 0;
+	double meshMs = 0.0;
+	// set by draw()
+	size_t trianglesDrawn = 0;
+	size_t chunksDrawn = 0;
+
+	VoxelWorld(ThreadPool& pool, int viewRadius = 6, size_t memoryBudget = 64 * 1024 * 1024)
+		: viewRadius(viewRadius), memoryBudget(memoryBudget), pool(pool)
+	{
+		maxJobs = (int)pool.size() * 2 + 2;
+	}
+
+	~VoxelWorld()
+	{
+		for (std::future<void>& job : jobs)
+			job.wait();
+		for (auto& entry : chunks)
+			releaseMesh(entry.second);
+		for (const MeshBuffers& buffers : freeBuffers)
+		{
+			glDeleteVertexArrays(1, &buffers.vao);
+			glDeleteBuffers(1, &buffers.vbo);
+			glDeleteBuffers(1, &buffers.ebo);
+		}
+	}
+
+	VoxelWorld(const VoxelWorld&) = delete;
+	VoxelWorld& operator=(const VoxelWorld&) = delete;
+
+	size_t chunkCount() const
+	{
+		return chunks.size();
+	}
+
+	// every chunk the radius and budget allow is loaded and nothing is generating, meshing or waiting for upload
+	bool idle() const
+	{
+		return inFlight == 0 && streamingDone;
+	}
+
+	void update(const glm::vec3& cameraPosition)
+	{
+		glm::ivec3 center = chunkOf(glm::ivec3((int)floorf(cameraPosition.x), (int)floorf(cameraPosition.y), (int)floorf(cameraPosition.z)));
+		if (!haveCenter || center != lastCenter || viewRadius != lastRadius)
+			planStreaming(center);
+
+		collectResults();
+		uploadFinished();
+		evictOutOfRange(center);
+		// the chunks just uploaded may have gone over, give back the farthest and stop requesting chunks
+		// that far out. The limit is lifted once the chunks left use well under the budget (after moving
+		// to cheaper terrain), the gap keeps the same chunk from being loaded and evicted over and over
+		while (residentBytes > memoryBudget && chunks.size() > 1)
+		{
+			VoxelChunk* farthest = farthestChunk(center);
+			budgetLimit = distance2(farthest->coord, center);
+			budgetEvictions++;
+			evict(farthest->coord);
+		}
+		if (residentBytes < memoryBudget / 4 * 3)
+			budgetLimit = INT_MAX;
+
+		// edits first, they are on screen already
+		for (auto& entry : chunks)
+		{
+			if (inFlight >= maxJobs)
+				break;
+			VoxelChunk& chunk = entry.second;
+			if (chunk.dirty && !chunk.busy && chunk.blocks)
+				startJob(chunk);
+		}
+
+		streamingDone = false;
+		size_t next = 0;
+		for (; next < wanted.size() && inFlight < maxJobs; next++)
+		{
+			const glm::ivec3& coord = wanted[next];
+			if (distance2(coord, center) >= budgetLimit)
+				break;
+			if (chunks.count(key(coord)))
+				continue;
+			VoxelChunk& chunk = chunks[key(coord)];
+			chunk.coord = coord;
+			chunk.model = glm::translate(glm::mat4(1.0f), glm::vec3(coord) * (float)CHUNK_SIZE);
+			startJob(chunk);
+		}
+		streamingDone = next == wanted.size() || inFlight < maxJobs;
+	}
+
+	BlockType getBlock(const glm::ivec3& world) const
+	{
+		auto found = chunks.find(key(chunkOf(world)));
+		if (found == chunks.end() || !found->second.blocks)
+			return generator.blockAt(world.x, world.y, world.z);
+		glm::ivec3 local = world - chunkOf(world) * CHUNK_SIZE;
+		return found->second.blocks->get(local.x, local.y, local.z);
+	}
+
+	// changes a block of a resident chunk and queues the remesh of it (and of the neighbours it borders),
+	// returns false when the chunk isn't loaded. The chunk's blocks are copied on write, jobs that are
+	// meshing the old ones keep reading them
+	bool setBlock(const glm::ivec3& world, BlockType block)
+	{
+		glm::ivec3 coord = chunkOf(world);
+		auto found = chunks.find(key(coord));
+		if (found == chunks.end() || !found->second.blocks)
+			return false;
+		VoxelChunk& chunk = found->second;
+		glm::ivec3 local = world - coord * CHUNK_SIZE;
+		std::shared_ptr<PaletteChunk> edited = std::make_shared<PaletteChunk>(*chunk.blocks);
+		edited->set(local.x, local.y, local.z, block);
+		residentBytes += edited->memoryBytes() - chunk.blocks->memoryBytes();
+		chunk.blocks = edited;
+		chunk.edited = true;
+		markDirty(chunk);
+		for (int face = 0; face < 6; face++)
+		{
+			int axis = face / 2;
+			if (local[axis] != ((face & 1) ? CHUNK_SIZE - 1 : 0))
+				continue;
+			auto neighbour = chunks.find(key(coord + faceStep(face)));
+			if (neighbour != chunks.end() && neighbour->second.blocks)
+				markDirty(neighbour->second);
+		}
+		return true;
+	}
+
+	// submits every resident chunk with a mesh that is inside the frustum, one draw each with its model matrix.
+	// Sort depths are view depths over `farPlane`
+	void draw(RenderQueue& queue, unsigned int program, int modelLocation, uint16_t material, const glm::mat4& view, float farPlane, const Frustum& frustum)
+	{
+		drawable.clear();
+		bounds.clear();
+		glm::vec3 extent(CHUNK_SIZE * 0.5f);
+		for (auto& entry : chunks)
+		{
+			const VoxelChunk& chunk = entry.second;
+			if (chunk.indexCount == 0)
+				continue;
+			drawable.push_back(&chunk);
+			bounds.add(glm::vec3(chunk.coord) * (float)CHUNK_SIZE + extent, extent);
+		}
+		culler.cull(bounds, frustum, pool);
+
+		trianglesDrawn = 0;
+		chunksDrawn = culler.visible.size();
+		for (uint32_t index : culler.visible)
+		{
+			const VoxelChunk& chunk = *drawable[index];
+			glm::vec3 center = glm::vec3(chunk.coord) * (float)CHUNK_SIZE + extent;
+			float depth = -(view * glm::vec4(center, 1.0f)).z / farPlane;
+			queue.submit(0, program, chunk.vao, material, depth, GL_TRIANGLES, chunk.indexCount, chunk.indexType, 1, modelLocation, &chunk.model);
+			trianglesDrawn += chunk.indexCount / 3;
+		}
+	}
+
+private:
+	struct VoxelChunk
+	{
+		glm::ivec3 coord = glm::ivec3(0, 0, 0);
+		glm::mat4 model = glm::mat4(1.0f);
+		// NULL until the first job generated them
+		std::shared_ptr<const PaletteChunk> blocks;
+		unsigned int vao = 0, vbo = 0, ebo = 0;
+		GLsizei indexCount = 0;
+		GLenum indexType = GL_UNSIGNED_SHORT;
+		size_t meshBytes = 0;
+		size_t triangles = 0;
+		// bumped by every edit, results of jobs started before it are stale
+		uint32_t version = 0;
+		// serial of the chunk's last job, a result carrying another serial was started for an evicted
+		// chunk at the same coordinates
+		uint32_t job = 0;
+		bool busy = false;
+		bool dirty = false;
+		// blocks differ from what the generator makes
+		bool edited = false;
+	};
+
+	struct MeshBuffers
+	{
+		unsigned int vao, vbo, ebo;
+	};
+
+	struct MeshResult
+	{
+		glm::ivec3 coord;
+		uint32_t job;
+		uint32_t version;
+		std::shared_ptr<const PaletteChunk> blocks;
+		VoxelMesh mesh;
+		double ms;
+	};
+
+	ThreadPool& pool;
+	int maxJobs;
+	int inFlight = 0;
+	// last job serial handed out, 0 is never used
+	uint32_t jobSerial = 0;
+	std::unordered_map<uint64_t, VoxelChunk> chunks;
+	// coordinates within the radius, nearest first
+	std::vector<glm::ivec3> wanted;
+	glm::ivec3 lastCenter = glm::ivec3(0, 0, 0);
+	int lastRadius = 0;
+	bool haveCenter = false;
+	// the last update found no more chunks to request
+	bool streamingDone = false;
+	// squared chunk distance from the camera's chunk at which the memory budget ran out
+	int budgetLimit = INT_MAX;
+	std::mutex finishedMutex;
+	std::vector<std::unique_ptr<MeshResult>> finished;
+	std::vector<std::unique_ptr<MeshResult>> ready;
+	std::vector<std::future<void>> jobs;
+	// vertex arrays and buffers of released meshes, reused by the next uploads so streaming doesn't
+	// keep creating GL objects (and new vertex array slots in the render queue)
+	std::vector<MeshBuffers> freeBuffers;
+	std::vector<const VoxelChunk*> drawable;
+	ObjectStore bounds;
+	FrustumCuller culler;
+
+	static uint64_t key(const glm::ivec3& coord)
+	{
+		return ((uint64_t)(coord.x & 0x1fffff)) | ((uint64_t)(coord.y & 0x1fffff) << 21) | ((uint64_t)(coord.z & 0x1fffff) << 42);
+	}
+
+	static glm::ivec3 chunkOf(const glm::ivec3& world)
+	{
+		return glm::ivec3((int)floorf(world.x / (float)CHUNK_SIZE), (int)floorf(world.y / (float)CHUNK_SIZE), (int)floorf(world.z / (float)CHUNK_SIZE));
+	}
+
+	static glm::ivec3 faceStep(int face)
+	{
+		glm::ivec3 step(0, 0, 0);
+		step[face / 2] = (face & 1) ? 1 : -1;
+		return step;
+	}
+
+	static int distance2(const glm::ivec3& a, const glm::ivec3& b)
+	{
+		glm::ivec3 d = a - b;
+		return d.x * d.x + d.y * d.y + d.z * d.z;
+	}
+
+	void planStreaming(const glm::ivec3& center)
+	{
+		haveCenter = true;
+		lastCenter = center;
+		lastRadius = viewRadius;
+		wanted.clear();
+		for (int dz = -viewRadius; dz <= viewRadius; dz++)
+		{
+			for (int dx = -viewRadius; dx <= viewRadius; dx++)
+			{
+				if (dx * dx + dz * dz > viewRadius * viewRadius)
+					continue;
+				for (int y = minChunkY; y <= maxChunkY; y++)
+					wanted.push_back(glm::ivec3(center.x + dx, y, center.z + dz));
+			}
+		}
+		std::sort(wanted.begin(), wanted.end(), [&](const glm::ivec3& a, const glm::ivec3& b)
+			{ return distance2(a, center) < distance2(b, center); });
+	}
+
+	bool inRange(const glm::ivec3& coord, const glm::ivec3& center) const
+	{
+		// one chunk of slack so chunks on the edge don't flicker in and out
+		int dx = coord.x - center.x, dz = coord.z - center.z;
+		return dx * dx + dz * dz <= (viewRadius + 1) * (viewRadius + 1) && coord.y >= minChunkY && coord.y <= maxChunkY;
+	}
+
+	void evictOutOfRange(const glm::ivec3& center)
+	{
+		std::vector<glm::ivec3> leaving;
+		for (auto& entry : chunks)
+		{
+			if (!inRange(entry.second.coord, center))
+				leaving.push_back(entry.second.coord);
+		}
+		for (const glm::ivec3& coord : leaving)
+			evict(coord);
+	}
+
+	VoxelChunk* farthestChunk(const glm::ivec3& center)
+	{
+		VoxelChunk* farthest = NULL;
+		for (auto& entry : chunks)
+		{
+			if (!farthest || distance2(entry.second.coord, center) > distance2(farthest->coord, center))
+				farthest = &entry.second;
+		}
+		return farthest;
+	}
+
+	void evict(const glm::ivec3& coord)
+	{
+		auto found = chunks.find(key(coord));
+		if (found == chunks.end())
+			return;
+		// a job still running for it is dropped when it lands, even if the chunk has been requested again
+		releaseMesh(found->second);
+		if (found->second.blocks)
+			residentBytes -= found->second.blocks->memoryBytes();
+		bool edited = found->second.edited;
+		chunks.erase(found);
+		chunksEvicted++;
+		// the neighbours were meshed against the edited border, it comes back as generated
+		for (int face = 0; edited && face < 6; face++)
+		{
+			auto neighbour = chunks.find(key(coord + faceStep(face)));
+			if (neighbour != chunks.end() && neighbour->second.blocks)
+				markDirty(neighbour->second);
+		}
+	}
+
+	void releaseMesh(VoxelChunk& chunk)
+	{
+		if (chunk.vao)
+		{
+			MeshBuffers buffers = { chunk.vao, chunk.vbo, chunk.ebo };
+			freeBuffers.push_back(buffers);
+		}
+		chunk.vao = chunk.vbo = chunk.ebo = 0;
+		chunk.indexCount = 0;
+		residentBytes -= chunk.meshBytes;
+		residentTriangles -= chunk.triangles;
+		chunk.meshBytes = 0;
+		chunk.triangles = 0;
+	}
+
+	void markDirty(VoxelChunk& chunk)
+	{
+		chunk.dirty = true;
+		chunk.version++;
+		streamingDone = false;
+	}
+
+	// generates the chunk if it has no blocks yet, then meshes it with the border of its loaded
+	// neighbours, all on a worker. The job only holds shared pointers to immutable blocks
+	void startJob(VoxelChunk& chunk)
+	{
+		std::shared_ptr<const PaletteChunk> blocks = chunk.blocks;
+		std::shared_ptr<const PaletteChunk> neighbours[6];
+		for (int face = 0; face < 6; face++)
+		{
+			auto found = chunks.find(key(chunk.coord + faceStep(face)));
+			if (found != chunks.end())
+				neighbours[face] = found->second.blocks;
+		}
+		glm::ivec3 coord = chunk.coord;
+		uint32_t version = chunk.version;
+		uint32_t job = ++jobSerial;
+		chunk.job = job;
+		chunk.busy = true;
+		chunk.dirty = false;
+		inFlight++;
+		jobs.push_back(pool.submit([this, coord, job, version, blocks, neighbours]
+		{
+			std::unique_ptr<MeshResult> result(new MeshResult());
+			result->coord = coord;
+			result->job = job;
+			result->version = version;
+			double start = nowMs();
+			if (blocks)
+				result->blocks = blocks;
+			else
+			{
+				std::vector<BlockType> dense(CHUNK_VOLUME);
+				generator.fillChunk(coord, dense.data());
+				result->blocks = std::make_shared<PaletteChunk>(PaletteChunk::fromDense(dense.data()));
+			}
+			// empty and fully buried uniform chunks have nothing to mesh unless a neighbour opens them up
+			std::vector<BlockType> padded(PADDED_CHUNK_VOLUME);
+			const PaletteChunk* borders[6];
+			for (int face = 0; face < 6; face++)
+				borders[face] = neighbours[face].get();
+			if (!(result->blocks->isUniform() && result->blocks->palette[0] == BLOCK_AIR))
+			{
+				buildPaddedChunk(coord, *result->blocks, borders, generator, padded.data());
+				greedyMeshChunk(padded.data(), result->mesh);
+			}
+			result->ms = nowMs() - start;
+			std::lock_guard<std::mutex> lock(finishedMutex);
+			finished.push_back(std::move(result));
+		}));
+	}
+
+	void collectResults()
+	{
+		{
+			std::unique_lock<std::mutex> lock(finishedMutex, std::try_to_lock);
+			if (lock.owns_lock())
+			{
+				for (std::unique_ptr<MeshResult>& result : finished)
+					ready.push_back(std::move(result));
+				finished.clear();
+			}
+		}
+		jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](std::future<void>& job)
+			{ return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }), jobs.end());
+	}
+
+	void uploadFinished()
+	{
+		size_t uploaded = 0;
+		size_t count = 0;
+		while (count < ready.size() && (count == 0 || uploaded < uploadBudget))
+		{
+			MeshResult& result = *ready[count++];
+			inFlight--;
+			chunksMeshed++;
+			meshMs += result.ms;
+			// the chunk was evicted while the job ran, its blocks may hold edits that must not come back
+			auto found = chunks.find(key(result.coord));
+			if (found == chunks.end() || found->second.job != result.job)
+				continue;
+			VoxelChunk& chunk = found->second;
+			chunk.busy = false;
+			if (!chunk.blocks)
+			{
+				chunk.blocks = result.blocks;
+				residentBytes += chunk.blocks->memoryBytes();
+			}
+			if (result.version != chunk.version)
+			{
+				// edited while meshing, the newer blocks get their own job
+				chunk.dirty = true;
+				continue;
+			}
+			releaseMesh(chunk);
+			uploaded += uploadMesh(chunk, result.mesh);
+		}
+		ready.erase(ready.begin(), ready.begin() + count);
+	}
+
+	size_t uploadMesh(VoxelChunk& chunk, const VoxelMesh& mesh)
+	{
+		if (mesh.indices.empty())
+			return 0;
+		bool shortIndices = mesh.vertices.size() <= 65536;
+		std::vector<uint16_t> packedIndices;
+		const void* indexData = mesh.indices.data();
+		size_t indexBytes = mesh.indices.size() * sizeof(uint32_t);
+		if (shortIndices)
+		{
+			packedIndices.assign(mesh.indices.begin(), mesh.indices.end());
+			indexData = packedIndices.data();
+			indexBytes = packedIndices.size() * sizeof(uint16_t);
+		}
+		size_t vertexBytes = mesh.vertices.size() * sizeof(VoxelVertex);
+
+		if (freeBuffers.empty())
+		{
+			glGenVertexArrays(1, &chunk.vao);
+			glGenBuffers(1, &chunk.vbo);
+			glGenBuffers(1, &chunk.ebo);
+		}
+		else
+		{
+			chunk.vao = freeBuffers.back().vao;
+			chunk.vbo = freeBuffers.back().vbo;
+			chunk.ebo = freeBuffers.back().ebo;
+			freeBuffers.pop_back();
+		}
+		glBindVertexArray(chunk.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, mesh.vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+		// read as an integer uvec4 in voxel.vert
+		glVertexAttribIPointer(0, 4, GL_UNSIGNED_BYTE, sizeof(VoxelVertex), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+
+		chunk.indexCount = (GLsizei)mesh.indices.size();
+		chunk.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		chunk.meshBytes = vertexBytes + indexBytes;
+		chunk.triangles = mesh.triangleCount();
+		residentBytes += chunk.meshBytes;
+		residentTriangles += chunk.triangles;
+		return chunk.meshBytes;
+	}
+};
+
+#endif